@@ -0,0 +1,362 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <boost/bind.hpp>
+#include "Aggregator.h"
+
+/* site names end up in file names */
+static bool
+isValidSiteName(const std::string& name)
+{
+    if (name.empty() || name.size() > 64 || name[0] == '.') {
+	return false;
+    }
+    for (char c : name) {
+	if (!isalnum((unsigned char) c) && c != '-' && c != '_' && c != '.') {
+	    return false;
+	}
+    }
+    return true;
+}
+
+AggregatorSite::AggregatorSite(const std::string& directory, const std::string& name) :
+    m_name(name),
+    m_sequenceFile(directory + "/" + name + ".seq"),
+    m_writer(directory + "/" + name + ".cap", true),
+    m_stored(0),
+    m_received(0),
+    m_unflushed(0)
+{
+    std::ifstream in(m_sequenceFile.c_str());
+    if (in) {
+	in >> m_stored;
+    }
+    m_received = m_stored;
+}
+
+AggregatorSite::~AggregatorSite()
+{
+    flush();
+}
+
+void
+AggregatorSite::addFrames(const std::vector<ForwardProtocol::Frame>& frames)
+{
+    size_t rejected = 0;
+
+    for (auto& frame : frames) {
+	/* resent after a lost ack */
+	if (frame.sequence <= m_received) {
+	    rejected++;
+	    continue;
+	}
+	m_writer.writeFrame(frame.timestamp, frame.data);
+	m_received = frame.sequence;
+	m_unflushed++;
+    }
+
+    if (rejected > 0) {
+	std::cerr << "Site " << m_name << ": ignoring " << rejected
+		  << " frames at or before stored sequence " << m_received << std::endl;
+    }
+}
+
+void
+AggregatorSite::flush()
+{
+    if (m_received == m_stored) {
+	return;
+    }
+
+    m_writer.flush();
+
+    std::string tmpPath = m_sequenceFile + ".tmp";
+    std::ofstream out(tmpPath.c_str(), std::ios::out | std::ios::trunc);
+    out << m_received << std::endl;
+    out.close();
+    if (out.fail() || rename(tmpPath.c_str(), m_sequenceFile.c_str()) != 0) {
+	std::cerr << "Could not write " << m_sequenceFile << std::endl;
+	return;
+    }
+
+    m_stored = m_received;
+    m_unflushed = 0;
+}
+
+
+AggregatorConnection::AggregatorConnection(boost::asio::io_service& ios, Aggregator& aggregator) :
+    m_socket(ios),
+    m_aggregator(aggregator),
+    m_acked(0)
+{
+}
+
+void
+AggregatorConnection::startRead()
+{
+    m_socket.async_read_some(boost::asio::buffer(m_readBuffer),
+	    boost::bind(&AggregatorConnection::handleRead, shared_from_this(),
+			boost::asio::placeholders::error,
+			boost::asio::placeholders::bytes_transferred));
+}
+
+void
+AggregatorConnection::handleRead(const boost::system::error_code& error, size_t bytesTransferred)
+{
+    if (error == boost::asio::error::operation_aborted) {
+	return;
+    }
+
+    bool ok = !error;
+    if (ok && m_inflater) {
+	ok = m_inflater->decompress(m_readBuffer, bytesTransferred, m_input);
+    } else if (ok) {
+	m_input.insert(m_input.end(), m_readBuffer, m_readBuffer + bytesTransferred);
+    }
+
+    if (!ok || !processInput()) {
+	m_aggregator.stopConnection(shared_from_this());
+	return;
+    }
+
+    startRead();
+}
+
+bool
+AggregatorConnection::processInput()
+{
+    size_t pos = 0;
+
+    while (m_input.size() - pos >= ForwardProtocol::HeaderSize) {
+	uint32_t length;
+	if (!ForwardProtocol::decodeHeader(&m_input[pos], m_messageType, length)) {
+	    return false;
+	}
+	if (m_input.size() - pos - ForwardProtocol::HeaderSize < length) {
+	    break;
+	}
+
+	auto body = m_input.begin() + pos + ForwardProtocol::HeaderSize;
+	m_body.assign(body, body + length);
+	pos += ForwardProtocol::HeaderSize + length;
+
+	bool wasCompressed = m_inflater.get() != nullptr;
+	if (!handleMessage()) {
+	    return false;
+	}
+	if (m_inflater && !wasCompressed) {
+	    /* whatever followed the greeting is already compressed */
+	    std::vector<uint8_t> rest(m_input.begin() + pos, m_input.end());
+	    m_input.clear();
+	    pos = 0;
+	    if (!m_inflater->decompress(rest.data(), rest.size(), m_input)) {
+		return false;
+	    }
+	}
+    }
+
+    m_input.erase(m_input.begin(), m_input.begin() + pos);
+    return true;
+}
+
+bool
+AggregatorConnection::handleMessage()
+{
+    if (m_messageType == ForwardProtocol::HelloMessage && !m_site) {
+	std::string name;
+	uint8_t flags;
+	if (!ForwardProtocol::decodeHello(m_body, name, flags) || !isValidSiteName(name)) {
+	    std::cerr << "Rejecting forwarder with invalid greeting" << std::endl;
+	    return false;
+	}
+	m_site = m_aggregator.openSite(name);
+	if (!m_site) {
+	    return false;
+	}
+	flags &= Deflater::available() ? ForwardProtocol::CompressFlag : 0;
+	m_acked = m_site->stored();
+	send(ForwardProtocol::encodeWelcome(m_acked, flags));
+	if (flags & ForwardProtocol::CompressFlag) {
+	    m_inflater.reset(new Inflater());
+	}
+	return true;
+    }
+
+    if (m_messageType == ForwardProtocol::FramesMessage && m_site) {
+	if (!ForwardProtocol::decodeFrames(m_body, m_frames)) {
+	    return false;
+	}
+	m_site->addFrames(m_frames);
+	m_aggregator.framesAdded(m_site);
+	return true;
+    }
+
+    return false;
+}
+
+void
+AggregatorConnection::acknowledge()
+{
+    if (m_site && m_site->stored() != m_acked) {
+	m_acked = m_site->stored();
+	send(ForwardProtocol::encodeAck(m_acked));
+    }
+}
+
+void
+AggregatorConnection::send(std::vector<uint8_t>&& message)
+{
+    m_writeQueue.push_back(std::move(message));
+    if (m_writeQueue.size() == 1) {
+	boost::asio::async_write(m_socket, boost::asio::buffer(m_writeQueue.front()),
+		boost::bind(&AggregatorConnection::handleWrite, shared_from_this(),
+			    boost::asio::placeholders::error));
+    }
+}
+
+void
+AggregatorConnection::handleWrite(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted) {
+	return;
+    }
+    if (error) {
+	m_aggregator.stopConnection(shared_from_this());
+	return;
+    }
+
+    m_writeQueue.pop_front();
+    if (!m_writeQueue.empty()) {
+	boost::asio::async_write(m_socket, boost::asio::buffer(m_writeQueue.front()),
+		boost::bind(&AggregatorConnection::handleWrite, shared_from_this(),
+			    boost::asio::placeholders::error));
+    }
+}
+
+
+Aggregator::Aggregator(boost::asio::io_service& ios,
+		       boost::asio::ip::tcp::endpoint& endpoint,
+		       const std::string& directory) :
+    m_ios(ios),
+    m_acceptor(ios, endpoint),
+    m_directory(directory),
+    m_flushTimer(ios)
+{
+    startAccepting();
+    scheduleFlush();
+}
+
+Aggregator::~Aggregator()
+{
+    m_acceptor.close();
+    m_flushTimer.cancel();
+    std::for_each(m_connections.begin(), m_connections.end(),
+		  boost::bind(&AggregatorConnection::close, _1));
+    m_connections.clear();
+}
+
+void
+Aggregator::handleAccept(AggregatorConnection::Ptr connection,
+			 const boost::system::error_code& error)
+{
+    if (error) {
+	if (error != boost::asio::error::operation_aborted) {
+	    std::cerr << "Accept error: " << error.message() << std::endl;
+	}
+	return;
+    }
+
+    m_connections.insert(connection);
+    connection->startRead();
+    startAccepting();
+}
+
+void
+Aggregator::stopConnection(AggregatorConnection::Ptr connection)
+{
+    m_connections.erase(connection);
+    connection->close();
+}
+
+AggregatorSite::Ptr
+Aggregator::openSite(const std::string& name)
+{
+    auto iter = m_sites.find(name);
+    if (iter != m_sites.end()) {
+	return iter->second;
+    }
+
+    AggregatorSite::Ptr site(new AggregatorSite(m_directory, name));
+    if (!site->isOpen()) {
+	return AggregatorSite::Ptr();
+    }
+
+    m_sites[name] = site;
+    return site;
+}
+
+void
+Aggregator::framesAdded(const AggregatorSite::Ptr& site)
+{
+    if (site->unflushed() >= MaxUnflushedFrames) {
+	flushSite(site);
+    }
+}
+
+void
+Aggregator::flushSite(const AggregatorSite::Ptr& site)
+{
+    site->flush();
+
+    /* a site may briefly have two connections while a forwarder reconnects */
+    for (auto& connection : m_connections) {
+	if (connection->site() == site) {
+	    connection->acknowledge();
+	}
+    }
+}
+
+void
+Aggregator::scheduleFlush()
+{
+    m_flushTimer.expires_from_now(boost::posix_time::seconds(FlushIntervalSeconds));
+    m_flushTimer.async_wait([this] (const boost::system::error_code& error) {
+	if (error == boost::asio::error::operation_aborted) {
+	    return;
+	}
+	for (auto& site : m_sites) {
+	    flushSite(site.second);
+	}
+	scheduleFlush();
+    });
+}
+
+void
+Aggregator::startAccepting()
+{
+    AggregatorConnection::Ptr connection(new AggregatorConnection(m_ios, *this));
+    m_acceptor.async_accept(connection->socket(),
+			    boost::bind(&Aggregator::handleAccept, this,
+					connection, boost::asio::placeholders::error));
+}
@@ -0,0 +1,156 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __AGGREGATOR_H__
+#define __AGGREGATOR_H__
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include "CaptureFile.h"
+#include "Compression.h"
+#include "ForwardProtocol.h"
+#include "Noncopyable.h"
+
+class Aggregator;
+
+/*
+ * Frames received from one site, stored in '<site>.cap' in the aggregator
+ * directory. The sequence number of the last frame on disk is kept in
+ * '<site>.seq', so forwarders can resume after it.
+ */
+class AggregatorSite : private boost::noncopyable
+{
+    public:
+	typedef boost::shared_ptr<AggregatorSite> Ptr;
+
+    public:
+	AggregatorSite(const std::string& directory, const std::string& name);
+	~AggregatorSite();
+
+	bool isOpen() const {
+	    return m_writer.isOpen();
+	}
+	uint64_t stored() const {
+	    return m_stored;
+	}
+	size_t unflushed() const {
+	    return m_unflushed;
+	}
+	void addFrames(const std::vector<ForwardProtocol::Frame>& frames);
+	void flush();
+
+    private:
+	std::string m_name;
+	std::string m_sequenceFile;
+	CaptureWriter m_writer;
+	/* last frame on disk and last frame handed to the writer */
+	uint64_t m_stored;
+	uint64_t m_received;
+	size_t m_unflushed;
+};
+
+class AggregatorConnection : public boost::enable_shared_from_this<AggregatorConnection>,
+			     private boost::noncopyable
+{
+    public:
+	typedef boost::shared_ptr<AggregatorConnection> Ptr;
+
+    public:
+	AggregatorConnection(boost::asio::io_service& ios, Aggregator& aggregator);
+
+    public:
+	boost::asio::ip::tcp::socket& socket() {
+	    return m_socket;
+	}
+	const AggregatorSite::Ptr& site() const {
+	    return m_site;
+	}
+	void startRead();
+	void close() {
+	    m_socket.close();
+	}
+	void acknowledge();
+
+    private:
+	void handleRead(const boost::system::error_code& error, size_t bytesTransferred);
+	bool processInput();
+	bool handleMessage();
+	void send(std::vector<uint8_t>&& message);
+	void handleWrite(const boost::system::error_code& error);
+
+    private:
+	boost::asio::ip::tcp::socket m_socket;
+	Aggregator& m_aggregator;
+	AggregatorSite::Ptr m_site;
+	uint64_t m_acked;
+	uint8_t m_readBuffer[4096];
+	/* received data, decompressed if requested */
+	std::vector<uint8_t> m_input;
+	std::unique_ptr<Inflater> m_inflater;
+	ForwardProtocol::MessageType m_messageType;
+	std::vector<uint8_t> m_body;
+	std::vector<ForwardProtocol::Frame> m_frames;
+	std::deque<std::vector<uint8_t> > m_writeQueue;
+};
+
+/*
+ * Central end of the frame forwarding. Accepts connections of forwarding
+ * collectors and appends their frames to one capture file per site, which
+ * can be fed into the database with --reprocess. Frames are acknowledged
+ * once they are flushed to disk, which happens after a number of frames or
+ * a fixed interval, whichever comes first.
+ */
+class Aggregator : private boost::noncopyable
+{
+    public:
+	Aggregator(boost::asio::io_service& ios,
+		   boost::asio::ip::tcp::endpoint& endpoint,
+		   const std::string& directory);
+	~Aggregator();
+
+    public:
+	void stopConnection(AggregatorConnection::Ptr connection);
+	AggregatorSite::Ptr openSite(const std::string& name);
+	void framesAdded(const AggregatorSite::Ptr& site);
+
+    private:
+	void handleAccept(AggregatorConnection::Ptr connection,
+			  const boost::system::error_code& error);
+	void startAccepting();
+	void scheduleFlush();
+	void flushSite(const AggregatorSite::Ptr& site);
+
+    private:
+	static const unsigned int FlushIntervalSeconds = 30;
+	static const size_t MaxUnflushedFrames = 1024;
+
+	boost::asio::io_service& m_ios;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+	std::string m_directory;
+	std::set<AggregatorConnection::Ptr> m_connections;
+	std::map<std::string, AggregatorSite::Ptr> m_sites;
+	boost::asio::deadline_timer m_flushTimer;
+};
+
+#endif /* __AGGREGATOR_H__ */
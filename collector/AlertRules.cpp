@@ -0,0 +1,316 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "AlertRules.h"
+#include "ValueApi.h"
+
+static bool
+parseFloat(std::istream& stream, float& result)
+{
+    std::string token;
+    char *end;
+
+    if (!(stream >> token)) {
+	return false;
+    }
+    result = strtof(token.c_str(), &end);
+    return *end == '\0';
+}
+
+static bool
+parseSeconds(std::istream& stream, uint64_t& result)
+{
+    std::string token;
+    char *end;
+
+    if (!(stream >> token)) {
+	return false;
+    }
+    result = strtoul(token.c_str(), &end, 10) * 1000ULL;
+    return *end == '\0';
+}
+
+bool
+AlertRules::parseRule(const std::string& line, Key& key, Rule& rule) const
+{
+    std::istringstream stream(line);
+    std::string keyName, condition, token;
+
+    if (!(stream >> rule.name >> keyName >> condition)) {
+	return false;
+    }
+
+    EmsValue::SubType subtype;
+    EmsValue::Type type;
+
+    if (!ValueApi::parseValueKey(keyName, type, subtype)) {
+	return false;
+    }
+    key = std::make_pair(type, subtype);
+    rule.key = keyName;
+
+    rule.limit = rule.hysteresis = 0;
+    rule.window = rule.duration = 0;
+    rule.active = false;
+    rule.pendingSince = 0;
+
+    if (condition == "above" || condition == "below") {
+	rule.condition = condition == "above" ? Above : Below;
+	if (!parseFloat(stream, rule.limit)) {
+	    return false;
+	}
+    } else if (condition == "rise" || condition == "drop") {
+	rule.condition = condition == "rise" ? Rise : Drop;
+	if (!parseFloat(stream, rule.limit) || !(stream >> token) || token != "within"
+		|| !parseSeconds(stream, rule.window) || rule.window == 0) {
+	    return false;
+	}
+    } else if (condition == "is" || condition == "not") {
+	rule.condition = condition == "is" ? Is : IsNot;
+	if (!(stream >> rule.text)) {
+	    return false;
+	}
+    } else {
+	return false;
+    }
+
+    while (stream >> token) {
+	if (token == "hysteresis" && rule.condition != Is && rule.condition != IsNot) {
+	    if (!parseFloat(stream, rule.hysteresis)) {
+		return false;
+	    }
+	} else if (token == "for") {
+	    if (!parseSeconds(stream, rule.duration)) {
+		return false;
+	    }
+	} else {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+bool
+AlertRules::load(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    unsigned int lineNumber = 0;
+
+    if (!file.is_open()) {
+	std::cerr << "Could not open alert rule file " << path << std::endl;
+	return false;
+    }
+
+    std::map<Key, std::vector<Rule> > rules;
+    while (std::getline(file, line)) {
+	lineNumber++;
+
+	size_t pos = line.find('#');
+	if (pos != std::string::npos) {
+	    line.erase(pos);
+	}
+	if (line.find_first_not_of(" \t\r") == std::string::npos) {
+	    continue;
+	}
+
+	Key key;
+	Rule rule;
+	if (!parseRule(line, key, rule)) {
+	    std::cerr << "Invalid alert rule in " << path << ", line "
+		      << lineNumber << ": " << line << std::endl;
+	    return false;
+	}
+	rules[key].push_back(rule);
+    }
+
+    /* an alert which is still active must be cleared by its rule later */
+    std::set<const Rule *> kept;
+    for (auto& entry : rules) {
+	auto previous = m_rules.find(entry.first);
+	if (previous == m_rules.end()) {
+	    continue;
+	}
+	for (auto& rule : entry.second) {
+	    for (auto& old : previous->second) {
+		if (old.name == rule.name && old.condition == rule.condition &&
+			old.limit == rule.limit && old.hysteresis == rule.hysteresis &&
+			old.window == rule.window && old.duration == rule.duration &&
+			old.text == rule.text) {
+		    rule.active = old.active;
+		    rule.pendingSince = old.pendingSince;
+		    rule.samples = old.samples;
+		    kept.insert(&old);
+		    break;
+		}
+	    }
+	}
+    }
+
+    clearDropped(kept);
+    m_rules.swap(rules);
+    return true;
+}
+
+void
+AlertRules::clear()
+{
+    clearDropped(std::set<const Rule *>());
+    m_rules.clear();
+}
+
+/* alerts of rules going away can't be cleared by them anymore */
+void
+AlertRules::clearDropped(const std::set<const Rule *>& kept)
+{
+    Timestamp now = Timestamp::now();
+
+    for (auto& entry : m_rules) {
+	for (auto& rule : entry.second) {
+	    if (rule.active && kept.find(&rule) == kept.end()) {
+		rule.active = false;
+		report(rule, std::string(), now);
+	    }
+	}
+    }
+}
+
+void
+AlertRules::handleValue(const EmsValue& value)
+{
+    auto iter = m_rules.find(std::make_pair(value.getType(), value.getSubType()));
+    if (iter == m_rules.end() || !value.isValid()) {
+	return;
+    }
+
+    uint64_t now = value.getTimestamp().monotonic;
+    for (auto& rule : iter->second) {
+	bool active = evaluate(rule, value, now);
+
+	if (rule.duration != 0) {
+	    if (!active) {
+		rule.pendingSince = 0;
+	    } else if (!rule.active) {
+		if (rule.pendingSince == 0) {
+		    rule.pendingSince = now;
+		}
+		active = now - rule.pendingSince >= rule.duration;
+	    }
+	}
+
+	if (active != rule.active) {
+	    rule.active = active;
+	    report(rule, ValueApi::formatValue(value), value.getTimestamp());
+	}
+    }
+}
+
+bool
+AlertRules::evaluate(Rule& rule, const EmsValue& value, uint64_t now) const
+{
+    float current = 0;
+
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    current = value.getValue<float>();
+	    break;
+	case EmsValue::Integer:
+	    current = value.getValue<unsigned int>();
+	    break;
+	default:
+	    if (rule.condition == Is || rule.condition == IsNot) {
+		break;
+	    }
+	    return false;
+    }
+
+    /* an active alert only clears once the value is back by the hysteresis */
+    float hysteresis = rule.active ? rule.hysteresis : 0;
+
+    switch (rule.condition) {
+	case Above:
+	    return current > rule.limit - hysteresis;
+	case Below:
+	    return current < rule.limit + hysteresis;
+	case Rise:
+	case Drop: {
+	    /*
+	     * Keep only those samples which may still become the window
+	     * minimum (rise) or maximum (drop), so the front always holds
+	     * the extreme value of the window.
+	     */
+	    auto& samples = rule.samples;
+	    bool rise = rule.condition == Rise;
+
+	    while (!samples.empty() &&
+		    (rise ? samples.back().value >= current : samples.back().value <= current)) {
+		samples.pop_back();
+	    }
+	    Sample sample = { now, current };
+	    samples.push_back(sample);
+	    while (now - samples.front().time > rule.window) {
+		samples.pop_front();
+	    }
+
+	    float change = rise ? current - samples.front().value : samples.front().value - current;
+	    return change >= rule.limit - hysteresis;
+	}
+	case Is:
+	case IsNot: {
+	    bool equal = ValueApi::formatValue(value) == rule.text;
+	    return rule.condition == Is ? equal : !equal;
+	}
+    }
+
+    return false;
+}
+
+void
+AlertRules::report(const Rule& rule, const std::string& value, const Timestamp& timestamp)
+{
+    Alert alert;
+
+    alert.rule = rule.name;
+    alert.key = rule.key;
+    alert.value = value;
+    alert.active = rule.active;
+    alert.timestamp = timestamp;
+
+    if (m_log) {
+	time_t seconds = alert.timestamp.seconds();
+	char buffer[32];
+
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+	m_log << buffer << " ALERT " << alert.rule << (alert.active ? " raised" : " cleared");
+	if (alert.value.empty()) {
+	    /* the rule was removed or changed */
+	    m_log << " (" << alert.key << ")" << std::endl;
+	} else {
+	    m_log << " (" << alert.key << " = " << alert.value << ")" << std::endl;
+	}
+    }
+    if (m_output) {
+	m_output(alert);
+    }
+}
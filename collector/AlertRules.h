@@ -0,0 +1,130 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ALERTRULES_H__
+#define __ALERTRULES_H__
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+#include "Options.h"
+
+/*
+ * Evaluates alert rules on every incoming value. Rules are read from a
+ * file, one per line:
+ *
+ *   <name> [<subtype>/]<type> <condition> [for <seconds>]
+ *
+ * with the value names used by the data port and these conditions:
+ *
+ *   above <limit> [hysteresis <amount>]
+ *   below <limit> [hysteresis <amount>]
+ *   rise <amount> within <seconds>
+ *   drop <amount> within <seconds>
+ *   is <value>
+ *   not <value>
+ *
+ * Rules are indexed by the value they apply to, so each value only
+ * evaluates its own rules. An alert is raised when the condition
+ * becomes true (and stayed true for the given time), and cleared when
+ * it becomes false again or its rule is removed or changed.
+ */
+class AlertRules : private boost::noncopyable
+{
+    public:
+	struct Alert {
+	    std::string rule;
+	    std::string key;
+	    /* empty if cleared because the rule went away */
+	    std::string value;
+	    bool active;
+	    Timestamp timestamp;
+	};
+	typedef std::function<void (const Alert& alert)> AlertCallback;
+
+    public:
+	AlertRules() { }
+
+	/* replaces the current rules, keeping the state of unchanged ones */
+	bool load(const std::string& path);
+	void clear();
+	void setLogFile(const std::string& path) {
+	    if (path.empty()) {
+		m_log.reset();
+	    } else {
+		m_log.setFile(path);
+	    }
+	}
+	void setOutput(const AlertCallback& output) {
+	    m_output = output;
+	}
+	void handleValue(const EmsValue& value);
+
+    private:
+	typedef enum {
+	    Above,
+	    Below,
+	    Rise,
+	    Drop,
+	    Is,
+	    IsNot
+	} Condition;
+
+	struct Sample {
+	    uint64_t time;
+	    float value;
+	};
+
+	struct Rule {
+	    std::string name;
+	    std::string key;
+	    Condition condition;
+	    float limit;
+	    float hysteresis;
+	    /* ms, window for rise and drop */
+	    uint64_t window;
+	    /* ms the condition needs to hold before raising */
+	    uint64_t duration;
+	    std::string text;
+
+	    bool active;
+	    uint64_t pendingSince;
+	    /* extreme values of the window, oldest first */
+	    std::deque<Sample> samples;
+	};
+
+	typedef std::pair<EmsValue::Type, EmsValue::SubType> Key;
+
+	bool parseRule(const std::string& line, Key& key, Rule& rule) const;
+	bool evaluate(Rule& rule, const EmsValue& value, uint64_t now) const;
+	void report(const Rule& rule, const std::string& value, const Timestamp& timestamp);
+	void clearDropped(const std::set<const Rule *>& kept);
+
+    private:
+	std::map<Key, std::vector<Rule> > m_rules;
+	AlertCallback m_output;
+	DebugStream m_log;
+};
+
+#endif /* __ALERTRULES_H__ */
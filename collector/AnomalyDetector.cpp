@@ -0,0 +1,178 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include "AnomalyDetector.h"
+#include "ValueApi.h"
+
+AnomalyDetector::AnomalyDetector(float threshold) :
+    m_threshold(threshold),
+    m_hourStart(0),
+    m_hourEnd(0),
+    m_hour(0)
+{
+}
+
+bool
+AnomalyDetector::addValue(const std::string& name)
+{
+    EmsValue::SubType subtype;
+    EmsValue::Type type;
+
+    if (!ValueApi::parseValueKey(name, type, subtype)) {
+	return false;
+    }
+
+    Entry entry = Entry();
+    entry.name = name;
+    m_index[std::make_pair(type, subtype)] = m_entries.size();
+    m_entries.push_back(entry);
+    return true;
+}
+
+unsigned int
+AnomalyDetector::hourOfDay(time_t now)
+{
+    /* only call into localtime once per hour */
+    if (now < m_hourStart || now >= m_hourEnd) {
+	struct tm local = *localtime(&now);
+	m_hour = local.tm_hour;
+	m_hourStart = now - local.tm_min * 60 - local.tm_sec;
+	m_hourEnd = m_hourStart + 3600;
+    }
+    return m_hour;
+}
+
+void
+AnomalyDetector::update(Baseline& baseline, double value, uint64_t now, double timeConstant)
+{
+    if (baseline.observed == 0 && baseline.lastUpdate == 0) {
+	baseline.mean = value;
+	baseline.variance = 0;
+	baseline.lastUpdate = now;
+	return;
+    }
+
+    uint64_t step = now > baseline.lastUpdate ? now - baseline.lastUpdate : 0;
+    if (step > MaxStep) {
+	step = MaxStep;
+    }
+
+    /* weight by time rather than samples, as values arrive irregularly */
+    double alpha = 1.0 - exp(-(double) step / timeConstant);
+    double diff = value - baseline.mean;
+    double increment = alpha * diff;
+
+    baseline.mean += increment;
+    baseline.variance = (1.0 - alpha) * (baseline.variance + diff * increment);
+    baseline.observed += step;
+    baseline.lastUpdate = now;
+}
+
+void
+AnomalyDetector::handleValue(const EmsValue& value)
+{
+    auto iter = m_index.find(std::make_pair(value.getType(), value.getSubType()));
+    if (iter == m_index.end() || !value.isValid()) {
+	return;
+    }
+
+    double current;
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric: current = value.getValue<float>(); break;
+	case EmsValue::Integer: current = value.getValue<unsigned int>(); break;
+	default: return;
+    }
+
+    Entry& entry = m_entries[iter->second];
+    const Timestamp& timestamp = value.getTimestamp();
+    Baseline& hourly = entry.hourly[hourOfDay(timestamp.seconds())];
+    const Baseline *baseline = NULL;
+
+    if (hourly.observed >= HourlyTimeConstant) {
+	baseline = &hourly;
+    } else if (entry.overall.observed >= OverallTimeConstant) {
+	baseline = &entry.overall;
+    }
+
+    if (baseline) {
+	/* values which hardly ever change would otherwise alarm on every step */
+	double deviation = std::max(sqrt(baseline->variance), std::max(0.1, 0.01 * fabs(baseline->mean)));
+	double z = (current - baseline->mean) / deviation;
+	bool anomalous = fabs(z) >= m_threshold;
+
+	if (anomalous && !entry.anomalous && m_output) {
+	    std::ostringstream text;
+	    text << entry.name << " " << current << " z=" << (floor(z * 10 + 0.5) / 10)
+		 << " mean=" << baseline->mean;
+	    EmsValue event(EmsValue::Anomalie, EmsValue::None, text.str());
+	    event.setTimestamp(timestamp);
+	    m_output(event);
+	}
+	entry.anomalous = anomalous;
+    }
+
+    /* scored before updating, so an outlier doesn't hide itself */
+    update(entry.overall, current, timestamp.monotonic, OverallTimeConstant);
+    update(hourly, current, timestamp.monotonic, HourlyTimeConstant);
+}
+
+void
+AnomalyDetector::loadState(const StateFile& state)
+{
+    for (auto& entry : m_entries) {
+	for (size_t i = 0; i <= 24; i++) {
+	    Baseline& baseline = i == 24 ? entry.overall : entry.hourly[i];
+	    std::ostringstream prefix;
+	    double mean, variance, observed;
+
+	    prefix << "anomaly." << entry.name << "." << (i == 24 ? std::string("all") : std::to_string(i));
+	    if (state.get(prefix.str() + ".mean", mean) &&
+		    state.get(prefix.str() + ".variance", variance) &&
+		    state.get(prefix.str() + ".observed", observed)) {
+		baseline.mean = mean;
+		baseline.variance = variance;
+		baseline.observed = observed;
+		/* monotonic times don't survive a restart */
+		baseline.lastUpdate = 0;
+	    }
+	}
+    }
+}
+
+void
+AnomalyDetector::saveState(StateFile& state) const
+{
+    for (auto& entry : m_entries) {
+	for (size_t i = 0; i <= 24; i++) {
+	    const Baseline& baseline = i == 24 ? entry.overall : entry.hourly[i];
+	    std::ostringstream prefix;
+
+	    if (baseline.observed == 0) {
+		continue;
+	    }
+	    prefix << "anomaly." << entry.name << "." << (i == 24 ? std::string("all") : std::to_string(i));
+	    state.set(prefix.str() + ".mean", baseline.mean);
+	    state.set(prefix.str() + ".variance", baseline.variance);
+	    state.set(prefix.str() + ".observed", (double) baseline.observed);
+	}
+    }
+}
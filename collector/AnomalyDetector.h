@@ -0,0 +1,93 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ANOMALYDETECTOR_H__
+#define __ANOMALYDETECTOR_H__
+
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+#include "StateFile.h"
+
+/*
+ * Learns the normal behaviour of selected numeric values and emits an
+ * Anomalie value when a value deviates from it. For each value, an
+ * exponentially weighted mean and variance is kept overall and per hour
+ * of the day; the per hour baseline is preferred once it has seen
+ * enough data. Memory use is fixed per monitored value, and each
+ * incoming value is handled in constant time.
+ */
+class AnomalyDetector : private boost::noncopyable
+{
+    public:
+	AnomalyDetector(float threshold);
+
+	/* [<subtype>/]<type> as used by the data port */
+	bool addValue(const std::string& name);
+	void setThreshold(float threshold) {
+	    m_threshold = threshold;
+	}
+	void setOutput(const EmsMessage::ValueHandler& output) {
+	    m_output = output;
+	}
+	void handleValue(const EmsValue& value);
+
+	void loadState(const StateFile& state);
+	void saveState(StateFile& state) const;
+
+    private:
+	struct Baseline {
+	    double mean;
+	    double variance;
+	    /* ms of data seen, used for the warm up */
+	    uint64_t observed;
+	    uint64_t lastUpdate;
+	};
+
+	struct Entry {
+	    std::string name;
+	    Baseline overall;
+	    Baseline hourly[24];
+	    bool anomalous;
+	};
+
+	unsigned int hourOfDay(time_t now);
+	static void update(Baseline& baseline, double value, uint64_t now, double timeConstant);
+
+    private:
+	/* time constants of the averages, in ms of observed data */
+	static const uint64_t OverallTimeConstant = 60 * 60 * 1000;
+	static const uint64_t HourlyTimeConstant = 7 * 60 * 60 * 1000;
+	/* steps between samples longer than this count as this long */
+	static const uint64_t MaxStep = 60 * 1000;
+
+	EmsMessage::ValueHandler m_output;
+	float m_threshold;
+	std::vector<Entry> m_entries;
+	std::map<std::pair<EmsValue::Type, EmsValue::SubType>, size_t> m_index;
+
+	/* local time hour cache */
+	time_t m_hourStart, m_hourEnd;
+	unsigned int m_hour;
+};
+
+#endif /* __ANOMALYDETECTOR_H__ */
@@ -30,10 +30,16 @@
 ApiCommandParser::ApiCommandParser(EmsCommandSender& sender,
 				   const boost::shared_ptr<EmsCommandClient>& client,
 				   ValueCache *cache,
-				   OutputCallback outputCb) :
+				   OutputCallback outputCb,
+				   SeriesHistory *history,
+				   GraphRenderer *graphs,
+				   WindowStats *stats) :
     m_sender(sender),
     m_client(client),
     m_cache(cache),
+    m_history(history),
+    m_graphs(graphs),
+    m_stats(stats),
     m_outputCb(outputCb),
     m_responseCounter(0),
     m_parsePosition(0),
@@ -73,6 +79,9 @@ ApiCommandParser::parse(std::istream& request)
 		"raw\n"
 #endif
 		"cache\n"
+		"series\n"
+		"graph\n"
+		"stats\n"
 		"getversion\n"
 		"OK");
 	return Ok;
@@ -96,6 +105,12 @@ ApiCommandParser::parse(std::istream& request)
 #endif
     } else if (category == "cache") {
 	return handleCacheCommand(request);
+    } else if (category == "series") {
+	return handleSeriesCommand(request);
+    } else if (category == "graph") {
+	return handleGraphCommand(request);
+    } else if (category == "stats") {
+	return handleStatsCommand(request);
     } else if (category == "getversion") {
 	output("collector version: " API_VERSION);
 	startRequest(EmsProto::addressUBA, 0x02, 0, 3);
@@ -453,6 +468,166 @@ ApiCommandParser::handleCacheCommand(std::istream& request)
     return InvalidCmd;
 }
 
+ApiCommandParser::CommandResult
+ApiCommandParser::handleSeriesCommand(std::istream& request)
+{
+    std::string cmd;
+    request >> cmd;
+
+    if (!m_history) {
+	return InvalidCmd;
+    }
+
+    if (cmd == "help") {
+	output("Available subcommands:\n"
+	       "csv <start> <end> <points> <key> [<key> ...]\n"
+	       "json <start> <end> <points> <key> [<key> ...]\n"
+	       "Times are UNIX timestamps, values <= 0 are relative to now.\n"
+	       "OK");
+	return Ok;
+    } else if (cmd == "csv" || cmd == "json") {
+	long long start, end;
+	size_t points;
+	std::vector<std::string> keys;
+
+	request >> start >> end >> points;
+	if (!request) {
+	    return InvalidArgs;
+	}
+	while (request) {
+	    std::string token;
+	    request >> token;
+	    if (!token.empty()) {
+		keys.push_back(token);
+	    }
+	}
+	if (keys.empty()) {
+	    return InvalidArgs;
+	}
+
+	time_t now = time(NULL);
+	if (start <= 0) {
+	    start += now;
+	}
+	if (end <= 0) {
+	    end += now;
+	}
+	if (start < 0 || end < start) {
+	    return InvalidArgs;
+	}
+
+	std::vector<std::vector<SeriesHistory::Point> > results(keys.size());
+	for (size_t i = 0; i < keys.size(); i++) {
+	    if (!m_history->fetch(keys[i], start, end, points, results[i])) {
+		return InvalidArgs;
+	    }
+	}
+
+	std::ostringstream stream;
+	if (cmd == "csv") {
+	    for (size_t i = 0; i < keys.size(); i++) {
+		stream << "# " << keys[i] << '\n';
+		for (auto& point : results[i]) {
+		    stream << point.time << ',' << point.value << '\n';
+		}
+	    }
+	} else {
+	    stream << '{';
+	    for (size_t i = 0; i < keys.size(); i++) {
+		stream << (i != 0 ? "," : "") << '"' << keys[i] << "\":[";
+		for (size_t j = 0; j < results[i].size(); j++) {
+		    stream << (j != 0 ? "," : "") << '[' << results[i][j].time
+			   << ',' << results[i][j].value << ']';
+		}
+		stream << ']';
+	    }
+	    stream << "}\n";
+	}
+	output(stream.str() + "OK");
+	return Ok;
+    }
+
+    return InvalidCmd;
+}
+
+ApiCommandParser::CommandResult
+ApiCommandParser::handleGraphCommand(std::istream& request)
+{
+    std::string cmd;
+    request >> cmd;
+
+    if (!m_graphs) {
+	return InvalidCmd;
+    }
+
+    if (cmd == "help") {
+	output("Available subcommands:\n"
+	       "list\n"
+	       "svg <graph> [day|halfweek|week|month]\n"
+	       "OK");
+	return Ok;
+    } else if (cmd == "list") {
+	for (auto& name : m_graphs->graphNames()) {
+	    output(name);
+	}
+	output("OK");
+	return Ok;
+    } else if (cmd == "svg") {
+	std::string graph, span, svg;
+
+	request >> graph >> span;
+	if (span.empty()) {
+	    span = "day";
+	}
+	if (!m_graphs->render(graph, span, svg)) {
+	    return InvalidArgs;
+	}
+	output(svg);
+	output("OK");
+	return Ok;
+    }
+
+    return InvalidCmd;
+}
+
+ApiCommandParser::CommandResult
+ApiCommandParser::handleStatsCommand(std::istream& request)
+{
+    std::vector<std::string> keys;
+
+    if (!m_stats) {
+	return InvalidCmd;
+    }
+
+    while (request) {
+	std::string token;
+	request >> token;
+	if (!token.empty()) {
+	    keys.push_back(token);
+	}
+    }
+
+    if (keys.size() == 1 && keys[0] == "help") {
+	output("Usage: stats <key> [<key> ...]\n"
+	       "Outputs <key> <period> <since> <min> <min time> <max> <max time> <average>\n"
+	       "for the periods day, halfweek, week, month, today and yesterday.\n"
+	       "OK");
+	return Ok;
+    }
+    if (keys.empty()) {
+	return InvalidArgs;
+    }
+
+    std::ostringstream stream;
+    for (auto& key : keys) {
+	if (!m_stats->output(key, stream)) {
+	    return InvalidArgs;
+	}
+    }
+    output(stream.str() + "OK");
+    return Ok;
+}
+
 ApiCommandParser::CommandResult
 ApiCommandParser::handleHkCommand(std::istream& request, uint8_t type)
 {
@@ -1461,10 +1636,8 @@ ApiCommandParser::sendCommand(uint8_t dest, uint8_t type, uint8_t offset,
 			       const uint8_t *data, size_t count,
 			       bool expectResponse)
 {
-    std::vector<uint8_t> sendData(data, data + count);
-
     m_retriesLeft = MaxRequestRetries;
-    m_activeRequest.reset(new EmsMessage(dest, type, offset, sendData, expectResponse));
+    m_activeRequest = EmsCommandRequest::create(dest, type, offset, data, count, expectResponse);
 
     sendActiveRequest();
 }
@@ -22,6 +22,9 @@
 
 #include <boost/logic/tribool.hpp>
 #include "CommandScheduler.h"
+#include "GraphRenderer.h"
+#include "SeriesHistory.h"
+#include "WindowStats.h"
 #include "ValueCache.h"
 
 class ApiCommandParser : public boost::noncopyable
@@ -39,7 +42,10 @@ class ApiCommandParser : public boost::noncopyable
 	ApiCommandParser(EmsCommandSender& sender,
 			 const boost::shared_ptr<EmsCommandClient>& client,
 			 ValueCache *cache,
-			 OutputCallback outputCb);
+			 OutputCallback outputCb,
+			 SeriesHistory *history = nullptr,
+			 GraphRenderer *graphs = nullptr,
+			 WindowStats *stats = nullptr);
 
 	CommandResult parse(std::istream& request);
 	boost::tribool onIncomingMessage(const EmsMessage& message);
@@ -57,6 +63,9 @@ class ApiCommandParser : public boost::noncopyable
 	CommandResult handleRawCommand(std::istream& request);
 #endif
 	CommandResult handleCacheCommand(std::istream& request);
+	CommandResult handleSeriesCommand(std::istream& request);
+	CommandResult handleGraphCommand(std::istream& request);
+	CommandResult handleStatsCommand(std::istream& request);
 	CommandResult handleHkCommand(std::istream& request, uint8_t base);
 	CommandResult handleSingleByteValue(std::istream& request, uint8_t dest, uint8_t type,
 					    uint8_t offset, int multiplier, int min, int max);
@@ -92,10 +101,13 @@ class ApiCommandParser : public boost::noncopyable
 	EmsCommandSender& m_sender;
 	boost::shared_ptr<EmsCommandClient> m_client;
 	ValueCache *m_cache;
+	SeriesHistory *m_history;
+	GraphRenderer *m_graphs;
+	WindowStats *m_stats;
 	OutputCallback m_outputCb;
 	unsigned int m_responseCounter;
 	unsigned int m_retriesLeft;
-	boost::shared_ptr<EmsMessage> m_activeRequest;
+	EmsCommandRequest::Ptr m_activeRequest;
 	std::vector<uint8_t> m_requestResponse;
 	size_t m_requestOffset;
 	size_t m_requestLength;
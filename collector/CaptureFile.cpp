@@ -0,0 +1,629 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include "CaptureFile.h"
+
+const char CaptureFile::magic[8] = { 'E', 'M', 'S', 'C', 'A', 'P', '0', '2' };
+const char CaptureFile::indexMagic[8] = { 'E', 'M', 'S', 'I', 'D', 'X', '0', '2' };
+
+static void
+put32(uint8_t *buffer, uint32_t value)
+{
+    for (size_t i = 0; i < 4; i++) {
+	buffer[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static void
+put64(uint8_t *buffer, uint64_t value)
+{
+    for (size_t i = 0; i < 8; i++) {
+	buffer[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+static uint32_t
+get32(const uint8_t *buffer)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+	value |= ((uint32_t) buffer[i]) << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t
+get64(const uint8_t *buffer)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+	value |= ((uint64_t) buffer[i]) << (8 * i);
+    }
+    return value;
+}
+
+static void
+putVarint(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    while (value >= 0x80) {
+	buffer.push_back((value & 0x7f) | 0x80);
+	value >>= 7;
+    }
+    buffer.push_back(value);
+}
+
+static bool
+getVarint(const std::vector<uint8_t>& buffer, size_t& pos, uint64_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 64 && pos < buffer.size(); shift += 7) {
+	uint8_t byte = buffer[pos++];
+	value |= ((uint64_t) (byte & 0x7f)) << shift;
+	if (!(byte & 0x80)) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+/* frames with the same key are expected to repeat or change slowly */
+static std::vector<uint8_t>
+frameKey(const std::vector<uint8_t>& data)
+{
+    /* EMS+ telegrams carry their real type after the offset */
+    size_t length = data.size() >= 3 && data[2] >= 0xf0 ? 6 : 4;
+    return std::vector<uint8_t>(data.begin(), data.begin() + std::min(length, data.size()));
+}
+
+static void
+filterBits(uint8_t source, uint8_t type, unsigned int& bit1, unsigned int& bit2)
+{
+    /* the top bit of the source address only marks polled replies */
+    uint32_t hash = ((((uint32_t) source & 0x7f) << 8) | type) * 2654435761U;
+    bit1 = hash >> 23;
+    bit2 = (hash >> 14) & 0x1ff;
+}
+
+bool
+CaptureFile::Block::mayContain(uint8_t source, uint8_t type) const
+{
+    unsigned int bit1, bit2;
+
+    filterBits(source, type, bit1, bit2);
+    return (filter[bit1 / 8] & (1 << (bit1 % 8))) && (filter[bit2 / 8] & (1 << (bit2 % 8)));
+}
+
+bool
+CaptureFile::Block::mayContainType(uint8_t type) const
+{
+    for (unsigned int source = 0; source < 0x80; source++) {
+	if (mayContain(source, type)) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+void
+CaptureFile::addToFilter(Block& block, uint8_t source, uint8_t type)
+{
+    unsigned int bit1, bit2;
+
+    filterBits(source, type, bit1, bit2);
+    block.filter[bit1 / 8] |= 1 << (bit1 % 8);
+    block.filter[bit2 / 8] |= 1 << (bit2 % 8);
+}
+
+void
+CaptureFile::encodeHeader(const Block& block, uint8_t *buffer)
+{
+    put32(buffer, (block.frames & 0xffffff) | (block.encoding << 24));
+    put32(buffer + 4, block.length);
+    put64(buffer + 8, block.firstTimestamp);
+    put64(buffer + 16, block.lastTimestamp);
+    memcpy(buffer + 24, block.filter, FilterSize);
+}
+
+void
+CaptureFile::decodeHeader(const uint8_t *buffer, Block& block)
+{
+    uint32_t frames = get32(buffer);
+    block.frames = frames & 0xffffff;
+    block.encoding = frames >> 24;
+    block.length = get32(buffer + 4);
+    block.firstTimestamp = get64(buffer + 8);
+    block.lastTimestamp = get64(buffer + 16);
+    memcpy(block.filter, buffer + 24, FilterSize);
+}
+
+CaptureWriter::CaptureWriter(const std::string& path, bool compact,
+			     unsigned int blockFrames,
+			     unsigned int blockSeconds) :
+    m_offset(0),
+    m_blockFrames(std::min(blockFrames, 0xffffffU)),
+    m_blockDuration(blockSeconds * 1000ULL),
+    m_compact(compact),
+    m_lastTimestamp(0)
+{
+    std::string indexPath = path + ".idx";
+    std::vector<Block> unindexed;
+
+    memset(&m_block, 0, sizeof(m_block));
+
+    if (!recover(path, indexPath, unindexed)) {
+	return;
+    }
+
+    m_file.open(path.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+    if (!m_file.is_open()) {
+	std::cerr << "Could not open capture file " << path << std::endl;
+	return;
+    }
+
+    if (m_offset == 0) {
+	/* a fresh capture must not inherit a stale index */
+	m_file.write(magic, sizeof(magic));
+	m_offset = sizeof(magic);
+	m_index.open(indexPath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    } else {
+	m_index.open(indexPath.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+	m_index.seekp(0, std::ios::end);
+    }
+
+    if (!m_index.is_open()) {
+	std::cerr << "Could not open capture index " << indexPath << std::endl;
+	return;
+    }
+    if (m_index.tellp() == 0) {
+	m_index.write(indexMagic, sizeof(indexMagic));
+    }
+    for (size_t i = 0; i < unindexed.size(); i++) {
+	writeIndexEntry(unindexed[i]);
+    }
+    m_index.flush();
+}
+
+bool
+CaptureWriter::recover(const std::string& path, const std::string& indexPath,
+		       std::vector<Block>& unindexed)
+{
+    CaptureReader reader(path);
+
+    if (!reader.isOpen()) {
+	std::ifstream file(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (file.is_open() && file.tellg() > 0) {
+	    std::cerr << "Capture file " << path << " has an unknown format" << std::endl;
+	    return false;
+	}
+	return true;
+    }
+
+    /*
+     * Blocks are written before their index entry, so a crash may have left
+     * complete blocks missing from the index as well as a partially written
+     * block at the end. Drop the latter and index the former.
+     */
+    const std::vector<Block>& blocks = reader.blocks();
+    m_offset = blocks.empty() ? sizeof(magic) :
+	    blocks.back().offset + blockHeaderSize + blocks.back().length;
+
+    if (m_offset < reader.fileSize()) {
+	std::cerr << "Discarding " << (reader.fileSize() - m_offset)
+		  << " bytes of incomplete data at the end of " << path << std::endl;
+	if (truncate(path.c_str(), m_offset) != 0) {
+	    std::cerr << "Could not truncate capture file " << path << std::endl;
+	    return false;
+	}
+    }
+
+    size_t indexed = reader.indexedBlocks();
+    if (indexed > 0) {
+	/* drop index entries past the first stale one */
+	truncate(indexPath.c_str(), sizeof(indexMagic) + indexed * indexEntrySize);
+    } else {
+	std::ofstream index(indexPath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    }
+    unindexed.assign(blocks.begin() + indexed, blocks.end());
+
+    return true;
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    flush();
+}
+
+void
+CaptureWriter::writeFrame(uint64_t timestamp, const std::vector<uint8_t>& data)
+{
+    if (!m_file.is_open() || data.size() > 255) {
+	return;
+    }
+
+    /* start a new block if the current one is too old, or time went backwards,
+     * as both encodings store the time relative to earlier frames unsigned */
+    if (m_block.frames > 0 && (timestamp < m_block.lastTimestamp ||
+	    timestamp - m_block.firstTimestamp >= m_blockDuration)) {
+	flush();
+    }
+
+    if (m_block.frames == 0) {
+	m_block.firstTimestamp = m_lastTimestamp = timestamp;
+	m_block.encoding = m_compact ? CompactEncoding : PlainEncoding;
+    }
+    m_block.lastTimestamp = timestamp;
+    m_block.frames++;
+    if (data.size() >= 3) {
+	addToFilter(m_block, data[0], data[2]);
+    }
+
+    if (m_compact) {
+	appendCompact(timestamp, data);
+    } else {
+	appendPlain(timestamp, data);
+    }
+
+    if (m_block.frames >= m_blockFrames) {
+	flush();
+    }
+}
+
+void
+CaptureWriter::appendPlain(uint64_t timestamp, const std::vector<uint8_t>& data)
+{
+    uint8_t header[recordHeaderSize];
+
+    put32(header, timestamp - m_block.firstTimestamp);
+    header[4] = data.size();
+    m_payload.insert(m_payload.end(), header, header + sizeof(header));
+    m_payload.insert(m_payload.end(), data.begin(), data.end());
+}
+
+void
+CaptureWriter::appendCompact(uint64_t timestamp, const std::vector<uint8_t>& data)
+{
+    uint64_t delta = (timestamp - m_lastTimestamp) << 2;
+    std::vector<uint8_t> key = frameKey(data);
+    auto iter = m_keys.find(key);
+
+    m_lastTimestamp = timestamp;
+
+    if (iter == m_keys.end()) {
+	m_keys[key] = m_previous.size();
+	m_previous.push_back(data);
+	putVarint(m_payload, delta | 0);
+	m_payload.push_back(data.size());
+	m_payload.insert(m_payload.end(), data.begin(), data.end());
+	return;
+    }
+
+    std::vector<uint8_t>& previous = m_previous[iter->second];
+    if (previous.size() != data.size()) {
+	putVarint(m_payload, delta | 3);
+	putVarint(m_payload, iter->second);
+	m_payload.push_back(data.size());
+	m_payload.insert(m_payload.end(), data.begin(), data.end());
+    } else if (previous == data) {
+	putVarint(m_payload, delta | 1);
+	putVarint(m_payload, iter->second);
+    } else {
+	std::vector<uint8_t> runs;
+	size_t runCount = 0, pos = 0, last = 0;
+
+	while (pos < data.size()) {
+	    if (data[pos] == previous[pos]) {
+		pos++;
+		continue;
+	    }
+	    size_t start = pos;
+	    while (pos < data.size() && data[pos] != previous[pos]) {
+		pos++;
+	    }
+	    putVarint(runs, start - last);
+	    putVarint(runs, pos - start);
+	    for (size_t i = start; i < pos; i++) {
+		runs.push_back(data[i] ^ previous[i]);
+	    }
+	    last = pos;
+	    runCount++;
+	}
+
+	putVarint(m_payload, delta | 2);
+	putVarint(m_payload, iter->second);
+	putVarint(m_payload, runCount);
+	m_payload.insert(m_payload.end(), runs.begin(), runs.end());
+    }
+    previous = data;
+}
+
+void
+CaptureWriter::flush()
+{
+    uint8_t header[blockHeaderSize];
+
+    if (m_block.frames == 0) {
+	return;
+    }
+
+    m_block.offset = m_offset;
+    m_block.length = m_payload.size();
+    encodeHeader(m_block, header);
+
+    m_file.write((const char *) header, sizeof(header));
+    m_file.write((const char *) &m_payload[0], m_payload.size());
+    m_file.flush();
+    m_offset += sizeof(header) + m_payload.size();
+
+    /* the index is written last, readers recover blocks missing from it */
+    if (m_index.is_open()) {
+	writeIndexEntry(m_block);
+	m_index.flush();
+    }
+
+    memset(&m_block, 0, sizeof(m_block));
+    m_payload.clear();
+    m_keys.clear();
+    m_previous.clear();
+}
+
+void
+CaptureWriter::writeIndexEntry(const Block& block)
+{
+    uint8_t entry[indexEntrySize];
+
+    put64(entry, block.offset);
+    encodeHeader(block, entry + 8);
+    m_index.write((const char *) entry, sizeof(entry));
+}
+
+CaptureReader::CaptureReader(const std::string& path) :
+    m_file(path.c_str(), std::ios::in | std::ios::binary),
+    m_valid(false),
+    m_sorted(true),
+    m_fileSize(0),
+    m_indexedBlocks(0)
+{
+    char fileMagic[sizeof(magic)];
+
+    if (!m_file.read(fileMagic, sizeof(fileMagic))) {
+	return;
+    }
+    m_valid = memcmp(fileMagic, magic, sizeof(magic)) == 0;
+    if (!m_valid) {
+	return;
+    }
+
+    m_file.seekg(0, std::ios::end);
+    m_fileSize = m_file.tellg();
+
+    loadIndex(path + ".idx", m_fileSize);
+    m_indexedBlocks = m_blocks.size();
+    if (m_blocks.empty()) {
+	scanBlocks(sizeof(magic), m_fileSize);
+    } else {
+	const Block& last = m_blocks.back();
+	scanBlocks(last.offset + blockHeaderSize + last.length, m_fileSize);
+    }
+
+    for (size_t i = 1; i < m_blocks.size() && m_sorted; i++) {
+	m_sorted = m_blocks[i].firstTimestamp >= m_blocks[i - 1].lastTimestamp;
+    }
+}
+
+void
+CaptureReader::loadIndex(const std::string& path, uint64_t fileSize)
+{
+    std::ifstream index(path.c_str(), std::ios::in | std::ios::binary);
+    char fileMagic[sizeof(indexMagic)];
+    uint8_t entry[indexEntrySize];
+
+    if (!index.read(fileMagic, sizeof(fileMagic)) ||
+	    memcmp(fileMagic, indexMagic, sizeof(indexMagic)) != 0) {
+	return;
+    }
+
+    uint64_t expectedOffset = sizeof(magic);
+    while (index.read((char *) entry, sizeof(entry))) {
+	Block block;
+	block.offset = get64(entry);
+	decodeHeader(entry + 8, block);
+	/*
+	 * Stop at entries not backed by the capture (e.g. after truncation)
+	 * or not directly following the previous block (e.g. a block whose
+	 * entry was lost), the remainder is recovered by scanning the capture
+	 */
+	if (block.offset != expectedOffset ||
+		block.offset + blockHeaderSize + block.length > fileSize) {
+	    break;
+	}
+	m_blocks.push_back(block);
+	expectedOffset = block.offset + blockHeaderSize + block.length;
+    }
+}
+
+void
+CaptureReader::scanBlocks(uint64_t offset, uint64_t fileSize)
+{
+    uint8_t header[blockHeaderSize];
+
+    m_file.clear();
+    while (offset + blockHeaderSize <= fileSize) {
+	Block block;
+
+	m_file.seekg(offset);
+	if (!m_file.read((char *) header, sizeof(header))) {
+	    break;
+	}
+	block.offset = offset;
+	decodeHeader(header, block);
+	if (block.frames == 0 || block.encoding > CompactEncoding ||
+		offset + blockHeaderSize + block.length > fileSize) {
+	    /* incomplete block at the end of the file */
+	    break;
+	}
+	m_blocks.push_back(block);
+	offset += blockHeaderSize + block.length;
+    }
+    m_file.clear();
+}
+
+std::vector<CaptureFile::Block>
+CaptureReader::findBlocks(uint64_t start, uint64_t end) const
+{
+    std::vector<Block> result;
+    auto iter = m_blocks.begin();
+
+    if (m_sorted && start != 0) {
+	iter = std::lower_bound(m_blocks.begin(), m_blocks.end(), start,
+				[] (const Block& block, uint64_t start) {
+	    return block.lastTimestamp < start;
+	});
+    }
+
+    for (; iter != m_blocks.end(); ++iter) {
+	if (end != 0 && iter->firstTimestamp >= end) {
+	    if (m_sorted) {
+		break;
+	    }
+	    continue;
+	}
+	if (start != 0 && iter->lastTimestamp < start) {
+	    continue;
+	}
+	result.push_back(*iter);
+    }
+
+    return result;
+}
+
+bool
+CaptureReader::readBlock(const Block& block, std::vector<Frame>& frames)
+{
+    frames.clear();
+    if (!m_valid) {
+	return false;
+    }
+
+    m_buffer.resize(block.length);
+    m_file.clear();
+    m_file.seekg(block.offset + blockHeaderSize);
+    if (block.length > 0 && !m_file.read((char *) &m_buffer[0], block.length)) {
+	return false;
+    }
+
+    frames.reserve(block.frames);
+    switch (block.encoding) {
+	case PlainEncoding: return decodePlain(block, frames);
+	case CompactEncoding: return decodeCompact(block, frames);
+    }
+
+    return false;
+}
+
+bool
+CaptureReader::decodePlain(const Block& block, std::vector<Frame>& frames)
+{
+    size_t pos = 0;
+
+    while (pos + recordHeaderSize <= m_buffer.size()) {
+	Frame frame;
+	uint8_t length = m_buffer[pos + 4];
+
+	if (pos + recordHeaderSize + length > m_buffer.size()) {
+	    break;
+	}
+	frame.timestamp = block.firstTimestamp + get32(&m_buffer[pos]);
+	pos += recordHeaderSize;
+	frame.data.assign(m_buffer.begin() + pos, m_buffer.begin() + pos + length);
+	pos += length;
+	frames.push_back(frame);
+    }
+
+    return frames.size() == block.frames;
+}
+
+bool
+CaptureReader::decodeCompact(const Block& block, std::vector<Frame>& frames)
+{
+    uint64_t timestamp = block.firstTimestamp;
+    size_t pos = 0;
+
+    m_previous.clear();
+    while (pos < m_buffer.size()) {
+	uint64_t header, index = 0;
+	unsigned int kind;
+	Frame frame;
+
+	if (!getVarint(m_buffer, pos, header)) {
+	    return false;
+	}
+	timestamp += header >> 2;
+	kind = header & 3;
+
+	if (kind != 0 && (!getVarint(m_buffer, pos, index) || index >= m_previous.size())) {
+	    return false;
+	}
+
+	if (kind == 0 || kind == 3) {
+	    if (pos >= m_buffer.size() || pos + 1 + m_buffer[pos] > m_buffer.size()) {
+		return false;
+	    }
+	    size_t length = m_buffer[pos++];
+	    frame.data.assign(m_buffer.begin() + pos, m_buffer.begin() + pos + length);
+	    pos += length;
+	    if (kind == 0) {
+		m_previous.push_back(frame.data);
+	    } else {
+		m_previous[index] = frame.data;
+	    }
+	} else if (kind == 1) {
+	    frame.data = m_previous[index];
+	} else {
+	    std::vector<uint8_t>& previous = m_previous[index];
+	    uint64_t runs, offset = 0;
+
+	    if (!getVarint(m_buffer, pos, runs)) {
+		return false;
+	    }
+	    for (uint64_t i = 0; i < runs; i++) {
+		uint64_t gap, length;
+		if (!getVarint(m_buffer, pos, gap) || !getVarint(m_buffer, pos, length)) {
+		    return false;
+		}
+		offset += gap;
+		if (offset + length > previous.size() || pos + length > m_buffer.size()) {
+		    return false;
+		}
+		for (uint64_t j = 0; j < length; j++) {
+		    previous[offset++] ^= m_buffer[pos++];
+		}
+	    }
+	    frame.data = previous;
+	}
+
+	frame.timestamp = timestamp;
+	frames.push_back(frame);
+    }
+
+    return frames.size() == block.frames;
+}
@@ -0,0 +1,180 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CAPTUREFILE_H__
+#define __CAPTUREFILE_H__
+
+#include <stdint.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "Noncopyable.h"
+#include "Timestamp.h"
+
+/*
+ * Raw bus capture file. The file starts with an 8 byte magic, followed by
+ * blocks of frames. Each block starts with a header
+ *   uint32_t frame count (low 24 bits) and payload encoding (high 8 bits)
+ *   uint32_t payload length
+ *   uint64_t first timestamp (ms since epoch)
+ *   uint64_t last timestamp (ms since epoch)
+ *   uint8_t  filter[64] (bloom filter of the (source, type) pairs in the block)
+ * followed by the payload. With the plain encoding, there's one record
+ * per frame
+ *   uint32_t timestamp (ms since first timestamp of the block)
+ *   uint8_t  length
+ *   uint8_t  data[length] (source, dest, type, offset, payload)
+ * The compact encoding exploits that most frames repeat the previous frame
+ * with the same header. Each record starts with a varint holding the ms
+ * since the previous frame shifted left by two, the low bits being
+ *   0: new frame header, followed by length and data
+ *   1: repeat, followed by the varint key number
+ *   2: delta, followed by the key number, the varint count of changed runs
+ *      and per run the varint gap, varint length and the XORed bytes
+ *   3: replacement (length changed), followed by key number, length, data
+ * Key numbers count the distinct frame headers in order of appearance and
+ * start from zero in each block, so blocks can be decoded independently.
+ * All fixed size numbers are little endian. A sparse index of all block headers and
+ * their offsets is kept in '<file>.idx', so readers can locate a time range
+ * without scanning the capture. Index entries are written after their block;
+ * writers appending to a capture drop an incomplete block at its end and add
+ * the index entries missing after a crash.
+ */
+class CaptureFile
+{
+    public:
+	static const size_t FilterSize = 64;
+
+	typedef enum {
+	    PlainEncoding = 0,
+	    CompactEncoding = 1
+	} Encoding;
+
+	struct Frame {
+	    uint64_t timestamp;
+	    std::vector<uint8_t> data;
+	};
+
+	struct Block {
+	    uint64_t offset;
+	    uint32_t frames;
+	    uint8_t encoding;
+	    uint32_t length;
+	    uint64_t firstTimestamp;
+	    uint64_t lastTimestamp;
+	    uint8_t filter[FilterSize];
+
+	    /* may return false positives, but never false negatives */
+	    bool mayContain(uint8_t source, uint8_t type) const;
+	    bool mayContainType(uint8_t type) const;
+	};
+
+    protected:
+	static const char magic[8];
+	static const char indexMagic[8];
+	static const size_t blockHeaderSize = 88;
+	static const size_t indexEntrySize = 8 + blockHeaderSize;
+	static const size_t recordHeaderSize = 5;
+
+	static void addToFilter(Block& block, uint8_t source, uint8_t type);
+	static void encodeHeader(const Block& block, uint8_t *buffer);
+	static void decodeHeader(const uint8_t *buffer, Block& block);
+};
+
+class CaptureWriter : public CaptureFile, private boost::noncopyable
+{
+    public:
+	CaptureWriter(const std::string& path, bool compact = false,
+		      unsigned int blockFrames = 1024,
+		      unsigned int blockSeconds = 60);
+	~CaptureWriter();
+
+	bool isOpen() const {
+	    return m_file.is_open();
+	}
+	void handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp) {
+	    writeFrame(timestamp.realtime, data);
+	}
+	void writeFrame(uint64_t timestamp, const std::vector<uint8_t>& data);
+	/* writes out the pending block */
+	void flush();
+
+    private:
+	bool recover(const std::string& path, const std::string& indexPath,
+		     std::vector<Block>& unindexed);
+	void writeIndexEntry(const Block& block);
+	void appendPlain(uint64_t timestamp, const std::vector<uint8_t>& data);
+	void appendCompact(uint64_t timestamp, const std::vector<uint8_t>& data);
+
+    private:
+	std::ofstream m_file;
+	std::ofstream m_index;
+	uint64_t m_offset;
+	unsigned int m_blockFrames;
+	uint64_t m_blockDuration;
+	Block m_block;
+	std::vector<uint8_t> m_payload;
+	/* compact encoding state */
+	bool m_compact;
+	uint64_t m_lastTimestamp;
+	std::map<std::vector<uint8_t>, size_t> m_keys;
+	std::vector<std::vector<uint8_t> > m_previous;
+};
+
+class CaptureReader : public CaptureFile, private boost::noncopyable
+{
+    public:
+	CaptureReader(const std::string& path);
+
+	bool isOpen() const {
+	    return m_valid;
+	}
+	const std::vector<Block>& blocks() const {
+	    return m_blocks;
+	}
+	uint64_t fileSize() const {
+	    return m_fileSize;
+	}
+	/* number of leading blocks that were found in the index */
+	size_t indexedBlocks() const {
+	    return m_indexedBlocks;
+	}
+	/* blocks overlapping [start, end), 0 meaning unbounded */
+	std::vector<Block> findBlocks(uint64_t start, uint64_t end) const;
+	bool readBlock(const Block& block, std::vector<Frame>& frames);
+
+    private:
+	bool decodePlain(const Block& block, std::vector<Frame>& frames);
+	bool decodeCompact(const Block& block, std::vector<Frame>& frames);
+	void loadIndex(const std::string& path, uint64_t fileSize);
+	void scanBlocks(uint64_t offset, uint64_t fileSize);
+
+    private:
+	std::ifstream m_file;
+	bool m_valid;
+	bool m_sorted;
+	uint64_t m_fileSize;
+	size_t m_indexedBlocks;
+	std::vector<Block> m_blocks;
+	std::vector<uint8_t> m_buffer;
+	std::vector<std::vector<uint8_t> > m_previous;
+};
+
+#endif /* __CAPTUREFILE_H__ */
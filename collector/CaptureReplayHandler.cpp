@@ -0,0 +1,119 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include "CaptureReplayHandler.h"
+#include "Options.h"
+
+CaptureReplayHandler::CaptureReplayHandler(const std::string& path, ValueCache& cache) :
+    IoHandler(cache),
+    m_reader(path),
+    m_nextBlock(0),
+    m_start(Options::replayStart() * 1000ULL),
+    m_end(Options::replayEnd() * 1000ULL)
+{
+    if (!m_reader.isOpen()) {
+	std::cerr << "Could not read capture file " << path << std::endl;
+	doClose(boost::system::error_code());
+	return;
+    }
+
+    for (auto& block : m_reader.findBlocks(m_start, m_end)) {
+	if (blockMatches(block)) {
+	    m_blocks.push_back(block);
+	}
+    }
+
+    DebugStream& debug = Options::ioDebug();
+    if (debug) {
+	debug << "IO: Replaying " << std::dec << m_blocks.size() << " of "
+	      << m_reader.blocks().size() << " blocks from " << path << std::endl;
+    }
+
+    post(boost::bind(&CaptureReplayHandler::replayNextBlock, this));
+}
+
+bool
+CaptureReplayHandler::blockMatches(const CaptureFile::Block& block) const
+{
+    const std::vector<Options::FrameFilter>& filters = Options::replayFilter();
+
+    if (filters.empty()) {
+	return true;
+    }
+
+    for (auto& filter : filters) {
+	if (filter.source < 0 ? block.mayContainType(filter.type)
+			      : block.mayContain(filter.source, filter.type)) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+bool
+CaptureReplayHandler::frameMatches(const CaptureFile::Frame& frame) const
+{
+    const std::vector<Options::FrameFilter>& filters = Options::replayFilter();
+
+    if (frame.timestamp < m_start || (m_end != 0 && frame.timestamp >= m_end)) {
+	return false;
+    }
+    if (filters.empty()) {
+	return true;
+    }
+    if (frame.data.size() < 3) {
+	return false;
+    }
+
+    for (auto& filter : filters) {
+	bool sourceMatches = filter.source < 0 ||
+		(frame.data[0] & 0x7f) == (filter.source & 0x7f);
+	if (sourceMatches && frame.data[2] == filter.type) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+void
+CaptureReplayHandler::replayNextBlock()
+{
+    if (m_nextBlock >= m_blocks.size()) {
+	doClose(boost::system::error_code());
+	return;
+    }
+
+    if (!m_reader.readBlock(m_blocks[m_nextBlock], m_frames)) {
+	std::cerr << "Damaged capture block at offset "
+		  << m_blocks[m_nextBlock].offset << std::endl;
+    }
+    m_nextBlock++;
+
+    for (auto& frame : m_frames) {
+	if (frameMatches(frame)) {
+	    handleFrame(frame.data, Timestamp::fromRealtime(frame.timestamp));
+	}
+    }
+
+    /* one block per handler invocation keeps signals and clients serviced */
+    post(boost::bind(&CaptureReplayHandler::replayNextBlock, this));
+}
@@ -0,0 +1,57 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CAPTUREREPLAYHANDLER_H__
+#define __CAPTUREREPLAYHANDLER_H__
+
+#include "CaptureFile.h"
+#include "IoHandler.h"
+
+/*
+ * Feeds the frames of a capture file through the normal message handling.
+ * Only blocks overlapping the configured time window and possibly holding
+ * one of the configured telegram types are read.
+ */
+class CaptureReplayHandler : public IoHandler
+{
+    public:
+	CaptureReplayHandler(const std::string& path, ValueCache& cache);
+
+	virtual bool restartable() const override {
+	    return false;
+	}
+
+    protected:
+	virtual void readStart() { }
+	virtual void doCloseImpl() { }
+
+    private:
+	void replayNextBlock();
+	bool blockMatches(const CaptureFile::Block& block) const;
+	bool frameMatches(const CaptureFile::Frame& frame) const;
+
+    private:
+	CaptureReader m_reader;
+	std::vector<CaptureFile::Block> m_blocks;
+	std::vector<CaptureFile::Frame> m_frames;
+	size_t m_nextBlock;
+	uint64_t m_start, m_end;
+};
+
+#endif /* __CAPTUREREPLAYHANDLER_H__ */
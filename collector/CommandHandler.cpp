@@ -19,29 +19,39 @@
 
 #include <iostream>
 #include "CommandHandler.h"
+#include "Options.h"
 
 CommandHandler::CommandHandler(boost::asio::io_service& ios,
 			       EmsCommandSender& sender,
 			       ValueCache *cache,
-			       boost::asio::ip::tcp::endpoint& endpoint) :
+			       SeriesHistory *history,
+			       GraphRenderer *graphs,
+			       WindowStats *stats,
+			       const std::vector<StreamAcceptor::Endpoint>& endpoints) :
     m_ios(ios),
     m_sender(sender),
     m_cache(cache),
-    m_acceptor(ios, endpoint)
+    m_history(history),
+    m_graphs(graphs),
+    m_stats(stats),
+    m_draining(false)
 {
-    startAccepting();
+    for (auto& endpoint : endpoints) {
+	m_acceptors.emplace_back(new StreamAcceptor(ios, endpoint, Options::socketMode()));
+	startAccepting(m_acceptors.back().get());
+    }
 }
 
 CommandHandler::~CommandHandler()
 {
-    m_acceptor.close();
+    m_acceptors.clear();
     std::for_each(m_connections.begin(), m_connections.end(),
 		  boost::bind(&CommandConnection::close, _1));
     m_connections.clear();
 }
 
 void
-CommandHandler::handleAccept(CommandConnection::Ptr connection,
+CommandHandler::handleAccept(StreamAcceptor *acceptor, CommandConnection::Ptr connection,
 			     const boost::system::error_code& error)
 {
     if (error) {
@@ -51,8 +61,20 @@ CommandHandler::handleAccept(CommandConnection::Ptr connection,
 	return;
     }
 
+    if (!m_limiter.admit(connection->socket())) {
+	/* turning a client away shouldn't cost more than accepting it */
+	connection->close();
+	accept(acceptor, connection);
+	return;
+    }
+
     startConnection(connection);
-    startAccepting();
+    if (full()) {
+	/* further clients wait in the listen backlog until one leaves */
+	m_pausedAcceptors.push_back(acceptor);
+    } else {
+	startAccepting(acceptor);
+    }
 }
 
 void
@@ -67,14 +89,76 @@ CommandHandler::stopConnection(CommandConnection::Ptr connection)
 {
     m_connections.erase(connection);
     connection->close();
+    resumeAccepting();
+    if (m_drainCb && m_connections.empty()) {
+	m_ios.post(m_drainCb);
+	m_drainCb = nullptr;
+    }
+}
+
+std::vector<int>
+CommandHandler::listeners() const
+{
+    std::vector<int> fds;
+    for (auto& acceptor : m_acceptors) {
+	fds.push_back(acceptor->descriptor());
+    }
+    return fds;
+}
+
+void
+CommandHandler::drain(const std::function<void ()>& done)
+{
+    for (auto& acceptor : m_acceptors) {
+	acceptor->release();
+    }
+    m_draining = true;
+    m_pausedAcceptors.clear();
+
+    if (m_connections.empty()) {
+	m_ios.post(done);
+	return;
+    }
+
+    m_drainCb = done;
+    /* connections may stop right away */
+    std::set<CommandConnection::Ptr> connections = m_connections;
+    std::for_each(connections.begin(), connections.end(),
+		  boost::bind(&CommandConnection::drain, _1));
+}
+
+void
+CommandHandler::resumeAccepting()
+{
+    if (m_draining) {
+	return;
+    }
+    while (!m_pausedAcceptors.empty() && !full()) {
+	startAccepting(m_pausedAcceptors.back());
+	m_pausedAcceptors.pop_back();
+    }
+}
+
+bool
+CommandHandler::full() const
+{
+    unsigned int maxConnections = Options::maxConnections();
+    return maxConnections != 0 && m_connections.size() >= maxConnections;
 }
 
 void
-CommandHandler::startAccepting()
+CommandHandler::startAccepting(StreamAcceptor *acceptor)
 {
-    CommandConnection::Ptr connection(new CommandConnection(m_ios, m_sender, *this, m_cache));
-    m_acceptor.async_accept(connection->socket(),
-		            boost::bind(&CommandHandler::handleAccept, this,
+    CommandConnection::Ptr connection(new CommandConnection(m_ios, m_sender, *this, m_cache,
+							    m_history, m_graphs, m_stats));
+    accept(acceptor, connection);
+}
+
+void
+CommandHandler::accept(StreamAcceptor *acceptor, CommandConnection::Ptr connection)
+{
+    acceptor->acceptor().async_accept(connection->socket(),
+		            boost::bind(&CommandHandler::handleAccept, this, acceptor,
 					connection, boost::asio::placeholders::error));
 }
 
@@ -82,23 +166,92 @@ CommandHandler::startAccepting()
 CommandConnection::CommandConnection(boost::asio::io_service& ios,
 				     EmsCommandSender& sender,
 				     CommandHandler& handler,
-				     ValueCache *cache) :
+				     ValueCache *cache,
+				     SeriesHistory *history,
+				     GraphRenderer *graphs,
+				     WindowStats *stats) :
+    m_ios(ios),
     m_socket(ios),
     m_commandClient(new CommandClient(this)),
-    m_parser(sender, m_commandClient, cache, boost::bind(&CommandConnection::respond, this, _1)),
-    m_handler(handler)
+    m_parser(sender, m_commandClient, cache,
+	     boost::bind(&CommandConnection::respond, this, _1), history, graphs, stats),
+    m_handler(handler),
+    m_pendingBytes(0),
+    m_idleTimer(ios),
+    m_readTimer(ios),
+    m_draining(false)
 {
 }
 
+void
+CommandConnection::startRead()
+{
+    unsigned int idleTimeout = Options::idleTimeout();
+
+    if (idleTimeout != 0) {
+	m_idleTimer.expires_from_now(boost::posix_time::seconds(idleTimeout));
+	m_idleTimer.async_wait(boost::bind(&CommandConnection::handleIdleTimeout,
+					   shared_from_this(), boost::asio::placeholders::error));
+    }
+    boost::asio::async_read_until(m_socket, m_request, "\n",
+	boost::bind(&CommandConnection::handleRequest, shared_from_this(),
+		    boost::asio::placeholders::error));
+}
+
+void
+CommandConnection::close()
+{
+    boost::system::error_code error;
+    m_idleTimer.cancel(error);
+    m_readTimer.cancel(error);
+    m_socket.close(error);
+}
+
+void
+CommandConnection::handleIdleTimeout(const boost::system::error_code& error)
+{
+    if (!error && m_socket.is_open()) {
+	m_handler.stopConnection(shared_from_this());
+    }
+}
+
+void
+CommandConnection::readNextRequest()
+{
+    TokenBucket::Clock::duration delay =
+	    m_requestBucket.delay(Options::requestRate(), std::chrono::seconds(1));
+
+    if (delay == TokenBucket::Clock::duration::zero()) {
+	startRead();
+	return;
+    }
+
+    /* further requests stay in the socket until the client may send again */
+    m_readTimer.expires_from_now(boost::posix_time::microseconds(
+	    std::chrono::duration_cast<std::chrono::microseconds>(delay).count()));
+    m_readTimer.async_wait(boost::bind(&CommandConnection::handleReadDelay, shared_from_this(),
+				       boost::asio::placeholders::error));
+}
+
+void
+CommandConnection::handleReadDelay(const boost::system::error_code& error)
+{
+    if (!error && m_socket.is_open()) {
+	startRead();
+    }
+}
+
 void
 CommandConnection::handleRequest(const boost::system::error_code& error)
 {
+    m_idleTimer.cancel();
     if (error) {
 	if (error != boost::asio::error::operation_aborted) {
 	    m_handler.stopConnection(shared_from_this());
 	}
 	return;
     }
+    m_requestBucket.take(Options::requestRate(), std::chrono::seconds(1));
 
     std::istream requestStream(&m_request);
     ApiCommandParser::CommandResult result = m_request.size() > 2
@@ -123,13 +276,65 @@ CommandConnection::handleRequest(const boost::system::error_code& error)
     std::string remainder;
     std::getline(requestStream, remainder);
 
-    startRead();
+    readNextRequest();
+}
+
+void
+CommandConnection::respond(const std::string& response)
+{
+    if (!m_socket.is_open()) {
+	return;
+    }
+
+    m_pendingBytes += response.size() + 1;
+    if (m_pendingBytes > MaxPendingBytes) {
+	/* we may be called from within the parser */
+	boost::system::error_code error;
+	m_socket.close(error);
+	m_ios.post(boost::bind(&CommandHandler::stopConnection,
+						   &m_handler, shared_from_this()));
+	return;
+    }
+
+    /* the buffer has to stay valid until it's written */
+    m_responses.push_back(response + "\n");
+    if (m_responses.size() == 1) {
+	startWrite();
+    }
+}
+
+void
+CommandConnection::startWrite()
+{
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_responses.front()),
+	boost::bind(&CommandConnection::handleWrite, shared_from_this(),
+		    boost::asio::placeholders::error));
 }
 
 void
 CommandConnection::handleWrite(const boost::system::error_code& error)
 {
-    if (error && error != boost::asio::error::operation_aborted) {
+    if (error) {
+	if (error != boost::asio::error::operation_aborted) {
+	    m_handler.stopConnection(shared_from_this());
+	}
+	return;
+    }
+
+    m_pendingBytes -= m_responses.front().size();
+    m_responses.pop_front();
+    if (!m_responses.empty()) {
+	startWrite();
+    } else if (m_draining) {
+	m_handler.stopConnection(shared_from_this());
+    }
+}
+
+void
+CommandConnection::drain()
+{
+    m_draining = true;
+    if (m_responses.empty()) {
 	m_handler.stopConnection(shared_from_this());
     }
 }
@@ -20,14 +20,18 @@
 #ifndef __COMMANDHANDLER_H__
 #define __COMMANDHANDLER_H__
 
+#include <deque>
+#include <memory>
 #include <set>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include "ApiCommandParser.h"
 #include "CommandScheduler.h"
+#include "ConnectionLimiter.h"
 #include "EmsMessage.h"
 #include "Noncopyable.h"
+#include "StreamAcceptor.h"
 
 class CommandHandler;
 
@@ -41,26 +45,30 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 	CommandConnection(boost::asio::io_service& ios,
 			  EmsCommandSender& sender,
 			  CommandHandler& handler,
-			  ValueCache *cache);
+			  ValueCache *cache,
+			  SeriesHistory *history,
+			  GraphRenderer *graphs,
+			  WindowStats *stats);
 
     public:
-	boost::asio::ip::tcp::socket& socket() {
+	StreamAcceptor::Socket& socket() {
 	    return m_socket;
 	}
-	void startRead() {
-	    boost::asio::async_read_until(m_socket, m_request, "\n",
-		boost::bind(&CommandConnection::handleRequest, shared_from_this(),
-			    boost::asio::placeholders::error));
-	}
-	void close() {
-	    m_socket.close();
-	}
+	void startRead();
+	void close();
 	void onIncomingMessage(const EmsMessage& message);
 	void onTimeout();
+	/* closes the connection once the pending responses are sent */
+	void drain();
 
     private:
 	void handleRequest(const boost::system::error_code& error);
 	void handleWrite(const boost::system::error_code& error);
+	void handleIdleTimeout(const boost::system::error_code& error);
+	void handleReadDelay(const boost::system::error_code& error);
+	void readNextRequest();
+	void respond(const std::string& response);
+	void startWrite();
 
 	class CommandClient : public EmsCommandClient {
 	    public:
@@ -78,18 +86,23 @@ class CommandConnection : public boost::enable_shared_from_this<CommandConnectio
 		CommandConnection *m_connection;
 	};
 
-	void respond(const std::string& response) {
-	    boost::asio::async_write(m_socket, boost::asio::buffer(response + "\n"),
-		boost::bind(&CommandConnection::handleWrite, shared_from_this(),
-			    boost::asio::placeholders::error));
-	}
-
     private:
-	boost::asio::ip::tcp::socket m_socket;
+	/* a client which doesn't read its responses isn't worth buffering for */
+	static const size_t MaxPendingBytes = 1024 * 1024;
+
+	boost::asio::io_service& m_ios;
+	StreamAcceptor::Socket m_socket;
 	boost::asio::streambuf m_request;
 	boost::shared_ptr<EmsCommandClient> m_commandClient;
 	ApiCommandParser m_parser;
 	CommandHandler& m_handler;
+	/* responses not yet written, the first one is being written */
+	std::deque<std::string> m_responses;
+	size_t m_pendingBytes;
+	boost::asio::deadline_timer m_idleTimer;
+	boost::asio::deadline_timer m_readTimer;
+	TokenBucket m_requestBucket;
+	bool m_draining;
 };
 
 class CommandHandler : private boost::noncopyable
@@ -98,24 +111,43 @@ class CommandHandler : private boost::noncopyable
 	CommandHandler(boost::asio::io_service& ios,
 		       EmsCommandSender& sender,
 		       ValueCache *cache,
-		       boost::asio::ip::tcp::endpoint& endpoint);
+		       SeriesHistory *history,
+		       GraphRenderer *graphs,
+		       WindowStats *stats,
+		       const std::vector<StreamAcceptor::Endpoint>& endpoints);
 	~CommandHandler();
 
     public:
 	void startConnection(CommandConnection::Ptr connection);
 	void stopConnection(CommandConnection::Ptr connection);
+	/* descriptors of the listening sockets, for handing them over */
+	std::vector<int> listeners() const;
+	/* stops accepting and calls 'done' once all clients are closed */
+	void drain(const std::function<void ()>& done);
+	/* accepts clients again if the connection limit allows it */
+	void resumeAccepting();
 
     private:
-	void handleAccept(CommandConnection::Ptr connection,
+	void handleAccept(StreamAcceptor *acceptor, CommandConnection::Ptr connection,
 			  const boost::system::error_code& error);
-	void startAccepting();
+	void startAccepting(StreamAcceptor *acceptor);
+	void accept(StreamAcceptor *acceptor, CommandConnection::Ptr connection);
+	bool full() const;
 
     private:
 	boost::asio::io_service& m_ios;
 	EmsCommandSender& m_sender;
 	ValueCache *m_cache;
-	boost::asio::ip::tcp::acceptor m_acceptor;
+	SeriesHistory *m_history;
+	GraphRenderer *m_graphs;
+	WindowStats *m_stats;
+	std::vector<std::unique_ptr<StreamAcceptor> > m_acceptors;
 	std::set<CommandConnection::Ptr> m_connections;
+	ConnectionLimiter m_limiter;
+	/* acceptors not accepting while the connection limit is reached */
+	std::vector<StreamAcceptor *> m_pausedAcceptors;
+	bool m_draining;
+	std::function<void ()> m_drainCb;
 };
 
 #endif /* __COMMANDHANDLER_H__ */
@@ -1,7 +1,7 @@
 /*
  * Buderus EMS data collector
  *
- * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ * Copyright (C) 2016 Danny Baumann <dannybaumann@web.de>
  *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
@@ -17,13 +17,84 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <boost/bind.hpp>
+#include <string.h>
 #include "CommandScheduler.h"
 
+/* only used from the I/O thread */
+EmsCommandRequest EmsCommandRequest::s_pool[PoolSize];
+size_t EmsCommandRequest::s_poolUsed = 0;
+EmsCommandRequest *EmsCommandRequest::s_freeList = NULL;
+
+EmsCommandRequest::Ptr
+EmsCommandRequest::create(uint8_t dest, uint8_t type, uint8_t offset,
+			  const uint8_t *data, size_t count, bool expectResponse)
+{
+    EmsCommandRequest *request;
+
+    if (s_freeList) {
+	request = s_freeList;
+	s_freeList = request->m_next;
+	request->m_next = NULL;
+    } else if (s_poolUsed < PoolSize) {
+	request = &s_pool[s_poolUsed++];
+	request->m_pooled = true;
+    } else {
+	request = new EmsCommandRequest;
+    }
+
+    request->m_dest = dest | (expectResponse ? 0x80 : 0);
+    request->m_type = type;
+    request->m_offset = offset;
+    request->m_length = std::min(count, MaxPayloadSize);
+    memcpy(request->m_data, data, request->m_length);
+
+    return Ptr(request);
+}
+
+void
+EmsCommandRequest::release(EmsCommandRequest *request)
+{
+    request->m_client.reset();
+    if (request->m_pooled) {
+	request->m_next = s_freeList;
+	s_freeList = request;
+    } else {
+	delete request;
+    }
+}
+
+size_t
+EmsCommandRequest::getSendData(uint8_t *buffer, bool omitSenderAddress) const
+{
+    size_t length = 0;
+
+    if (!omitSenderAddress) {
+	buffer[length++] = EmsProto::addressPC;
+    }
+    buffer[length++] = m_dest;
+    buffer[length++] = m_type;
+    buffer[length++] = m_offset;
+    memcpy(buffer + length, m_data, m_length);
+
+    return length + m_length;
+}
+
+EmsCommandSender::~EmsCommandSender()
+{
+    m_responseTimeout.cancel();
+    m_sendTimer.cancel();
+    while (m_pendingHead) {
+	EmsCommandRequest *request = m_pendingHead;
+	m_pendingHead = request->m_next;
+	request->m_next = NULL;
+	intrusive_ptr_release(request);
+    }
+}
+
 void
 EmsCommandSender::handlePcMessage(const EmsMessage& message)
 {
-    m_lastCommTimes[message.getSource()] = boost::posix_time::microsec_clock::universal_time();
+    m_lastCommTimes[message.getSource() & 0x7f] = boost::posix_time::microsec_clock::universal_time();
     m_responseTimeout.cancel();
     if (m_currentClient) {
 	m_currentClient->onIncomingMessage(message);
@@ -32,10 +103,20 @@ EmsCommandSender::handlePcMessage(const EmsMessage& message)
 }
 
 void
-EmsCommandSender::sendMessage(ClientPtr& client, MessagePtr& message)
+EmsCommandSender::sendMessage(const ClientPtr& client, const RequestPtr& request)
 {
     bool wasIdle = !m_currentClient;
-    m_pending.push_back(std::make_pair(client, message));
+    EmsCommandRequest *entry = request.get();
+
+    intrusive_ptr_add_ref(entry);
+    entry->m_client = client;
+    if (m_pendingTail) {
+	m_pendingTail->m_next = entry;
+    } else {
+	m_pendingHead = entry;
+    }
+    m_pendingTail = entry;
+
     if (wasIdle) {
 	continueWithNextRequest();
     }
@@ -45,54 +126,71 @@ void
 EmsCommandSender::scheduleResponseTimeout()
 {
     m_responseTimeout.expires_from_now(boost::posix_time::milliseconds(RequestTimeout));
-    m_responseTimeout.async_wait([this] (const boost::system::error_code& error) {
+    m_responseTimeout.async_wait(makeHandlerWithMemory(m_responseTimeoutMemory,
+	    [this] (const boost::system::error_code& error) {
 	if (error != boost::asio::error::operation_aborted) {
 	    if (m_currentClient) {
 		m_currentClient->onTimeout();
 	    }
 	    continueWithNextRequest();
 	}
-    });
+    }));
 }
 
 void
-EmsCommandSender::sendMessage(const MessagePtr& message)
+EmsCommandSender::sendCurrentRequest()
 {
-    auto timeIter = m_lastCommTimes.find(message->getDestination());
+    const boost::posix_time::ptime& lastTime = m_lastCommTimes[m_currentRequest->getDestination()];
     bool scheduled = false;
 
-    if (timeIter != m_lastCommTimes.end()) {
+    if (!lastTime.is_not_a_date_time()) {
 	boost::posix_time::ptime now(boost::posix_time::microsec_clock::universal_time());
-	boost::posix_time::time_duration diff = now - timeIter->second;
+	boost::posix_time::time_duration diff = now - lastTime;
 
 	if (diff.total_milliseconds() <= MinDistanceBetweenRequests) {
-	    m_sendTimer.expires_at(timeIter->second + boost::posix_time::milliseconds(MinDistanceBetweenRequests));
-	    m_sendTimer.async_wait(boost::bind(&EmsCommandSender::doSendMessage, this, *message));
+	    m_sendTimer.expires_at(lastTime + boost::posix_time::milliseconds(MinDistanceBetweenRequests));
+	    m_sendTimer.async_wait(makeHandlerWithMemory(m_sendTimerMemory,
+		    [this] (const boost::system::error_code& error) {
+		if (error != boost::asio::error::operation_aborted && m_currentRequest) {
+		    doSendMessage(*m_currentRequest);
+		}
+	    }));
 	    scheduled = true;
 	}
     }
     if (!scheduled) {
-	doSendMessage(*message);
+	doSendMessage(*m_currentRequest);
     }
 }
 
 void
-EmsCommandSender::doSendMessage(const EmsMessage& message)
+EmsCommandSender::doSendMessage(const EmsCommandRequest& request)
 {
-    sendMessageImpl(message);
+    sendMessageImpl(request);
     scheduleResponseTimeout();
-    m_lastCommTimes[message.getDestination()] = boost::posix_time::microsec_clock::universal_time();
+    m_lastCommTimes[request.getDestination()] = boost::posix_time::microsec_clock::universal_time();
 }
 
 void
 EmsCommandSender::continueWithNextRequest()
 {
-    if (m_pending.empty()) {
+    EmsCommandRequest *request = m_pendingHead;
+
+    if (!request) {
 	m_currentClient.reset();
+	m_currentRequest.reset();
 	return;
     }
-    auto& item = m_pending.front();
-    m_currentClient = item.first;
-    sendMessage(item.second);
-    m_pending.pop_front();
+
+    m_pendingHead = request->m_next;
+    if (!m_pendingHead) {
+	m_pendingTail = NULL;
+    }
+    request->m_next = NULL;
+
+    m_currentClient = request->m_client;
+    request->m_client.reset();
+    /* takes over the reference held by the queue */
+    m_currentRequest.reset(request, false);
+    sendCurrentRequest();
 }
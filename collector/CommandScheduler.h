@@ -20,8 +20,9 @@
 #ifndef __COMMANDSCHEDULER_H__
 #define __COMMANDSCHEDULER_H__
 
-#include <list>
+#include <type_traits>
 #include <boost/asio.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include "EmsMessage.h"
 #include "Noncopyable.h"
 
@@ -32,42 +33,213 @@ class EmsCommandClient
 	virtual void onTimeout() = 0;
 };
 
+/*
+ * Command for a device on the bus. Requests carry their payload inline
+ * and are taken from a fixed pool, so sending a command doesn't allocate
+ * memory. They are reference counted and go back to the pool once the
+ * last reference is dropped; only if more requests than the pool holds
+ * are in use at the same time, the additional ones are allocated.
+ */
+class EmsCommandRequest : private boost::noncopyable
+{
+    public:
+	typedef boost::intrusive_ptr<EmsCommandRequest> Ptr;
+
+	/* telegrams are at most 32 bytes, including header and checksum */
+	static const size_t MaxPayloadSize = 27;
+	/* sender address, destination, type, offset and payload */
+	static const size_t MaxSendSize = MaxPayloadSize + 4;
+
+	/* payloads longer than MaxPayloadSize are truncated */
+	static Ptr create(uint8_t dest, uint8_t type, uint8_t offset,
+			  const uint8_t *data, size_t count, bool expectResponse);
+
+    public:
+	uint8_t getDestination() const {
+	    return m_dest & 0x7f;
+	}
+	uint8_t getType() const {
+	    return m_type;
+	}
+	uint8_t getOffset() const {
+	    return m_offset;
+	}
+	/* writes the telegram to buffer, which must hold MaxSendSize bytes */
+	size_t getSendData(uint8_t *buffer, bool omitSenderAddress) const;
+
+    private:
+	EmsCommandRequest() :
+	    m_refCount(0),
+	    m_pooled(false),
+	    m_next(NULL)
+	{}
+
+	friend class EmsCommandSender;
+	friend void intrusive_ptr_add_ref(EmsCommandRequest *request) {
+	    request->m_refCount++;
+	}
+	friend void intrusive_ptr_release(EmsCommandRequest *request) {
+	    if (--request->m_refCount == 0) {
+		release(request);
+	    }
+	}
+	static void release(EmsCommandRequest *request);
+
+    private:
+	static const size_t PoolSize = 32;
+	static EmsCommandRequest s_pool[PoolSize];
+	static size_t s_poolUsed;
+	static EmsCommandRequest *s_freeList;
+
+	unsigned int m_refCount;
+	bool m_pooled;
+	/* link in the free list of the pool or the sender's queue */
+	EmsCommandRequest *m_next;
+	boost::shared_ptr<EmsCommandClient> m_client;
+	uint8_t m_dest;
+	uint8_t m_type;
+	uint8_t m_offset;
+	uint8_t m_length;
+	uint8_t m_data[MaxPayloadSize];
+};
+
+/*
+ * Storage for the handler of one outstanding timer wait, so that waiting
+ * doesn't allocate either (as in the allocation example of boost::asio).
+ * Handlers that don't fit or overlap a previous one use the heap. It is
+ * shared with the handlers, as the io_service may destroy them only after
+ * the sender is gone.
+ */
+class HandlerMemory : private boost::noncopyable
+{
+    public:
+	typedef boost::shared_ptr<HandlerMemory> Ptr;
+
+	HandlerMemory() :
+	    m_inUse(false)
+	{}
+
+	void * allocate(size_t size) {
+	    if (!m_inUse && size <= sizeof(m_storage)) {
+		m_inUse = true;
+		return &m_storage;
+	    }
+	    return ::operator new(size);
+	}
+	void deallocate(void *pointer) {
+	    if (pointer == &m_storage) {
+		m_inUse = false;
+	    } else {
+		::operator delete(pointer);
+	    }
+	}
+
+    private:
+	std::aligned_storage<256>::type m_storage;
+	bool m_inUse;
+};
+
+template<typename T> class HandlerAllocator
+{
+    public:
+	typedef T value_type;
+
+	explicit HandlerAllocator(const HandlerMemory::Ptr& memory) :
+	    m_memory(memory)
+	{}
+	template<typename U> HandlerAllocator(const HandlerAllocator<U>& other) :
+	    m_memory(other.m_memory)
+	{}
+
+	T * allocate(size_t count) {
+	    return static_cast<T *>(m_memory->allocate(sizeof(T) * count));
+	}
+	void deallocate(T *pointer, size_t /* count */) {
+	    m_memory->deallocate(pointer);
+	}
+	bool operator==(const HandlerAllocator& other) const {
+	    return m_memory == other.m_memory;
+	}
+	bool operator!=(const HandlerAllocator& other) const {
+	    return m_memory != other.m_memory;
+	}
+
+    private:
+	template<typename> friend class HandlerAllocator;
+	HandlerMemory::Ptr m_memory;
+};
+
+template<typename Handler> class HandlerWithMemory
+{
+    public:
+	typedef HandlerAllocator<Handler> allocator_type;
+
+	HandlerWithMemory(const HandlerMemory::Ptr& memory, const Handler& handler) :
+	    m_memory(memory),
+	    m_handler(handler)
+	{}
+
+	allocator_type get_allocator() const {
+	    return allocator_type(m_memory);
+	}
+	void operator()(const boost::system::error_code& error) {
+	    m_handler(error);
+	}
+
+    private:
+	HandlerMemory::Ptr m_memory;
+	Handler m_handler;
+};
+
+template<typename Handler> HandlerWithMemory<Handler>
+makeHandlerWithMemory(const HandlerMemory::Ptr& memory, const Handler& handler)
+{
+    return HandlerWithMemory<Handler>(memory, handler);
+}
+
 class EmsCommandSender : public boost::noncopyable
 {
     public:
-	typedef boost::shared_ptr<EmsMessage> MessagePtr;
+	typedef EmsCommandRequest::Ptr RequestPtr;
 	typedef boost::shared_ptr<EmsCommandClient> ClientPtr;
 
 	EmsCommandSender(boost::asio::io_service& ios) :
+	    m_pendingHead(NULL),
+	    m_pendingTail(NULL),
 	    m_responseTimeout(ios),
-	    m_sendTimer(ios)
+	    m_sendTimer(ios),
+	    m_responseTimeoutMemory(new HandlerMemory),
+	    m_sendTimerMemory(new HandlerMemory)
         {}
-	~EmsCommandSender() {
-	    m_responseTimeout.cancel();
-	    m_sendTimer.cancel();
-	}
+	~EmsCommandSender();
 
 	void handlePcMessage(const EmsMessage& message);
-	void sendMessage(ClientPtr& client, MessagePtr& message);
+	void sendMessage(const ClientPtr& client, const RequestPtr& request);
 
     protected:
-	virtual void sendMessageImpl(const EmsMessage& message) = 0;
+	virtual void sendMessageImpl(const EmsCommandRequest& request) = 0;
 
     private:
 	void continueWithNextRequest();
 	void scheduleResponseTimeout();
-	void sendMessage(const MessagePtr& message);
-	void doSendMessage(const EmsMessage& message);
+	void sendCurrentRequest();
+	void doSendMessage(const EmsCommandRequest& request);
 
     private:
 	static const unsigned int RequestTimeout = 1000; /* ms */
 	static const long MinDistanceBetweenRequests = 100; /* ms */
 
 	ClientPtr m_currentClient;
-	std::list<std::pair<ClientPtr, MessagePtr> > m_pending;
+	RequestPtr m_currentRequest;
+	/* queue linked through the requests, each entry holds a reference */
+	EmsCommandRequest *m_pendingHead;
+	EmsCommandRequest *m_pendingTail;
 	boost::asio::deadline_timer m_responseTimeout;
 	boost::asio::deadline_timer m_sendTimer;
-	std::map<uint8_t, boost::posix_time::ptime> m_lastCommTimes;
+	HandlerMemory::Ptr m_responseTimeoutMemory;
+	HandlerMemory::Ptr m_sendTimerMemory;
+	/* indexed by bus address */
+	boost::posix_time::ptime m_lastCommTimes[0x80];
 };
 
 #endif /* __COMMANDSCHEDULER_H__ */
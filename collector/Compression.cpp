@@ -0,0 +1,93 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Compression.h"
+
+#ifdef HAVE_ZLIB
+
+#include <string.h>
+
+static const size_t ChunkSize = 16384;
+
+Deflater::Deflater()
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+    deflateInit(&m_stream, Z_DEFAULT_COMPRESSION);
+}
+
+Deflater::~Deflater()
+{
+    deflateEnd(&m_stream);
+}
+
+void
+Deflater::compress(const uint8_t *data, size_t length, std::vector<uint8_t>& output)
+{
+    m_stream.next_in = (Bytef *) data;
+    m_stream.avail_in = length;
+
+    /* a sync flush is complete once it leaves space in the output */
+    do {
+	size_t pos = output.size();
+	output.resize(pos + ChunkSize);
+	m_stream.next_out = &output[pos];
+	m_stream.avail_out = ChunkSize;
+	deflate(&m_stream, Z_SYNC_FLUSH);
+	output.resize(pos + ChunkSize - m_stream.avail_out);
+    } while (m_stream.avail_out == 0);
+}
+
+Inflater::Inflater()
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+    inflateInit(&m_stream);
+}
+
+Inflater::~Inflater()
+{
+    inflateEnd(&m_stream);
+}
+
+bool
+Inflater::decompress(const uint8_t *data, size_t length, std::vector<uint8_t>& output)
+{
+    m_stream.next_in = (Bytef *) data;
+    m_stream.avail_in = length;
+
+    /* a full output buffer may leave decompressed data behind in the stream,
+     * even when all input was consumed */
+    do {
+	size_t pos = output.size();
+	output.resize(pos + ChunkSize);
+	m_stream.next_out = &output[pos];
+	m_stream.avail_out = ChunkSize;
+	int result = inflate(&m_stream, Z_SYNC_FLUSH);
+	output.resize(pos + ChunkSize - m_stream.avail_out);
+	if (result == Z_BUF_ERROR && m_stream.avail_in != 0 && m_stream.avail_out != 0) {
+	    /* no progress possible, which only happens on corrupt data */
+	    return false;
+	} else if (result != Z_OK && result != Z_BUF_ERROR) {
+	    return false;
+	}
+    } while (m_stream.avail_in != 0 || m_stream.avail_out == 0);
+
+    return true;
+}
+
+#endif /* HAVE_ZLIB */
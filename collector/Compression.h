@@ -0,0 +1,89 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COMPRESSION_H__
+#define __COMPRESSION_H__
+
+#include <stdint.h>
+#include <vector>
+#include "Noncopyable.h"
+
+#ifdef HAVE_ZLIB
+
+#include <zlib.h>
+
+/*
+ * Streaming zlib compression of a connection. One instance is kept for the
+ * whole connection, so repeated text compresses against everything sent
+ * before. Each call ends with a sync flush, so the peer can decode all data
+ * handed in so far without waiting for more.
+ */
+class Deflater : private boost::noncopyable
+{
+    public:
+	Deflater();
+	~Deflater();
+
+	static bool available() {
+	    return true;
+	}
+	void compress(const uint8_t *data, size_t length, std::vector<uint8_t>& output);
+
+    private:
+	z_stream m_stream;
+};
+
+class Inflater : private boost::noncopyable
+{
+    public:
+	Inflater();
+	~Inflater();
+
+	/* returns false if the data is corrupt */
+	bool decompress(const uint8_t *data, size_t length, std::vector<uint8_t>& output);
+
+    private:
+	z_stream m_stream;
+};
+
+#else /* HAVE_ZLIB */
+
+class Deflater : private boost::noncopyable
+{
+    public:
+	static bool available() {
+	    return false;
+	}
+	void compress(const uint8_t *data, size_t length, std::vector<uint8_t>& output) {
+	    output.insert(output.end(), data, data + length);
+	}
+};
+
+class Inflater : private boost::noncopyable
+{
+    public:
+	bool decompress(const uint8_t * /* data */, size_t /* length */,
+			std::vector<uint8_t>& /* output */) {
+	    return false;
+	}
+};
+
+#endif /* !HAVE_ZLIB */
+
+#endif /* __COMPRESSION_H__ */
@@ -0,0 +1,103 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2016 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ConnectionLimiter.h"
+#include "Options.h"
+
+void
+TokenBucket::refill(unsigned int rate, Clock::duration period)
+{
+    Clock::time_point now = Clock::now();
+
+    if (!m_used) {
+	/* start with a full bucket */
+	m_tokens = rate;
+	m_used = true;
+    } else {
+	std::chrono::duration<double> elapsed = now - m_last;
+	std::chrono::duration<double> length = period;
+	m_tokens = std::min<double>(rate, m_tokens + rate * elapsed.count() / length.count());
+    }
+    m_last = now;
+}
+
+bool
+TokenBucket::take(unsigned int rate, Clock::duration period)
+{
+    if (rate == 0) {
+	return true;
+    }
+
+    refill(rate, period);
+    if (m_tokens < 1) {
+	return false;
+    }
+    m_tokens -= 1;
+    return true;
+}
+
+TokenBucket::Clock::duration
+TokenBucket::delay(unsigned int rate, Clock::duration period)
+{
+    if (rate == 0) {
+	return Clock::duration::zero();
+    }
+
+    refill(rate, period);
+    if (m_tokens >= 1) {
+	return Clock::duration::zero();
+    }
+    return std::chrono::duration_cast<Clock::duration>((1 - m_tokens) * period / rate);
+}
+
+bool
+ConnectionLimiter::admit(const StreamAcceptor::Socket& socket)
+{
+    unsigned int rate = Options::connectionRate();
+    boost::system::error_code error;
+    StreamAcceptor::Endpoint endpoint = socket.remote_endpoint(error);
+    const uint8_t *address;
+    size_t length;
+
+    if (rate == 0 || error) {
+	return true;
+    }
+
+    const struct sockaddr *sockaddr = endpoint.data();
+    switch (sockaddr->sa_family) {
+	case AF_INET:
+	    address = (const uint8_t *) &((const struct sockaddr_in *) sockaddr)->sin_addr;
+	    length = sizeof(struct in_addr);
+	    break;
+	case AF_INET6:
+	    address = (const uint8_t *) &((const struct sockaddr_in6 *) sockaddr)->sin6_addr;
+	    length = sizeof(struct in6_addr);
+	    break;
+	default:
+	    return true;
+    }
+
+    /* FNV-1a */
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+	hash = (hash ^ address[i]) * 16777619U;
+    }
+
+    return m_buckets[hash % AddressSlots].take(rate, std::chrono::minutes(1));
+}
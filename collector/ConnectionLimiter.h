@@ -0,0 +1,74 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2016 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONNECTIONLIMITER_H__
+#define __CONNECTIONLIMITER_H__
+
+#include <chrono>
+#include "Noncopyable.h"
+#include "StreamAcceptor.h"
+
+/*
+ * Allows 'rate' events per period on average, in bursts of up to 'rate'
+ * events. The rate is passed on every use, so it may change at runtime.
+ */
+class TokenBucket
+{
+    public:
+	typedef std::chrono::steady_clock Clock;
+
+	TokenBucket() :
+	    m_tokens(0),
+	    m_used(false)
+	{}
+
+	/* takes a token if one is available */
+	bool take(unsigned int rate, Clock::duration period);
+	/* time until a token is available */
+	Clock::duration delay(unsigned int rate, Clock::duration period);
+
+    private:
+	void refill(unsigned int rate, Clock::duration period);
+
+    private:
+	double m_tokens;
+	Clock::time_point m_last;
+	bool m_used;
+};
+
+/*
+ * Limits how often a client may connect to the command or data interface.
+ * Clients are told apart by address; addresses share a fixed number of
+ * buckets, which keeps memory and time per connection constant no matter
+ * how many addresses a client uses. Clients of Unix sockets are local and
+ * not limited.
+ */
+class ConnectionLimiter : private boost::noncopyable
+{
+    public:
+	/* whether the client of a just accepted socket may stay connected */
+	bool admit(const StreamAcceptor::Socket& socket);
+
+    private:
+	static const size_t AddressSlots = 256;
+
+	TokenBucket m_buckets[AddressSlots];
+};
+
+#endif /* __CONNECTIONLIMITER_H__ */
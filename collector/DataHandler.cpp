@@ -19,26 +19,30 @@
 
 #include <iostream>
 #include "DataHandler.h"
+#include "Options.h"
 #include "ValueApi.h"
 
 DataHandler::DataHandler(boost::asio::io_service& ios,
-			 boost::asio::ip::tcp::endpoint& endpoint) :
+			 const std::vector<StreamAcceptor::Endpoint>& endpoints) :
     m_ios(ios),
-    m_acceptor(ios, endpoint)
+    m_draining(false)
 {
-    startAccepting();
+    for (auto& endpoint : endpoints) {
+	m_acceptors.emplace_back(new StreamAcceptor(ios, endpoint, Options::socketMode()));
+	startAccepting(m_acceptors.back().get());
+    }
 }
 
 DataHandler::~DataHandler()
 {
-    m_acceptor.close();
+    m_acceptors.clear();
     std::for_each(m_connections.begin(), m_connections.end(),
 		  boost::bind(&DataConnection::close, _1));
     m_connections.clear();
 }
 
 void
-DataHandler::handleAccept(DataConnection::Ptr connection,
+DataHandler::handleAccept(StreamAcceptor *acceptor, DataConnection::Ptr connection,
 			  const boost::system::error_code& error)
 {
     if (error) {
@@ -48,14 +52,27 @@ DataHandler::handleAccept(DataConnection::Ptr connection,
 	return;
     }
 
+    if (!m_limiter.admit(connection->socket())) {
+	/* turning a client away shouldn't cost more than accepting it */
+	connection->close();
+	accept(acceptor, connection);
+	return;
+    }
+
     startConnection(connection);
-    startAccepting();
+    if (full()) {
+	/* further clients wait in the listen backlog until one leaves */
+	m_pausedAcceptors.push_back(acceptor);
+    } else {
+	startAccepting(acceptor);
+    }
 }
 
 void
 DataHandler::startConnection(DataConnection::Ptr connection)
 {
     m_connections.insert(connection);
+    connection->startRead();
 }
 
 void
@@ -63,6 +80,42 @@ DataHandler::stopConnection(DataConnection::Ptr connection)
 {
     m_connections.erase(connection);
     connection->close();
+    resumeAccepting();
+    if (m_drainCb && m_connections.empty()) {
+	m_ios.post(m_drainCb);
+	m_drainCb = nullptr;
+    }
+}
+
+std::vector<int>
+DataHandler::listeners() const
+{
+    std::vector<int> fds;
+    for (auto& acceptor : m_acceptors) {
+	fds.push_back(acceptor->descriptor());
+    }
+    return fds;
+}
+
+void
+DataHandler::drain(const std::function<void ()>& done)
+{
+    for (auto& acceptor : m_acceptors) {
+	acceptor->release();
+    }
+    m_draining = true;
+    m_pausedAcceptors.clear();
+
+    if (m_connections.empty()) {
+	m_ios.post(done);
+	return;
+    }
+
+    m_drainCb = done;
+    /* connections may stop right away */
+    std::set<DataConnection::Ptr> connections = m_connections;
+    std::for_each(connections.begin(), connections.end(),
+		  boost::bind(&DataConnection::drain, _1));
 }
 
 void
@@ -73,18 +126,56 @@ DataHandler::handleValue(const EmsValue& value)
 }
 
 void
-DataHandler::startAccepting()
+DataHandler::handleAlert(const AlertRules::Alert& alert)
+{
+    std::for_each(m_connections.begin(), m_connections.end(),
+		  boost::bind(&DataConnection::handleAlert, _1, alert));
+}
+
+void
+DataHandler::resumeAccepting()
+{
+    if (m_draining) {
+	return;
+    }
+    while (!m_pausedAcceptors.empty() && !full()) {
+	startAccepting(m_pausedAcceptors.back());
+	m_pausedAcceptors.pop_back();
+    }
+}
+
+bool
+DataHandler::full() const
+{
+    unsigned int maxConnections = Options::maxConnections();
+    return maxConnections != 0 && m_connections.size() >= maxConnections;
+}
+
+void
+DataHandler::startAccepting(StreamAcceptor *acceptor)
 {
     DataConnection::Ptr connection(new DataConnection(m_ios, *this));
-    m_acceptor.async_accept(connection->socket(),
-		            boost::bind(&DataHandler::handleAccept, this,
+    accept(acceptor, connection);
+}
+
+void
+DataHandler::accept(StreamAcceptor *acceptor, DataConnection::Ptr connection)
+{
+    acceptor->acceptor().async_accept(connection->socket(),
+		            boost::bind(&DataHandler::handleAccept, this, acceptor,
 					connection, boost::asio::placeholders::error));
 }
 
 
 DataConnection::DataConnection(boost::asio::io_service& ios, DataHandler& handler) :
+    m_ios(ios),
     m_socket(ios),
-    m_handler(handler)
+    m_handler(handler),
+    m_flushPosted(false),
+    m_writing(false),
+    m_draining(false),
+    m_idleTimer(ios),
+    m_readTimer(ios)
 {
 }
 
@@ -92,10 +183,181 @@ DataConnection::~DataConnection()
 {
 }
 
+void
+DataConnection::startRead()
+{
+    boost::asio::async_read_until(m_socket, m_request, '\n',
+	    boost::bind(&DataConnection::handleRead, shared_from_this(),
+			boost::asio::placeholders::error));
+}
+
+void
+DataConnection::close()
+{
+    boost::system::error_code error;
+    m_idleTimer.cancel(error);
+    m_readTimer.cancel(error);
+    m_socket.close(error);
+}
+
+void
+DataConnection::readNextRequest()
+{
+    TokenBucket::Clock::duration delay =
+	    m_requestBucket.delay(Options::requestRate(), std::chrono::seconds(1));
+
+    if (delay == TokenBucket::Clock::duration::zero()) {
+	startRead();
+	return;
+    }
+
+    /* further requests stay in the socket until the client may send again */
+    m_readTimer.expires_from_now(boost::posix_time::microseconds(
+	    std::chrono::duration_cast<std::chrono::microseconds>(delay).count()));
+    m_readTimer.async_wait(boost::bind(&DataConnection::handleReadDelay, shared_from_this(),
+				       boost::asio::placeholders::error));
+}
+
+void
+DataConnection::handleReadDelay(const boost::system::error_code& error)
+{
+    if (!error && m_socket.is_open()) {
+	startRead();
+    }
+}
+
+void
+DataConnection::handleIdleTimeout(const boost::system::error_code& error)
+{
+    /* the client stopped taking data */
+    if (!error && m_writing && m_socket.is_open()) {
+	m_handler.stopConnection(shared_from_this());
+    }
+}
+
+void
+DataConnection::handleRead(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::eof) {
+	/* the client only listens from now on */
+	return;
+    } else if (error) {
+	if (error != boost::asio::error::operation_aborted) {
+	    m_handler.stopConnection(shared_from_this());
+	}
+	return;
+    }
+    m_requestBucket.take(Options::requestRate(), std::chrono::seconds(1));
+
+    std::istream request(&m_request);
+    std::string line;
+    std::getline(request, line);
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+	line.erase(line.size() - 1);
+    }
+
+    /* the only request clients can make: 'compress deflate' switches the
+     * rest of the stream to zlib, starting right after our answer */
+    if (line == "compress deflate" && !m_deflater) {
+	if (Deflater::available()) {
+	    output("compress deflate");
+	    encode();
+	    m_deflater.reset(new Deflater());
+	} else {
+	    output("compress none");
+	}
+    }
+
+    readNextRequest();
+}
+
+void
+DataConnection::output(const std::string& text)
+{
+    if (!m_socket.is_open()) {
+	return;
+    }
+
+    m_pending += text;
+    m_pending += '\n';
+
+    if (m_pending.size() + m_output.size() > MaxPendingBytes) {
+	/* we're called while the handler walks its connections */
+	boost::system::error_code ec;
+	m_socket.close(ec);
+	m_ios.post(boost::bind(&DataHandler::stopConnection, &m_handler, shared_from_this()));
+	return;
+    }
+
+    /* everything output while handling the current frame forms one batch,
+     * which is sent as soon as control returns to the event loop */
+    if (!m_flushPosted) {
+	m_flushPosted = true;
+	m_ios.post(boost::bind(&DataConnection::flush, shared_from_this()));
+    }
+}
+
+void
+DataConnection::encode()
+{
+    if (m_deflater) {
+	m_deflater->compress((const uint8_t *) m_pending.data(), m_pending.size(), m_output);
+    } else {
+	m_output.insert(m_output.end(), m_pending.begin(), m_pending.end());
+    }
+    m_pending.clear();
+}
+
+void
+DataConnection::flush()
+{
+    m_flushPosted = false;
+    if (!m_pending.empty()) {
+	encode();
+    }
+    if (m_writing || m_output.empty() || !m_socket.is_open()) {
+	return;
+    }
+
+    m_writeBuffer.swap(m_output);
+    m_output.clear();
+    m_writing = true;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_writeBuffer),
+	    boost::bind(&DataConnection::handleWrite, shared_from_this(),
+			boost::asio::placeholders::error));
+
+    unsigned int idleTimeout = Options::idleTimeout();
+    if (idleTimeout != 0) {
+	m_idleTimer.expires_from_now(boost::posix_time::seconds(idleTimeout));
+	m_idleTimer.async_wait(boost::bind(&DataConnection::handleIdleTimeout, shared_from_this(),
+					   boost::asio::placeholders::error));
+    }
+}
+
 void
 DataConnection::handleWrite(const boost::system::error_code& error)
 {
-    if (error && error != boost::asio::error::operation_aborted) {
+    m_writing = false;
+    m_idleTimer.cancel();
+    if (error) {
+	if (error != boost::asio::error::operation_aborted) {
+	    m_handler.stopConnection(shared_from_this());
+	}
+	return;
+    }
+
+    /* send what piled up while this write was in progress */
+    flush();
+    if (m_draining && !m_writing) {
+	m_handler.stopConnection(shared_from_this());
+    }
+}
+
+void
+DataConnection::drain()
+{
+    m_draining = true;
+    if (!m_flushPosted && !m_writing) {
 	m_handler.stopConnection(shared_from_this());
     }
 }
@@ -103,18 +365,37 @@ DataConnection::handleWrite(const boost::system::error_code& error)
 void
 DataConnection::handleValue(const EmsValue& value)
 {
-    std::ostringstream stream;
     std::string type = ValueApi::getTypeName(value.getType());
-    std::string subtype = ValueApi::getSubTypeName(value.getSubType());
+    std::string line = ValueApi::getSubTypeName(value.getSubType());
 
     if (type.empty()) {
 	return;
     }
 
-    if (!subtype.empty()) {
-	stream << subtype << " ";
+    if (!line.empty()) {
+	line += " ";
+    }
+    line += type;
+    line += " ";
+    line += ValueApi::formatValue(value);
+    if (Options::valueTimestamps()) {
+	line += " | ";
+	line += ValueApi::formatTimestamp(value.getTimestamp());
+    }
+
+    output(line);
+}
+
+void
+DataConnection::handleAlert(const AlertRules::Alert& alert)
+{
+    std::ostringstream stream;
+
+    stream << "alert " << alert.rule << (alert.active ? " raised " : " cleared ")
+	   << alert.key << " " << alert.value;
+    if (Options::valueTimestamps()) {
+	stream << " | " << ValueApi::formatTimestamp(alert.timestamp);
     }
-    stream << type << " " << ValueApi::formatValue(value);
 
     output(stream.str());
 }
@@ -20,13 +20,18 @@
 #ifndef __DATAHANDLER_H__
 #define __DATAHANDLER_H__
 
+#include <memory>
 #include <set>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/shared_ptr.hpp>
+#include "AlertRules.h"
+#include "Compression.h"
+#include "ConnectionLimiter.h"
 #include "EmsMessage.h"
 #include "Noncopyable.h"
+#include "StreamAcceptor.h"
 
 class DataHandler;
 
@@ -41,48 +46,84 @@ class DataConnection : public boost::enable_shared_from_this<DataConnection>,
 	~DataConnection();
 
     public:
-	boost::asio::ip::tcp::socket& socket() {
+	StreamAcceptor::Socket& socket() {
 	    return m_socket;
 	}
-	void close() {
-	    m_socket.close();
-	}
+	void close();
+	void startRead();
 	void handleValue(const EmsValue& value);
+	void handleAlert(const AlertRules::Alert& alert);
+	/* closes the connection once the pending output is sent */
+	void drain();
 
     private:
+	void handleRead(const boost::system::error_code& error);
 	void handleWrite(const boost::system::error_code& error);
+	void handleReadDelay(const boost::system::error_code& error);
+	void handleIdleTimeout(const boost::system::error_code& error);
+	void readNextRequest();
+
+	void output(const std::string& text);
+	void encode();
+	void flush();
 
-	void output(const std::string& text) {
-	    boost::asio::async_write(m_socket, boost::asio::buffer(text + "\n"),
-		boost::bind(&DataConnection::handleWrite, shared_from_this(),
-			    boost::asio::placeholders::error));
-	}
     private:
-	boost::asio::ip::tcp::socket m_socket;
+	/* a client which doesn't keep up isn't worth buffering for */
+	static const size_t MaxPendingBytes = 1024 * 1024;
+
+	boost::asio::io_service& m_ios;
+	StreamAcceptor::Socket m_socket;
 	DataHandler& m_handler;
+	boost::asio::streambuf m_request;
+	/* text of the current batch, encoded output and output on the wire */
+	std::string m_pending;
+	std::vector<uint8_t> m_output;
+	std::vector<uint8_t> m_writeBuffer;
+	bool m_flushPosted;
+	bool m_writing;
+	bool m_draining;
+	std::unique_ptr<Deflater> m_deflater;
+	/* runs while a write is in progress */
+	boost::asio::deadline_timer m_idleTimer;
+	boost::asio::deadline_timer m_readTimer;
+	TokenBucket m_requestBucket;
 };
 
 class DataHandler : private boost::noncopyable
 {
     public:
 	DataHandler(boost::asio::io_service& ios,
-		    boost::asio::ip::tcp::endpoint& endpoint);
+		    const std::vector<StreamAcceptor::Endpoint>& endpoints);
 	~DataHandler();
 
     public:
 	void startConnection(DataConnection::Ptr connection);
 	void stopConnection(DataConnection::Ptr connection);
 	void handleValue(const EmsValue& value);
+	void handleAlert(const AlertRules::Alert& alert);
+	/* descriptors of the listening sockets, for handing them over */
+	std::vector<int> listeners() const;
+	/* stops accepting and calls 'done' once all clients are closed */
+	void drain(const std::function<void ()>& done);
+	/* accepts clients again if the connection limit allows it */
+	void resumeAccepting();
 
     private:
-	void handleAccept(DataConnection::Ptr connection,
+	void handleAccept(StreamAcceptor *acceptor, DataConnection::Ptr connection,
 			  const boost::system::error_code& error);
-	void startAccepting();
+	void startAccepting(StreamAcceptor *acceptor);
+	void accept(StreamAcceptor *acceptor, DataConnection::Ptr connection);
+	bool full() const;
 
     private:
 	boost::asio::io_service& m_ios;
-	boost::asio::ip::tcp::acceptor m_acceptor;
+	std::vector<std::unique_ptr<StreamAcceptor> > m_acceptors;
 	std::set<DataConnection::Ptr> m_connections;
+	ConnectionLimiter m_limiter;
+	/* acceptors not accepting while the connection limit is reached */
+	std::vector<StreamAcceptor *> m_pausedAcceptors;
+	bool m_draining;
+	std::function<void ()> m_drainCb;
 };
 
 #endif /* __DATAHANDLER_H__ */
@@ -17,10 +17,19 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <boost/format.hpp>
 #include <mysql++/exceptions.h>
 #include <mysql++/query.h>
-#include <mysql++/ssqls.h>
+#include <mysql++/sql_types.h>
+#include <mysql++/transaction.h>
+#include "ByteOrder.h"
 #include "Database.h"
 #include "Options.h"
 
@@ -28,30 +37,27 @@ const char * Database::dbName = "ems_data";
 const char * Database::numericTableName = "numeric_data";
 const char * Database::booleanTableName = "boolean_data";
 const char * Database::stateTableName = "state_data";
-
-sql_create_4(NumericSensorValue, 1, 4,
-	     mysqlpp::sql_smallint, sensor,
-	     mysqlpp::sql_float, value,
-	     mysqlpp::sql_datetime, starttime,
-	     mysqlpp::sql_datetime, endtime);
-sql_create_4(BooleanSensorValue, 1, 4,
-	     mysqlpp::sql_smallint, sensor,
-	     mysqlpp::sql_bool, value,
-	     mysqlpp::sql_datetime, starttime,
-	     mysqlpp::sql_datetime, endtime);
-sql_create_4(StateSensorValue, 1, 4,
-	     mysqlpp::sql_smallint, sensor,
-	     mysqlpp::sql_varchar, value,
-	     mysqlpp::sql_datetime, starttime,
-	     mysqlpp::sql_datetime, endtime);
+const char * Database::errorHistoryTableName = "error_history";
 
 Database::Database() :
-    m_connection(NULL)
+    m_connection(NULL),
+    m_stopConnecting(false),
+    m_connected(false),
+    m_waitingForConnection(false),
+    m_droppedEntries(0)
 {
 }
 
 Database::~Database()
 {
+    if (m_connectThread.joinable()) {
+	{
+	    std::lock_guard<std::mutex> guard(m_connectLock);
+	    m_stopConnecting = true;
+	}
+	m_connectCond.notify_all();
+	m_connectThread.join();
+    }
     if (m_connection) {
 	delete m_connection;
     }
@@ -62,8 +68,13 @@ Database::connect(const std::string& server, const std::string& user, const std:
 {
     bool success = false;
 
+    m_server = server;
+    m_user = user;
+    m_password = password;
+
     m_connection = new mysqlpp::Connection();
     m_connection->set_option(new mysqlpp::ReconnectOption(true));
+    m_connection->set_option(new mysqlpp::ConnectTimeoutOption(connectTimeout));
 
     if (!m_connection->connect(NULL, server.c_str(), user.c_str(), password.c_str())) {
 	delete m_connection;
@@ -71,10 +82,6 @@ Database::connect(const std::string& server, const std::string& user, const std:
 	return false;
     }
 
-    NumericSensorValue::table(numericTableName);
-    BooleanSensorValue::table(booleanTableName);
-    StateSensorValue::table(stateTableName);
-
     try {
 	m_connection->select_db(dbName);
 	success = true;
@@ -92,6 +99,12 @@ Database::connect(const std::string& server, const std::string& user, const std:
     if (success) {
 	success = createTables();
     }
+    if (success) {
+	success = createErrorHistoryTable();
+    }
+    if (success && Options::databaseMsPrecision()) {
+	success = upgradeTimePrecision();
+    }
     if (!success) {
 	delete m_connection;
 	m_connection = NULL;
@@ -100,9 +113,82 @@ Database::connect(const std::string& server, const std::string& user, const std:
     return success;
 }
 
+void
+Database::connectInBackground(const std::string& server, const std::string& user,
+			      const std::string& password)
+{
+    m_server = server;
+    m_user = user;
+    m_password = password;
+    m_waitingForConnection = true;
+    m_connectThread = std::thread(&Database::connectLoop, this);
+}
+
+void
+Database::connectLoop()
+{
+    unsigned int interval = minConnectRetryInterval;
+    bool failed = false;
+    bool connected;
+
+    mysqlpp::Connection::thread_start();
+    while (!(connected = connect(m_server, m_user, m_password))) {
+	if (!failed) {
+	    std::cerr << "Could not connect to database, retrying in the background" << std::endl;
+	    failed = true;
+	}
+
+	std::unique_lock<std::mutex> guard(m_connectLock);
+	if (m_connectCond.wait_for(guard, std::chrono::seconds(interval),
+				   [this] { return m_stopConnecting; })) {
+	    break;
+	}
+	interval = std::min(2 * interval, maxConnectRetryInterval);
+    }
+    mysqlpp::Connection::thread_end();
+
+    if (connected) {
+	if (failed) {
+	    std::cerr << "Connected to database" << std::endl;
+	}
+	m_connected = true;
+    }
+}
+
+bool
+Database::attached()
+{
+    if (!m_waitingForConnection) {
+	return true;
+    }
+    if (!m_connected) {
+	return false;
+    }
+
+    m_connectThread.join();
+    m_waitingForConnection = false;
+
+    if (m_droppedEntries > 0) {
+	std::cerr << "Dropped " << m_droppedEntries
+		  << " values while waiting for the database" << std::endl;
+    }
+    for (auto& entry : m_queuedReadings) {
+	handleReading(entry.first, entry.second);
+    }
+    for (auto& event : m_queuedEvents) {
+	handleErrorEvent(event);
+    }
+    m_queuedReadings.clear();
+    m_queuedEvents.clear();
+
+    return true;
+}
+
 bool
 Database::createTables()
 {
+    const char *timeType = Options::databaseMsPrecision() ? "DATETIME(3)" : "DATETIME";
+
     try {
 	mysqlpp::Query query = m_connection->query();
 	
@@ -110,7 +196,8 @@ Database::createTables()
 
 	mysqlpp::StoreQueryResult res = query.store();
 	if (res && res.num_rows() > 0) {
-	    /* tables already present */
+	    /* tables already present, but newer versions may know more sensors */
+	    createSensorRows();
 	    return true;
 	}
 
@@ -134,8 +221,8 @@ Database::createTables()
 	      << "  id INT AUTO_INCREMENT, "
 	      << "  sensor SMALLINT UNSIGNED NOT NULL, "
 	      << "  value FLOAT NOT NULL, "
-	      << "  starttime DATETIME NOT NULL, "
-	      << "  endtime DATETIME NOT NULL, "
+	      << "  starttime " << timeType << " NOT NULL, "
+	      << "  endtime " << timeType << " NOT NULL, "
 	      << "  PRIMARY KEY (id), "
 	      << "  KEY sensor_starttime (sensor, starttime), "
 	      << "  KEY sensor_endtime (sensor, endtime)) "
@@ -147,8 +234,8 @@ Database::createTables()
 	      << "  id INT AUTO_INCREMENT, "
 	      << "  sensor SMALLINT UNSIGNED NOT NULL, "
 	      << "  value TINYINT NOT NULL, "
-	      << "  starttime DATETIME NOT NULL, "
-	      << "  endtime DATETIME NOT NULL, "
+	      << "  starttime " << timeType << " NOT NULL, "
+	      << "  endtime " << timeType << " NOT NULL, "
 	      << "  PRIMARY KEY (id), "
 	      << "  KEY sensor_starttime (sensor, starttime), "
 	      << "  KEY sensor_endtime (sensor, endtime)) "
@@ -160,8 +247,8 @@ Database::createTables()
 	      << "  id INT AUTO_INCREMENT, "
 	      << "  sensor SMALLINT UNSIGNED NOT NULL, "
 	      << "  value VARCHAR(100) NOT NULL, "
-	      << "  starttime DATETIME NOT NULL, "
-	      << "  endtime DATETIME NOT NULL, "
+	      << "  starttime " << timeType << " NOT NULL, "
+	      << "  endtime " << timeType << " NOT NULL, "
 	      << "  PRIMARY KEY (id), "
 	      << "  KEY sensor_starttime (sensor, starttime), "
 	      << "  KEY sensor_endtime (sensor, endtime)) "
@@ -183,103 +270,214 @@ Database::createTables()
     return true;
 }
 
+/* kept separately from the sensor tables, so existing databases get it as well */
+bool
+Database::createErrorHistoryTable()
+{
+    const char *timeType = Options::databaseMsPrecision() ? "DATETIME(3)" : "DATETIME";
+
+    try {
+	mysqlpp::Query query = m_connection->query();
+
+	query << "CREATE TABLE IF NOT EXISTS " << errorHistoryTableName << " ("
+	      << "  id INT AUTO_INCREMENT, "
+	      << "  time " << timeType << " NOT NULL, "
+	      << "  added TINYINT NOT NULL, "
+	      << "  type TINYINT UNSIGNED NOT NULL, "
+	      << "  slot TINYINT UNSIGNED NOT NULL, "
+	      << "  code CHAR(2) NOT NULL, "
+	      << "  cause SMALLINT UNSIGNED NOT NULL, "
+	      << "  errortime DATETIME, "
+	      << "  duration INT UNSIGNED NOT NULL, "
+	      << "  source TINYINT UNSIGNED NOT NULL, "
+	      << "  PRIMARY KEY (id), "
+	      << "  KEY time (time), "
+	      << "  KEY code_time (code, time)) "
+	      << "ENGINE MyISAM PACK_KEYS 1";
+	query.execute();
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not create error history table: " << e.what() << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+/* converts tables created without sub-second precision */
+bool
+Database::upgradeTimePrecision()
+{
+    static const char * tableNames[] = {
+	numericTableName, booleanTableName, stateTableName
+    };
+
+    try {
+	mysqlpp::Query query = m_connection->query();
+
+	for (auto table : tableNames) {
+	    query << "select datetime_precision from information_schema.columns "
+		  << "where table_schema = " << mysqlpp::quote << dbName
+		  << " and table_name = " << mysqlpp::quote << table
+		  << " and column_name = 'starttime'";
+
+	    mysqlpp::StoreQueryResult res = query.store();
+	    if (res && res.num_rows() > 0 && !res[0]["datetime_precision"].is_null() &&
+		    int(res[0]["datetime_precision"]) >= 3) {
+		continue;
+	    }
+
+	    query << "ALTER TABLE " << table
+		  << " MODIFY starttime DATETIME(3) NOT NULL,"
+		  << " MODIFY endtime DATETIME(3) NOT NULL";
+	    query.execute();
+	}
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Could not upgrade time precision: " << e.what() << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
 void
 Database::createSensorRows()
 {
     mysqlpp::Query query = m_connection->query();
 
-    query << "insert into sensors values (%0q, %1q, %2q, %3q:reading_type, %4q:unit, %5q:precision)";
+    query << "insert ignore into sensors values (%0q, %1q, %2q, %3q:reading_type, %4q:unit, %5q:precision)";
     query.parse();
     query.template_defaults["unit"] = mysqlpp::null;
     query.template_defaults["reading_type"] = mysqlpp::null;
     query.template_defaults["precision"] = mysqlpp::null;
 
     /* Numeric sensors */
-    query.execute(SensorKesselSollTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorKesselSollTemp, sensorTypeNumeric,
 		  "Kessel-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorKesselIstTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorKesselIstTemp, sensorTypeNumeric,
 		  "Kessel-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorWarmwasserSollTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorWarmwasserSollTemp, sensorTypeNumeric,
 		  "Warmwasser-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorWarmwasserIstTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorWarmwasserIstTemp, sensorTypeNumeric,
 		  "Warmwasser-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorVorlaufHK1SollTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorVorlaufHK1SollTemp, sensorTypeNumeric,
 		  "Vorlauf HK1-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorVorlaufHK1IstTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorVorlaufHK1IstTemp, sensorTypeNumeric,
 		  "Vorlauf HK1-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorVorlaufHK2SollTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorVorlaufHK2SollTemp, sensorTypeNumeric,
 		  "Vorlauf HK2-Soll-Temperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorVorlaufHK2IstTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorVorlaufHK2IstTemp, sensorTypeNumeric,
 		  "Vorlauf HK2-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorMischersteuerung, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorMischersteuerung, sensorTypeNumeric,
 		  "Mischersteuerung", readingTypeNone, "", 0);
-    query.execute(SensorRuecklaufTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorRuecklaufTemp, sensorTypeNumeric,
 		  "Rücklauftemperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorAussenTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorAussenTemp, sensorTypeNumeric,
 		  "Außentemperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorGedaempfteAussenTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorGedaempfteAussenTemp, sensorTypeNumeric,
 		  "Gedämpfte Außentemperatur", readingTypeTemperature, "°C", 0);
-    query.execute(SensorRaumSollTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorRaumSollTemp, sensorTypeNumeric,
 		  "Raum-Soll-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorRaumIstTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorRaumIstTemp, sensorTypeNumeric,
 		  "Raum-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorMomLeistung, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorMomLeistung, sensorTypeNumeric,
 		  "Momentane Leistung", readingTypePercent, "%", 0);
-    query.execute(SensorMaxLeistung, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorMaxLeistung, sensorTypeNumeric,
 		  "Maximale Leistung", readingTypePercent, "%", 0);
-    query.execute(SensorFlammenstrom, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorFlammenstrom, sensorTypeNumeric,
 		  "Flammenstrom", readingTypeCurrent, "µA", 1);
-    query.execute(SensorSystemdruck, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorSystemdruck, sensorTypeNumeric,
 		  "Systemdruck", readingTypePressure, "bar", 1);
-    query.execute(SensorBrennerstarts, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorBrennerstarts, sensorTypeNumeric,
 		  "Brennerstarts", readingTypeCount, "");
-    query.execute(SensorBetriebszeit, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorBetriebszeit, sensorTypeNumeric,
 		  "Betriebszeit", readingTypeTime, "min");
-    query.execute(SensorHeizZeit, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorHeizZeit, sensorTypeNumeric,
 		  "Heizzeit", readingTypeTime, "min");
-    query.execute(SensorWarmwasserbereitungsZeit, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorWarmwasserbereitungsZeit, sensorTypeNumeric,
 		  "Warmwasserbereitungszeit", readingTypeTime, "min");
-    query.execute(SensorWarmwasserBereitungen, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorWarmwasserBereitungen, sensorTypeNumeric,
 		  "Warmwasserbereitungen", readingTypeCount, "");
-    query.execute(SensorPumpenModulation, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorPumpenModulation, sensorTypeNumeric,
 		  "Kesselpumpenmodulation", readingTypePercent, "%", 0);
-    query.execute(SensorWaermetauscherTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorWaermetauscherTemp, sensorTypeNumeric,
 		  "Temperatur Ausgang Waermetauscher", readingTypeTemperature, "°C", 1);
-    query.execute(SensorWarmwasserDurchfluss, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorWarmwasserDurchfluss, sensorTypeNumeric,
 		  "Warmwasserdurchfluss", readingTypeFlowRate, "l/min", 1);
-    query.execute(SensorSolarSpeicherTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorSolarSpeicherTemp, sensorTypeNumeric,
 		  "Solarspeicher-Ist-Temperatur", readingTypeTemperature, "°C", 1);
-    query.execute(SensorSolarKollektorTemp, sensorTypeNumeric,
+    query.execute(SensorMapping::SensorSolarKollektorTemp, sensorTypeNumeric,
 		  "Solarkollektor-Ist-Temperatur", readingTypeTemperature, "°C", 1);
+    query.execute(SensorMapping::SensorBrennerZyklusDauer, sensorTypeNumeric,
+		  "Brenner-Zyklusdauer", readingTypeTime, "min", 1);
+    query.execute(SensorMapping::SensorBrennerPausenDauer, sensorTypeNumeric,
+		  "Brenner-Pausendauer", readingTypeTime, "min", 1);
+    query.execute(SensorMapping::SensorBrennerTastgrad, sensorTypeNumeric,
+		  "Brenner-Tastgrad", readingTypePercent, "%", 0);
+    query.execute(SensorMapping::SensorBrennerStartsProStunde, sensorTypeNumeric,
+		  "Brennerstarts pro Stunde", readingTypeCount, "");
+    query.execute(SensorMapping::SensorMittlereModulation, sensorTypeNumeric,
+		  "Mittlere Modulation", readingTypePercent, "%", 0);
+    query.execute(SensorMapping::SensorEnergieHeizungStunde, sensorTypeNumeric,
+		  "Energie Heizung aktuelle Stunde", readingTypeEnergy, "kWh", 2);
+    query.execute(SensorMapping::SensorEnergieWWStunde, sensorTypeNumeric,
+		  "Energie Warmwasser aktuelle Stunde", readingTypeEnergy, "kWh", 2);
+    query.execute(SensorMapping::SensorEnergieHeizungTag, sensorTypeNumeric,
+		  "Energie Heizung heute", readingTypeEnergy, "kWh", 1);
+    query.execute(SensorMapping::SensorEnergieWWTag, sensorTypeNumeric,
+		  "Energie Warmwasser heute", readingTypeEnergy, "kWh", 1);
+    query.execute(SensorMapping::SensorEnergieHeizungGesamt, sensorTypeNumeric,
+		  "Energie Heizung gesamt", readingTypeEnergy, "kWh", 0);
+    query.execute(SensorMapping::SensorEnergieWWGesamt, sensorTypeNumeric,
+		  "Energie Warmwasser gesamt", readingTypeEnergy, "kWh", 0);
+    query.execute(SensorMapping::SensorBrennstoffTag, sensorTypeNumeric,
+		  "Brennstoffverbrauch heute", readingTypeNone, "", 2);
+    query.execute(SensorMapping::SensorBrennstoffGesamt, sensorTypeNumeric,
+		  "Brennstoffverbrauch gesamt", readingTypeNone, "", 0);
 
     /* Boolean sensors */
-    query.execute(SensorFlamme, sensorTypeBoolean, "Flamme");
-    query.execute(SensorBrenner, sensorTypeBoolean, "Brenner");
-    query.execute(SensorZuendung, sensorTypeBoolean, "Zündung");
-    query.execute(SensorKesselPumpe, sensorTypeBoolean, "Kessel-Pumpe");
-    query.execute(Sensor3WegeVentil, sensorTypeBoolean, "3-Wege-Ventil");
-    query.execute(SensorZirkulation, sensorTypeBoolean, "Zirkulation");
-    query.execute(SensorZirkulationTagbetrieb, sensorTypeBoolean, "Zirkulation-Tagbetrieb");
-    query.execute(SensorWarmwasserBereitung, sensorTypeBoolean, "Warmwasserbereitung");
-    query.execute(SensorWWTagbetrieb, sensorTypeBoolean, "WW-Tagbetrieb");
-    query.execute(SensorSommerbetrieb, sensorTypeBoolean, "Sommerbetrieb");
-    query.execute(SensorWarmwasserTempOK, sensorTypeBoolean, "Warmwassertemperatur OK");
-    query.execute(SensorWWVorrang, sensorTypeBoolean, "Warmwasservorrang");
-    query.execute(SensorHK1Tagbetrieb, sensorTypeBoolean, "HK1 Tagbetrieb");
-    query.execute(SensorHK1Automatik, sensorTypeBoolean, "HK1 Automatikbetrieb");
-    query.execute(SensorHK1Pumpe, sensorTypeBoolean, "HK1 Pumpe");
-    query.execute(SensorHK1Ferien, sensorTypeBoolean, "HK1 Ferien");
-    query.execute(SensorHK1Party, sensorTypeBoolean, "HK1 Party");
-    query.execute(SensorHK2Tagbetrieb, sensorTypeBoolean, "HK2 Tagbetrieb");
-    query.execute(SensorHK2Automatik, sensorTypeBoolean, "HK2 Automatikbetrieb");
-    query.execute(SensorHK2Pumpe, sensorTypeBoolean, "HK2 Pumpe");
-    query.execute(SensorHK2Ferien, sensorTypeBoolean, "HK2 Ferien");
-    query.execute(SensorHK2Party, sensorTypeBoolean, "HK2 Party");
-    query.execute(SensorSolarPumpe, sensorTypeBoolean, "Solar-Pumpe");
+    query.execute(SensorMapping::SensorFlamme, sensorTypeBoolean, "Flamme");
+    query.execute(SensorMapping::SensorBrenner, sensorTypeBoolean, "Brenner");
+    query.execute(SensorMapping::SensorZuendung, sensorTypeBoolean, "Zündung");
+    query.execute(SensorMapping::SensorKesselPumpe, sensorTypeBoolean, "Kessel-Pumpe");
+    query.execute(SensorMapping::Sensor3WegeVentil, sensorTypeBoolean, "3-Wege-Ventil");
+    query.execute(SensorMapping::SensorZirkulation, sensorTypeBoolean, "Zirkulation");
+    query.execute(SensorMapping::SensorZirkulationTagbetrieb, sensorTypeBoolean, "Zirkulation-Tagbetrieb");
+    query.execute(SensorMapping::SensorWarmwasserBereitung, sensorTypeBoolean, "Warmwasserbereitung");
+    query.execute(SensorMapping::SensorWWTagbetrieb, sensorTypeBoolean, "WW-Tagbetrieb");
+    query.execute(SensorMapping::SensorSommerbetrieb, sensorTypeBoolean, "Sommerbetrieb");
+    query.execute(SensorMapping::SensorWarmwasserTempOK, sensorTypeBoolean, "Warmwassertemperatur OK");
+    query.execute(SensorMapping::SensorWWVorrang, sensorTypeBoolean, "Warmwasservorrang");
+    query.execute(SensorMapping::SensorHK1Tagbetrieb, sensorTypeBoolean, "HK1 Tagbetrieb");
+    query.execute(SensorMapping::SensorHK1Automatik, sensorTypeBoolean, "HK1 Automatikbetrieb");
+    query.execute(SensorMapping::SensorHK1Pumpe, sensorTypeBoolean, "HK1 Pumpe");
+    query.execute(SensorMapping::SensorHK1Ferien, sensorTypeBoolean, "HK1 Ferien");
+    query.execute(SensorMapping::SensorHK1Party, sensorTypeBoolean, "HK1 Party");
+    query.execute(SensorMapping::SensorHK2Tagbetrieb, sensorTypeBoolean, "HK2 Tagbetrieb");
+    query.execute(SensorMapping::SensorHK2Automatik, sensorTypeBoolean, "HK2 Automatikbetrieb");
+    query.execute(SensorMapping::SensorHK2Pumpe, sensorTypeBoolean, "HK2 Pumpe");
+    query.execute(SensorMapping::SensorHK2Ferien, sensorTypeBoolean, "HK2 Ferien");
+    query.execute(SensorMapping::SensorHK2Party, sensorTypeBoolean, "HK2 Party");
+    query.execute(SensorMapping::SensorSolarPumpe, sensorTypeBoolean, "Solar-Pumpe");
+    query.execute(SensorMapping::SensorTaktalarm, sensorTypeBoolean, "Taktalarm");
 
     /* State sensors */
-    query.execute(SensorServiceCode, sensorTypeState, "Servicecode");
-    query.execute(SensorFehlerCode, sensorTypeState, "Fehlercode");
+    query.execute(SensorMapping::SensorServiceCode, sensorTypeState, "Servicecode");
+    query.execute(SensorMapping::SensorFehlerCode, sensorTypeState, "Fehlercode");
+    query.execute(SensorMapping::SensorAnomalie, sensorTypeState, "Anomalie");
+}
+
+/* sub-second precision needs the DATETIME(3) columns */
+static std::string
+formatTime(const Timestamp& time)
+{
+    std::ostringstream stream;
+
+    stream << mysqlpp::sql_datetime(time.seconds());
+    if (Options::databaseMsPrecision()) {
+	stream << boost::format(".%03d") % time.milliseconds();
+    }
+
+    return stream.str();
 }
 
 bool
@@ -323,129 +521,82 @@ Database::executeQuery(mysqlpp::Query& query)
 void
 Database::handleValue(const EmsValue& value)
 {
-    static const struct {
-	EmsValue::Type type;
-	EmsValue::SubType subtype;
-	NumericSensors sensor;
-    } NUMERICMAPPING[] = {
-	{ EmsValue::SollTemp, EmsValue::Kessel, SensorKesselSollTemp },
-	{ EmsValue::IstTemp, EmsValue::Kessel, SensorKesselIstTemp },
-	{ EmsValue::SollTemp, EmsValue::WW, SensorWarmwasserSollTemp },
-	{ EmsValue::IstTemp, EmsValue::WW, SensorWarmwasserIstTemp },
-	{ EmsValue::SollTemp, EmsValue::HK1, SensorVorlaufHK1SollTemp },
-	{ EmsValue::IstTemp, EmsValue::HK1, SensorVorlaufHK1IstTemp },
-	{ EmsValue::SollTemp, EmsValue::HK2, SensorVorlaufHK2SollTemp },
-	{ EmsValue::IstTemp, EmsValue::HK2, SensorVorlaufHK2IstTemp },
-	{ EmsValue::IstTemp, EmsValue::Ruecklauf, SensorRuecklaufTemp },
-	{ EmsValue::IstTemp, EmsValue::Aussen, SensorAussenTemp },
-	{ EmsValue::GedaempfteTemp, EmsValue::Aussen, SensorGedaempfteAussenTemp },
-	{ EmsValue::RaumSollTemp, EmsValue::HK1, SensorRaumSollTemp },
-	{ EmsValue::RaumIstTemp, EmsValue::HK1, SensorRaumIstTemp },
-	{ EmsValue::Flammenstrom, EmsValue::None, SensorFlammenstrom },
-	{ EmsValue::Systemdruck, EmsValue::None, SensorSystemdruck },
-	{ EmsValue::IstTemp, EmsValue::Waermetauscher, SensorWaermetauscherTemp },
-	{ EmsValue::DurchflussMenge, EmsValue::WW, SensorWarmwasserDurchfluss },
-	{ EmsValue::IstTemp, EmsValue::SolarSpeicher, SensorSolarSpeicherTemp },
-	{ EmsValue::IstTemp, EmsValue::SolarKollektor, SensorSolarKollektorTemp }
-    };
-
-    static const struct {
-	EmsValue::Type type;
-	EmsValue::SubType subtype;
-	NumericSensors sensor;
-    } INTEGERMAPPING[] = {
-	{ EmsValue::BetriebsZeit, EmsValue::Kessel, SensorBetriebszeit },
-	{ EmsValue::HeizZeit, EmsValue::Kessel, SensorHeizZeit },
-	{ EmsValue::Brennerstarts, EmsValue::Kessel, SensorBrennerstarts },
-	{ EmsValue::WarmwasserbereitungsZeit, EmsValue::None, SensorWarmwasserbereitungsZeit },
-	{ EmsValue::WarmwasserBereitungen, EmsValue::None, SensorWarmwasserBereitungen },
-	{ EmsValue::Mischersteuerung, EmsValue::HK2, SensorMischersteuerung },
-	{ EmsValue::IstModulation, EmsValue::Brenner, SensorMomLeistung },
-	{ EmsValue::SollModulation, EmsValue::Brenner, SensorMaxLeistung },
-	{ EmsValue::IstModulation, EmsValue::KesselPumpe, SensorPumpenModulation }
-    };
+    SensorMapping::Reading reading;
 
-    static const struct {
-	EmsValue::Type type;
-	EmsValue::SubType subtype;
-	BooleanSensors sensor;
-    } BOOLMAPPING[] = {
-	{ EmsValue::FlammeAktiv, EmsValue::None, SensorFlamme },
-	{ EmsValue::BrennerAktiv, EmsValue::None, SensorBrenner },
-	{ EmsValue::ZuendungAktiv, EmsValue::None, SensorZuendung },
-	{ EmsValue::PumpeAktiv, EmsValue::Kessel, SensorKesselPumpe },
-	{ EmsValue::DreiWegeVentilAufWW, EmsValue::None, Sensor3WegeVentil },
-	{ EmsValue::Tagbetrieb, EmsValue::HK1, SensorHK1Tagbetrieb },
-	{ EmsValue::PumpeAktiv, EmsValue::HK1, SensorHK1Pumpe },
-	{ EmsValue::Ferien, EmsValue::HK1, SensorHK1Ferien },
-	{ EmsValue::Party, EmsValue::HK1, SensorHK1Party },
-	{ EmsValue::Tagbetrieb, EmsValue::HK2, SensorHK2Tagbetrieb },
-	{ EmsValue::PumpeAktiv, EmsValue::HK2, SensorHK2Pumpe },
-	{ EmsValue::Ferien, EmsValue::HK2, SensorHK2Ferien },
-	{ EmsValue::Party, EmsValue::HK2, SensorHK2Party },
-	{ EmsValue::WarmwasserBereitung, EmsValue::None, SensorWarmwasserBereitung },
-	{ EmsValue::WarmwasserTempOK, EmsValue::None, SensorWarmwasserTempOK },
-	{ EmsValue::ZirkulationAktiv, EmsValue::None, SensorZirkulation },
-	{ EmsValue::Tagbetrieb, EmsValue::Zirkulation, SensorZirkulationTagbetrieb },
-	{ EmsValue::WWVorrang, EmsValue::None, SensorWWVorrang },
-	{ EmsValue::Tagbetrieb, EmsValue::WW, SensorWWTagbetrieb },
-	{ EmsValue::Sommerbetrieb, EmsValue::None, SensorSommerbetrieb },
-	{ EmsValue::PumpeAktiv, EmsValue::Solar, SensorSolarPumpe }
-    };
-
-    static const struct {
-	EmsValue::Type type;
-	StateSensors sensor;
-    } STATEMAPPING[] = {
-	{ EmsValue::FehlerCode, SensorFehlerCode },
-	{ EmsValue::ServiceCode, SensorServiceCode }
-    };
-
-    if (!value.isValid()) {
+    if (!SensorMapping::map(value, reading)) {
 	return;
     }
 
-    EmsValue::Type type = value.getType();
-    EmsValue::SubType subtype = value.getSubType();
-
-    for (size_t i = 0; i < sizeof(NUMERICMAPPING) / sizeof(NUMERICMAPPING[0]); i++) {
-	if (type == NUMERICMAPPING[i].type && subtype == NUMERICMAPPING[i].subtype) {
-	    addSensorValue(NUMERICMAPPING[i].sensor, value.getValue<float>());
-	    return;
+    if (!attached()) {
+	if (m_queuedReadings.size() >= maxQueuedEntries) {
+	    m_queuedReadings.pop_front();
+	    m_droppedEntries++;
 	}
+	m_queuedReadings.push_back(std::make_pair(reading, value.getTimestamp()));
+	return;
     }
-    for (size_t i = 0; i < sizeof(INTEGERMAPPING) / sizeof(INTEGERMAPPING[0]); i++) {
-	if (type == INTEGERMAPPING[i].type && subtype == INTEGERMAPPING[i].subtype) {
-	    addSensorValue(INTEGERMAPPING[i].sensor, value.getValue<unsigned int>());
-	    return;
-	}
+
+    handleReading(reading, value.getTimestamp());
+}
+
+void
+Database::handleReading(const SensorMapping::Reading& reading, const Timestamp& time)
+{
+    switch (reading.kind) {
+	case SensorMapping::NumericReading:
+	    addSensorValue((SensorMapping::NumericSensors) reading.sensor, reading.numeric, time);
+	    break;
+	case SensorMapping::BooleanReading:
+	    addSensorValue((SensorMapping::BooleanSensors) reading.sensor, reading.boolean, time);
+	    break;
+	case SensorMapping::StateReading:
+	    addSensorValue((SensorMapping::StateSensors) reading.sensor, reading.state, time);
+	    break;
     }
-    for (size_t i = 0; i < sizeof(BOOLMAPPING) / sizeof(BOOLMAPPING[0]); i++) {
-	if (type == BOOLMAPPING[i].type) {
-	    if (BOOLMAPPING[i].subtype == EmsValue::None || subtype == BOOLMAPPING[i].subtype) {
-		addSensorValue(BOOLMAPPING[i].sensor, value.getValue<bool>());
-		return;
-	    }
+}
+
+void
+Database::handleErrorEvent(const ErrorTracker::Event& event)
+{
+    if (!attached()) {
+	if (m_queuedEvents.size() >= maxQueuedEntries) {
+	    m_queuedEvents.pop_front();
+	    m_droppedEntries++;
 	}
+	m_queuedEvents.push_back(event);
+	return;
     }
-    for (size_t i = 0; i < sizeof(STATEMAPPING) / sizeof(STATEMAPPING[0]); i++) {
-	if (type == STATEMAPPING[i].type) {
-	    addSensorValue(STATEMAPPING[i].sensor, value.getValue<std::string>());
-	    return;
-	}
+    if (!m_connection) {
+	return;
     }
 
-    if (type == EmsValue::Betriebsart && (subtype == EmsValue::HK1 || subtype == EmsValue::HK2)) {
-	BooleanSensors sensor = subtype == EmsValue::HK2 ? SensorHK2Automatik : SensorHK1Automatik;
-	addSensorValue(sensor, value.getValue<uint8_t>() == 2);
+    const EmsProto::ErrorRecord& record = event.entry.record;
+    mysqlpp::Query query = m_connection->query();
+
+    query << "insert into " << errorHistoryTableName
+	  << " (time, added, type, slot, code, cause, errortime, duration, source) values ('"
+	  << formatTime(event.timestamp) << "', " << (event.added ? 1 : 0) << ", "
+	  << (unsigned int) event.entry.type << ", " << event.entry.index << ", "
+	  << mysqlpp::quote << std::string((const char *) record.errorAscii, 2) << ", "
+	  << BE16_TO_CPU(record.code_be16) << ", ";
+    if (record.time.valid) {
+	query << boost::format("'%04d-%02d-%02d %02d:%02d:00'")
+		% (2000 + record.time.year) % (unsigned int) record.time.month
+		% (unsigned int) record.time.day % (unsigned int) record.time.hour
+		% (unsigned int) record.time.minute;
+    } else {
+	query << "NULL";
     }
+    query << ", " << BE16_TO_CPU(record.durationMinutes_be16) << ", "
+	  << (unsigned int) record.source << ")";
+    executeQuery(query);
 }
 
 void
-Database::addSensorValue(NumericSensors sensor, float value)
+Database::addSensorValue(SensorMapping::NumericSensors sensor, float value,
+			 const Timestamp& time)
 {
-    time_t now = time(NULL);
-    if (!m_connection || !checkAndUpdateRateLimit(sensor, now)) {
+    if (!m_connection || !checkAndUpdateRateLimit(sensor, time.seconds())) {
 	return;
     }
 
@@ -454,7 +605,7 @@ Database::addSensorValue(NumericSensors sensor, float value)
     std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
     bool valueChanged = cacheIter == m_numericCache.end() || cacheIter->second != value;
     bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
-    mysqlpp::sql_datetime timestamp(now);
+    std::string timestamp = formatTime(time);
 
     if (idValid) {
 	query << "update " << numericTableName << " set endtime ='" << timestamp
@@ -463,8 +614,8 @@ Database::addSensorValue(NumericSensors sensor, float value)
     }
 
     if (valueChanged || !idValid) {
-	NumericSensorValue row(sensor, value, timestamp, timestamp);
-	query.insert(row);
+	query << "insert into " << numericTableName << " (sensor, value, starttime, endtime) values ("
+	      << sensor << ", " << value << ", '" << timestamp << "', '" << timestamp << "')";
 	if (executeQuery(query)) {
 	    m_lastInsertIds[sensor] = query.insert_id();
 	    m_numericCache[sensor] = value;
@@ -473,9 +624,9 @@ Database::addSensorValue(NumericSensors sensor, float value)
 }
 
 void
-Database::addSensorValue(BooleanSensors sensor, bool value)
+Database::addSensorValue(SensorMapping::BooleanSensors sensor, bool value,
+			 const Timestamp& time)
 {
-    time_t now = time(NULL);
     if (!m_connection) {
 	return;
     }
@@ -485,7 +636,7 @@ Database::addSensorValue(BooleanSensors sensor, bool value)
     std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
     bool valueChanged = cacheIter == m_booleanCache.end() || cacheIter->second != value;
     bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
-    mysqlpp::sql_datetime timestamp(now);
+    std::string timestamp = formatTime(time);
 
     if (idValid) {
 	query << "update " << booleanTableName << " set endtime ='" << timestamp
@@ -494,8 +645,8 @@ Database::addSensorValue(BooleanSensors sensor, bool value)
     }
 
     if (valueChanged || !idValid) {
-	BooleanSensorValue row(sensor, value, timestamp, timestamp);
-	query.insert(row);
+	query << "insert into " << booleanTableName << " (sensor, value, starttime, endtime) values ("
+	      << sensor << ", " << value << ", '" << timestamp << "', '" << timestamp << "')";
 	if (executeQuery(query)) {
 	    m_lastInsertIds[sensor] = query.insert_id();
 	    m_booleanCache[sensor] = value;
@@ -504,9 +655,9 @@ Database::addSensorValue(BooleanSensors sensor, bool value)
 }
 
 void
-Database::addSensorValue(StateSensors sensor, const std::string& value)
+Database::addSensorValue(SensorMapping::StateSensors sensor, const std::string& value,
+			 const Timestamp& time)
 {
-    time_t now = time(NULL);
     if (!m_connection) {
 	return;
     }
@@ -516,7 +667,7 @@ Database::addSensorValue(StateSensors sensor, const std::string& value)
     std::map<unsigned int, mysqlpp::ulonglong>::iterator idIter = m_lastInsertIds.find(sensor);
     bool valueChanged = cacheIter == m_stateCache.end() || cacheIter->second != value;
     bool idValid = idIter != m_lastInsertIds.end() && idIter->second != 0;
-    mysqlpp::sql_datetime timestamp(now);
+    std::string timestamp = formatTime(time);
 
     if (idValid) {
 	query << "update " << stateTableName << " set endtime ='" << timestamp
@@ -525,8 +676,8 @@ Database::addSensorValue(StateSensors sensor, const std::string& value)
     }
 
     if (valueChanged || !idValid) {
-	StateSensorValue row(sensor, value, timestamp, timestamp);
-	query.insert(row);
+	query << "insert into " << stateTableName << " (sensor, value, starttime, endtime) values ("
+	      << sensor << ", " << mysqlpp::quote << value << ", '" << timestamp << "', '" << timestamp << "')";
 	if (executeQuery(query)) {
 	    m_lastInsertIds[sensor] = query.insert_id();
 	    m_stateCache[sensor] = value;
@@ -534,3 +685,302 @@ Database::addSensorValue(StateSensors sensor, const std::string& value)
     }
 }
 
+/*
+ * Limits the rows of the sensors matching the given condition to the part
+ * outside of [start, end), so the range can be refilled: rows spanning the
+ * whole range are split, rows overlapping one of its ends are clipped and
+ * rows inside it are deleted.
+ */
+static void
+clearRange(mysqlpp::Query& query, const char *table, const std::string& sensors,
+	   const std::string& start, const std::string& end)
+{
+    query << "insert into " << table << " (sensor, value, starttime, endtime) "
+	  << "select sensor, value, '" << end << "', endtime from " << table
+	  << " where " << sensors << " and starttime < '" << start
+	  << "' and endtime > '" << end << "'";
+    query.execute();
+    query << "update " << table << " set endtime = '" << start << "' where "
+	  << sensors << " and starttime < '" << start << "' and endtime > '" << start << "'";
+    query.execute();
+    query << "update " << table << " set starttime = '" << end << "' where "
+	  << sensors << " and starttime < '" << end << "' and endtime > '" << end << "'";
+    query.execute();
+    query << "delete from " << table << " where " << sensors
+	  << " and starttime >= '" << start << "' and endtime <= '" << end << "'";
+    query.execute();
+}
+
+bool
+Database::storeIntervals(time_t start, time_t end, const IntervalSource& source)
+{
+    static const char * tableNames[] = {
+	numericTableName, booleanTableName, stateTableName
+    };
+    static const size_t batchRows = 1000;
+
+    if (!m_connection) {
+	return false;
+    }
+
+    try {
+	mysqlpp::Transaction transaction(*m_connection);
+	mysqlpp::Query query = m_connection->query();
+	mysqlpp::Query inserts[3] = {
+	    m_connection->query(), m_connection->query(), m_connection->query()
+	};
+	size_t pending[3] = { 0, 0, 0 };
+	std::string rangeStart = formatTime(Timestamp::fromRealtime(start * 1000ULL));
+	std::string rangeEnd = formatTime(Timestamp::fromRealtime(end * 1000ULL));
+	bool failed = false;
+
+	auto flush = [&] (size_t kind) {
+	    if (pending[kind] > 0) {
+		inserts[kind].execute();
+		pending[kind] = 0;
+	    }
+	};
+
+	/*
+	 * Drop the history that is about to be replaced, including sensors
+	 * without any value in the range. Derived values can't be rebuilt
+	 * from the captures, so they are kept.
+	 */
+	std::ostringstream sensors;
+	const char *separator = "";
+	sensors << "sensor not in (";
+	for (auto sensor : SensorMapping::derivedSensors()) {
+	    sensors << separator << sensor;
+	    separator = ", ";
+	}
+	sensors << ")";
+	for (size_t i = 0; i < 3; i++) {
+	    clearRange(query, tableNames[i], sensors.str(), rangeStart, rangeEnd);
+	}
+
+	/* the intervals are produced while the captures are decoded */
+	bool success = source([&] (const SensorMapping::Interval& interval) {
+	    const SensorMapping::Reading& reading = interval.reading;
+	    mysqlpp::Query& insert = inserts[reading.kind];
+
+	    if (failed) {
+		return;
+	    }
+
+	    try {
+		if (pending[reading.kind] == 0) {
+		    insert << "insert into " << tableNames[reading.kind]
+			   << " (sensor, value, starttime, endtime) values ";
+		} else {
+		    insert << ", ";
+		}
+		insert << "(" << reading.sensor << ", ";
+		switch (reading.kind) {
+		    case SensorMapping::NumericReading: insert << reading.numeric; break;
+		    case SensorMapping::BooleanReading: insert << reading.boolean; break;
+		    case SensorMapping::StateReading: insert << mysqlpp::quote << reading.state; break;
+		}
+		insert << ", '" << formatTime(Timestamp::fromRealtime(interval.start)) << "', '"
+		       << formatTime(Timestamp::fromRealtime(interval.end)) << "')";
+
+		if (++pending[reading.kind] >= batchRows) {
+		    flush(reading.kind);
+		}
+	    } catch (const mysqlpp::Exception& e) {
+		std::cerr << "MySQL exception: " << e.what() << std::endl;
+		failed = true;
+	    }
+	});
+
+	if (!success || failed) {
+	    /* the transaction is rolled back */
+	    return false;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+	    flush(i);
+	}
+	transaction.commit();
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "MySQL exception: " << e.what() << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+static void
+writeCsvField(std::ostream& stream, const char *value)
+{
+    stream << '"';
+    for (; *value; value++) {
+	if (*value == '"') {
+	    stream << '"';
+	}
+	stream << *value;
+    }
+    stream << '"';
+}
+
+/*
+ * Exports every sensor into its own set of files <sensor>-<chunk>.csv with
+ * the columns start, end (as UNIX timestamps) and value, plus a sensors.csv
+ * describing them. Rows are streamed from the server, so memory use doesn't
+ * depend on the amount of history; sensors are exported in parallel, each
+ * worker using its own connection.
+ */
+bool
+Database::exportHistory(const std::string& directory, time_t start, time_t end,
+			unsigned int threads)
+{
+    std::vector<std::pair<unsigned int, unsigned int> > sensors;
+
+    if (!m_connection) {
+	return false;
+    }
+
+    try {
+	mysqlpp::Query query = m_connection->query();
+	std::string path = directory + "/sensors.csv";
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+
+	if (!file.is_open()) {
+	    std::cerr << "Could not open output file " << path << std::endl;
+	    return false;
+	}
+
+	query << "select type, value_type, name, reading_type, unit, `precision` from sensors order by type";
+	mysqlpp::StoreQueryResult res = query.store();
+
+	file << "sensor,value_type,name,reading_type,unit,precision\n";
+	for (size_t i = 0; i < res.num_rows(); i++) {
+	    const mysqlpp::Row& row = res[i];
+	    unsigned int sensor = row["type"], type = row["value_type"];
+
+	    file << sensor << ',' << type << ',';
+	    writeCsvField(file, row["name"].c_str());
+	    file << ',' << (row["reading_type"].is_null() ? "" : row["reading_type"].c_str()) << ',';
+	    writeCsvField(file, row["unit"].is_null() ? "" : row["unit"].c_str());
+	    file << ',' << (row["precision"].is_null() ? "" : row["precision"].c_str()) << '\n';
+	    sensors.push_back(std::make_pair(sensor, type));
+	}
+	file.close();
+	if (file.fail()) {
+	    return false;
+	}
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "MySQL exception: " << e.what() << std::endl;
+	return false;
+    }
+
+    if (threads == 0) {
+	threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    threads = std::min<size_t>(threads, std::max<size_t>(sensors.size(), 1));
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> success(true);
+
+    auto worker = [&] () {
+	mysqlpp::Connection::thread_start();
+	{
+	    mysqlpp::Connection connection;
+	    if (!connection.connect(dbName, m_server.c_str(), m_user.c_str(), m_password.c_str())) {
+		std::cerr << "Could not connect to database: " << connection.error() << std::endl;
+		success = false;
+	    } else {
+		for (size_t index = next++; index < sensors.size() && success; index = next++) {
+		    if (!exportSensor(connection, sensors[index].first, sensors[index].second,
+				      directory, start, end)) {
+			success = false;
+		    }
+		}
+	    }
+	}
+	mysqlpp::Connection::thread_end();
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; i++) {
+	workers.push_back(std::thread(worker));
+    }
+    for (auto& thread : workers) {
+	thread.join();
+    }
+
+    return success;
+}
+
+bool
+Database::exportSensor(mysqlpp::Connection& connection, unsigned int sensor,
+		       unsigned int sensorType, const std::string& directory,
+		       time_t start, time_t end)
+{
+    const char *table;
+
+    switch (sensorType) {
+	case sensorTypeNumeric: table = numericTableName; break;
+	case sensorTypeBoolean: table = booleanTableName; break;
+	case sensorTypeState: table = stateTableName; break;
+	default: return true;
+    }
+
+    try {
+	mysqlpp::Query query = connection.query();
+
+	query << "select unix_timestamp(starttime), unix_timestamp(endtime), value from "
+	      << table << " where sensor = " << sensor;
+	if (start != 0) {
+	    query << " and endtime >= '" << mysqlpp::sql_datetime(start) << "'";
+	}
+	if (end != 0) {
+	    query << " and starttime < '" << mysqlpp::sql_datetime(end) << "'";
+	}
+	query << " order by starttime";
+
+	mysqlpp::UseQueryResult res = query.use();
+	std::ofstream file;
+	size_t rows = 0, chunk = 0;
+
+	while (mysqlpp::Row row = res.fetch_row()) {
+	    if (rows % exportChunkRows == 0) {
+		std::string path = directory + "/" +
+			(boost::format("%d-%04d.csv") % sensor % chunk++).str();
+
+		if (file.is_open()) {
+		    file.close();
+		    if (file.fail()) {
+			return false;
+		    }
+		}
+		file.open(path.c_str(), std::ios::out | std::ios::trunc);
+		if (!file.is_open()) {
+		    std::cerr << "Could not open output file " << path << std::endl;
+		    return false;
+		}
+		file << "start,end,value\n";
+	    }
+
+	    file << row.at(0).c_str() << ',' << row.at(1).c_str() << ',';
+	    if (sensorType == sensorTypeState) {
+		writeCsvField(file, row.at(2).c_str());
+	    } else {
+		file << row.at(2).c_str();
+	    }
+	    file << '\n';
+	    rows++;
+	}
+
+	if (file.is_open()) {
+	    file.close();
+	    if (file.fail()) {
+		return false;
+	    }
+	}
+    } catch (const mysqlpp::Exception& e) {
+	std::cerr << "Exporting sensor " << sensor << " failed: " << e.what() << std::endl;
+	return false;
+    }
+
+    return true;
+}
@@ -20,11 +20,18 @@
 #ifndef __DATABASE_H__
 #define __DATABASE_H__
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <mysql++/connection.h>
 #include <mysql++/query.h>
 #include "EmsMessage.h"
+#include "ErrorTracker.h"
+#include "SensorMapping.h"
 
 class Database {
     public:
@@ -33,91 +40,48 @@ class Database {
 
     public:
 	bool connect(const std::string& server, const std::string& user, const std::string& password);
+	/* connects in a background thread, retrying until it succeeds;
+	 * values and events are queued until the connection is there */
+	void connectInBackground(const std::string& server, const std::string& user,
+				 const std::string& password);
 	void handleValue(const EmsValue& value);
+	void handleErrorEvent(const ErrorTracker::Event& event);
+	typedef boost::function<bool (const SensorMapping::IntervalHandler& handler)> IntervalSource;
+	/* replaces the stored history in [start, end) by the intervals the source
+	 * passes to the handler, in one transaction */
+	bool storeIntervals(time_t start, time_t end, const IntervalSource& source);
+	/* writes the history between start and end (0 for unlimited) as CSV files */
+	bool exportHistory(const std::string& directory, time_t start, time_t end,
+			   unsigned int threads);
 
     private:
-	typedef enum {
-	    SensorKesselSollTemp = 1,
-	    SensorKesselIstTemp = 2,
-	    SensorWarmwasserSollTemp = 3,
-	    SensorWarmwasserIstTemp = 4,
-	    SensorVorlaufHK1SollTemp = 5,
-	    SensorVorlaufHK1IstTemp = 6,
-	    SensorVorlaufHK2SollTemp = 7,
-	    SensorVorlaufHK2IstTemp = 8,
-	    SensorMischersteuerung = 9,
-	    SensorRuecklaufTemp = 10,
-	    SensorAussenTemp = 11,
-	    SensorGedaempfteAussenTemp = 12,
-	    SensorRaumSollTemp = 13,
-	    SensorRaumIstTemp = 14,
-	    SensorMomLeistung = 15,
-	    SensorMaxLeistung = 16,
-	    SensorFlammenstrom = 17,
-	    SensorSystemdruck = 18,
-	    SensorBetriebszeit = 19,
-	    SensorHeizZeit = 23,
-	    SensorBrennerstarts = 20,
-	    SensorWarmwasserbereitungsZeit = 21,
-	    SensorWarmwasserBereitungen = 22,
-	    SensorPumpenModulation = 24,
-	    SensorWaermetauscherTemp = 25,
-	    SensorWarmwasserDurchfluss = 26,
-	    SensorSolarSpeicherTemp = 27,
-	    SensorSolarKollektorTemp = 28
-	} NumericSensors;
-
-	typedef enum {
-	    SensorFlamme = 100,
-	    SensorBrenner = 101,
-	    SensorZuendung = 102,
-	    SensorKesselPumpe = 103,
-	    /* 0 = HK, 1 = WW */
-	    Sensor3WegeVentil = 106,
-	    SensorHK1Automatik = 122,
-	    SensorHK1Tagbetrieb = 104,
-	    SensorHK1Pumpe = 116,
-	    SensorHK1Ferien = 118,
-	    SensorHK1Party = 119,
-	    SensorHK2Automatik = 123,
-	    SensorHK2Tagbetrieb = 105,
-	    SensorHK2Pumpe = 117,
-	    SensorHK2Ferien = 120,
-	    SensorHK2Party = 121,
-	    SensorWarmwasserBereitung = 110,
-	    SensorWarmwasserTempOK = 114,
-	    SensorZirkulation = 107,
-	    SensorZirkulationTagbetrieb = 124,
-	    SensorWWVorrang = 115,
-	    SensorWWTagbetrieb = 112,
-	    SensorSommerbetrieb = 113,
-	    SensorSolarPumpe = 125,
-	    /* not valid for DB */
-	    BooleanSensorLast = 126
-	} BooleanSensors;
-
-	typedef enum {
-	    SensorServiceCode = 200,
-	    SensorFehlerCode = 201,
-	    /* not valid for DB */
-	    StateSensorLast = 202
-	} StateSensors;
-
-	void addSensorValue(NumericSensors sensor, float value);
-	void addSensorValue(BooleanSensors sensor, bool value);
-	void addSensorValue(StateSensors sensor, const std::string& value);
+	void connectLoop();
+	bool attached();
+	void handleReading(const SensorMapping::Reading& reading, const Timestamp& time);
+	void addSensorValue(SensorMapping::NumericSensors sensor, float value,
+			    const Timestamp& time);
+	void addSensorValue(SensorMapping::BooleanSensors sensor, bool value,
+			    const Timestamp& time);
+	void addSensorValue(SensorMapping::StateSensors sensor, const std::string& value,
+			    const Timestamp& time);
 
     private:
 	bool createTables();
+	bool createErrorHistoryTable();
+	bool upgradeTimePrecision();
 	void createSensorRows();
 	bool checkAndUpdateRateLimit(unsigned int sensor, time_t now);
 	bool executeQuery(mysqlpp::Query& query);
+	bool exportSensor(mysqlpp::Connection& connection, unsigned int sensor,
+			  unsigned int sensorType, const std::string& directory,
+			  time_t start, time_t end);
 
     private:
 	static const char *dbName;
 	static const char *numericTableName;
 	static const char *booleanTableName;
 	static const char *stateTableName;
+	static const char *errorHistoryTableName;
 
 	static const unsigned int sensorTypeNumeric = 1;
 	static const unsigned int sensorTypeBoolean = 2;
@@ -131,6 +95,16 @@ class Database {
 	static const unsigned int readingTypeTime = 5;
 	static const unsigned int readingTypeCount = 6;
 	static const unsigned int readingTypeFlowRate = 7;
+	static const unsigned int readingTypeEnergy = 8;
+
+	static const unsigned int connectTimeout = 10; /* s */
+	/* rows per export file */
+	static const size_t exportChunkRows = 1000000;
+	/* readings and events kept while waiting for the connection */
+	static const size_t maxQueuedEntries = 10000;
+	/* delay between connection attempts, doubled after each failure */
+	static const unsigned int minConnectRetryInterval = 2; /* s */
+	static const unsigned int maxConnectRetryInterval = 60; /* s */
 
 	std::map<unsigned int, time_t> m_lastWrites;
 	std::map<unsigned int, float> m_numericCache;
@@ -138,6 +112,18 @@ class Database {
 	std::map<unsigned int, std::string> m_stateCache;
 	std::map<unsigned int, mysqlpp::ulonglong> m_lastInsertIds;
 	mysqlpp::Connection *m_connection;
+	std::string m_server, m_user, m_password;
+
+	std::thread m_connectThread;
+	std::mutex m_connectLock;
+	std::condition_variable m_connectCond;
+	bool m_stopConnecting;
+	/* set by the connect thread, which doesn't touch anything afterwards */
+	std::atomic<bool> m_connected;
+	bool m_waitingForConnection;
+	std::deque<std::pair<SensorMapping::Reading, Timestamp> > m_queuedReadings;
+	std::deque<ErrorTracker::Event> m_queuedEvents;
+	size_t m_droppedEntries;
 };
 
 #endif /* __DATABASE_H__ */
@@ -0,0 +1,341 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <boost/format.hpp>
+#include "DebugLog.h"
+
+DebugLog&
+DebugLog::instance()
+{
+    static DebugLog log;
+    return log;
+}
+
+DebugLog::DebugLog() :
+    m_cells(new Cell[RingSize]),
+    m_enqueuePos(0),
+    m_dequeuePos(0),
+    m_dropped(0),
+    m_maxFileSize(0),
+    m_running(false)
+{
+    for (size_t i = 0; i < RingSize; i++) {
+	m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+DebugLog::~DebugLog()
+{
+    stop();
+}
+
+unsigned int
+DebugLog::openSink(const std::string& file)
+{
+    std::string path = file.empty() ? "stdout" : file;
+    std::lock_guard<std::mutex> guard(m_sinkLock);
+
+    for (size_t i = 0; i < m_sinks.size(); i++) {
+	if (m_sinks[i]->path == path) {
+	    return i;
+	}
+    }
+
+    std::unique_ptr<Sink> sink(new Sink);
+    sink->path = path;
+    sink->size = 0;
+    sink->continuing = false;
+    if (path == "stdout") {
+	sink->stream = &std::cout;
+    } else if (path == "stderr") {
+	sink->stream = &std::cerr;
+    } else {
+	sink->file.open(path.c_str(), std::ios::out | std::ios::app);
+	sink->file.seekp(0, std::ios::end);
+	sink->size = sink->file.tellp();
+	sink->stream = &sink->file;
+    }
+
+    m_sinks.push_back(std::move(sink));
+    return m_sinks.size() - 1;
+}
+
+void
+DebugLog::start()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+
+    if (!m_running && !m_sinks.empty()) {
+	m_running = true;
+	m_thread = std::thread(&DebugLog::run, this);
+    }
+}
+
+void
+DebugLog::stop()
+{
+    {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_running = false;
+    }
+    m_cond.notify_all();
+
+    if (m_thread.joinable()) {
+	m_thread.join();
+    }
+    /* records logged before the thread was started or after it ended */
+    drain();
+}
+
+void
+DebugLog::push(unsigned int sink, RecordType type, const uint8_t *data, size_t length)
+{
+    uint64_t timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+	    std::chrono::system_clock::now().time_since_epoch()).count();
+    bool first = true;
+
+    do {
+	size_t chunk = std::min(length, PayloadSize);
+	if (!pushRecord(sink, type, first, length > chunk, timestamp, data, chunk)) {
+	    m_dropped.fetch_add(1, std::memory_order_relaxed);
+	    return;
+	}
+	data += chunk;
+	length -= chunk;
+	first = false;
+    } while (length > 0);
+}
+
+/* bounded MPMC queue as described by Dmitry Vyukov */
+bool
+DebugLog::pushRecord(unsigned int sink, RecordType type, bool first, bool continued,
+		     uint64_t timestamp, const uint8_t *data, size_t length)
+{
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    while (true) {
+	cell = &m_cells[pos & (RingSize - 1)];
+	size_t sequence = cell->sequence.load(std::memory_order_acquire);
+	intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+	if (diff == 0) {
+	    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+		break;
+	    }
+	} else if (diff < 0) {
+	    /* ring is full */
+	    return false;
+	} else {
+	    pos = m_enqueuePos.load(std::memory_order_relaxed);
+	}
+    }
+
+    Record& record = cell->record;
+    record.timestamp = timestamp;
+    record.sink = sink;
+    record.type = type;
+    record.first = first;
+    record.continued = continued;
+    record.length = length;
+    memcpy(record.payload, data, length);
+
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    /*
+     * The writer may have gone to sleep if it already took all records
+     * before this one. Pairs with the fence in pending().
+     */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_dequeuePos.load(std::memory_order_relaxed) == pos) {
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_cond.notify_one();
+    }
+    return true;
+}
+
+bool
+DebugLog::pop(Record& record)
+{
+    size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+
+    while (true) {
+	cell = &m_cells[pos & (RingSize - 1)];
+	size_t sequence = cell->sequence.load(std::memory_order_acquire);
+	intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+	if (diff == 0) {
+	    if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+		break;
+	    }
+	} else if (diff < 0) {
+	    /* ring is empty */
+	    return false;
+	} else {
+	    pos = m_dequeuePos.load(std::memory_order_relaxed);
+	}
+    }
+
+    record = cell->record;
+    cell->sequence.store(pos + RingSize, std::memory_order_release);
+    return true;
+}
+
+bool
+DebugLog::pending() const
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    return m_cells[pos & (RingSize - 1)].sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+void
+DebugLog::run()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    while (m_running) {
+	guard.unlock();
+	drain();
+	guard.lock();
+
+	/* push() wakes us up when adding a record to the empty ring */
+	m_cond.wait(guard, [this] { return !m_running || pending(); });
+    }
+}
+
+size_t
+DebugLog::drain()
+{
+    std::lock_guard<std::mutex> guard(m_sinkLock);
+    Record record;
+    size_t count = 0;
+
+    while (pop(record)) {
+	format(record);
+	count++;
+    }
+
+    size_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+    for (auto& sink : m_sinks) {
+	if (dropped != 0) {
+	    if (sink->continuing) {
+		*sink->stream << "\n";
+		sink->continuing = false;
+	    }
+	    *sink->stream << "LOG: " << std::dec << dropped << " records dropped" << std::endl;
+	}
+	if (count != 0) {
+	    sink->stream->flush();
+	}
+    }
+
+    return count;
+}
+
+void
+DebugLog::format(const Record& record)
+{
+    if (record.sink >= m_sinks.size()) {
+	return;
+    }
+
+    Sink& sink = *m_sinks[record.sink];
+    std::ostream& stream = *sink.stream;
+    std::streampos start = stream.tellp();
+
+    /* the rest of the previous line was dropped because the ring was full */
+    if (record.first && sink.continuing) {
+	stream << "\n";
+	sink.continuing = false;
+    }
+
+    switch (record.type) {
+	case TextRecord:
+	    stream.write((const char *) record.payload, record.length);
+	    break;
+	case ReceivedBytesRecord:
+	case SentBytesRecord:
+	    if (!sink.continuing) {
+		stream << (record.type == ReceivedBytesRecord ? "IO: Got bytes " : "IO: Sending bytes ");
+	    }
+	    for (size_t i = 0; i < record.length; i++) {
+		stream << std::setfill('0') << std::setw(2)
+		       << std::showbase << std::hex
+		       << (unsigned int) record.payload[i] << " ";
+	    }
+	    if (!record.continued) {
+		stream << "\n";
+	    }
+	    break;
+	case MessageRecord: {
+	    time_t seconds = record.timestamp / 1000;
+	    struct tm time;
+
+	    if (record.length < 4) {
+		break;
+	    }
+
+	    localtime_r(&seconds, &time);
+	    boost::format f("MESSAGE[%02d.%02d.%04d %02d:%02d:%02d]: "
+			    "source 0x%02x, dest 0x%02x, type 0x%02x, offset %d");
+	    f % time.tm_mday % (time.tm_mon + 1) % (time.tm_year + 1900);
+	    f % time.tm_hour % time.tm_min % time.tm_sec;
+	    f % (unsigned int) record.payload[0] % (unsigned int) record.payload[1];
+	    f % (unsigned int) record.payload[2] % (unsigned int) record.payload[3];
+
+	    stream << f << ", data:";
+	    for (size_t i = 4; i < record.length; i++) {
+		stream << " 0x" << std::hex << std::setw(2)
+		       << std::setfill('0') << (unsigned int) record.payload[i];
+	    }
+	    stream << "\n";
+	    break;
+	}
+    }
+    sink.continuing = record.continued;
+
+    if (sink.stream == &sink.file && start != std::streampos(-1)) {
+	sink.size += stream.tellp() - start;
+	if (m_maxFileSize != 0 && sink.size >= m_maxFileSize && !sink.continuing) {
+	    rotate(sink);
+	}
+    }
+}
+
+void
+DebugLog::rotate(Sink& sink)
+{
+    sink.file.close();
+
+    for (unsigned int i = RotatedFiles; i > 0; i--) {
+	std::string from = i > 1 ? sink.path + "." + std::to_string(i - 1) : sink.path;
+	std::string to = sink.path + "." + std::to_string(i);
+	rename(from.c_str(), to.c_str());
+    }
+
+    sink.file.open(sink.path.c_str(), std::ios::out | std::ios::trunc);
+    sink.size = 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEBUGLOG_H__
+#define __DEBUGLOG_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Noncopyable.h"
+
+/*
+ * Asynchronous debug log backend. Producers store binary records into a
+ * bounded lock-free ring; a background thread formats them and writes
+ * them to their sinks. If the ring is full, records are dropped rather
+ * than blocking the producer.
+ */
+class DebugLog : private boost::noncopyable
+{
+    public:
+	typedef enum {
+	    /* preformatted text, written verbatim */
+	    TextRecord,
+	    /* raw bytes read from the bus */
+	    ReceivedBytesRecord,
+	    /* raw bytes sent to the bus */
+	    SentBytesRecord,
+	    /* source, dest, type, offset and payload of a message */
+	    MessageRecord
+	} RecordType;
+
+	/* enough for a complete EMS frame */
+	static const size_t PayloadSize = 260;
+
+	static DebugLog& instance();
+
+	/* sinks opened while the log is running need another start() */
+	unsigned int openSink(const std::string& file);
+	void setMaxFileSize(size_t size) {
+	    m_maxFileSize = size;
+	}
+
+	/* starts the writer thread if there are sinks; needs to happen after
+	 * daemonizing */
+	void start();
+	/* writes out all pending records and stops the writer thread */
+	void stop();
+
+	void push(unsigned int sink, RecordType type, const uint8_t *data, size_t length);
+
+    private:
+	static const size_t RingSize = 2048;
+	static const unsigned int RotatedFiles = 3;
+
+	struct Record {
+	    uint64_t timestamp;
+	    uint16_t sink;
+	    uint8_t type;
+	    /* starts an output line */
+	    bool first;
+	    /* more records of the same output line follow */
+	    bool continued;
+	    uint16_t length;
+	    uint8_t payload[PayloadSize];
+	};
+
+	struct Cell {
+	    std::atomic<size_t> sequence;
+	    Record record;
+	};
+
+	struct Sink {
+	    std::string path;
+	    std::ostream *stream;
+	    std::ofstream file;
+	    size_t size;
+	    /* a record with the continued flag was written last */
+	    bool continuing;
+	};
+
+	DebugLog();
+	~DebugLog();
+
+	bool pushRecord(unsigned int sink, RecordType type, bool first, bool continued,
+			uint64_t timestamp, const uint8_t *data, size_t length);
+	bool pop(Record& record);
+	/* whether the next record can be popped */
+	bool pending() const;
+	void run();
+	size_t drain();
+	void format(const Record& record);
+	void rotate(Sink& sink);
+
+    private:
+	std::unique_ptr<Cell[]> m_cells;
+	std::atomic<size_t> m_enqueuePos;
+	std::atomic<size_t> m_dequeuePos;
+	std::atomic<size_t> m_dropped;
+
+	/* guards the sinks against being added to while writing */
+	std::mutex m_sinkLock;
+	std::vector<std::unique_ptr<Sink> > m_sinks;
+	std::atomic<size_t> m_maxFileSize;
+
+	std::thread m_thread;
+	std::mutex m_lock;
+	std::condition_variable m_cond;
+	bool m_running;
+};
+
+#endif /* __DEBUGLOG_H__ */
@@ -0,0 +1,228 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "DerivedValues.h"
+#include "Options.h"
+
+DerivedValues::DerivedValues() :
+    m_burnerActive(false),
+    m_flameActive(false),
+    m_stateKnown(false),
+    m_running(false),
+    m_lastInput(0),
+    m_lastUpdate(0),
+    m_observedSince(0),
+    m_phaseStart(0),
+    m_cycleTime(0),
+    m_modulation(0),
+    m_modulationSince(0),
+    m_modulationIntegral(0),
+    m_modulationTime(0),
+    m_alarmKnown(false),
+    m_alarm(false)
+{
+}
+
+void
+DerivedValues::handleValue(const EmsValue& value)
+{
+    if (!value.isValid()) {
+	return;
+    }
+
+    uint64_t now = value.getTimestamp().monotonic;
+
+    switch (value.getType()) {
+	case EmsValue::IstModulation:
+	    if (value.getSubType() == EmsValue::Brenner) {
+		accumulateModulation(now);
+		m_modulation = value.getValue<unsigned int>();
+		m_modulationSince = now;
+	    }
+	    break;
+	case EmsValue::FlammeAktiv:
+	    m_flameActive = value.getValue<bool>();
+	    break;
+	case EmsValue::BrennerAktiv:
+	    /* both flags are sent in the same message, the burner flag last */
+	    m_burnerActive = value.getValue<bool>();
+	    if (m_stateKnown && (now < m_lastInput || now - m_lastInput > MaxGap)) {
+		reset();
+	    }
+	    m_lastInput = now;
+	    update(now, m_burnerActive || m_flameActive, value.getTimestamp());
+	    break;
+	default:
+	    break;
+    }
+}
+
+void
+DerivedValues::reset()
+{
+    /* nothing is known about the time we didn't receive any data for */
+    m_stateKnown = false;
+    m_phaseStart = 0;
+    m_cycles.clear();
+    m_cycleTime = 0;
+    m_starts.clear();
+    m_shortCycles.clear();
+    m_modulationSince = 0;
+    m_modulationIntegral = 0;
+    m_modulationTime = 0;
+}
+
+void
+DerivedValues::update(uint64_t now, bool running, const Timestamp& timestamp)
+{
+    if (!m_stateKnown) {
+	m_stateKnown = true;
+	m_running = running;
+	m_observedSince = now;
+	m_lastUpdate = now;
+	return;
+    }
+
+    expire(now);
+
+    if (running == m_running) {
+	if (now - m_lastUpdate >= UpdateInterval) {
+	    emitStatistics(now, timestamp);
+	}
+	return;
+    }
+
+    if (running) {
+	if (m_phaseStart != 0) {
+	    emit(EmsValue(EmsValue::BrennerPausenDauer, EmsValue::Brenner,
+			  (float) (now - m_phaseStart) / 60000.0f), timestamp);
+	}
+	m_starts.push_back(now);
+	m_modulationIntegral = 0;
+	m_modulationTime = 0;
+	if (m_modulationSince != 0) {
+	    m_modulationSince = now;
+	}
+    } else {
+	/* a cycle which was already running when we started is only
+	 * partially observed, so it only counts towards the duty cycle */
+	uint64_t start = m_phaseStart != 0 ? m_phaseStart : m_observedSince;
+	Cycle cycle = { start, now };
+	m_cycles.push_back(cycle);
+	m_cycleTime += now - start;
+
+	if (m_phaseStart != 0) {
+	    uint64_t length = now - m_phaseStart;
+	    unsigned int shortLength = Options::shortCycleLength();
+
+	    emit(EmsValue(EmsValue::BrennerZyklusDauer, EmsValue::Brenner,
+			  (float) length / 60000.0f), timestamp);
+	    accumulateModulation(now);
+	    if (m_modulationTime != 0) {
+		emit(EmsValue(EmsValue::MittlereModulation, EmsValue::Brenner,
+			      (float) m_modulationIntegral / (float) m_modulationTime), timestamp);
+	    }
+	    if (shortLength != 0 && length < shortLength * 1000ULL) {
+		m_shortCycles.push_back(now);
+	    }
+	}
+    }
+
+    m_running = running;
+    m_phaseStart = now;
+    emitStatistics(now, timestamp);
+}
+
+void
+DerivedValues::expire(uint64_t now)
+{
+    uint64_t windowStart = now > WindowLength ? now - WindowLength : 0;
+
+    while (!m_cycles.empty() && m_cycles.front().end <= windowStart) {
+	m_cycleTime -= m_cycles.front().end - m_cycles.front().start;
+	m_cycles.pop_front();
+    }
+    while (!m_starts.empty() && m_starts.front() < windowStart) {
+	m_starts.pop_front();
+    }
+    while (!m_shortCycles.empty() && m_shortCycles.front() < windowStart) {
+	m_shortCycles.pop_front();
+    }
+}
+
+void
+DerivedValues::accumulateModulation(uint64_t now)
+{
+    if (m_running && m_modulationSince != 0 && now > m_modulationSince) {
+	m_modulationIntegral += (uint64_t) m_modulation * (now - m_modulationSince);
+	m_modulationTime += now - m_modulationSince;
+    }
+    if (m_modulationSince != 0) {
+	m_modulationSince = now;
+    }
+}
+
+void
+DerivedValues::emitStatistics(uint64_t now, const Timestamp& timestamp)
+{
+    uint64_t windowStart = now > WindowLength ? now - WindowLength : 0;
+    uint64_t observedStart = std::max(windowStart, m_observedSince);
+    uint64_t runTime = m_cycleTime;
+
+    m_lastUpdate = now;
+
+    /* only the first cycle can reach over the start of the window */
+    if (!m_cycles.empty() && m_cycles.front().start < observedStart) {
+	runTime -= observedStart - m_cycles.front().start;
+    }
+    if (m_running) {
+	uint64_t start = m_phaseStart != 0 ? m_phaseStart : m_observedSince;
+	runTime += now - std::max(start, observedStart);
+    }
+
+    if (now > observedStart) {
+	emit(EmsValue(EmsValue::BrennerTastgrad, EmsValue::Brenner,
+		      100.0f * runTime / (float) (now - observedStart)), timestamp);
+    }
+    /* a shorter observation would report too few starts */
+    if (now - m_observedSince >= WindowLength) {
+	emit(EmsValue(EmsValue::BrennerStartsProStunde, EmsValue::Brenner,
+		      (unsigned int) m_starts.size()), timestamp);
+    }
+
+    unsigned int alarmCount = Options::shortCycleCount();
+    if (alarmCount != 0) {
+	bool alarm = m_shortCycles.size() >= alarmCount;
+	if (!m_alarmKnown || alarm != m_alarm) {
+	    m_alarm = alarm;
+	    m_alarmKnown = true;
+	    emit(EmsValue(EmsValue::Taktalarm, EmsValue::Brenner, alarm), timestamp);
+	}
+    }
+}
+
+void
+DerivedValues::emit(EmsValue&& value, const Timestamp& timestamp)
+{
+    value.setTimestamp(timestamp);
+    if (m_output) {
+	m_output(value);
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DERIVEDVALUES_H__
+#define __DERIVEDVALUES_H__
+
+#include <deque>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+
+/*
+ * Computes burner cycle statistics from the burner state values as they
+ * arrive and emits them as values of their own. The burner counts as
+ * running while either the burner or the flame is reported active.
+ * All statistics are kept incrementally over a sliding window, so each
+ * incoming value costs constant time. Starts per hour are only emitted
+ * once a whole window was observed, after startup and after data gaps.
+ */
+class DerivedValues : private boost::noncopyable
+{
+    public:
+	DerivedValues();
+
+	void setOutput(const EmsMessage::ValueHandler& output) {
+	    m_output = output;
+	}
+	void handleValue(const EmsValue& value);
+
+    private:
+	struct Cycle {
+	    uint64_t start;
+	    uint64_t end;
+	};
+
+	void reset();
+	void update(uint64_t now, bool running, const Timestamp& timestamp);
+	void expire(uint64_t now);
+	void accumulateModulation(uint64_t now);
+	void emitStatistics(uint64_t now, const Timestamp& timestamp);
+	void emit(EmsValue&& value, const Timestamp& timestamp);
+
+    private:
+	/* length of the window for starts per hour and duty cycle */
+	static const uint64_t WindowLength = 60 * 60 * 1000;
+	/* inputs further apart than this are treated as missing data */
+	static const uint64_t MaxGap = 5 * 60 * 1000;
+	/* interval for refreshing the windowed values while nothing changes */
+	static const uint64_t UpdateInterval = 60 * 1000;
+
+	EmsMessage::ValueHandler m_output;
+
+	bool m_burnerActive, m_flameActive;
+	bool m_stateKnown, m_running;
+	uint64_t m_lastInput, m_lastUpdate, m_observedSince;
+
+	/* start time of the current cycle or pause, 0 if not observed */
+	uint64_t m_phaseStart;
+
+	/* closed cycles ending in the window and their summed run time */
+	std::deque<Cycle> m_cycles;
+	uint64_t m_cycleTime;
+	/* start times of cycles in the window */
+	std::deque<uint64_t> m_starts;
+	/* end times of short cycles in the window */
+	std::deque<uint64_t> m_shortCycles;
+
+	unsigned int m_modulation;
+	uint64_t m_modulationSince;
+	uint64_t m_modulationIntegral;
+	uint64_t m_modulationTime;
+
+	bool m_alarmKnown, m_alarm;
+};
+
+#endif /* __DERIVEDVALUES_H__ */
@@ -17,8 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <iostream>
-#include <sstream>
 #include <iomanip>
 #include <cmath>
 #include <boost/format.hpp>
@@ -141,11 +141,39 @@ EmsValue::EmsValue(Type type, SubType subType, const std::string& value) :
 {
 }
 
+EmsValue::EmsValue(Type type, SubType subType, float value) :
+    m_type(type),
+    m_subType(subType),
+    m_readingType(Numeric),
+    m_value(value),
+    m_isValid(true)
+{
+}
+
+EmsValue::EmsValue(Type type, SubType subType, unsigned int value) :
+    m_type(type),
+    m_subType(subType),
+    m_readingType(Integer),
+    m_value(value),
+    m_isValid(true)
+{
+}
+
+EmsValue::EmsValue(Type type, SubType subType, bool value) :
+    m_type(type),
+    m_subType(subType),
+    m_readingType(Boolean),
+    m_value(value),
+    m_isValid(true)
+{
+}
+
 EmsMessage::EmsMessage(ValueHandler& valueHandler, CacheAccessor cacheAccessor,
-		       const std::vector<uint8_t>& data) :
+		       const std::vector<uint8_t>& data, const Timestamp& timestamp) :
     m_valueHandler(valueHandler),
     m_cacheAccessor(cacheAccessor),
-    m_data(data)
+    m_data(data),
+    m_timestamp(timestamp)
 {
     if (m_data.size() >= 4) {
 	m_source = m_data[0];
@@ -161,35 +189,6 @@ EmsMessage::EmsMessage(ValueHandler& valueHandler, CacheAccessor cacheAccessor,
     }
 }
 
-EmsMessage::EmsMessage(uint8_t dest, uint8_t type, uint8_t offset,
-		       const std::vector<uint8_t>& data,
-		       bool expectResponse) :
-    m_valueHandler(),
-    m_data(data),
-    m_source(EmsProto::addressPC),
-    m_dest(dest | (expectResponse ? 0x80 : 0)),
-    m_type(type),
-    m_offset(offset)
-{
-}
-
-std::vector<uint8_t>
-EmsMessage::getSendData(bool omitSenderAddress) const
-{
-    std::vector<uint8_t> data;
-    static constexpr uint8_t ourSenderAddress = EmsProto::addressPC;
-
-    if (!omitSenderAddress) {
-	data.push_back(ourSenderAddress);
-    }
-    data.push_back(m_dest);
-    data.push_back(m_type);
-    data.push_back(m_offset);
-    data.insert(data.end(), m_data.begin(), m_data.end());
-
-    return data;
-}
-
 void
 EmsMessage::handle()
 {
@@ -197,23 +196,12 @@ EmsMessage::handle()
     DebugStream& debug = Options::messageDebug();
 
     if (debug) {
-	time_t now = time(NULL);
-	struct tm time;
-
-	localtime_r(&now, &time);
-	boost::format f("MESSAGE[%02d.%02d.%04d %02d:%02d:%02d]: "
-			"source 0x%02x, dest 0x%02x, type 0x%02x, offset %d");
-	f  % time.tm_mday % (time.tm_mon + 1) % (time.tm_year + 1900);
-	f % time.tm_hour % time.tm_min % time.tm_sec;
-	f % (unsigned int) m_source % (unsigned int) m_dest;
-	f % (unsigned int) m_type % (unsigned int) m_offset;
-
-	debug << f << ", data:";
-	for (size_t i = 0; i < m_data.size(); i++) {
-	    debug << " 0x" << std::hex << std::setw(2)
-		  << std::setfill('0') << (unsigned int) m_data[i];
-	}
-	debug << std::endl;
+	/* formatting is done by the log thread */
+	uint8_t record[DebugLog::PayloadSize] = { m_source, m_dest, m_type, m_offset };
+	size_t length = std::min(m_data.size(), sizeof(record) - 4);
+
+	std::copy(m_data.begin(), m_data.begin() + length, record + 4);
+	debug.logMessage(record, length + 4);
     }
 
     if (!m_valueHandler) {
@@ -339,7 +327,7 @@ EmsMessage::parseEnum(size_t offset, EmsValue::Type type, EmsValue::SubType subt
 {
     if (canAccess(offset, 1)) {
 	EmsValue value(type, subtype, m_data[offset - m_offset]);
-	m_valueHandler(value);
+	emitValue(value);
     }
 }
 
@@ -351,7 +339,7 @@ EmsMessage::parseNumeric(size_t offset, size_t size, int divider,
     if (canAccess(offset, size)) {
 	EmsValue value(type, subtype, &m_data.at(offset - m_offset),
 		size, divider, isSigned, invalidValues);
-	m_valueHandler(value);
+	emitValue(value);
     }
 }
 
@@ -361,7 +349,7 @@ EmsMessage::parseBool(size_t offset, uint8_t bit,
 {
     if (canAccess(offset, 1)) {
 	EmsValue value(type, subtype, m_data.at(offset - m_offset), bit);
-	m_valueHandler(value);
+	emitValue(value);
     }
 }
 
@@ -384,14 +372,14 @@ EmsMessage::parseUBAMonitorFastMessage()
     parseTemperature(25, EmsValue::IstTemp, EmsValue::Ansaugluft);
 
     if (canAccess(18, 2)) {
-	std::ostringstream ss;
-	ss << m_data[18] << m_data[19];
-	m_valueHandler(EmsValue(EmsValue::ServiceCode, EmsValue::None, ss.str()));
+	std::string code;
+	code += (char) m_data[18];
+	code += (char) m_data[19];
+	emitValue(EmsValue(EmsValue::ServiceCode, EmsValue::None, code));
     }
     if (canAccess(20, 2)) {
-	std::ostringstream ss;
-	ss << std::dec << (m_data[20] << 8 | m_data[21]);
-	m_valueHandler(EmsValue(EmsValue::FehlerCode, EmsValue::None, ss.str()));
+	emitValue(EmsValue(EmsValue::FehlerCode, EmsValue::None,
+			   std::to_string(m_data[20] << 8 | m_data[21])));
     }
 }
 
@@ -408,7 +396,7 @@ EmsMessage::parseUBAMaintenanceSettingsMessage()
     parseInteger(1, 1, EmsValue::HektoStundenVorWartung, EmsValue::Kessel);
     if (canAccess(2, sizeof(EmsProto::DateRecord))) {
 	EmsProto::DateRecord *record = (EmsProto::DateRecord *) &m_data.at(2 - m_offset);
-	m_valueHandler(EmsValue(EmsValue::Wartungstermin, EmsValue::Kessel, *record));
+	emitValue(EmsValue(EmsValue::Wartungstermin, EmsValue::Kessel, *record));
     }
 }
 
@@ -460,7 +448,7 @@ EmsMessage::parseUBAMonitorWWMessage()
 	// offset 7, bit 0: manually enabled
 	bool enabled = m_data[7 - m_offset] & (1 << 0);
 	uint8_t mode = manual ? (enabled ? 1 : 0) : 2;
-	m_valueHandler(EmsValue(EmsValue::Betriebsart, EmsValue::Zirkulation, mode));
+	emitValue(EmsValue(EmsValue::Betriebsart, EmsValue::Zirkulation, mode));
     }
 }
 
@@ -489,7 +477,7 @@ EmsMessage::parseUBAErrorMessage()
 	unsigned int index = start / sizeof(EmsProto::ErrorRecord);
 	EmsValue::ErrorEntry entry = { m_type, index, *record };
 
-	m_valueHandler(EmsValue(EmsValue::Fehler, EmsValue::None, entry));
+	emitValue(EmsValue(EmsValue::Fehler, EmsValue::None, entry));
 	start += sizeof(EmsProto::ErrorRecord);
     }
 }
@@ -515,7 +503,7 @@ EmsMessage::parseRCTimeMessage()
     if (canAccess(0, sizeof(EmsProto::SystemTimeRecord))) {
 	EmsProto::SystemTimeRecord *record = (EmsProto::SystemTimeRecord *) &m_data.at(0);
 	EmsValue value(EmsValue::SystemZeit, EmsValue::None, *record);
-	m_valueHandler(value);
+	emitValue(value);
     }
 }
 
@@ -556,8 +544,8 @@ EmsMessage::parseRCHKOpmodeMessage(EmsValue::SubType subtype)
 	    system = value;
 	    roomControlled = 0;
 	}
-	m_valueHandler(EmsValue(EmsValue::HeizSystem, subtype, system));
-	m_valueHandler(EmsValue(EmsValue::FuehrungsGroesse, subtype, roomControlled));
+	emitValue(EmsValue(EmsValue::HeizSystem, subtype, system));
+	emitValue(EmsValue(EmsValue::FuehrungsGroesse, subtype, roomControlled));
     } else if (rcType == Options::RC35) {
 	parseEnum(32, EmsValue::HeizSystem, subtype);
 	parseEnum(33, EmsValue::FuehrungsGroesse, subtype);
@@ -626,7 +614,7 @@ EmsMessage::parseRCHKMonitorMessage(EmsValue::SubType subtype)
 	// offset 1, bit 1: day mode
 	bool day = m_data[1] & (1 << 1);
 	uint8_t mode = automatic ? 2 : day ? 1 : 0;
-	m_valueHandler(EmsValue(EmsValue::Betriebsart, subtype, mode));
+	emitValue(EmsValue(EmsValue::Betriebsart, subtype, mode));
     }
 
     parseNumeric(2, 1, 2, EmsValue::RaumSollTemp, subtype);
@@ -637,7 +625,7 @@ EmsMessage::parseRCHKMonitorMessage(EmsValue::SubType subtype)
     if (canAccess(7, 3)) {
 	EmsValue value(EmsValue::HKKennlinie, subtype, m_data[7 - m_offset],
 		m_data[8 - m_offset], m_data[9 - m_offset]);
-	m_valueHandler(value);
+	emitValue(value);
     }
 
     if (canAccess(10, 1) && (m_data[10 - m_offset] & 1) == 0) {
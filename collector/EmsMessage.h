@@ -23,6 +23,7 @@
 #include <vector>
 #include <boost/function.hpp>
 #include <boost/variant.hpp>
+#include "Timestamp.h"
 
 class EmsProto {
     public:
@@ -135,6 +136,17 @@ class EmsValue {
 	    UrlaubAbsenkungsSchwellenTemp,
 	    AbsenkungsAbbruchTemp,
 	    DurchflussMenge,
+	    /* derived from burner state, see DerivedValues */
+	    BrennerZyklusDauer, /* Brenner */
+	    BrennerPausenDauer, /* Brenner */
+	    BrennerTastgrad, /* Brenner */
+	    MittlereModulation, /* Brenner */
+	    /* derived from burner modulation, see EnergyEstimator */
+	    EnergieStunde, /* Heizung, WW */
+	    EnergieTag, /* Heizung, WW */
+	    EnergieGesamt, /* Heizung, WW */
+	    BrennstoffTag,
+	    BrennstoffGesamt,
 	    /* integer */
 	    BetriebsZeit,
 	    BetriebsZeit2,
@@ -150,6 +162,7 @@ class EmsValue {
 	    NachlaufZeit,
 	    PartyZeit,
 	    PausenZeit,
+	    BrennerStartsProStunde, /* Brenner, derived */
 	    /* boolean */
 	    FlammeAktiv,
 	    BrennerAktiv,
@@ -185,6 +198,7 @@ class EmsValue {
 	    Stoerung,
 	    StoerungDesinfektion,
 	    Ladevorgang,
+	    Taktalarm, /* Brenner, derived */
 	    /* enum */
 	    WWSystemType,
 	    Schaltpunkte,
@@ -210,6 +224,8 @@ class EmsValue {
 	    /* state */
 	    ServiceCode,
 	    FehlerCode,
+	    Anomalie, /* derived, see AnomalyDetector */
+	    FehlerEreignis, /* derived, see ErrorTracker */
 	};
 
 	enum SubType {
@@ -232,7 +248,8 @@ class EmsValue {
 	    Solar,
 	    SolarPumpe,
 	    SolarSpeicher,
-	    SolarKollektor
+	    SolarKollektor,
+	    Heizung
 	};
 
 	enum ReadingType {
@@ -275,6 +292,10 @@ class EmsValue {
 	EmsValue(Type type, SubType subType, const EmsProto::DateRecord& date);
 	EmsValue(Type type, SubType subType, const EmsProto::SystemTimeRecord& time);
 	EmsValue(Type type, SubType subType, const std::string& value);
+	/* for values not decoded from a message */
+	EmsValue(Type type, SubType subType, float value);
+	EmsValue(Type type, SubType subType, unsigned int value);
+	EmsValue(Type type, SubType subType, bool value);
 
 	Type getType() const {
 	    return m_type;
@@ -288,6 +309,13 @@ class EmsValue {
 	bool isValid() const {
 	    return m_isValid;
 	}
+	/* reception time of the frame the value was decoded from */
+	const Timestamp& getTimestamp() const {
+	    return m_timestamp;
+	}
+	void setTimestamp(const Timestamp& timestamp) {
+	    m_timestamp = timestamp;
+	}
 	template<typename T> const T& getValue() const {
 	    return boost::get<T>(m_value);
 	}
@@ -303,6 +331,7 @@ class EmsValue {
 	ReadingType m_readingType;
 	Reading m_value;
 	bool m_isValid;
+	Timestamp m_timestamp;
 };
 
 class EmsMessage
@@ -311,9 +340,8 @@ class EmsMessage
 	typedef boost::function<void (const EmsValue& value)> ValueHandler;
 	typedef boost::function<const EmsValue * (EmsValue::Type type, EmsValue::SubType subtype)> CacheAccessor;
 
-	EmsMessage(ValueHandler& valueHandler, CacheAccessor cacheAccesor, const std::vector<uint8_t>& data);
-	EmsMessage(uint8_t dest, uint8_t type, uint8_t offset,
-		   const std::vector<uint8_t>& data, bool expectResponse);
+	EmsMessage(ValueHandler& valueHandler, CacheAccessor cacheAccesor,
+		   const std::vector<uint8_t>& data, const Timestamp& timestamp);
 
 	void handle();
 
@@ -333,9 +361,19 @@ class EmsMessage
 	const std::vector<uint8_t>& getData() const {
 	    return m_data;
 	}
-	std::vector<uint8_t> getSendData(bool omitSenderAddress) const;
+	const Timestamp& getTimestamp() const {
+	    return m_timestamp;
+	}
 
     private:
+	void emitValue(EmsValue& value) {
+	    value.setTimestamp(m_timestamp);
+	    m_valueHandler(value);
+	}
+	void emitValue(EmsValue&& value) {
+	    emitValue(value);
+	}
+
 	void parseUBATotalUptimeMessage();
 	void parseUBAMonitorFastMessage();
 	void parseUBAMonitorSlowMessage();
@@ -404,6 +442,7 @@ class EmsMessage
 	uint8_t m_dest;
 	uint8_t m_type;
 	uint8_t m_offset;
+	Timestamp m_timestamp;
 };
 
 #endif /* __EMSMESSAGE_H__ */
@@ -0,0 +1,214 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EnergyEstimator.h"
+
+EnergyEstimator::EnergyEstimator(float nominalPower, float fuelEnergyContent) :
+    m_nominalPower(nominalPower),
+    m_fuelEnergyContent(fuelEnergyContent),
+    m_modulationKnown(false),
+    m_modulation(0),
+    m_lastSample(0),
+    m_lastUpdate(0),
+    m_integrated(0),
+    m_warmWater(false),
+    m_hourStart(0),
+    m_dayStart(0)
+{
+    for (size_t i = 0; i < UsageCount; i++) {
+	m_hour[i] = m_day[i] = m_total[i] = 0;
+    }
+}
+
+static time_t
+periodStart(time_t time, bool day)
+{
+    struct tm local = *localtime(&time);
+
+    local.tm_sec = local.tm_min = 0;
+    if (day) {
+	local.tm_hour = 0;
+    }
+    local.tm_isdst = -1;
+    return mktime(&local);
+}
+
+void
+EnergyEstimator::handleValue(const EmsValue& value)
+{
+    if (!value.isValid()) {
+	return;
+    }
+
+    if (value.getType() == EmsValue::DreiWegeVentilAufWW) {
+	bool warmWater = value.getValue<bool>();
+	if (warmWater != m_warmWater) {
+	    /* the time held so far belongs to the previous usage */
+	    integrate(value.getTimestamp());
+	    m_warmWater = warmWater;
+	}
+	return;
+    }
+    if (value.getType() != EmsValue::IstModulation || value.getSubType() != EmsValue::Brenner) {
+	return;
+    }
+
+    const Timestamp& timestamp = value.getTimestamp();
+    uint64_t now = timestamp.monotonic;
+
+    integrate(timestamp);
+
+    m_modulation = value.getValue<unsigned int>();
+    m_modulationKnown = true;
+    m_lastSample = now;
+
+    if (m_lastUpdate == 0 || now < m_lastUpdate || now - m_lastUpdate >= UpdateInterval) {
+	m_lastUpdate = now;
+	emitCounters(timestamp);
+    }
+}
+
+void
+EnergyEstimator::integrate(const Timestamp& timestamp)
+{
+    uint64_t now = timestamp.monotonic;
+    uint64_t held = 0;
+
+    /* the modulation is held until the next sample */
+    if (m_modulationKnown && now >= m_integrated && now - m_lastSample <= MaxGap) {
+	held = now - m_integrated;
+    }
+
+    /* the part before a period boundary still belongs to the finished period */
+    uint64_t boundary = periodStart(timestamp.seconds(), false) * 1000ULL;
+    if (held > 0 && timestamp.realtime - held < boundary) {
+	uint64_t before = boundary - (timestamp.realtime - held);
+	addEnergy(before);
+	held -= before;
+    }
+
+    checkPeriods(timestamp.seconds(), timestamp);
+    addEnergy(held);
+    m_integrated = now;
+}
+
+void
+EnergyEstimator::addEnergy(uint64_t duration)
+{
+    double hours = duration / 3600000.0;
+    double energy = m_nominalPower * m_modulation / 100.0 * hours;
+    Usage usage = m_warmWater ? WarmWater : Heating;
+
+    m_hour[usage] += energy;
+    m_day[usage] += energy;
+    m_total[usage] += energy;
+}
+
+void
+EnergyEstimator::checkPeriods(time_t now, const Timestamp& timestamp)
+{
+    time_t hourStart = periodStart(now, false);
+    time_t dayStart = periodStart(now, true);
+
+    if (hourStart == m_hourStart && dayStart == m_dayStart) {
+	return;
+    }
+
+    /* publish the final values of the finished periods */
+    if (m_modulationKnown) {
+	emitCounters(timestamp);
+    }
+
+    if (hourStart != m_hourStart) {
+	m_hourStart = hourStart;
+	m_hour[Heating] = m_hour[WarmWater] = 0;
+    }
+    if (dayStart != m_dayStart) {
+	m_dayStart = dayStart;
+	m_day[Heating] = m_day[WarmWater] = 0;
+    }
+}
+
+void
+EnergyEstimator::emitCounters(const Timestamp& timestamp)
+{
+    static const EmsValue::SubType subtypes[UsageCount] = {
+	EmsValue::Heizung, EmsValue::WW
+    };
+
+    for (size_t i = 0; i < UsageCount; i++) {
+	emit(EmsValue(EmsValue::EnergieStunde, subtypes[i], (float) m_hour[i]), timestamp);
+	emit(EmsValue(EmsValue::EnergieTag, subtypes[i], (float) m_day[i]), timestamp);
+	emit(EmsValue(EmsValue::EnergieGesamt, subtypes[i], (float) m_total[i]), timestamp);
+    }
+
+    if (m_fuelEnergyContent > 0) {
+	double day = m_day[Heating] + m_day[WarmWater];
+	double total = m_total[Heating] + m_total[WarmWater];
+
+	emit(EmsValue(EmsValue::BrennstoffTag, EmsValue::None,
+		      (float) (day / m_fuelEnergyContent)), timestamp);
+	emit(EmsValue(EmsValue::BrennstoffGesamt, EmsValue::None,
+		      (float) (total / m_fuelEnergyContent)), timestamp);
+    }
+}
+
+void
+EnergyEstimator::emit(EmsValue&& value, const Timestamp& timestamp)
+{
+    value.setTimestamp(timestamp);
+    if (m_output) {
+	m_output(value);
+    }
+}
+
+void
+EnergyEstimator::loadState(const StateFile& state)
+{
+    long long hourStart, dayStart;
+
+    state.get("energy.total.heating", m_total[Heating]);
+    state.get("energy.total.warmwater", m_total[WarmWater]);
+
+    /* the period counters are only valid while the period lasts,
+     * checkPeriods() resets them otherwise */
+    if (state.get("energy.hour.start", hourStart)) {
+	m_hourStart = hourStart;
+	state.get("energy.hour.heating", m_hour[Heating]);
+	state.get("energy.hour.warmwater", m_hour[WarmWater]);
+    }
+    if (state.get("energy.day.start", dayStart)) {
+	m_dayStart = dayStart;
+	state.get("energy.day.heating", m_day[Heating]);
+	state.get("energy.day.warmwater", m_day[WarmWater]);
+    }
+}
+
+void
+EnergyEstimator::saveState(StateFile& state) const
+{
+    state.set("energy.total.heating", m_total[Heating]);
+    state.set("energy.total.warmwater", m_total[WarmWater]);
+    state.set("energy.hour.start", (long long) m_hourStart);
+    state.set("energy.hour.heating", m_hour[Heating]);
+    state.set("energy.hour.warmwater", m_hour[WarmWater]);
+    state.set("energy.day.start", (long long) m_dayStart);
+    state.set("energy.day.heating", m_day[Heating]);
+    state.set("energy.day.warmwater", m_day[WarmWater]);
+}
@@ -0,0 +1,88 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ENERGYESTIMATOR_H__
+#define __ENERGYESTIMATOR_H__
+
+#include <time.h>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+#include "StateFile.h"
+
+/*
+ * Estimates the burner energy consumption by integrating the burner
+ * modulation times the nominal heat input over time. The energy is
+ * booked to warm water while the 3-way valve points there, and to
+ * heating otherwise. Counters for the current hour, the current day
+ * and in total are emitted as values.
+ */
+class EnergyEstimator : private boost::noncopyable
+{
+    public:
+	EnergyEstimator(float nominalPower, float fuelEnergyContent);
+
+	void setOutput(const EmsMessage::ValueHandler& output) {
+	    m_output = output;
+	}
+	void handleValue(const EmsValue& value);
+
+	void loadState(const StateFile& state);
+	void saveState(StateFile& state) const;
+
+    private:
+	typedef enum {
+	    Heating,
+	    WarmWater,
+	    UsageCount
+	} Usage;
+
+	/* adds the modulation held since the last call to the counters */
+	void integrate(const Timestamp& timestamp);
+	/* adds the held modulation over duration ms to the counters */
+	void addEnergy(uint64_t duration);
+	void checkPeriods(time_t now, const Timestamp& timestamp);
+	void emitCounters(const Timestamp& timestamp);
+	void emit(EmsValue&& value, const Timestamp& timestamp);
+
+    private:
+	/* samples further apart than this are not integrated */
+	static const uint64_t MaxGap = 5 * 60 * 1000;
+	/* interval for emitting the counters */
+	static const uint64_t UpdateInterval = 60 * 1000;
+
+	EmsMessage::ValueHandler m_output;
+	float m_nominalPower;
+	float m_fuelEnergyContent;
+
+	bool m_modulationKnown;
+	unsigned int m_modulation;
+	uint64_t m_lastSample, m_lastUpdate;
+	/* time up to which the held modulation was added */
+	uint64_t m_integrated;
+	bool m_warmWater;
+
+	/* start of the periods the counters refer to */
+	time_t m_hourStart, m_dayStart;
+	/* kWh */
+	double m_hour[UsageCount];
+	double m_day[UsageCount];
+	double m_total[UsageCount];
+};
+
+#endif /* __ENERGYESTIMATOR_H__ */
@@ -0,0 +1,167 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "ErrorTracker.h"
+#include "ValueApi.h"
+
+bool
+ErrorTracker::openHistory(const std::string& path)
+{
+    m_history.open(path.c_str(), std::ios::out | std::ios::app);
+    if (!m_history.is_open()) {
+	std::cerr << "Could not open error history file " << path << std::endl;
+	return false;
+    }
+    return true;
+}
+
+/* the duration of an active error keeps increasing, so it's ignored */
+bool
+ErrorTracker::sameError(const EmsProto::ErrorRecord& a, const EmsProto::ErrorRecord& b)
+{
+    return memcmp(a.errorAscii, b.errorAscii, sizeof(a.errorAscii)) == 0 &&
+	   a.code_be16 == b.code_be16 && a.source == b.source &&
+	   memcmp(&a.time, &b.time, sizeof(a.time)) == 0;
+}
+
+/* returns whether the entry wasn't seen before */
+bool
+ErrorTracker::remember(uint8_t type, const EmsProto::ErrorRecord& record)
+{
+    std::deque<EmsProto::ErrorRecord>& seen = m_seen[type];
+
+    for (auto& known : seen) {
+	if (sameError(known, record)) {
+	    return false;
+	}
+    }
+
+    seen.push_back(record);
+    if (seen.size() > MaxRemembered) {
+	seen.pop_front();
+    }
+    return true;
+}
+
+void
+ErrorTracker::handleValue(const EmsValue& value)
+{
+    if (value.getReadingType() != EmsValue::Error) {
+	return;
+    }
+
+    const EmsValue::ErrorEntry& entry = value.getValue<EmsValue::ErrorEntry>();
+    SlotKey key(entry.type, entry.index);
+    auto iter = m_slots.find(key);
+
+    bool known = iter != m_slots.end();
+    bool added = !isEmpty(entry.record) && remember(entry.type, entry.record);
+
+    if (!known) {
+	/* without a previous state, we can't tell whether the entry is new */
+	m_slots[key] = entry.record;
+	return;
+    }
+
+    EmsProto::ErrorRecord previous = iter->second;
+    iter->second = entry.record;
+
+    if (added) {
+	report(true, entry, value.getTimestamp());
+    } else if (isEmpty(entry.record) && !isEmpty(previous)) {
+	EmsValue::ErrorEntry cleared = { entry.type, entry.index, previous };
+	report(false, cleared, value.getTimestamp());
+    }
+}
+
+void
+ErrorTracker::report(bool added, const EmsValue::ErrorEntry& entry, const Timestamp& timestamp)
+{
+    Event event;
+
+    event.added = added;
+    event.entry = entry;
+    event.timestamp = timestamp;
+
+    EmsValue value(EmsValue::Fehler, EmsValue::None, entry);
+    std::string text = std::string(added ? "new " : "cleared ") + ValueApi::formatValue(value);
+
+    if (m_history.is_open()) {
+	time_t seconds = event.timestamp.seconds();
+	char buffer[32];
+
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+	m_history << buffer << '\t' << text << std::endl;
+    }
+    for (auto& cb : m_eventCallbacks) {
+	cb(event);
+    }
+    if (m_output) {
+	EmsValue eventValue(EmsValue::FehlerEreignis, EmsValue::None, text);
+	eventValue.setTimestamp(event.timestamp);
+	m_output(eventValue);
+    }
+}
+
+void
+ErrorTracker::loadState(const StateFile& state)
+{
+    static const uint8_t types[] = { 0x10, 0x11, 0x12, 0x13 };
+
+    for (auto type : types) {
+	for (unsigned int index = 0; ; index++) {
+	    std::ostringstream key;
+	    std::string hex;
+
+	    key << "errors." << std::hex << (unsigned int) type << "." << std::dec << index;
+	    if (!state.get(key.str(), hex) || hex.size() != 2 * sizeof(EmsProto::ErrorRecord)) {
+		break;
+	    }
+
+	    EmsProto::ErrorRecord record;
+	    uint8_t *bytes = (uint8_t *) &record;
+	    for (size_t i = 0; i < sizeof(record); i++) {
+		bytes[i] = strtoul(hex.substr(2 * i, 2).c_str(), NULL, 16);
+	    }
+	    m_slots[SlotKey(type, index)] = record;
+	    if (!isEmpty(record)) {
+		remember(type, record);
+	    }
+	}
+    }
+}
+
+void
+ErrorTracker::saveState(StateFile& state) const
+{
+    for (auto& slot : m_slots) {
+	std::ostringstream key, hex;
+	const uint8_t *bytes = (const uint8_t *) &slot.second;
+
+	key << "errors." << std::hex << (unsigned int) slot.first.first << "." << std::dec << slot.first.second;
+	for (size_t i = 0; i < sizeof(slot.second); i++) {
+	    hex << std::hex << std::setw(2) << std::setfill('0') << (unsigned int) bytes[i];
+	}
+	state.set(key.str(), hex.str());
+    }
+}
@@ -0,0 +1,87 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ERRORTRACKER_H__
+#define __ERRORTRACKER_H__
+
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <map>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+#include "StateFile.h"
+
+/*
+ * The UBA error log telegrams repeat all error slots every time. This
+ * keeps the last content of every slot and only reports entries which
+ * are new or were cleared. Entries moving to the next slot when a new
+ * error is logged in front of them are not reported again.
+ */
+class ErrorTracker : private boost::noncopyable
+{
+    public:
+	struct Event {
+	    bool added;
+	    EmsValue::ErrorEntry entry;
+	    Timestamp timestamp;
+	};
+	typedef std::function<void (const Event& event)> EventCallback;
+
+    public:
+	ErrorTracker() { }
+
+	/* appends all events to the given file */
+	bool openHistory(const std::string& path);
+	void addEventCallback(const EventCallback& cb) {
+	    m_eventCallbacks.push_back(cb);
+	}
+	/* events are also passed on as FehlerEreignis values */
+	void setOutput(const EmsMessage::ValueHandler& output) {
+	    m_output = output;
+	}
+	void handleValue(const EmsValue& value);
+
+	void loadState(const StateFile& state);
+	void saveState(StateFile& state) const;
+
+    private:
+	typedef std::pair<uint8_t, unsigned int> SlotKey;
+
+	static bool isEmpty(const EmsProto::ErrorRecord& record) {
+	    return record.errorAscii[0] == 0;
+	}
+	static bool sameError(const EmsProto::ErrorRecord& a, const EmsProto::ErrorRecord& b);
+	bool remember(uint8_t type, const EmsProto::ErrorRecord& record);
+	void report(bool added, const EmsValue::ErrorEntry& entry, const Timestamp& timestamp);
+
+    private:
+	/* more than the error logs hold, so shifted entries are still known */
+	static const size_t MaxRemembered = 64;
+
+	std::map<SlotKey, EmsProto::ErrorRecord> m_slots;
+	/* entries seen in any slot, per log type */
+	std::map<uint8_t, std::deque<EmsProto::ErrorRecord> > m_seen;
+	std::list<EventCallback> m_eventCallbacks;
+	EmsMessage::ValueHandler m_output;
+	std::ofstream m_history;
+};
+
+#endif /* __ERRORTRACKER_H__ */
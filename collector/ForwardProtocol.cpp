@@ -0,0 +1,232 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ForwardProtocol.h"
+
+static void
+putVarint(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    while (value >= 0x80) {
+	buffer.push_back((value & 0x7f) | 0x80);
+	value >>= 7;
+    }
+    buffer.push_back(value);
+}
+
+static bool
+getVarint(const std::vector<uint8_t>& buffer, size_t& pos, uint64_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 64 && pos < buffer.size(); shift += 7) {
+	uint8_t byte = buffer[pos++];
+	value |= ((uint64_t) (byte & 0x7f)) << shift;
+	if (!(byte & 0x80)) {
+	    return true;
+	}
+    }
+    return false;
+}
+
+static std::vector<uint8_t>
+startMessage(ForwardProtocol::MessageType type)
+{
+    /* the length is filled in by finishMessage() */
+    std::vector<uint8_t> message(ForwardProtocol::HeaderSize, 0);
+    message[4] = type;
+    return message;
+}
+
+static void
+finishMessage(std::vector<uint8_t>& message)
+{
+    uint32_t length = message.size() - ForwardProtocol::HeaderSize;
+    for (size_t i = 0; i < 4; i++) {
+	message[i] = (length >> (8 * i)) & 0xff;
+    }
+}
+
+void
+ForwardProtocol::put64(std::vector<uint8_t>& buffer, uint64_t value)
+{
+    for (size_t i = 0; i < 8; i++) {
+	buffer.push_back((value >> (8 * i)) & 0xff);
+    }
+}
+
+uint64_t
+ForwardProtocol::get64(const uint8_t *buffer)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+	value |= ((uint64_t) buffer[i]) << (8 * i);
+    }
+    return value;
+}
+
+bool
+ForwardProtocol::decodeHeader(const uint8_t *buffer, MessageType& type, uint32_t& length)
+{
+    length = 0;
+    for (size_t i = 0; i < 4; i++) {
+	length |= ((uint32_t) buffer[i]) << (8 * i);
+    }
+    type = (MessageType) buffer[4];
+
+    return length <= MaxPayloadSize && type >= HelloMessage && type <= AckMessage;
+}
+
+std::vector<uint8_t>
+ForwardProtocol::encodeHello(const std::string& site, uint8_t flags)
+{
+    std::vector<uint8_t> message = startMessage(HelloMessage);
+
+    message.push_back(Version);
+    message.push_back(flags);
+    message.insert(message.end(), site.begin(), site.end());
+    finishMessage(message);
+
+    return message;
+}
+
+bool
+ForwardProtocol::decodeHello(const std::vector<uint8_t>& payload, std::string& site, uint8_t& flags)
+{
+    if (payload.size() < 2 || payload[0] != Version) {
+	return false;
+    }
+
+    flags = payload[1];
+    site.assign(payload.begin() + 2, payload.end());
+    return true;
+}
+
+std::vector<uint8_t>
+ForwardProtocol::encodeWelcome(uint64_t sequence, uint8_t flags)
+{
+    std::vector<uint8_t> message = startMessage(WelcomeMessage);
+
+    put64(message, sequence);
+    message.push_back(flags);
+    finishMessage(message);
+
+    return message;
+}
+
+bool
+ForwardProtocol::decodeWelcome(const std::vector<uint8_t>& payload, uint64_t& sequence, uint8_t& flags)
+{
+    if (payload.size() != 9) {
+	return false;
+    }
+
+    sequence = get64(&payload[0]);
+    flags = payload[8];
+    return true;
+}
+
+std::vector<uint8_t>
+ForwardProtocol::encodeAck(uint64_t sequence)
+{
+    std::vector<uint8_t> message = startMessage(AckMessage);
+
+    put64(message, sequence);
+    finishMessage(message);
+
+    return message;
+}
+
+bool
+ForwardProtocol::decodeAck(const std::vector<uint8_t>& payload, uint64_t& sequence)
+{
+    if (payload.size() != 8) {
+	return false;
+    }
+
+    sequence = get64(&payload[0]);
+    return true;
+}
+
+bool
+ForwardProtocol::decodeFrames(const std::vector<uint8_t>& payload, std::vector<Frame>& frames)
+{
+    frames.clear();
+    if (payload.size() < 16) {
+	return false;
+    }
+
+    uint64_t sequence = get64(&payload[0]);
+    uint64_t timestamp = get64(&payload[8]);
+    size_t pos = 16;
+
+    while (pos < payload.size()) {
+	uint64_t sequenceDelta, timestampDelta;
+	if (!getVarint(payload, pos, sequenceDelta) || !getVarint(payload, pos, timestampDelta)) {
+	    return false;
+	}
+	if (pos >= payload.size() || pos + 1 + payload[pos] > payload.size()) {
+	    return false;
+	}
+
+	Frame frame;
+	sequence += sequenceDelta;
+	/* zigzag decoding, the clock may have been set back */
+	timestamp += (timestampDelta >> 1) ^ -(timestampDelta & 1);
+	frame.sequence = sequence;
+	frame.timestamp = timestamp;
+	frame.data.assign(payload.begin() + pos + 1, payload.begin() + pos + 1 + payload[pos]);
+	pos += 1 + payload[pos];
+	frames.push_back(frame);
+    }
+
+    return true;
+}
+
+void
+ForwardProtocol::FrameEncoder::add(const Frame& frame)
+{
+    if (m_count == 0) {
+	m_payload = startMessage(FramesMessage);
+	put64(m_payload, frame.sequence);
+	put64(m_payload, frame.timestamp);
+	m_lastSequence = frame.sequence;
+	m_lastTimestamp = frame.timestamp;
+    }
+
+    int64_t timestampDelta = frame.timestamp - m_lastTimestamp;
+    putVarint(m_payload, frame.sequence - m_lastSequence);
+    putVarint(m_payload, ((uint64_t) timestampDelta << 1) ^ (timestampDelta >> 63));
+    m_payload.push_back(frame.data.size());
+    m_payload.insert(m_payload.end(), frame.data.begin(), frame.data.end());
+
+    m_lastSequence = frame.sequence;
+    m_lastTimestamp = frame.timestamp;
+    m_count++;
+}
+
+std::vector<uint8_t>
+ForwardProtocol::FrameEncoder::finish()
+{
+    std::vector<uint8_t> message;
+
+    finishMessage(m_payload);
+    message.swap(m_payload);
+    m_count = 0;
+
+    return message;
+}
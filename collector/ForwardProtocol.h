@@ -0,0 +1,106 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FORWARDPROTOCOL_H__
+#define __FORWARDPROTOCOL_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Protocol between a forwarding collector and an aggregator. Every message
+ * starts with a header
+ *   uint32_t payload length
+ *   uint8_t  message type
+ * followed by the payload:
+ *   Hello (forwarder):    uint8_t version, uint8_t requested flags, site name
+ *   Welcome (aggregator): uint64_t sequence number of the last stored frame,
+ *                         uint8_t accepted flags
+ *   Frames (forwarder):   uint64_t first sequence number,
+ *                         uint64_t first timestamp (ms since epoch),
+ *                         per frame varint sequence delta, zigzag varint
+ *                         timestamp delta, uint8_t length, data
+ *   Ack (aggregator):     uint64_t sequence number of the last stored frame
+ * The deltas refer to the previous frame of the message, the first frame
+ * has deltas of 0. All fixed size numbers are little endian.
+ * If the aggregator accepts CompressFlag, everything the forwarder sends
+ * after receiving the Welcome message is a zlib stream, flushed after each
+ * message.
+ */
+namespace ForwardProtocol {
+    static const uint8_t Version = 2;
+    static const uint8_t CompressFlag = 0x01;
+    static const size_t HeaderSize = 5;
+    static const uint32_t MaxPayloadSize = 1024 * 1024;
+
+    typedef enum {
+	HelloMessage = 1,
+	WelcomeMessage = 2,
+	FramesMessage = 3,
+	AckMessage = 4
+    } MessageType;
+
+    struct Frame {
+	uint64_t sequence;
+	uint64_t timestamp;
+	std::vector<uint8_t> data;
+    };
+
+    void put64(std::vector<uint8_t>& buffer, uint64_t value);
+    uint64_t get64(const uint8_t *buffer);
+
+    bool decodeHeader(const uint8_t *buffer, MessageType& type, uint32_t& length);
+
+    std::vector<uint8_t> encodeHello(const std::string& site, uint8_t flags);
+    bool decodeHello(const std::vector<uint8_t>& payload, std::string& site, uint8_t& flags);
+
+    std::vector<uint8_t> encodeWelcome(uint64_t sequence, uint8_t flags);
+    bool decodeWelcome(const std::vector<uint8_t>& payload, uint64_t& sequence, uint8_t& flags);
+
+    std::vector<uint8_t> encodeAck(uint64_t sequence);
+    bool decodeAck(const std::vector<uint8_t>& payload, uint64_t& sequence);
+
+    bool decodeFrames(const std::vector<uint8_t>& payload, std::vector<Frame>& frames);
+
+    /* builds a Frames message, the frames must be added in sequence order */
+    class FrameEncoder {
+	public:
+	    FrameEncoder() :
+		m_count(0)
+	    { }
+
+	    void add(const Frame& frame);
+	    size_t count() const {
+		return m_count;
+	    }
+	    uint64_t lastSequence() const {
+		return m_lastSequence;
+	    }
+	    std::vector<uint8_t> finish();
+
+	private:
+	    std::vector<uint8_t> m_payload;
+	    size_t m_count;
+	    uint64_t m_lastSequence;
+	    uint64_t m_lastTimestamp;
+    };
+}
+
+#endif /* __FORWARDPROTOCOL_H__ */
@@ -0,0 +1,549 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <boost/bind.hpp>
+#include "FrameForwarder.h"
+
+/* spool records are uint64_t sequence, uint64_t timestamp, uint8_t length, data */
+static const size_t SpoolRecordHeaderSize = 17;
+
+static bool
+readSpoolRecord(std::istream& in, ForwardProtocol::Frame& frame)
+{
+    uint8_t header[SpoolRecordHeaderSize];
+
+    if (!in.read((char *) header, sizeof(header))) {
+	return false;
+    }
+    frame.sequence = ForwardProtocol::get64(header);
+    frame.timestamp = ForwardProtocol::get64(header + 8);
+    frame.data.resize(header[16]);
+    if (!frame.data.empty() && !in.read((char *) &frame.data[0], frame.data.size())) {
+	return false;
+    }
+    return true;
+}
+
+static bool
+writeSpoolRecord(std::ostream& out, const ForwardProtocol::Frame& frame)
+{
+    std::vector<uint8_t> record;
+
+    ForwardProtocol::put64(record, frame.sequence);
+    ForwardProtocol::put64(record, frame.timestamp);
+    record.push_back(frame.data.size());
+    record.insert(record.end(), frame.data.begin(), frame.data.end());
+
+    return (bool) out.write((const char *) &record[0], record.size());
+}
+
+static bool
+sequenceLess(uint64_t sequence, const ForwardProtocol::Frame& frame)
+{
+    return sequence < frame.sequence;
+}
+
+FrameForwarder::FrameForwarder(boost::asio::io_service& ios,
+			       const std::string& host, const std::string& port,
+			       const std::string& site, const std::string& spoolFile,
+			       bool compress) :
+    m_host(host),
+    m_port(port),
+    m_site(site),
+    m_compress(compress),
+    m_resolver(ios),
+    m_socket(ios),
+    m_retryTimer(ios),
+    m_retryDelay(MinRetryDelaySeconds),
+    m_connecting(false),
+    m_connected(false),
+    m_closed(false),
+    m_lastSequence(0),
+    m_acked(0),
+    m_sent(0),
+    m_highestSent(0),
+    m_sendScheduled(false),
+    m_sendTimer(ios),
+    m_spoolFile(spoolFile),
+    m_spoolLast(0),
+    m_spoolSize(0),
+    m_spoolOffset(0),
+    m_dropReported(false)
+{
+    scanSpool();
+}
+
+void
+FrameForwarder::start()
+{
+    connect();
+}
+
+void
+FrameForwarder::close()
+{
+    if (m_closed) {
+	return;
+    }
+
+    m_closed = true;
+    m_retryTimer.cancel();
+    m_sendTimer.cancel();
+    m_resolver.cancel();
+    boost::system::error_code ec;
+    m_socket.close(ec);
+
+    for (auto& frame : m_queue) {
+	if (frame.sequence > m_acked) {
+	    spoolFrame(frame);
+	}
+    }
+}
+
+void
+FrameForwarder::handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp)
+{
+    if (data.size() > 255) {
+	return;
+    }
+
+    ForwardProtocol::Frame frame;
+    frame.sequence = std::max(m_lastSequence + 1, timestamp.realtime << 8);
+    frame.timestamp = timestamp.realtime;
+    frame.data = data;
+    m_lastSequence = frame.sequence;
+    m_queue.push_back(frame);
+
+    if (m_queue.size() > MaxQueuedFrames) {
+	if (m_queue.front().sequence > m_acked) {
+	    spoolFrame(m_queue.front());
+	}
+	m_queue.pop_front();
+    }
+
+    auto firstUnsent = std::upper_bound(m_queue.begin(), m_queue.end(), m_sent, sequenceLess);
+    if ((size_t) (m_queue.end() - firstUnsent) >= MaxBatchFrames) {
+	sendFrames();
+    } else {
+	scheduleSend();
+    }
+}
+
+void
+FrameForwarder::connect()
+{
+    boost::asio::ip::tcp::resolver::query query(m_host, m_port);
+
+    Ptr self = shared_from_this();
+    m_connecting = true;
+    m_resolver.async_resolve(query,
+	    [this, self] (const boost::system::error_code& error,
+			  boost::asio::ip::tcp::resolver::iterator endpoint) {
+	if (error == boost::asio::error::operation_aborted || m_closed) {
+	    return;
+	}
+	if (error) {
+	    disconnect(error.message());
+	    return;
+	}
+	boost::asio::async_connect(m_socket, endpoint,
+		boost::bind(&FrameForwarder::handleConnect, self,
+			    boost::asio::placeholders::error));
+    });
+}
+
+void
+FrameForwarder::handleConnect(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	disconnect(error.message());
+	return;
+    }
+
+    m_socket.set_option(boost::asio::socket_base::keep_alive(true));
+    uint8_t flags = m_compress && Deflater::available() ? ForwardProtocol::CompressFlag : 0;
+    send(ForwardProtocol::encodeHello(m_site, flags));
+    readHeader();
+}
+
+void
+FrameForwarder::disconnect(const std::string& reason)
+{
+    if (!m_connecting && !m_connected) {
+	/* the other pending operation already failed */
+	return;
+    }
+
+    if (m_connected || m_retryDelay == MinRetryDelaySeconds) {
+	std::cerr << "Forwarding connection to " << m_host << ":" << m_port
+		  << " failed: " << reason << std::endl;
+    }
+
+    boost::system::error_code ec;
+    m_socket.close(ec);
+    m_connecting = false;
+    m_connected = false;
+    m_writeQueue.clear();
+    m_deflater.reset();
+    m_inFlight.clear();
+    m_sendTimer.cancel();
+    m_sendScheduled = false;
+
+    scheduleReconnect();
+}
+
+void
+FrameForwarder::scheduleReconnect()
+{
+    Ptr self = shared_from_this();
+    m_retryTimer.expires_from_now(boost::posix_time::seconds(m_retryDelay));
+    m_retryTimer.async_wait([this, self] (const boost::system::error_code& error) {
+	if (error != boost::asio::error::operation_aborted && !m_closed) {
+	    connect();
+	}
+    });
+    m_retryDelay = std::min(2 * m_retryDelay, MaxRetryDelaySeconds);
+}
+
+void
+FrameForwarder::readHeader()
+{
+    boost::asio::async_read(m_socket, boost::asio::buffer(m_header),
+	    boost::bind(&FrameForwarder::handleHeader, shared_from_this(),
+			boost::asio::placeholders::error));
+}
+
+void
+FrameForwarder::handleHeader(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	disconnect(error.message());
+	return;
+    }
+
+    uint32_t length;
+    if (!ForwardProtocol::decodeHeader(m_header, m_messageType, length)) {
+	disconnect("protocol error");
+	return;
+    }
+
+    m_body.resize(length);
+    boost::asio::async_read(m_socket, boost::asio::buffer(m_body),
+	    boost::bind(&FrameForwarder::handleBody, shared_from_this(),
+			boost::asio::placeholders::error));
+}
+
+void
+FrameForwarder::handleBody(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	disconnect(error.message());
+	return;
+    }
+
+    uint64_t sequence;
+    uint8_t flags;
+
+    if (m_messageType == ForwardProtocol::WelcomeMessage && !m_connected &&
+	    ForwardProtocol::decodeWelcome(m_body, sequence, flags)) {
+	if (flags & ForwardProtocol::CompressFlag) {
+	    m_deflater.reset(new Deflater());
+	}
+	m_connecting = false;
+	m_connected = true;
+	m_retryDelay = MinRetryDelaySeconds;
+	/* resend everything the aggregator doesn't have */
+	m_sent = sequence;
+	m_spoolOffset = 0;
+	renumberUnsent(sequence);
+	handleAck(sequence);
+    } else if (m_messageType == ForwardProtocol::AckMessage && m_connected &&
+	    ForwardProtocol::decodeAck(m_body, sequence)) {
+	handleAck(sequence);
+    } else {
+	disconnect("protocol error");
+	return;
+    }
+
+    readHeader();
+}
+
+void
+FrameForwarder::handleAck(uint64_t sequence)
+{
+    m_acked = std::max(m_acked, sequence);
+
+    while (!m_inFlight.empty() && m_inFlight.front() <= sequence) {
+	m_inFlight.pop_front();
+    }
+    while (!m_queue.empty() && m_queue.front().sequence <= m_acked) {
+	m_queue.pop_front();
+    }
+    if (m_spoolLast != 0 && m_spoolLast <= m_acked) {
+	m_spool.close();
+	m_spool.open(m_spoolFile.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+	m_spool.close();
+	m_spoolLast = 0;
+	m_spoolSize = 0;
+	m_spoolOffset = 0;
+	m_dropReported = false;
+    }
+
+    sendFrames();
+}
+
+void
+FrameForwarder::renumberUnsent(uint64_t sequence)
+{
+    /*
+     * Frames which were never sent can't be stored by the aggregator, even
+     * if their sequence number doesn't exceed the one it reported. This
+     * happens when we restart with an empty spool and a clock behind the
+     * previous run. Move them behind the aggregator's last frame instead
+     * of treating them as acknowledged.
+     */
+    uint64_t next = std::max(sequence, m_highestSent);
+    size_t renumbered = 0;
+
+    if (m_spoolLast > m_highestSent) {
+	renumbered += renumberSpool(next);
+    }
+
+    auto iter = std::upper_bound(m_queue.begin(), m_queue.end(), m_highestSent, sequenceLess);
+    for (; iter != m_queue.end(); ++iter) {
+	if (iter->sequence <= next) {
+	    iter->sequence = ++next;
+	    renumbered++;
+	} else {
+	    next = iter->sequence;
+	}
+    }
+    m_lastSequence = std::max(m_lastSequence, next);
+
+    if (renumbered > 0) {
+	std::cerr << "Aggregator is ahead of the local clock, renumbered "
+		  << renumbered << " frames" << std::endl;
+    }
+}
+
+size_t
+FrameForwarder::renumberSpool(uint64_t& next)
+{
+    std::string tmpPath = m_spoolFile + ".tmp";
+    std::ifstream in(m_spoolFile.c_str(), std::ios::in | std::ios::binary);
+    std::ofstream out(tmpPath.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+    ForwardProtocol::Frame frame;
+    uint64_t spoolNext = next;
+    size_t renumbered = 0;
+
+    m_spool.flush();
+    while (readSpoolRecord(in, frame)) {
+	if (frame.sequence > m_highestSent) {
+	    if (frame.sequence <= spoolNext) {
+		frame.sequence = ++spoolNext;
+		renumbered++;
+	    } else {
+		spoolNext = frame.sequence;
+	    }
+	}
+	if (!writeSpoolRecord(out, frame)) {
+	    break;
+	}
+    }
+    in.close();
+    out.close();
+
+    if (renumbered == 0 || out.fail()) {
+	remove(tmpPath.c_str());
+	return 0;
+    }
+
+    m_spool.close();
+    if (rename(tmpPath.c_str(), m_spoolFile.c_str()) != 0) {
+	std::cerr << "Could not rewrite spool file " << m_spoolFile << std::endl;
+	remove(tmpPath.c_str());
+	return 0;
+    }
+    m_spoolLast = next = spoolNext;
+    return renumbered;
+}
+
+void
+FrameForwarder::scheduleSend()
+{
+    if (!m_connected || m_sendScheduled) {
+	return;
+    }
+
+    Ptr self = shared_from_this();
+    m_sendScheduled = true;
+    m_sendTimer.expires_from_now(boost::posix_time::seconds(SendDelaySeconds));
+    m_sendTimer.async_wait([this, self] (const boost::system::error_code& error) {
+	if (error != boost::asio::error::operation_aborted && !m_closed) {
+	    m_sendScheduled = false;
+	    sendFrames();
+	}
+    });
+}
+
+void
+FrameForwarder::sendFrames()
+{
+    if (!m_connected) {
+	return;
+    }
+
+    while (m_inFlight.size() < MaxInFlight) {
+	ForwardProtocol::FrameEncoder encoder;
+
+	/* everything in the spool is older than the queue */
+	if (m_spoolLast > m_sent) {
+	    readSpool(encoder);
+	}
+	if (encoder.count() == 0) {
+	    auto iter = std::upper_bound(m_queue.begin(), m_queue.end(), m_sent, sequenceLess);
+	    for (; iter != m_queue.end() && encoder.count() < MaxBatchFrames; ++iter) {
+		encoder.add(*iter);
+	    }
+	}
+	if (encoder.count() == 0) {
+	    break;
+	}
+
+	m_sent = encoder.lastSequence();
+	m_highestSent = std::max(m_highestSent, m_sent);
+	m_inFlight.push_back(m_sent);
+	send(encoder.finish());
+    }
+}
+
+bool
+FrameForwarder::readSpool(ForwardProtocol::FrameEncoder& encoder)
+{
+    ForwardProtocol::Frame frame;
+
+    m_spool.flush();
+    std::ifstream in(m_spoolFile.c_str(), std::ios::in | std::ios::binary);
+    if (!in || !in.seekg(m_spoolOffset)) {
+	return false;
+    }
+
+    while (encoder.count() < MaxBatchFrames && readSpoolRecord(in, frame)) {
+	m_spoolOffset = in.tellg();
+	if (frame.sequence > m_sent) {
+	    encoder.add(frame);
+	}
+    }
+
+    return true;
+}
+
+void
+FrameForwarder::send(std::vector<uint8_t>&& message)
+{
+    if (m_deflater) {
+	std::vector<uint8_t> compressed;
+	m_deflater->compress(&message[0], message.size(), compressed);
+	message.swap(compressed);
+    }
+
+    m_writeQueue.push_back(std::move(message));
+    if (m_writeQueue.size() == 1) {
+	boost::asio::async_write(m_socket, boost::asio::buffer(m_writeQueue.front()),
+		boost::bind(&FrameForwarder::handleWrite, shared_from_this(),
+			    boost::asio::placeholders::error));
+    }
+}
+
+void
+FrameForwarder::handleWrite(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	disconnect(error.message());
+	return;
+    }
+
+    m_writeQueue.pop_front();
+    if (!m_writeQueue.empty()) {
+	boost::asio::async_write(m_socket, boost::asio::buffer(m_writeQueue.front()),
+		boost::bind(&FrameForwarder::handleWrite, shared_from_this(),
+			    boost::asio::placeholders::error));
+    }
+}
+
+void
+FrameForwarder::spoolFrame(const ForwardProtocol::Frame& frame)
+{
+    size_t size = SpoolRecordHeaderSize + frame.data.size();
+
+    if (m_spoolFile.empty() || m_spoolSize + size > MaxSpoolSize) {
+	if (!m_dropReported) {
+	    std::cerr << "Forwarding queue is full, dropping frames" << std::endl;
+	    m_dropReported = true;
+	}
+	return;
+    }
+
+    if (!m_spool.is_open()) {
+	m_spool.open(m_spoolFile.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+    }
+
+    if (!writeSpoolRecord(m_spool, frame)) {
+	std::cerr << "Could not write spool file " << m_spoolFile << std::endl;
+	return;
+    }
+
+    m_spoolLast = frame.sequence;
+    m_spoolSize += size;
+}
+
+void
+FrameForwarder::scanSpool()
+{
+    if (m_spoolFile.empty()) {
+	return;
+    }
+
+    std::ifstream in(m_spoolFile.c_str(), std::ios::in | std::ios::binary);
+    ForwardProtocol::Frame frame;
+
+    while (readSpoolRecord(in, frame)) {
+	m_spoolLast = frame.sequence;
+	m_spoolSize += SpoolRecordHeaderSize + frame.data.size();
+    }
+    m_lastSequence = m_spoolLast;
+    /* the previous run may have sent these already */
+    m_highestSent = m_spoolLast;
+}
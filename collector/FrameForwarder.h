@@ -0,0 +1,141 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FRAMEFORWARDER_H__
+#define __FRAMEFORWARDER_H__
+
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include "Compression.h"
+#include "ForwardProtocol.h"
+#include "Noncopyable.h"
+#include "Timestamp.h"
+
+/*
+ * Streams all received frames to an aggregator over a persistent TCP
+ * connection. Frames stay queued until the aggregator acknowledges them.
+ * When the queue grows too large during an outage, the oldest frames go
+ * to the spool file, which is also where the queue is saved on shutdown.
+ * On connecting the aggregator tells us the last frame it has stored, so
+ * sending resumes right after it.
+ *
+ * On request the connection is compressed, which shrinks the repetitive
+ * bus traffic considerably.
+ *
+ * Sequence numbers are derived from the reception time, so they keep
+ * increasing across restarts without having to be stored anywhere. If the
+ * clock is behind the previous run, frames which weren't sent yet are
+ * renumbered after the last frame the aggregator reports on connecting.
+ */
+class FrameForwarder : public boost::enable_shared_from_this<FrameForwarder>,
+		       private boost::noncopyable
+{
+    public:
+	typedef boost::shared_ptr<FrameForwarder> Ptr;
+
+    public:
+	FrameForwarder(boost::asio::io_service& ios,
+		       const std::string& host, const std::string& port,
+		       const std::string& site, const std::string& spoolFile,
+		       bool compress);
+
+	void start();
+	/* saves the queue into the spool file; the pending operations keep
+	 * the object alive until their handlers ran */
+	void close();
+	void handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp);
+
+    private:
+	void connect();
+	void handleConnect(const boost::system::error_code& error);
+	void disconnect(const std::string& reason);
+	void scheduleReconnect();
+	void readHeader();
+	void handleHeader(const boost::system::error_code& error);
+	void handleBody(const boost::system::error_code& error);
+	void handleAck(uint64_t sequence);
+	void renumberUnsent(uint64_t sequence);
+	size_t renumberSpool(uint64_t& next);
+	void scheduleSend();
+	void sendFrames();
+	bool readSpool(ForwardProtocol::FrameEncoder& encoder);
+	void send(std::vector<uint8_t>&& message);
+	void handleWrite(const boost::system::error_code& error);
+	void spoolFrame(const ForwardProtocol::Frame& frame);
+	void scanSpool();
+
+    private:
+	static const unsigned int MinRetryDelaySeconds = 5;
+	static const unsigned int MaxRetryDelaySeconds = 5 * 60;
+	/* delay for collecting frames into one message */
+	static const unsigned int SendDelaySeconds = 1;
+	static const size_t MaxBatchFrames = 512;
+	/* unacknowledged messages on the wire */
+	static const size_t MaxInFlight = 8;
+	/* a few hours of bus traffic */
+	static const size_t MaxQueuedFrames = 100000;
+	static const size_t MaxSpoolSize = 256 * 1024 * 1024;
+
+	std::string m_host;
+	std::string m_port;
+	std::string m_site;
+	bool m_compress;
+
+	boost::asio::ip::tcp::resolver m_resolver;
+	boost::asio::ip::tcp::socket m_socket;
+	boost::asio::deadline_timer m_retryTimer;
+	unsigned int m_retryDelay;
+	bool m_connecting;
+	/* set once the aggregator has greeted us */
+	bool m_connected;
+	bool m_closed;
+
+	uint8_t m_header[ForwardProtocol::HeaderSize];
+	ForwardProtocol::MessageType m_messageType;
+	std::vector<uint8_t> m_body;
+	std::deque<std::vector<uint8_t> > m_writeQueue;
+	std::unique_ptr<Deflater> m_deflater;
+
+	uint64_t m_lastSequence;
+	uint64_t m_acked;
+	/* sequence number of the last frame sent over this connection */
+	uint64_t m_sent;
+	/* highest sequence number which may have reached the aggregator */
+	uint64_t m_highestSent;
+	/* last sequence number of each message awaiting an ack */
+	std::deque<uint64_t> m_inFlight;
+	std::deque<ForwardProtocol::Frame> m_queue;
+	bool m_sendScheduled;
+	boost::asio::deadline_timer m_sendTimer;
+
+	std::string m_spoolFile;
+	std::ofstream m_spool;
+	/* sequence number of the last spooled frame, 0 if the spool is empty */
+	uint64_t m_spoolLast;
+	uint64_t m_spoolSize;
+	/* position of the first spooled frame which wasn't sent yet */
+	uint64_t m_spoolOffset;
+	bool m_dropReported;
+};
+
+#endif /* __FRAMEFORWARDER_H__ */
@@ -0,0 +1,229 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <boost/format.hpp>
+#include "GraphRenderer.h"
+
+/* plot area */
+static const int PlotLeft = 70;
+static const int PlotRight = 780;
+static const int PlotTop = 40;
+static const int PlotBottom = 380;
+
+static const char * lineColors[] = {
+    "#9400d3", "#009e73", "#56b4e9", "#e69f00", "#f0e442"
+};
+static const size_t lineColorCount = sizeof(lineColors) / sizeof(lineColors[0]);
+
+const std::vector<GraphRenderer::Graph>&
+GraphRenderer::graphs()
+{
+    static const std::vector<Graph> GRAPHS = {
+	{ "aussentemp", "Aussentemperatur", "Temperatur (°C)", {
+	    { "outdoor/currenttemperature", "Außentemperatur", false },
+	    { "outdoor/dampedtemperature", "Ged. Außentemperatur", false }
+	} },
+	{ "raumtemp", "Raumtemperatur", "Temperatur (°C)", {
+	    { "hk1/roomtargettemperature", "Raum-Soll", true },
+	    { "hk1/roomcurrenttemperature", "Raum-Ist", false }
+	} },
+	{ "kessel", "Temperaturen", "Temperatur (°C)", {
+	    { "heater/targettemperature", "Kessel-Soll", true },
+	    { "heater/currenttemperature", "Kessel-Ist", false },
+	    { "hk1/currenttemperature", "Vorlauf HK1", false },
+	    { "hk2/currenttemperature", "Vorlauf HK2", false },
+	    { "returnflow/currenttemperature", "Rücklauf", false }
+	} },
+	{ "ww", "Warmwasser", "Temperatur (°C)", {
+	    { "ww/targettemperature", "Solltemperatur", true },
+	    { "ww/currenttemperature", "Isttemperatur", false }
+	} }
+    };
+    return GRAPHS;
+}
+
+const std::vector<GraphRenderer::Span>&
+GraphRenderer::spans()
+{
+    static const std::vector<Span> SPANS = {
+	{ "day", 86400, 3 * 3600, "%H:%M" },
+	{ "halfweek", 3 * 86400, 12 * 3600, "%H:%M (%a)" },
+	{ "week", 7 * 86400, 86400, "%a, %Hh" },
+	{ "month", 31 * 86400, 3 * 86400, "%d.%m" }
+    };
+    return SPANS;
+}
+
+std::vector<std::string>
+GraphRenderer::graphNames() const
+{
+    std::vector<std::string> names;
+
+    for (auto& graph : graphs()) {
+	names.push_back(graph.name);
+    }
+    return names;
+}
+
+bool
+GraphRenderer::render(const std::string& graphName, const std::string& spanName, std::string& svg)
+{
+    auto graph = std::find_if(graphs().begin(), graphs().end(), [&] (const Graph& g) {
+	return graphName == g.name;
+    });
+    auto span = std::find_if(spans().begin(), spans().end(), [&] (const Span& s) {
+	return spanName == s.name;
+    });
+
+    if (graph == graphs().end() || span == spans().end()) {
+	return false;
+    }
+
+    /*
+     * The time axis moves by a pixel every pixelTime, whether there's new
+     * data or not, and new data appearing in less time isn't worth redrawing
+     */
+    time_t now = time(NULL);
+    time_t pixelTime = span->length / (PlotRight - PlotLeft);
+    CacheEntry& entry = m_cache[std::make_pair(graphName, spanName)];
+
+    if (entry.svg.empty() || now < entry.renderTime || now - entry.renderTime >= pixelTime) {
+	std::ostringstream out;
+	draw(*graph, *span, now, out);
+	entry.svg = out.str();
+	entry.renderTime = now;
+    }
+
+    svg = entry.svg;
+    return true;
+}
+
+static double
+tickStep(double range)
+{
+    /* 1, 2 or 5 times a power of ten, for about 6 ticks */
+    double raw = range / 6;
+    double magnitude = pow(10, floor(log10(raw)));
+    double normalized = raw / magnitude;
+
+    if (normalized < 1.5) {
+	return magnitude;
+    } else if (normalized < 3.5) {
+	return 2 * magnitude;
+    } else if (normalized < 7.5) {
+	return 5 * magnitude;
+    }
+    return 10 * magnitude;
+}
+
+void
+GraphRenderer::draw(const Graph& graph, const Span& span, time_t now, std::ostream& out) const
+{
+    time_t start = now - span.length;
+    std::vector<std::vector<SeriesHistory::Point> > data(graph.lines.size());
+    float minValue = HUGE_VALF, maxValue = -HUGE_VALF;
+
+    for (size_t i = 0; i < graph.lines.size(); i++) {
+	m_history.fetch(graph.lines[i].key, start, now, PlotRight - PlotLeft, data[i]);
+	for (auto& point : data[i]) {
+	    minValue = std::min(minValue, point.value);
+	    maxValue = std::max(maxValue, point.value);
+	}
+    }
+    if (minValue > maxValue) {
+	minValue = 0;
+	maxValue = 1;
+    }
+
+    double step = tickStep(std::max(maxValue - minValue, 1.0f));
+    double low = floor(minValue / step) * step, high = ceil(maxValue / step) * step;
+    if (high <= low) {
+	high = low + step;
+    }
+
+    auto x = [&] (time_t time) {
+	return PlotLeft + (double) (time - start) * (PlotRight - PlotLeft) / span.length;
+    };
+    auto y = [&] (double value) {
+	return PlotBottom - (value - low) * (PlotBottom - PlotTop) / (high - low);
+    };
+
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	<< "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << Width
+	<< "\" height=\"" << Height << "\" font-family=\"arial\" font-size=\"12\">\n"
+	<< "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n"
+	<< "<text x=\"" << (PlotLeft + PlotRight) / 2 << "\" y=\"24\" text-anchor=\"middle\""
+	<< " font-size=\"14\">" << graph.title << "</text>\n"
+	<< "<text transform=\"translate(16 " << (PlotTop + PlotBottom) / 2 << ") rotate(-90)\""
+	<< " text-anchor=\"middle\">" << graph.unit << "</text>\n"
+	<< "<text x=\"" << (PlotLeft + PlotRight) / 2 << "\" y=\"" << Height - 8
+	<< "\" text-anchor=\"middle\">Datum</text>\n"
+	<< "<g stroke=\"#aaaaaa\" stroke-width=\"0.5\">\n";
+
+    /* horizontal grid */
+    for (double value = low; value <= high + step / 2; value += step) {
+	out << boost::format("<line x1=\"%d\" y1=\"%.1f\" x2=\"%d\" y2=\"%.1f\"/>"
+			     "<text x=\"%d\" y=\"%.1f\" text-anchor=\"end\" stroke=\"none\">%g</text>\n")
+		% PlotLeft % y(value) % PlotRight % y(value)
+		% (PlotLeft - 6) % (y(value) + 4) % value;
+    }
+
+    /* vertical grid, aligned to local time */
+    struct tm local = *localtime(&start);
+    time_t tick = start - local.tm_min * 60 - local.tm_sec - (local.tm_hour * 3600) % span.tickInterval;
+    for (; tick <= now; tick += span.tickInterval) {
+	if (tick < start) {
+	    continue;
+	}
+	char label[32];
+	local = *localtime(&tick);
+	strftime(label, sizeof(label), span.tickFormat, &local);
+	out << boost::format("<line x1=\"%.1f\" y1=\"%d\" x2=\"%.1f\" y2=\"%d\"/>"
+			     "<text transform=\"translate(%.1f %d) rotate(45)\" stroke=\"none\">%s</text>\n")
+		% x(tick) % PlotTop % x(tick) % PlotBottom % x(tick) % (PlotBottom + 14) % label;
+    }
+    out << "</g>\n"
+	<< "<rect x=\"" << PlotLeft << "\" y=\"" << PlotTop << "\" width=\"" << PlotRight - PlotLeft
+	<< "\" height=\"" << PlotBottom - PlotTop << "\" fill=\"none\" stroke=\"black\"/>\n";
+
+    for (size_t i = 0; i < graph.lines.size(); i++) {
+	const char *color = lineColors[i % lineColorCount];
+
+	out << "<polyline fill=\"none\" stroke-width=\"2\" stroke=\"" << color << "\" points=\"";
+	for (size_t j = 0; j < data[i].size(); j++) {
+	    const SeriesHistory::Point& point = data[i][j];
+	    if (graph.lines[i].steps && j > 0) {
+		out << boost::format("%.1f,%.1f ") % x(point.time) % y(data[i][j - 1].value);
+	    }
+	    out << boost::format("%.1f,%.1f ") % x(point.time) % y(point.value);
+	}
+	out << "\"/>\n";
+
+	int legendY = PlotTop + 16 + 16 * i;
+	out << boost::format("<text x=\"%d\" y=\"%d\" text-anchor=\"end\">%s</text>"
+			     "<line x1=\"%d\" y1=\"%d\" x2=\"%d\" y2=\"%d\" stroke=\"%s\" stroke-width=\"2\"/>\n")
+		% (PlotRight - 40) % (legendY + 4) % graph.lines[i].label
+		% (PlotRight - 34) % legendY % (PlotRight - 8) % legendY % color;
+    }
+
+    out << "</svg>";
+}
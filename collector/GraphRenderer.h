@@ -0,0 +1,80 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GRAPHRENDERER_H__
+#define __GRAPHRENDERER_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Noncopyable.h"
+#include "SeriesHistory.h"
+
+/*
+ * Renders the graphs known from tools/ems-gen-graphs.py as SVG on demand.
+ * Rendered graphs are cached until their time axis moved by a pixel.
+ */
+class GraphRenderer : private boost::noncopyable
+{
+    public:
+	GraphRenderer(const SeriesHistory& history) :
+	    m_history(history)
+	{ }
+
+	/* returns false for unknown graph names or spans */
+	bool render(const std::string& graph, const std::string& span, std::string& svg);
+	std::vector<std::string> graphNames() const;
+
+    private:
+	struct Line {
+	    const char *key;
+	    const char *label;
+	    /* set points are drawn as steps */
+	    bool steps;
+	};
+	struct Graph {
+	    const char *name;
+	    const char *title;
+	    const char *unit;
+	    std::vector<Line> lines;
+	};
+	struct Span {
+	    const char *name;
+	    time_t length;
+	    time_t tickInterval;
+	    const char *tickFormat;
+	};
+	struct CacheEntry {
+	    time_t renderTime;
+	    std::string svg;
+	};
+
+	static const std::vector<Graph>& graphs();
+	static const std::vector<Span>& spans();
+	void draw(const Graph& graph, const Span& span, time_t now, std::ostream& out) const;
+
+    private:
+	static const unsigned int Width = 800;
+	static const unsigned int Height = 450;
+
+	const SeriesHistory& m_history;
+	std::map<std::pair<std::string, std::string>, CacheEntry> m_cache;
+};
+
+#endif /* __GRAPHRENDERER_H__ */
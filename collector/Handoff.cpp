@@ -0,0 +1,481 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <boost/bind.hpp>
+#include "EmsMessage.h"
+#include "Handoff.h"
+
+void
+FrameSnapshot::handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp)
+{
+    if (data.size() < 4) {
+	return;
+    }
+
+    /* source, destination, type and offset */
+    uint32_t key = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+    Entry& entry = m_frames[key];
+
+    entry.order = m_count++;
+    entry.frame.timestamp = timestamp.realtime;
+    entry.frame.data = data;
+}
+
+std::vector<CaptureFile::Frame>
+FrameSnapshot::frames() const
+{
+    std::map<uint64_t, const CaptureFile::Frame *> ordered;
+    std::vector<CaptureFile::Frame> frames;
+
+    for (auto& item : m_frames) {
+	ordered[item.second.order] = &item.second.frame;
+    }
+    for (auto& item : ordered) {
+	frames.push_back(*item.second);
+    }
+
+    return frames;
+}
+
+void
+FrameSnapshot::restore(const std::vector<CaptureFile::Frame>& frames, ValueCache& cache)
+{
+    EmsMessage::ValueHandler valueCb = boost::bind(&ValueCache::handleValue, &cache, _1);
+    EmsMessage::CacheAccessor cacheCb = boost::bind(&ValueCache::getValue, &cache, _1, _2);
+
+    for (auto& frame : frames) {
+	EmsMessage message(valueCb, cacheCb, frame.data, Timestamp::fromRealtime(frame.timestamp));
+	message.handle();
+    }
+}
+
+std::string Handoff::s_executable;
+std::string Handoff::s_directory;
+std::vector<std::string> Handoff::s_arguments;
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+static const char *HandoffVariable = "EMSCOLLECTOR_HANDOFF_FD";
+static const size_t MaxDescriptors = 16;
+
+static void
+put(std::vector<uint8_t>& buffer, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) {
+	buffer.push_back((value >> (8 * i)) & 0xff);
+    }
+}
+
+static bool
+get(const std::vector<uint8_t>& buffer, size_t& pos, uint64_t& value, size_t bytes)
+{
+    if (pos + bytes > buffer.size()) {
+	return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+	value |= ((uint64_t) buffer[pos++]) << (8 * i);
+    }
+    return true;
+}
+
+static bool
+decodeState(const std::vector<uint8_t>& payload, const std::vector<int>& fds,
+	    Handoff::State& state)
+{
+    size_t pos = 0;
+    uint64_t hasTransport, listeners, inputLength, frameCount;
+
+    if (!get(payload, pos, hasTransport, 1) || !get(payload, pos, listeners, 1) ||
+	    hasTransport + listeners != fds.size()) {
+	return false;
+    }
+    state.transport = hasTransport ? fds[0] : -1;
+    state.listeners.assign(fds.begin() + hasTransport, fds.end());
+
+    if (!get(payload, pos, inputLength, 2) || pos + inputLength > payload.size()) {
+	return false;
+    }
+    state.input.assign(payload.begin() + pos, payload.begin() + pos + inputLength);
+    pos += inputLength;
+
+    if (!get(payload, pos, frameCount, 4)) {
+	return false;
+    }
+    for (size_t i = 0; i < frameCount; i++) {
+	CaptureFile::Frame frame;
+	uint64_t length;
+
+	if (!get(payload, pos, frame.timestamp, 8) || !get(payload, pos, length, 1) ||
+		pos + length > payload.size()) {
+	    return false;
+	}
+	frame.data.assign(payload.begin() + pos, payload.begin() + pos + length);
+	pos += length;
+	state.frames.push_back(frame);
+    }
+
+    return pos == payload.size();
+}
+
+static std::vector<int>
+openDescriptors()
+{
+    std::vector<int> fds;
+    DIR *dir = opendir("/proc/self/fd");
+
+    if (dir) {
+	while (struct dirent *entry = readdir(dir)) {
+	    if (entry->d_name[0] != '.') {
+		fds.push_back(atoi(entry->d_name));
+	    }
+	}
+	closedir(dir);
+    }
+
+    return fds;
+}
+
+Handoff::Handoff(boost::asio::io_service& ios, const ReadyCallback& readyCb) :
+    m_socket(ios),
+    m_readyCb(readyCb),
+    m_pid(0)
+{
+}
+
+Handoff::~Handoff()
+{
+    if (m_pid > 0) {
+	/* the bus connection was lost while the new process was starting */
+	kill(m_pid, SIGTERM);
+	reap();
+    }
+}
+
+void
+Handoff::init(int argc, char *argv[])
+{
+    char buffer[4096];
+    ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+
+    /* an upgrade replaces the binary, but keeps its path */
+    s_executable = length > 0 ? std::string(buffer, length) : argv[0];
+    if (getcwd(buffer, sizeof(buffer))) {
+	s_directory = buffer;
+    }
+    s_arguments.assign(argv, argv + argc);
+}
+
+bool
+Handoff::start()
+{
+    int fds[2];
+
+    if (m_pid > 0) {
+	std::cerr << "Handoff is already in progress" << std::endl;
+	return false;
+    }
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+	std::cerr << "Could not create handoff socket: " << strerror(errno) << std::endl;
+	return false;
+    }
+
+    /* the child may not allocate memory before exec, so prepare everything */
+    std::vector<int> inherited = openDescriptors();
+    std::ostringstream variable;
+    std::vector<char *> arguments, environment;
+
+    variable << HandoffVariable << "=" << fds[1];
+    std::string variableText = variable.str();
+    for (auto& argument : s_arguments) {
+	arguments.push_back(const_cast<char *>(argument.c_str()));
+    }
+    arguments.push_back(nullptr);
+    for (char **entry = environ; *entry; entry++) {
+	if (strncmp(*entry, HandoffVariable, strlen(HandoffVariable)) != 0) {
+	    environment.push_back(*entry);
+	}
+    }
+    environment.push_back(const_cast<char *>(variableText.c_str()));
+    environment.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+	std::cerr << "Could not start new process: " << strerror(errno) << std::endl;
+	close(fds[0]);
+	close(fds[1]);
+	return false;
+    } else if (pid == 0) {
+	sigset_t signals;
+
+	/* clients must see their connection close when the old process exits */
+	for (int fd : inherited) {
+	    if (fd > 2 && fd != fds[1]) {
+		close(fd);
+	    }
+	}
+	sigemptyset(&signals);
+	sigprocmask(SIG_SETMASK, &signals, nullptr);
+	if (!s_directory.empty() && chdir(s_directory.c_str()) != 0) {
+	    _exit(127);
+	}
+	execve(s_executable.c_str(), &arguments[0], &environment[0]);
+	_exit(127);
+    }
+
+    close(fds[1]);
+    m_pid = pid;
+    m_socket.assign(boost::asio::local::stream_protocol(), fds[0]);
+    boost::asio::async_read(m_socket, boost::asio::buffer(&m_ready, 1),
+	    boost::bind(&Handoff::handleReady, this, boost::asio::placeholders::error));
+
+    return true;
+}
+
+void
+Handoff::handleReady(const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted) {
+	return;
+    } else if (error) {
+	std::cerr << "New process exited before taking over" << std::endl;
+	reap();
+	return;
+    }
+
+    m_readyCb();
+}
+
+void
+Handoff::reap()
+{
+    boost::system::error_code error;
+
+    m_socket.close(error);
+    waitpid(m_pid, nullptr, 0);
+    m_pid = 0;
+}
+
+bool
+Handoff::send(const State& state)
+{
+    std::vector<uint8_t> payload;
+    std::vector<int> fds;
+
+    if (state.transport >= 0) {
+	fds.push_back(state.transport);
+    }
+    fds.insert(fds.end(), state.listeners.begin(), state.listeners.end());
+
+    put(payload, 0, 4);
+    put(payload, state.transport >= 0 ? 1 : 0, 1);
+    put(payload, state.listeners.size(), 1);
+    put(payload, state.input.size(), 2);
+    payload.insert(payload.end(), state.input.begin(), state.input.end());
+    put(payload, state.frames.size(), 4);
+    for (auto& frame : state.frames) {
+	put(payload, frame.timestamp, 8);
+	put(payload, frame.data.size(), 1);
+	payload.insert(payload.end(), frame.data.begin(), frame.data.end());
+    }
+    uint32_t length = payload.size() - 4;
+    for (size_t i = 0; i < 4; i++) {
+	payload[i] = (length >> (8 * i)) & 0xff;
+    }
+
+    /* the descriptors travel with the first byte */
+    char control[CMSG_SPACE(sizeof(int) * MaxDescriptors)];
+    struct iovec iov = { &payload[0], payload.size() };
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    if (!fds.empty()) {
+	message.msg_control = control;
+	message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+	struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+	memcpy(CMSG_DATA(header), &fds[0], sizeof(int) * fds.size());
+    }
+
+    int fd = m_socket.native_handle();
+    size_t sent = 0;
+    m_socket.native_non_blocking(false);
+    while (sent < payload.size()) {
+	ssize_t result = sent == 0 ? sendmsg(fd, &message, MSG_NOSIGNAL)
+		: ::send(fd, &payload[sent], payload.size() - sent, MSG_NOSIGNAL);
+	if (result < 0 && errno == EINTR) {
+	    continue;
+	} else if (result < 0) {
+	    std::cerr << "Could not hand over to new process: " << strerror(errno) << std::endl;
+	    reap();
+	    return false;
+	}
+	sent += result;
+    }
+
+    /* the new process lives on, so it's not waited for */
+    boost::system::error_code error;
+    m_socket.close(error);
+    m_pid = 0;
+
+    return true;
+}
+
+bool
+Handoff::pending()
+{
+    return getenv(HandoffVariable) != nullptr;
+}
+
+bool
+Handoff::receive(State& state)
+{
+    int fd = atoi(getenv(HandoffVariable));
+    uint8_t ready = 1;
+    uint8_t header[4];
+    char control[CMSG_SPACE(sizeof(int) * MaxDescriptors)];
+    struct iovec iov = { header, sizeof(header) };
+    struct msghdr message;
+    std::vector<int> fds;
+
+    unsetenv(HandoffVariable);
+    if (write(fd, &ready, 1) != 1) {
+	std::cerr << "Could not contact previous process: " << strerror(errno) << std::endl;
+	close(fd);
+	return false;
+    }
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t result;
+    do {
+	result = recvmsg(fd, &message, MSG_WAITALL);
+    } while (result < 0 && errno == EINTR);
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); result > 0 && cmsg;
+	    cmsg = CMSG_NXTHDR(&message, cmsg)) {
+	if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+	    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+	    fds.resize(count);
+	    memcpy(&fds[0], CMSG_DATA(cmsg), count * sizeof(int));
+	}
+    }
+
+    uint32_t length = 0;
+    for (size_t i = 0; i < 4; i++) {
+	length |= ((uint32_t) header[i]) << (8 * i);
+    }
+
+    std::vector<uint8_t> payload(length);
+    size_t received = 0;
+    while (result == sizeof(header) && received < length) {
+	ssize_t count = recv(fd, &payload[received], length - received, MSG_WAITALL);
+	if (count < 0 && errno == EINTR) {
+	    continue;
+	} else if (count <= 0) {
+	    break;
+	}
+	received += count;
+    }
+    close(fd);
+
+    if (result != sizeof(header) || received != length || !decodeState(payload, fds, state)) {
+	std::cerr << "Previous process did not hand over its state" << std::endl;
+	for (int descriptor : fds) {
+	    close(descriptor);
+	}
+	return false;
+    }
+
+    return true;
+}
+
+#else /* BOOST_ASIO_HAS_LOCAL_SOCKETS */
+
+Handoff::Handoff(boost::asio::io_service& /* ios */, const ReadyCallback& readyCb) :
+    m_readyCb(readyCb),
+    m_pid(0)
+{
+}
+
+Handoff::~Handoff()
+{
+}
+
+void
+Handoff::init(int /* argc */, char * /* argv */[])
+{
+}
+
+bool
+Handoff::start()
+{
+    std::cerr << "Handing over to a new process is not supported on this platform" << std::endl;
+    return false;
+}
+
+bool
+Handoff::send(const State& /* state */)
+{
+    return false;
+}
+
+bool
+Handoff::pending()
+{
+    return false;
+}
+
+bool
+Handoff::receive(State& /* state */)
+{
+    return false;
+}
+
+void
+Handoff::handleReady(const boost::system::error_code& /* error */)
+{
+}
+
+void
+Handoff::reap()
+{
+}
+
+#endif /* !BOOST_ASIO_HAS_LOCAL_SOCKETS */
@@ -0,0 +1,118 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HANDOFF_H__
+#define __HANDOFF_H__
+
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "CaptureFile.h"
+#include "Noncopyable.h"
+#include "Timestamp.h"
+#include "ValueCache.h"
+
+/*
+ * Keeps the latest frame of every message, so a new process can fill its
+ * value cache without waiting for the bus to repeat everything.
+ */
+class FrameSnapshot : private boost::noncopyable
+{
+    public:
+	FrameSnapshot() :
+	    m_count(0)
+	{ }
+
+	void handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp);
+	/* the frames in the order they were received */
+	std::vector<CaptureFile::Frame> frames() const;
+
+	static void restore(const std::vector<CaptureFile::Frame>& frames, ValueCache& cache);
+
+    private:
+	struct Entry {
+	    uint64_t order;
+	    CaptureFile::Frame frame;
+	};
+
+	std::map<uint32_t, Entry> m_frames;
+	uint64_t m_count;
+};
+
+/*
+ * Hands the running collector over to a newly started instance of its
+ * binary, so it can be upgraded without interrupting the bus connection.
+ * The new process is started with one end of a socket pair and performs
+ * its own setup while the old one keeps collecting. Once it reports being
+ * ready, the old process stops reading at a frame boundary and passes the
+ * bus connection and the listening sockets, which keeps queued clients
+ * connecting, along with the input it read past that frame. Afterwards it
+ * lets its clients receive what was queued for them and exits.
+ */
+class Handoff : private boost::noncopyable
+{
+    public:
+	struct State {
+	    State() :
+		transport(-1)
+	    { }
+
+	    int transport;
+	    std::vector<int> listeners;
+	    /* read after the last complete frame */
+	    std::vector<uint8_t> input;
+	    std::vector<CaptureFile::Frame> frames;
+	};
+
+	typedef std::function<void ()> ReadyCallback;
+
+    public:
+	Handoff(boost::asio::io_service& ios, const ReadyCallback& readyCb);
+	~Handoff();
+
+	/* starts the new process, which reports back once it's set up */
+	bool start();
+	bool send(const State& state);
+
+	/* remembers how this process was started, for starting the next one */
+	static void init(int argc, char *argv[]);
+	/* whether this process was started to take over from another one */
+	static bool pending();
+	/* reports being ready to the previous process and waits for its state */
+	static bool receive(State& state);
+
+    private:
+	void handleReady(const boost::system::error_code& error);
+	void reap();
+
+    private:
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	boost::asio::local::stream_protocol::socket m_socket;
+#endif
+	ReadyCallback m_readyCb;
+	int m_pid;
+	uint8_t m_ready;
+
+	static std::string s_executable;
+	static std::string s_directory;
+	static std::vector<std::string> s_arguments;
+};
+
+#endif /* __HANDOFF_H__ */
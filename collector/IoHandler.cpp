@@ -23,13 +23,16 @@
 #include <boost/format.hpp>
 #include "ByteOrder.h"
 #include "IoHandler.h"
+#include "NameTable.h"
 #include "Options.h"
+#include "ValueApi.h"
 
 IoHandler::IoHandler(ValueCache& cache) :
     boost::asio::io_service(),
     m_active(true),
     m_state(Syncing),
-    m_pos(0)
+    m_pos(0),
+    m_pauseForced(false)
 {
     /* pre-alloc buffer to avoid reallocations */
     m_data.reserve(256);
@@ -47,19 +50,16 @@ IoHandler::readComplete(const boost::system::error_code& error,
     size_t pos = 0;
     DebugStream& debug = Options::ioDebug();
 
-    if (error) {
+    if (error == boost::asio::error::operation_aborted && m_pauseCb) {
+	finishPause(std::vector<uint8_t>());
+	return;
+    } else if (error) {
 	doClose(error);
 	return;
     }
 
     if (debug) {
-	debug << "IO: Got bytes ";
-	for (size_t i = 0; i < bytesTransferred; i++) {
-	    debug << std::setfill('0') << std::setw(2)
-		  << std::showbase << std::hex
-		  << (unsigned int) m_recvBuffer[i] << " ";
-	}
-	debug << std::endl;
+	debug.logBytes(false, m_recvBuffer, bytesTransferred);
     }
 
     while (pos < bytesTransferred) {
@@ -92,22 +92,83 @@ IoHandler::readComplete(const boost::system::error_code& error,
 		break;
 	    case Checksum:
 		if (m_checkSum == dataByte) {
-		    EmsMessage message(m_valueCb, m_cacheCb, m_data);
-		    message.handle();
-		    if (message.getDestination() == EmsProto::addressPC) {
-			onPcMessageReceived(message);
-		    }
+		    handleFrame(m_data, Timestamp::now());
 		}
 		m_data.clear();
 		m_state = Syncing;
 		m_pos = 0;
+		if (m_pauseCb) {
+		    finishPause(std::vector<uint8_t>(m_recvBuffer + pos,
+						     m_recvBuffer + bytesTransferred));
+		    return;
+		}
 		break;
 	}
     }
 
+    if (m_pauseCb && (m_pauseForced || (m_state == Syncing && m_pos == 0))) {
+	finishPause(std::vector<uint8_t>());
+	return;
+    }
+
     readStart();
 }
 
+void
+IoHandler::pauseInput(const InputCallback& cb)
+{
+    m_pauseCb = cb;
+    if (m_state == Syncing && m_pos == 0) {
+	/* between frames, nothing is lost by aborting the read */
+	cancelRead();
+    }
+}
+
+void
+IoHandler::forcePause()
+{
+    if (m_pauseCb) {
+	m_pauseForced = true;
+	cancelRead();
+    }
+}
+
+void
+IoHandler::finishPause(const std::vector<uint8_t>& input)
+{
+    InputCallback cb = m_pauseCb;
+
+    m_pauseCb = nullptr;
+    m_pauseForced = false;
+    m_data.clear();
+    m_state = Syncing;
+    m_pos = 0;
+    cb(input);
+}
+
+void
+IoHandler::resumeInput(const std::vector<uint8_t>& input)
+{
+    size_t length = std::min(input.size(), sizeof(m_recvBuffer));
+
+    std::copy(input.begin(), input.begin() + length, m_recvBuffer);
+    readComplete(boost::system::error_code(), length);
+}
+
+void
+IoHandler::handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp)
+{
+    for (auto& cb : m_frameCallbacks) {
+	cb(data, timestamp);
+    }
+
+    EmsMessage message(m_valueCb, m_cacheCb, data, timestamp);
+    message.handle();
+    if (message.getDestination() == EmsProto::addressPC) {
+	onPcMessageReceived(message);
+    }
+}
+
 void
 IoHandler::doClose(const boost::system::error_code& error)
 {
@@ -120,10 +181,11 @@ IoHandler::doClose(const boost::system::error_code& error)
     stop();
 }
 
+#ifndef NO_DESCRIPTIVE_DEBUG
 static void
 printDescriptive(std::ostream& stream, const EmsValue& value)
 {
-    static const std::map<EmsValue::Type, const char *> TYPEMAPPING = {
+    static constexpr NameTable::Entry<EmsValue::Type> TYPEMAPPING[] = {
 	{ EmsValue::SollTemp, "Solltemperatur" },
 	{ EmsValue::IstTemp, "Isttemperatur" },
 	{ EmsValue::SetTemp, "Temperatureinstellung" },
@@ -136,43 +198,51 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	{ EmsValue::RaumIstTemp, "Raum-Isttemperatur" },
 	{ EmsValue::RaumEinfluss, "Max. Raumeinfluss" },
 	{ EmsValue::RaumOffset, "Raumoffset" },
-	{ EmsValue::SchwelleSommerWinter, "Schwelle Sommer/Winter" },
-	{ EmsValue::FrostSchutzTemp, "Frostschutztemperatur" },
-	{ EmsValue::AuslegungsTemp, "Auslegungstemperatur" },
-	{ EmsValue::RaumUebersteuerTemp, "Temporäre Raumtemperaturübersteuerung" },
-	{ EmsValue::AbsenkungsSchwellenTemp, "Schwellentemperatur Außenhaltbetrieb" },
-	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "Schwellentemperatur Außenhaltbetrieb Urlaub" },
-	{ EmsValue::AbsenkungsAbbruchTemp, "Nachtabsenkung abbrechen unterhalb" },
 	{ EmsValue::GedaempfteTemp, "Temperatur (gedämpft)" },
 	{ EmsValue::DesinfektionsTemp, "Desinfektionstemperatur" },
 	{ EmsValue::RaumTemperaturAenderung, "Raumtemperaturänderung" },
 	{ EmsValue::Mischersteuerung, "Mischersteuerung" },
 	{ EmsValue::Flammenstrom, "Flammenstrom" },
 	{ EmsValue::Systemdruck, "Systemdruck" },
-	{ EmsValue::BetriebsZeit, "Betriebszeit" },
-	{ EmsValue::BetriebsZeit, "Betriebszeit 2" },
-	{ EmsValue::SollModulation, "Sollwert Modulation" },
 	{ EmsValue::IstModulation, "Istwert Modulation" },
 	{ EmsValue::MinModulation, "Min. Modulation" },
 	{ EmsValue::MaxModulation, "Max. Modulation" },
+	{ EmsValue::SollModulation, "Sollwert Modulation" },
+	{ EmsValue::SollLeistung, "Angeforderte Leistung" },
 	{ EmsValue::EinschaltHysterese, "Einschalthysterese" },
 	{ EmsValue::AusschaltHysterese, "Abschalthysterese" },
+	{ EmsValue::SchwelleSommerWinter, "Schwelle Sommer/Winter" },
+	{ EmsValue::FrostSchutzTemp, "Frostschutztemperatur" },
+	{ EmsValue::AuslegungsTemp, "Auslegungstemperatur" },
+	{ EmsValue::RaumUebersteuerTemp, "Temporäre Raumtemperaturübersteuerung" },
+	{ EmsValue::AbsenkungsSchwellenTemp, "Schwellentemperatur Außenhaltbetrieb" },
+	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "Schwellentemperatur Außenhaltbetrieb Urlaub" },
+	{ EmsValue::AbsenkungsAbbruchTemp, "Nachtabsenkung abbrechen unterhalb" },
 	{ EmsValue::DurchflussMenge, "Durchflussmenge" },
-	{ EmsValue::SollLeistung, "Angeforderte Leistung" },
-
+	{ EmsValue::BrennerZyklusDauer, "Dauer letzter Zyklus" },
+	{ EmsValue::BrennerPausenDauer, "Dauer letzte Pause" },
+	{ EmsValue::BrennerTastgrad, "Tastgrad letzte Stunde" },
+	{ EmsValue::MittlereModulation, "Mittlere Modulation letzter Zyklus" },
+	{ EmsValue::EnergieStunde, "Energie aktuelle Stunde" },
+	{ EmsValue::EnergieTag, "Energie heute" },
+	{ EmsValue::EnergieGesamt, "Energie gesamt" },
+	{ EmsValue::BrennstoffTag, "Brennstoff heute" },
+	{ EmsValue::BrennstoffGesamt, "Brennstoff gesamt" },
+	{ EmsValue::BetriebsZeit, "Betriebszeit" },
+	{ EmsValue::BetriebsZeit2, "Betriebszeit 2" },
 	{ EmsValue::HeizZeit, "Heizzeit" },
 	{ EmsValue::WarmwasserbereitungsZeit, "WW-Bereitungszeit" },
 	{ EmsValue::Brennerstarts, "Brennerstarts" },
 	{ EmsValue::WarmwasserBereitungen, "WW-Bereitungen " },
+	{ EmsValue::DesinfektionStunde, "Thermische Desinfektion Stunde" },
+	{ EmsValue::HektoStundenVorWartung, "Wartungsintervall in 100h" },
 	{ EmsValue::EinschaltoptimierungsZeit, "Einschaltoptimierungszeit" },
 	{ EmsValue::AusschaltoptimierungsZeit, "Abschaltoptimierungszeit" },
 	{ EmsValue::AntipendelZeit, "Antipendelzeit" },
 	{ EmsValue::NachlaufZeit, "Nachlaufzeit" },
-	{ EmsValue::DesinfektionStunde, "Thermische Desinfektion Stunde" },
-	{ EmsValue::HektoStundenVorWartung, "Wartungsintervall in 100h" },
-	{ EmsValue::PausenZeit, "restl. Pausenzeit" },
 	{ EmsValue::PartyZeit, "restl. Partyzeit" },
-
+	{ EmsValue::PausenZeit, "restl. Pausenzeit" },
+	{ EmsValue::BrennerStartsProStunde, "Starts letzte Stunde" },
 	{ EmsValue::FlammeAktiv, "Flamme" },
 	{ EmsValue::BrennerAktiv, "Brenner" },
 	{ EmsValue::ZuendungAktiv, "Zündung" },
@@ -198,8 +268,8 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	{ EmsValue::SchaltuhrEin, "Schaltuhr aktiv" },
 	{ EmsValue::KesselSchalter, "per Kesselschalter freigegeben" },
 	{ EmsValue::EigenesProgrammAktiv, "Eigenes Programm aktiv" },
-	{ EmsValue::EinmalLadungsLED, "Einmalladungs-LED" },
 	{ EmsValue::Desinfektion, "Thermische Desinfektion" },
+	{ EmsValue::EinmalLadungsLED, "Einmalladungs-LED" },
 	{ EmsValue::ATDaempfung, "Dämpfung Außentemperatur" },
 	{ EmsValue::SchaltzeitOptimierung, "Schaltzeitoptimierung" },
 	{ EmsValue::Fuehler1Defekt, "Fühler 1 defekt" },
@@ -207,36 +277,37 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	{ EmsValue::Stoerung, "Störung" },
 	{ EmsValue::StoerungDesinfektion, "Störung Desinfektion" },
 	{ EmsValue::Ladevorgang, "Ladevorgang" },
-
+	{ EmsValue::Taktalarm, "Taktalarm" },
 	{ EmsValue::WWSystemType, "WW-System-Typ" },
-	{ EmsValue::Betriebsart, "Betriebsart" },
+	{ EmsValue::Schaltpunkte, "Schaltpunkte" },
 	{ EmsValue::Wartungsmeldungen, "Wartungsmeldungen" },
 	{ EmsValue::WartungFaellig, "Wartung fällig?" },
+	{ EmsValue::Betriebsart, "Betriebsart" },
 	{ EmsValue::DesinfektionTag, "Thermische Desinfektion Tag" },
-	{ EmsValue::Schaltpunkte, "Schaltpunkte" },
 	{ EmsValue::GebaeudeArt, "Gebäudeart" },
 	{ EmsValue::AbsenkModus, "Absenk-Modus" },
 	{ EmsValue::HeizSystem, "Heizsystem" },
 	{ EmsValue::FuehrungsGroesse, "Führungsgröße" },
-	{ EmsValue::Frostschutz, "Frostschutz" },
 	{ EmsValue::UrlaubAbsenkungsArt, "Urlaubsabsenkungsart" },
+	{ EmsValue::Frostschutz, "Frostschutz" },
 	{ EmsValue::FBTyp, "Fernbedienungstyp" },
-
 	{ EmsValue::HKKennlinie, "Kennlinie" },
 	{ EmsValue::Fehler, "Fehler" },
 	{ EmsValue::SystemZeit, "Systemzeit" },
 	{ EmsValue::Wartungstermin, "Wartungstermin" },
-
 	{ EmsValue::ServiceCode, "Servicecode" },
-	{ EmsValue::FehlerCode, "Fehlercode" }
+	{ EmsValue::FehlerCode, "Fehlercode" },
+	{ EmsValue::Anomalie, "Anomalie" },
+	{ EmsValue::FehlerEreignis, "Fehlerereignis" }
     };
-    static const std::map<EmsValue::SubType, const char *> SUBTYPEMAPPING = {
+    static_assert(NameTable::isSorted(TYPEMAPPING), "TYPEMAPPING must be sorted");
+    static constexpr NameTable::Entry<EmsValue::SubType> SUBTYPEMAPPING[] = {
 	{ EmsValue::HK1, "HK1" },
 	{ EmsValue::HK2, "HK2" },
 	{ EmsValue::HK3, "HK3" },
 	{ EmsValue::HK4, "HK4" },
-	{ EmsValue::Kessel, "Kessel" },
 	{ EmsValue::Brenner, "Brenner" },
+	{ EmsValue::Kessel, "Kessel" },
 	{ EmsValue::KesselPumpe, "Kesselpumpe" },
 	{ EmsValue::Ruecklauf, "Rücklauf" },
 	{ EmsValue::Waermetauscher, "Wärmetauscher" },
@@ -247,9 +318,11 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	{ EmsValue::Ansaugluft, "Ansaugluft" },
 	{ EmsValue::Solar, "Solar" },
 	{ EmsValue::SolarSpeicher, "Solarspeicher" },
-	{ EmsValue::SolarKollektor, "Solarkollektor" }
+	{ EmsValue::SolarKollektor, "Solarkollektor" },
+	{ EmsValue::Heizung, "Heizung" }
     };
-    static const std::map<EmsValue::Type, const char *> UNITMAPPING = {
+    static_assert(NameTable::isSorted(SUBTYPEMAPPING), "SUBTYPEMAPPING must be sorted");
+    static constexpr NameTable::Entry<EmsValue::Type> UNITMAPPING[] = {
 	{ EmsValue::SollTemp, "°C" },
 	{ EmsValue::IstTemp, "°C" },
 	{ EmsValue::SetTemp, "°C" },
@@ -262,6 +335,18 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	{ EmsValue::RaumIstTemp, "°C" },
 	{ EmsValue::RaumEinfluss, "K" },
 	{ EmsValue::RaumOffset, "K" },
+	{ EmsValue::GedaempfteTemp, "°C" },
+	{ EmsValue::DesinfektionsTemp, "°C" },
+	{ EmsValue::RaumTemperaturAenderung, "K/min" },
+	{ EmsValue::Flammenstrom, "µA" },
+	{ EmsValue::Systemdruck, "bar" },
+	{ EmsValue::IstModulation, "%" },
+	{ EmsValue::MinModulation, "%" },
+	{ EmsValue::MaxModulation, "%" },
+	{ EmsValue::SollModulation, "%" },
+	{ EmsValue::SollLeistung, "%" },
+	{ EmsValue::EinschaltHysterese, "K" },
+	{ EmsValue::AusschaltHysterese, "K" },
 	{ EmsValue::SchwelleSommerWinter, "°C" },
 	{ EmsValue::FrostSchutzTemp, "°C" },
 	{ EmsValue::AuslegungsTemp, "°C" },
@@ -269,111 +354,120 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	{ EmsValue::AbsenkungsSchwellenTemp, "°C" },
 	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "°C" },
 	{ EmsValue::AbsenkungsAbbruchTemp, "°C" },
-	{ EmsValue::GedaempfteTemp, "°C" },
-	{ EmsValue::DesinfektionsTemp, "°C" },
-	{ EmsValue::RaumTemperaturAenderung, "K/min" },
-	{ EmsValue::EinschaltHysterese, "K" },
-	{ EmsValue::AusschaltHysterese, "K" },
 	{ EmsValue::DurchflussMenge, "l/min" },
-	{ EmsValue::IstModulation, "%" },
-	{ EmsValue::SollModulation, "%" },
-	{ EmsValue::MinModulation, "%" },
-	{ EmsValue::MaxModulation, "%" },
-	{ EmsValue::SollLeistung, "%" },
-	{ EmsValue::Flammenstrom, "µA" },
-	{ EmsValue::Systemdruck, "bar" },
+	{ EmsValue::BrennerZyklusDauer, "min" },
+	{ EmsValue::BrennerPausenDauer, "min" },
+	{ EmsValue::BrennerTastgrad, "%" },
+	{ EmsValue::MittlereModulation, "%" },
+	{ EmsValue::EnergieStunde, "kWh" },
+	{ EmsValue::EnergieTag, "kWh" },
+	{ EmsValue::EnergieGesamt, "kWh" },
 	{ EmsValue::BetriebsZeit, "min" },
 	{ EmsValue::BetriebsZeit2, "min" },
 	{ EmsValue::HeizZeit, "min" },
 	{ EmsValue::WarmwasserbereitungsZeit, "min" },
+	{ EmsValue::DesinfektionStunde, "h" },
 	{ EmsValue::EinschaltoptimierungsZeit, "min" },
 	{ EmsValue::AusschaltoptimierungsZeit, "min" },
 	{ EmsValue::AntipendelZeit, "min" },
 	{ EmsValue::NachlaufZeit, "min" },
-	{ EmsValue::DesinfektionStunde, "h" },
-	{ EmsValue::PausenZeit, "h" },
-	{ EmsValue::PartyZeit, "h" }
+	{ EmsValue::PartyZeit, "h" },
+	{ EmsValue::PausenZeit, "h" }
     };
+    static_assert(NameTable::isSorted(UNITMAPPING), "UNITMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> WWSYSTEMMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> WWSYSTEMMAPPING[] = {
 	{ EmsProto::WWSystemNone, "keins" },
 	{ EmsProto::WWSystemDurchlauf, "Durchlauferhitzer" },
 	{ EmsProto::WWSystemKlein, "klein" },
 	{ EmsProto::WWSystemGross, "groß" },
 	{ EmsProto::WWSystemSpeicherlade, "Speicherladesystem" }
     };
+    static_assert(NameTable::isSorted(WWSYSTEMMAPPING), "WWSYSTEMMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> ZIRKSPMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> ZIRKSPMAPPING[] = {
 	{ 0, "aus" },
 	{ 1, "1x 3min" }, { 2, "2x 3min" }, { 3, "3x 3min" },
 	{ 4, "4x 3min" }, { 5, "5x 3min" }, { 6, "6x 3min" },
 	{ 7, "dauerhaft an" }
     };
+    static_assert(NameTable::isSorted(ZIRKSPMAPPING), "ZIRKSPMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> MAINTENANCEMESSAGESMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> MAINTENANCEMESSAGESMAPPING[] = {
 	{ 0, "keine" },
 	{ 1, "nach Betriebsstunden" },
 	{ 2, "nach Datum" }
     };
+    static_assert(NameTable::isSorted(MAINTENANCEMESSAGESMAPPING), "MAINTENANCEMESSAGESMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> MAINTENANCENEEDEDMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> MAINTENANCENEEDEDMAPPING[] = {
 	{ 0, "nein" },
 	{ 3, "ja, wegen Betriebsstunden" },
 	{ 8, "ja, wegen Datum" }
     };
+    static_assert(NameTable::isSorted(MAINTENANCENEEDEDMAPPING), "MAINTENANCENEEDEDMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> ERRORTYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> ERRORTYPEMAPPING[] = {
 	{ 0x10, "Verriegelnder Fehler" },
 	{ 0x11, "Blockierender Fehler" },
 	{ 0x12, "Anlagenfehler" },
 	{ 0x13, "Zurückgesetzter Anlagenfehler" }
     };
+    static_assert(NameTable::isSorted(ERRORTYPEMAPPING), "ERRORTYPEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> WEEKDAYMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> WEEKDAYMAPPING[] = {
 	{ 0, "Montag" }, { 1, "Dienstag" }, { 2, "Mittwoch" }, { 3, "Donnerstag" },
 	{ 4, "Freitag" }, { 5, "Samstag" }, { 6, "Sonntag" }
     };
+    static_assert(NameTable::isSorted(WEEKDAYMAPPING), "WEEKDAYMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> OPMODEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> OPMODEMAPPING[] = {
 	{ 0, "ständig aus" }, { 1, "ständig an" }, { 2, "Automatik" }
     };
+    static_assert(NameTable::isSorted(OPMODEMAPPING), "OPMODEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> HKOPMODEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> HKOPMODEMAPPING[] = {
 	{ 0, "immer Nachtbetrieb" }, { 1, "immer Tagbetrieb" }, { 2, "Automatik" }
     };
+    static_assert(NameTable::isSorted(HKOPMODEMAPPING), "HKOPMODEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> BUILDINGTYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> BUILDINGTYPEMAPPING[] = {
 	{ 0, "leicht" }, { 1, "mittel" }, { 2, "schwer" }
     };
+    static_assert(NameTable::isSorted(BUILDINGTYPEMAPPING), "BUILDINGTYPEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> HEATINGTYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> HEATINGTYPEMAPPING[] = {
 	{ 1, "Heizkörper" }, { 2, "Konvektor" }, { 3, "Fußboden" },
     };
+    static_assert(NameTable::isSorted(HEATINGTYPEMAPPING), "HEATINGTYPEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> REDUCTIONMODEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> REDUCTIONMODEMAPPING[] = {
 	{ 0, "Abschalt" }, { 1, "Reduziert" }, { 2, "Raumhalt" }, { 3, "Außenhalt" }
     };
+    static_assert(NameTable::isSorted(REDUCTIONMODEMAPPING), "REDUCTIONMODEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> FROSTPROTECTMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> FROSTPROTECTMAPPING[] = {
 	{ 0, "kein" }, { 1, "Außentemperatur" }, { 2, "Raumtemperatur 5 Grad" }
     };
+    static_assert(NameTable::isSorted(FROSTPROTECTMAPPING), "FROSTPROTECTMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> RELEVANTVALUEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> RELEVANTVALUEMAPPING[] = {
 	{ 0, "außentemperaturgeführt" }, { 1, "raumtemperaturgeführt" }
     };
+    static_assert(NameTable::isSorted(RELEVANTVALUEMAPPING), "RELEVANTVALUEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> VACATIONREDUCTIONMAPPING = {
-	{ 3, "Außenhalt" }, { 2, "Raumhalt" }
+    static constexpr NameTable::Entry<uint8_t> VACATIONREDUCTIONMAPPING[] = {
+	{ 2, "Raumhalt" }, { 3, "Außenhalt" }
     };
+    static_assert(NameTable::isSorted(VACATIONREDUCTIONMAPPING), "VACATIONREDUCTIONMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> REMOTETYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> REMOTETYPEMAPPING[] = {
 	{ 0, "Keine" }, { 1, "RC20" }, { 2, "RC3x" }
     };
+    static_assert(NameTable::isSorted(REMOTETYPEMAPPING), "REMOTETYPEMAPPING must be sorted");
 
-    auto typeIter = TYPEMAPPING.find(value.getType());
-    const char *type = typeIter != TYPEMAPPING.end() ? typeIter->second : NULL;
-    auto subtypeIter = SUBTYPEMAPPING.find(value.getSubType());
-    const char *subtype = subtypeIter != SUBTYPEMAPPING.end() ? subtypeIter->second : NULL;
+    const char *type = NameTable::lookup(TYPEMAPPING, value.getType());
+    const char *subtype = NameTable::lookup(SUBTYPEMAPPING, value.getSubType());
 
     if (subtype) {
 	stream << subtype;
@@ -397,9 +491,9 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 		} else {
 		    stream << value.getValue<unsigned int>();
 		}
-		auto unitIter = UNITMAPPING.find(value.getType());
-		if (unitIter != UNITMAPPING.end()) {
-		    stream << " " << unitIter->second;
+		const char *unit = NameTable::lookup(UNITMAPPING, value.getType());
+		if (unit) {
+		    stream << " " << unit;
 		}
 	    } else {
 		stream << "nicht verfügbar";
@@ -410,28 +504,29 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	    stream << (value.getValue<bool>() ? "AN" : "AUS");
 	    break;
 	case EmsValue::Enumeration: {
-	    const std::map<uint8_t, const char *> *map = NULL;
+	    const char *name = NULL;
 	    uint8_t enumValue = value.getValue<uint8_t>();
 	    switch (value.getType()) {
-		case EmsValue::WWSystemType: map = &WWSYSTEMMAPPING; break;
-		case EmsValue::Schaltpunkte: map = &ZIRKSPMAPPING; break;
-		case EmsValue::Wartungsmeldungen: map = &MAINTENANCEMESSAGESMAPPING; break;
-		case EmsValue::WartungFaellig: map = &MAINTENANCENEEDEDMAPPING; break;
+		case EmsValue::WWSystemType: name = NameTable::lookup(WWSYSTEMMAPPING, enumValue); break;
+		case EmsValue::Schaltpunkte: name = NameTable::lookup(ZIRKSPMAPPING, enumValue); break;
+		case EmsValue::Wartungsmeldungen: name = NameTable::lookup(MAINTENANCEMESSAGESMAPPING, enumValue); break;
+		case EmsValue::WartungFaellig: name = NameTable::lookup(MAINTENANCENEEDEDMAPPING, enumValue); break;
 		case EmsValue::Betriebsart:
-		    map = value.isForHK() ? &HKOPMODEMAPPING : &OPMODEMAPPING;
+		    name = value.isForHK() ? NameTable::lookup(HKOPMODEMAPPING, enumValue)
+					   : NameTable::lookup(OPMODEMAPPING, enumValue);
 		    break;
-		case EmsValue::DesinfektionTag: map = &WEEKDAYMAPPING; break;
-		case EmsValue::GebaeudeArt: map = &BUILDINGTYPEMAPPING; break;
-		case EmsValue::HeizSystem: map = &HEATINGTYPEMAPPING; break;
-		case EmsValue::AbsenkModus: map = &REDUCTIONMODEMAPPING; break;
-		case EmsValue::FBTyp: map = &REMOTETYPEMAPPING; break;
-		case EmsValue::Frostschutz: map = &FROSTPROTECTMAPPING; break;
-		case EmsValue::FuehrungsGroesse: map = &RELEVANTVALUEMAPPING; break;
-		case EmsValue::UrlaubAbsenkungsArt: map = &VACATIONREDUCTIONMAPPING; break;
+		case EmsValue::DesinfektionTag: name = NameTable::lookup(WEEKDAYMAPPING, enumValue); break;
+		case EmsValue::GebaeudeArt: name = NameTable::lookup(BUILDINGTYPEMAPPING, enumValue); break;
+		case EmsValue::HeizSystem: name = NameTable::lookup(HEATINGTYPEMAPPING, enumValue); break;
+		case EmsValue::AbsenkModus: name = NameTable::lookup(REDUCTIONMODEMAPPING, enumValue); break;
+		case EmsValue::FBTyp: name = NameTable::lookup(REMOTETYPEMAPPING, enumValue); break;
+		case EmsValue::Frostschutz: name = NameTable::lookup(FROSTPROTECTMAPPING, enumValue); break;
+		case EmsValue::FuehrungsGroesse: name = NameTable::lookup(RELEVANTVALUEMAPPING, enumValue); break;
+		case EmsValue::UrlaubAbsenkungsArt: name = NameTable::lookup(VACATIONREDUCTIONMAPPING, enumValue); break;
 		default: break;
 	    }
-	    if (map && map->find(enumValue) != map->end()) {
-		stream << map->at(enumValue);
+	    if (name) {
+		stream << name;
 	    } else {
 		stream << "??? (" << (unsigned int) enumValue << ")";
 	    }
@@ -447,7 +542,8 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	case EmsValue::Error: {
 	    EmsValue::ErrorEntry entry = value.getValue<EmsValue::ErrorEntry>();
 	    EmsProto::ErrorRecord& record = entry.record;
-	    stream << ERRORTYPEMAPPING.at(entry.type) << " " << entry.index << ": ";
+	    const char *errorType = NameTable::lookup(ERRORTYPEMAPPING, entry.type);
+	    stream << (errorType ? errorType : "???") << " " << entry.index << ": ";
 	    if (record.errorAscii[0] == 0) {
 		stream << "Leer" << std::endl;
 	    } else {
@@ -476,14 +572,14 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	}
 	case EmsValue::SystemTime: {
 	    EmsProto::SystemTimeRecord record = value.getValue<EmsProto::SystemTimeRecord>();
-	    auto dayIter = WEEKDAYMAPPING.find(record.dayOfWeek);
+	    const char *day = NameTable::lookup(WEEKDAYMAPPING, record.dayOfWeek);
 
 	    stream << boost::format("%d.%d.%d")
 		    % (unsigned int) record.common.day % (unsigned int) record.common.month
 		    % (2000 + record.common.year);
 
-	    if (dayIter != WEEKDAYMAPPING.end()) {
-		stream << " (" << dayIter->second << ")";
+	    if (day) {
+		stream << " (" << day << ")";
 	    }
 	    stream << ", " << boost::format("%d:%02d:%02d")
 		    % (unsigned int) record.common.hour % (unsigned int) record.common.minute
@@ -514,6 +610,20 @@ printDescriptive(std::ostream& stream, const EmsValue& value)
 	    break;
     }
 }
+#else
+/* without the German descriptions, fall back to the data port format */
+static void
+printDescriptive(std::ostream& stream, const EmsValue& value)
+{
+    std::string subtype = ValueApi::getSubTypeName(value.getSubType());
+    std::string type = ValueApi::getTypeName(value.getType());
+
+    if (!subtype.empty()) {
+	stream << subtype << " ";
+    }
+    stream << (type.empty() ? "???" : type) << " = " << ValueApi::formatValue(value);
+}
+#endif
 
 void
 IoHandler::handleValue(const EmsValue& value)
@@ -31,6 +31,9 @@ class IoHandler : public boost::asio::io_service
 {
     public:
 	typedef std::function<void (const EmsValue& value)> ValueCallback;
+	typedef std::function<void (const std::vector<uint8_t>& data,
+				    const Timestamp& timestamp)> FrameCallback;
+	typedef std::function<void (const std::vector<uint8_t>& input)> InputCallback;
 
     public:
 	IoHandler(ValueCache& cache);
@@ -43,10 +46,34 @@ class IoHandler : public boost::asio::io_service
 	bool active() {
 	    return m_active;
 	}
+	/* whether the target should be reopened after it was closed */
+	virtual bool restartable() const {
+	    return true;
+	}
 
 	void addValueCallback(ValueCallback& cb) {
 	    m_valueCallbacks.push_back(cb);
 	}
+	/* passes values which weren't decoded from a frame to all value callbacks */
+	void injectValue(const EmsValue& value) {
+	    handleValue(value);
+	}
+	/* called with every complete frame that passed the checksum test */
+	void addFrameCallback(FrameCallback& cb) {
+	    m_frameCallbacks.push_back(cb);
+	}
+
+	/* descriptor of the bus connection, -1 if it can't be handed over */
+	virtual int descriptor() {
+	    return -1;
+	}
+	/* stops reading at the next frame boundary, the callback gets what
+	 * was read after that frame */
+	void pauseInput(const InputCallback& cb);
+	/* stops reading right away, a partially received frame is dropped */
+	void forcePause();
+	/* starts reading, after passing input read by a previous process */
+	void resumeInput(const std::vector<uint8_t>& input);
 
     protected:
 	/* maximum amount of data to read in one operation */
@@ -54,15 +81,21 @@ class IoHandler : public boost::asio::io_service
 
 	virtual void readStart() = 0;
 	virtual void doCloseImpl() = 0;
+	/* aborts the pending read */
+	virtual void cancelRead() { }
 
 	virtual void onPcMessageReceived(const EmsMessage& /* message */) { }
 	virtual void readComplete(const boost::system::error_code& error, size_t bytesTransferred);
 	void doClose(const boost::system::error_code& error);
+	void handleFrame(const std::vector<uint8_t>& data, const Timestamp& timestamp);
 	void handleValue(const EmsValue& value);
 
 	bool m_active;
 	unsigned char m_recvBuffer[maxReadLength];
 
+    private:
+	void finishPause(const std::vector<uint8_t>& input);
+
     private:
 	typedef enum {
 	    Syncing,
@@ -76,8 +109,11 @@ class IoHandler : public boost::asio::io_service
 	uint8_t m_checkSum;
 	std::vector<uint8_t> m_data;
 	std::list<ValueCallback> m_valueCallbacks;
+	std::list<FrameCallback> m_frameCallbacks;
 	EmsMessage::ValueHandler m_valueCb;
 	EmsMessage::CacheAccessor m_cacheCb;
+	InputCallback m_pauseCb;
+	bool m_pauseForced;
 };
 
 #endif /* __IOHANDLER_H__ */
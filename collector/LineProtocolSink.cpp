@@ -0,0 +1,595 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <boost/bind.hpp>
+#include "LineProtocolSink.h"
+#include "ValueApi.h"
+
+/* measurement names and tag values must have ',', ' ' and '=' escaped */
+static std::string
+escapeName(const std::string& name)
+{
+    std::string result;
+
+    for (char c : name) {
+	if (c == ',' || c == ' ' || c == '=') {
+	    result += '\\';
+	}
+	result += c;
+    }
+    return result;
+}
+
+static std::string
+quoteString(const std::string& value)
+{
+    std::string result = "\"";
+
+    for (char c : value) {
+	if (c == '"' || c == '\\') {
+	    result += '\\';
+	}
+	/* a line break would end the line early */
+	if ((unsigned char) c >= ' ') {
+	    result += c;
+	}
+    }
+    return result + "\"";
+}
+
+LineProtocolSink::LineProtocolSink(boost::asio::io_service& ios,
+				   const std::string& target,
+				   const std::string& spoolFile) :
+    m_protocol(Invalid),
+    m_batchSize(MaxBatchSize),
+    m_flushScheduled(false),
+    m_flushTimer(ios),
+    m_udpResolver(ios),
+    m_udpResolving(false),
+    m_udpSocket(ios),
+    m_resolver(ios),
+    m_socket(ios),
+    m_requestTimer(ios),
+    m_requestActive(false),
+    m_failing(false),
+    m_closed(false),
+    m_spoolFile(spoolFile),
+    m_spooled(false),
+    m_spoolOffset(0),
+    m_spoolFullReported(false),
+    m_drainScheduled(false),
+    m_drainTimer(ios)
+{
+    if (target.compare(0, 4, "udp:") == 0) {
+	size_t pos = target.rfind(':');
+	if (pos > 4) {
+	    m_host = target.substr(4, pos - 4);
+	    m_port = target.substr(pos + 1);
+	    m_batchSize = MaxDatagramSize;
+	    m_protocol = Udp;
+	}
+    } else if (target.compare(0, 7, "http://") == 0) {
+	size_t pathPos = target.find('/', 7);
+	std::string hostPort = target.substr(7, pathPos == std::string::npos ?
+						   std::string::npos : pathPos - 7);
+	size_t portPos = hostPort.find(':');
+
+	m_host = hostPort.substr(0, portPos);
+	m_port = portPos != std::string::npos ? hostPort.substr(portPos + 1) : "80";
+	m_path = pathPos != std::string::npos ? target.substr(pathPos) : "/write";
+	if (!m_host.empty()) {
+	    m_protocol = Http;
+	}
+    }
+
+    if (!m_spoolFile.empty()) {
+	struct stat st;
+	m_spooled = stat(m_spoolFile.c_str(), &st) == 0 && st.st_size > 0;
+    }
+}
+
+void
+LineProtocolSink::close()
+{
+    if (m_closed) {
+	return;
+    }
+
+    m_closed = true;
+    m_flushTimer.cancel();
+    m_requestTimer.cancel();
+    m_drainTimer.cancel();
+    m_resolver.cancel();
+    m_udpResolver.cancel();
+    boost::system::error_code error;
+    m_socket.close(error);
+
+    if (!m_batch.empty()) {
+	m_pending.push_back(m_batch);
+    }
+    if (m_protocol == Udp && m_udpEndpoint.port() != 0) {
+	for (auto& batch : m_pending) {
+	    sendDatagrams(batch);
+	}
+    } else {
+	/* the request in flight may or may not have been processed yet, but
+	 * writing the same points again just overwrites them */
+	for (auto& batch : m_pending) {
+	    spool(batch);
+	}
+    }
+}
+
+void
+LineProtocolSink::handleValue(const EmsValue& value)
+{
+    if (!value.isValid() || m_protocol == Invalid || m_closed) {
+	return;
+    }
+
+    /* this runs for every value, so avoid the stream machinery */
+    std::string text = linePrefix(value);
+    char buffer[32];
+
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    snprintf(buffer, sizeof(buffer), "%g", value.getValue<float>());
+	    text += buffer;
+	    break;
+	case EmsValue::Integer:
+	    snprintf(buffer, sizeof(buffer), "%ui", value.getValue<unsigned int>());
+	    text += buffer;
+	    break;
+	case EmsValue::Boolean:
+	    text += value.getValue<bool>() ? "true" : "false";
+	    break;
+	default:
+	    text += quoteString(ValueApi::formatValue(value));
+	    break;
+    }
+    if (value.getTimestamp().realtime != 0) {
+	/* the default precision of the protocol is nanoseconds */
+	snprintf(buffer, sizeof(buffer), " %llu000000",
+		 (unsigned long long) value.getTimestamp().realtime);
+	text += buffer;
+    }
+    text += '\n';
+
+    if (!m_batch.empty() && m_batch.size() + text.size() > m_batchSize) {
+	flush();
+    }
+    m_batch += text;
+    if (m_batch.size() >= m_batchSize) {
+	flush();
+    } else {
+	scheduleFlush();
+    }
+}
+
+const std::string&
+LineProtocolSink::linePrefix(const EmsValue& value)
+{
+    auto key = std::make_pair(value.getType(), value.getSubType());
+    auto iter = m_prefixes.find(key);
+
+    if (iter == m_prefixes.end()) {
+	std::string prefix = escapeName(ValueApi::getTypeName(value.getType()));
+	if (value.getSubType() != EmsValue::None) {
+	    prefix += ",subtype=" + escapeName(ValueApi::getSubTypeName(value.getSubType()));
+	}
+	prefix += " value=";
+	iter = m_prefixes.insert(std::make_pair(key, prefix)).first;
+    }
+
+    return iter->second;
+}
+
+void
+LineProtocolSink::scheduleFlush()
+{
+    /* only armed while there is data, so an idle sink keeps no work pending */
+    if (m_flushScheduled) {
+	return;
+    }
+
+    Ptr self = shared_from_this();
+    m_flushScheduled = true;
+    m_flushTimer.expires_from_now(boost::posix_time::seconds(FlushDelaySeconds));
+    m_flushTimer.async_wait([this, self] (const boost::system::error_code& error) {
+	if (error != boost::asio::error::operation_aborted && !m_closed) {
+	    m_flushScheduled = false;
+	    flush();
+	}
+    });
+}
+
+void
+LineProtocolSink::flush()
+{
+    if (m_flushScheduled) {
+	m_flushScheduled = false;
+	m_flushTimer.cancel();
+    }
+    if (m_batch.empty()) {
+	return;
+    }
+
+    m_pending.push_back(std::move(m_batch));
+    m_batch.clear();
+
+    if (m_pending.size() > MaxPendingBatches) {
+	/* the target can't keep up, keep the newest batch for later */
+	spool(m_pending.back());
+	m_pending.pop_back();
+    }
+
+    sendNext();
+}
+
+void
+LineProtocolSink::sendNext()
+{
+    if (m_protocol == Udp) {
+	if (m_udpEndpoint.port() == 0) {
+	    resolveUdp();
+	    return;
+	}
+	while (!m_pending.empty()) {
+	    std::string batch = m_pending.front();
+	    m_pending.pop_front();
+	    sendDatagrams(batch);
+	}
+    } else if (!m_requestActive && !m_pending.empty()) {
+	sendRequest();
+    }
+}
+
+void
+LineProtocolSink::resolveUdp()
+{
+    /* the batches stay queued until the target is known */
+    if (m_udpResolving) {
+	return;
+    }
+
+    boost::asio::ip::udp::resolver::query query(boost::asio::ip::udp::v4(), m_host, m_port);
+    m_udpResolving = true;
+    m_udpResolver.async_resolve(query,
+	    boost::bind(&LineProtocolSink::handleUdpResolve, shared_from_this(),
+			boost::asio::placeholders::error,
+			boost::asio::placeholders::iterator));
+}
+
+void
+LineProtocolSink::handleUdpResolve(const boost::system::error_code& error,
+				   boost::asio::ip::udp::resolver::iterator endpoint)
+{
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+
+    boost::system::error_code ec = error;
+    m_udpResolving = false;
+    if (!ec && endpoint == boost::asio::ip::udp::resolver::iterator()) {
+	ec = boost::asio::error::host_not_found;
+    }
+    if (!ec) {
+	m_udpSocket.open(endpoint->endpoint().protocol(), ec);
+    }
+    if (ec) {
+	/* the next flush tries again */
+	reportFailure(ec.message());
+	for (auto& batch : m_pending) {
+	    spool(batch);
+	}
+	m_pending.clear();
+	return;
+    }
+
+    m_udpEndpoint = *endpoint;
+    sendNext();
+}
+
+void
+LineProtocolSink::sendDatagrams(const std::string& batch)
+{
+    boost::system::error_code error;
+
+    m_udpSocket.send_to(boost::asio::buffer(batch), m_udpEndpoint, 0, error);
+
+    if (error) {
+	reportFailure(error.message());
+	spool(batch);
+    } else {
+	if (m_failing) {
+	    std::cerr << "Line protocol target reachable again" << std::endl;
+	    m_failing = false;
+	}
+	if (m_spooled) {
+	    scheduleDrain();
+	}
+    }
+}
+
+void
+LineProtocolSink::scheduleDrain()
+{
+    if (m_drainScheduled || m_closed) {
+	return;
+    }
+
+    Ptr self = shared_from_this();
+    m_drainScheduled = true;
+    m_drainTimer.expires_from_now(boost::posix_time::milliseconds(DrainIntervalMs));
+    m_drainTimer.async_wait([this, self] (const boost::system::error_code& error) {
+	if (error != boost::asio::error::operation_aborted && !m_closed) {
+	    m_drainScheduled = false;
+	    unspool();
+	    sendNext();
+	}
+    });
+}
+
+void
+LineProtocolSink::sendRequest()
+{
+    const std::string& body = m_pending.front();
+    std::ostringstream request;
+
+    request << "POST " << m_path << " HTTP/1.1\r\n";
+    request << "Host: " << m_host << ":" << m_port << "\r\n";
+    request << "Content-Type: text/plain; charset=utf-8\r\n";
+    request << "Content-Length: " << body.size() << "\r\n";
+    request << "Connection: close\r\n\r\n";
+    request << body;
+
+    m_request = request.str();
+    m_requestActive = true;
+
+    Ptr self = shared_from_this();
+    m_requestTimer.expires_from_now(boost::posix_time::seconds(RequestTimeoutSeconds));
+    m_requestTimer.async_wait([this, self] (const boost::system::error_code& error) {
+	/* a timer which was already queued when the request finished
+	 * finds the deadline of the next request or none at all */
+	if (error != boost::asio::error::operation_aborted && !m_closed && m_requestActive &&
+		m_requestTimer.expires_at() <= boost::asio::deadline_timer::traits_type::now()) {
+	    /* the pending operation is aborted and ignores its result */
+	    m_resolver.cancel();
+	    reportFailure("request timed out");
+	    requestDone(false);
+	}
+    });
+
+    boost::asio::ip::tcp::resolver::query query(m_host, m_port);
+    m_resolver.async_resolve(query,
+	    boost::bind(&LineProtocolSink::handleResolve, shared_from_this(),
+			boost::asio::placeholders::error,
+			boost::asio::placeholders::iterator));
+}
+
+void
+LineProtocolSink::handleResolve(const boost::system::error_code& error,
+				boost::asio::ip::tcp::resolver::iterator endpoint)
+{
+    /* the request timed out or the sink was closed */
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	reportFailure(error.message());
+	requestDone(false);
+	return;
+    }
+
+    boost::asio::async_connect(m_socket, endpoint,
+	    boost::bind(&LineProtocolSink::handleConnect, shared_from_this(),
+			boost::asio::placeholders::error));
+}
+
+void
+LineProtocolSink::handleConnect(const boost::system::error_code& error)
+{
+    /* the request timed out or the sink was closed */
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	reportFailure(error.message());
+	requestDone(false);
+	return;
+    }
+
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_request),
+	    boost::bind(&LineProtocolSink::handleWrite, shared_from_this(),
+			boost::asio::placeholders::error));
+}
+
+void
+LineProtocolSink::handleWrite(const boost::system::error_code& error)
+{
+    /* the request timed out or the sink was closed */
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	reportFailure(error.message());
+	requestDone(false);
+	return;
+    }
+
+    boost::asio::async_read_until(m_socket, m_response, "\r\n",
+	    boost::bind(&LineProtocolSink::handleResponse, shared_from_this(),
+			boost::asio::placeholders::error));
+}
+
+void
+LineProtocolSink::handleResponse(const boost::system::error_code& error)
+{
+    /* the request timed out or the sink was closed */
+    if (error == boost::asio::error::operation_aborted || m_closed) {
+	return;
+    }
+    if (error) {
+	reportFailure(error.message());
+	requestDone(false);
+	return;
+    }
+
+    std::istream response(&m_response);
+    std::string version, message;
+    unsigned int status = 0;
+
+    response >> version >> status;
+    std::getline(response, message);
+
+    if (status < 200 || status >= 300) {
+	std::ostringstream reason;
+	reason << "HTTP status " << status << message;
+	reportFailure(reason.str());
+	requestDone(false);
+    } else {
+	requestDone(true);
+    }
+}
+
+void
+LineProtocolSink::requestDone(bool success)
+{
+    boost::system::error_code error;
+
+    m_requestTimer.cancel();
+    m_socket.close(error);
+    m_response.consume(m_response.size());
+    m_requestActive = false;
+
+    if (success) {
+	m_pending.pop_front();
+	if (m_failing) {
+	    std::cerr << "Line protocol target reachable again" << std::endl;
+	    m_failing = false;
+	}
+	if (m_spooled) {
+	    unspool();
+	}
+	sendNext();
+    } else {
+	/* don't retry right away, the next flush will try again and pick
+	 * up the spooled batches once the target is back */
+	for (auto& batch : m_pending) {
+	    spool(batch);
+	}
+	m_pending.clear();
+    }
+}
+
+void
+LineProtocolSink::reportFailure(const std::string& reason)
+{
+    if (!m_failing) {
+	std::cerr << "Could not send values to line protocol target: " << reason << std::endl;
+	m_failing = true;
+    }
+}
+
+void
+LineProtocolSink::spool(const std::string& batch)
+{
+    if (m_spoolFile.empty()) {
+	return;
+    }
+
+    struct stat st;
+    if (stat(m_spoolFile.c_str(), &st) == 0 && (size_t) st.st_size + batch.size() > MaxSpoolSize) {
+	if (!m_spoolFullReported) {
+	    std::cerr << "Spool file " << m_spoolFile << " is full, dropping values" << std::endl;
+	    m_spoolFullReported = true;
+	}
+	return;
+    }
+
+    std::ofstream out(m_spoolFile.c_str(), std::ios::out | std::ios::app | std::ios::binary);
+    if (!out) {
+	std::cerr << "Could not open spool file " << m_spoolFile << std::endl;
+	return;
+    }
+    out << batch;
+    m_spooled = true;
+}
+
+void
+LineProtocolSink::unspool()
+{
+    /* queue as many batches as we'd keep in memory anyway, split at line
+     * boundaries, and leave the rest for the next successful send */
+    size_t budget = (MaxPendingBatches - std::min(m_pending.size(), MaxPendingBatches)) * m_batchSize;
+    if (budget == 0) {
+	return;
+    }
+
+    std::string contents(budget, '\0');
+    {
+	std::ifstream in(m_spoolFile.c_str(), std::ios::in | std::ios::binary);
+	if (!in || !in.seekg(m_spoolOffset)) {
+	    m_spooled = false;
+	    m_spoolOffset = 0;
+	    return;
+	}
+	in.read(&contents[0], budget);
+	contents.resize(in.gcount());
+	if (in.gcount() == (std::streamsize) budget) {
+	    /* don't split the last line, unless it's the only one */
+	    size_t newline = contents.rfind('\n');
+	    if (newline != std::string::npos) {
+		contents.resize(newline + 1);
+	    }
+	}
+    }
+
+    size_t pos = 0;
+    while (pos < contents.size()) {
+	size_t end = pos + m_batchSize;
+	if (end >= contents.size()) {
+	    end = contents.size();
+	} else {
+	    size_t newline = contents.rfind('\n', end - 1);
+	    if (newline == std::string::npos || newline < pos) {
+		newline = contents.find('\n', end);
+	    }
+	    end = newline != std::string::npos ? newline + 1 : contents.size();
+	}
+	m_pending.push_back(contents.substr(pos, end - pos));
+	pos = end;
+    }
+    m_spoolOffset += contents.size();
+
+    struct stat st;
+    if (stat(m_spoolFile.c_str(), &st) != 0 || m_spoolOffset >= (size_t) st.st_size) {
+	/* everything is queued, start over with an empty file */
+	std::ofstream out(m_spoolFile.c_str(), std::ios::out | std::ios::trunc | std::ios::binary);
+	m_spooled = false;
+	m_spoolOffset = 0;
+	m_spoolFullReported = false;
+    }
+}
@@ -0,0 +1,135 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LINEPROTOCOLSINK_H__
+#define __LINEPROTOCOLSINK_H__
+
+#include <deque>
+#include <map>
+#include <boost/asio.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/shared_ptr.hpp>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+
+/*
+ * Writes all values to a time series database in the Influx line protocol,
+ * which is also understood by VictoriaMetrics and others. The target is
+ * either udp:<host>:<port> or an http:// write URL. Lines are collected
+ * into batches which are sent when they are full or after a short delay.
+ * Batches which can't be delivered are appended to the spool file and
+ * sent again as soon as the target accepts data again.
+ */
+class LineProtocolSink : public boost::enable_shared_from_this<LineProtocolSink>,
+			 private boost::noncopyable
+{
+    public:
+	typedef boost::shared_ptr<LineProtocolSink> Ptr;
+
+    public:
+	LineProtocolSink(boost::asio::io_service& ios,
+			 const std::string& target,
+			 const std::string& spoolFile);
+
+	bool isValid() const {
+	    return m_protocol != Invalid;
+	}
+	/* spools what wasn't sent yet; a request in flight keeps the object
+	 * alive until its handler ran */
+	void close();
+	void handleValue(const EmsValue& value);
+
+    private:
+	const std::string& linePrefix(const EmsValue& value);
+	void scheduleFlush();
+	void flush();
+	void sendNext();
+	void resolveUdp();
+	void handleUdpResolve(const boost::system::error_code& error,
+			      boost::asio::ip::udp::resolver::iterator endpoint);
+	void sendDatagrams(const std::string& batch);
+	void sendRequest();
+	void handleResolve(const boost::system::error_code& error,
+			   boost::asio::ip::tcp::resolver::iterator endpoint);
+	void handleConnect(const boost::system::error_code& error);
+	void handleWrite(const boost::system::error_code& error);
+	void handleResponse(const boost::system::error_code& error);
+	void requestDone(bool success);
+	void reportFailure(const std::string& reason);
+	void spool(const std::string& batch);
+	void unspool();
+	void scheduleDrain();
+
+    private:
+	/* batch size for HTTP, the size of a single request body */
+	static const size_t MaxBatchSize = 64 * 1024;
+	/* batch size for UDP, chosen to avoid IP fragmentation */
+	static const size_t MaxDatagramSize = 1400;
+	static const unsigned int FlushDelaySeconds = 10;
+	static const unsigned int RequestTimeoutSeconds = 30;
+	/* batches waiting for the request in flight before we start spooling */
+	static const size_t MaxPendingBatches = 16;
+	static const size_t MaxSpoolSize = 16 * 1024 * 1024;
+	/* pause between sending spooled batches over UDP, which has no
+	 * acknowledgement pacing it */
+	static const unsigned int DrainIntervalMs = 100;
+
+	typedef enum {
+	    Invalid,
+	    Udp,
+	    Http
+	} Protocol;
+
+	Protocol m_protocol;
+	std::string m_host;
+	std::string m_port;
+	std::string m_path;
+	size_t m_batchSize;
+
+	/* '<measurement>[,subtype=<tag>] value=' for each value key */
+	std::map<std::pair<EmsValue::Type, EmsValue::SubType>, std::string> m_prefixes;
+	std::string m_batch;
+	std::deque<std::string> m_pending;
+	bool m_flushScheduled;
+	boost::asio::deadline_timer m_flushTimer;
+
+	boost::asio::ip::udp::resolver m_udpResolver;
+	bool m_udpResolving;
+	boost::asio::ip::udp::socket m_udpSocket;
+	boost::asio::ip::udp::endpoint m_udpEndpoint;
+
+	boost::asio::ip::tcp::resolver m_resolver;
+	boost::asio::ip::tcp::socket m_socket;
+	boost::asio::deadline_timer m_requestTimer;
+	bool m_requestActive;
+	std::string m_request;
+	boost::asio::streambuf m_response;
+
+	bool m_failing;
+	bool m_closed;
+	std::string m_spoolFile;
+	bool m_spooled;
+	/* start of the spooled data which wasn't queued for sending yet */
+	size_t m_spoolOffset;
+	bool m_spoolFullReported;
+	bool m_drainScheduled;
+	boost::asio::deadline_timer m_drainTimer;
+};
+
+#endif /* __LINEPROTOCOLSINK_H__ */
@@ -63,6 +63,9 @@ MqttAdapter::handleValue(const EmsValue& value)
     topic += "value";
 
     std::string formattedValue = ValueApi::formatValue(value);
+    if (Options::valueTimestamps()) {
+	formattedValue += " | " + ValueApi::formatTimestamp(value.getTimestamp());
+    }
     DebugStream& debug = Options::ioDebug();
     if (debug) {
 	debug << "MQTT: publishing topic '" << topic << "' with value " << formattedValue << std::endl;
@@ -70,6 +73,26 @@ MqttAdapter::handleValue(const EmsValue& value)
     m_client->publish_at_most_once(topic, formattedValue);
 }
 
+void
+MqttAdapter::handleAlert(const AlertRules::Alert& alert)
+{
+    if (!m_connected) {
+	return;
+    }
+
+    std::string topic = m_topicPrefix + "/alert/" + alert.rule;
+    std::string payload = (alert.active ? "raised " : "cleared ") + alert.value;
+    if (Options::valueTimestamps()) {
+	payload += " | " + ValueApi::formatTimestamp(alert.timestamp);
+    }
+    DebugStream& debug = Options::ioDebug();
+    if (debug) {
+	debug << "MQTT: publishing topic '" << topic << "' with value " << payload << std::endl;
+    }
+    /* retained, so subscribers see the current state of all alerts */
+    m_client->publish_at_most_once(topic, payload, true);
+}
+
 bool
 MqttAdapter::onConnect(bool sessionPresent, uint8_t returnCode)
 {
@@ -20,6 +20,7 @@
 #ifndef __MQTTADAPTER_H__
 #define __MQTTADAPTER_H__
 
+#include "AlertRules.h"
 #include "CommandScheduler.h"
 #include "EmsMessage.h"
 
@@ -38,6 +39,7 @@ class MqttAdapter : public boost::noncopyable
 		    const std::string& topicPrefix);
 
 	void handleValue(const EmsValue& value);
+	void handleAlert(const AlertRules::Alert& alert);
 
     private:
 	bool onConnect(bool sessionPresent, uint8_t returnCode);
@@ -88,6 +90,7 @@ class MqttAdapter {
 	{}
 
 	void handleValue(const EmsValue& /* value */) {}
+	void handleAlert(const AlertRules::Alert& /* alert */) {}
 };
 
 #endif /* !HAVE_MQTT */
@@ -0,0 +1,60 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __NAMETABLE_H__
+#define __NAMETABLE_H__
+
+#include <stddef.h>
+#include <algorithm>
+
+/*
+ * Constant table of names, sorted by key. Unlike a std::map, it lives in
+ * read only data and needs neither heap memory nor initialization at run
+ * time. Tables are declared constexpr, so their order can be checked with
+ * static_assert(NameTable::isSorted(TABLE)).
+ */
+namespace NameTable {
+    template<typename Key> struct Entry {
+	Key key;
+	const char *name;
+    };
+
+    template<typename Key, size_t N> constexpr bool
+    isSorted(const Entry<Key> (&table)[N], size_t i = 1)
+    {
+	return i >= N || (table[i - 1].key < table[i].key && isSorted(table, i + 1));
+    }
+
+    /* returns NULL for keys not in the table */
+    template<typename Key> const char *
+    lookup(const Entry<Key> *begin, const Entry<Key> *end, Key key)
+    {
+	const Entry<Key> *entry = std::lower_bound(begin, end, key,
+		[] (const Entry<Key>& entry, Key key) { return entry.key < key; });
+	return entry != end && entry->key == key ? entry->name : NULL;
+    }
+
+    template<typename Key, size_t N> const char *
+    lookup(const Entry<Key> (&table)[N], Key key)
+    {
+	return lookup(table, table + N, key);
+    }
+}
+
+#endif /* __NAMETABLE_H__ */
@@ -17,6 +17,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstdlib>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/foreach.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/program_options.hpp>
@@ -27,6 +29,14 @@ namespace bpo = boost::program_options;
 std::string Options::m_target;
 std::string Options::m_mqttTarget;
 std::string Options::m_mqttPrefix;
+std::string Options::m_lineProtocolTarget;
+std::string Options::m_lineProtocolSpool;
+std::string Options::m_forwardTarget;
+std::string Options::m_forwardSite;
+std::string Options::m_forwardSpool;
+bool Options::m_forwardCompress = false;
+unsigned int Options::m_aggregatePort = 0;
+std::string Options::m_aggregateDirectory;
 unsigned int Options::m_rateLimit = 0;
 DebugStream Options::m_debugStreams[DebugCount];
 std::string Options::m_pidFilePath;
@@ -36,7 +46,64 @@ std::string Options::m_dbUser;
 std::string Options::m_dbPass;
 unsigned int Options::m_commandPort = 0;
 unsigned int Options::m_dataPort = 0;
+std::string Options::m_commandSocket;
+std::string Options::m_dataSocket;
+unsigned int Options::m_socketMode = 0660;
+unsigned int Options::m_maxConnections = 0;
+unsigned int Options::m_connectionRate = 0;
+unsigned int Options::m_requestRate = 0;
+unsigned int Options::m_idleTimeout = 0;
+unsigned int Options::m_seriesRetention = 0;
+std::vector<std::string> Options::m_windowStatsValues;
+bool Options::m_valueTimestamps = false;
+bool Options::m_dbMsPrecision = false;
+std::string Options::m_exportDirectory;
+time_t Options::m_exportStart = 0;
+time_t Options::m_exportEnd = 0;
+unsigned int Options::m_exportThreads = 0;
+unsigned int Options::m_shortCycleLength = 0;
+unsigned int Options::m_shortCycleCount = 0;
+float Options::m_nominalPower = 0;
+float Options::m_fuelEnergyContent = 0;
+std::vector<std::string> Options::m_anomalyValues;
+float Options::m_anomalyThreshold = 0;
+std::string Options::m_stateFile;
+std::string Options::m_alertRules;
+std::string Options::m_alertLog;
+std::string Options::m_errorHistory;
 Options::RoomControllerType Options::m_rcType = Options::RCUnknown;
+std::string Options::m_captureFile;
+bool Options::m_compactCapture = false;
+std::vector<std::string> Options::m_compactFiles;
+std::vector<std::string> Options::m_reprocessFiles;
+time_t Options::m_reprocessStart = 0;
+time_t Options::m_reprocessEnd = 0;
+unsigned int Options::m_reprocessThreads = 0;
+std::string Options::m_reprocessOutput;
+time_t Options::m_replayStart = 0;
+time_t Options::m_replayEnd = 0;
+std::vector<Options::FrameFilter> Options::m_replayFilter;
+std::string Options::m_configFile;
+std::set<std::string> Options::m_configOptions;
+std::set<std::string> Options::m_commandLineOptions;
+std::map<std::string, std::vector<std::string> > Options::m_configValues;
+
+/* settings the running collector picks up on reload, either because they're
+ * read on every use or because the components using them can be restarted
+ * on their own; changing any other one needs a restart of the collector */
+static const char *reloadableOptions[] = {
+    "ratelimit", "debug", "debug-file-size", "value-timestamps",
+    "short-cycle-length", "short-cycle-count", "anomaly-threshold",
+    "alert-rules", "alert-log",
+    "command-port", "data-port", "command-socket", "data-socket", "socket-mode",
+    "max-connections", "connection-rate", "request-rate", "idle-timeout",
+    "line-protocol-target", "line-protocol-spool", "mqtt-broker", "mqtt-prefix",
+    "forward-to", "forward-site", "forward-spool", "forward-compress"
+};
+
+/* the descriptions of the reloadable settings, taken from the ones parse()
+ * sets up so the reload writes into the same members with the same defaults */
+static bpo::options_description reloadDescriptions;
 
 static void
 usage(std::ostream& stream, const char *programName,
@@ -47,14 +114,74 @@ usage(std::ostream& stream, const char *programName,
     stream << "  serial:<device>     Connect to serial device <device> without sending support (e.g. Atmega8)" << std::endl;
     stream << "  tx-serial:<device>  Connect to serial device <device> with sending support (e.g. EMS Gateway)" << std::endl;
     stream << "  tcp:<host>:<port>   Connect to TCP address <host> at <port> (e.g. NetIO)" << std::endl;
+    stream << "  capture:<file>      Replay frames recorded with --capture-file" << std::endl;
     stream << options << std::endl;
 }
 
+static bool
+parseLocalTime(const std::string& text, time_t& result)
+{
+    try {
+	boost::posix_time::ptime time = boost::posix_time::time_from_string(text);
+	struct tm tm = boost::posix_time::to_tm(time);
+	tm.tm_isdst = -1;
+	result = mktime(&tm);
+    } catch (std::exception& e) {
+	return false;
+    }
+
+    return result != (time_t) -1;
+}
+
+/* parses [<source>:]<type>, both given in hex */
+static bool
+parseFrameFilter(const std::string& text, Options::FrameFilter& filter)
+{
+    size_t pos = text.find(':');
+    char *end;
+
+    filter.source = -1;
+    if (pos != std::string::npos) {
+	filter.source = strtoul(text.substr(0, pos).c_str(), &end, 16);
+	if (*end != '\0' || pos == 0 || filter.source > 0xff) {
+	    return false;
+	}
+    }
+
+    std::string type = text.substr(pos == std::string::npos ? 0 : pos + 1);
+    filter.type = strtoul(type.c_str(), &end, 16);
+    return !type.empty() && *end == '\0' && filter.type <= 0xff;
+}
+
+static bool
+parseSocketMode(const std::string& text, unsigned int& mode)
+{
+    char *end;
+
+    mode = strtoul(text.c_str(), &end, 8);
+    return !text.empty() && *end == '\0' && mode <= 0777;
+}
+
+/* options without default value that were removed from the file */
+template<typename T> static bool
+resetOption(const bpo::value_semantic& semantic)
+{
+    if (!dynamic_cast<const bpo::typed_value<T> *>(&semantic)) {
+	return false;
+    }
+    semantic.notify(boost::any(T()));
+    return true;
+}
+
 Options::ParseResult
 Options::parse(int argc, char *argv[])
 {
     std::string defaultPidFilePath;
     std::string config, rcType;
+    std::string reprocessStart, reprocessEnd;
+    std::string exportStart, exportEnd;
+    std::string replayStart, replayEnd;
+    std::vector<std::string> replayFilter;
 
     defaultPidFilePath = "/var/run/";
     defaultPidFilePath += argv[0];
@@ -69,7 +196,9 @@ Options::parse(int argc, char *argv[])
 	 "Rate limit (in s) for writing numeric sensor values into DB")
 	("debug,d", bpo::value<std::string>()->default_value("none"),
 	 "Comma separated list of debug flags (all, io, message, data, stats, none) "
-	 " and their files, e.g. message=/tmp/messages.txt");
+	 " and their files, e.g. message=/tmp/messages.txt")
+	("debug-file-size", bpo::value<unsigned int>()->default_value(0),
+	 "Rotate debug log files when they exceed the given size (in MB, 0 to disable)");
 
     bpo::options_description daemon("Daemon options");
     daemon.add_options()
@@ -90,7 +219,16 @@ Options::parse(int argc, char *argv[])
 	("db-user,u", bpo::value<std::string>(&m_dbUser)->composing(),
 	 "Database user name")
 	("db-pass,p", bpo::value<std::string>(&m_dbPass)->composing(),
-	 "Database password");
+	 "Database password")
+	("db-ms-precision", "Store sensor value times with millisecond precision (needs MySQL 5.6.4)")
+	("export", bpo::value<std::string>(&m_exportDirectory),
+	 "Export the sensor history as CSV files into the given directory and exit")
+	("export-start", bpo::value<std::string>(&exportStart),
+	 "Start of the time range to export (YYYY-MM-DD HH:MM:SS)")
+	("export-end", bpo::value<std::string>(&exportEnd),
+	 "End of the time range to export (YYYY-MM-DD HH:MM:SS)")
+	("export-threads", bpo::value<unsigned int>(&m_exportThreads)->default_value(0),
+	 "Number of sensors to export in parallel (0 to use all CPUs)");
 #endif
 
     bpo::options_description tcp("TCP options");
@@ -98,10 +236,90 @@ Options::parse(int argc, char *argv[])
 	("command-port,C", bpo::value<unsigned int>(&m_commandPort)->composing(),
 	 "TCP port for remote command interface (0 to disable)")
 	("data-port,D", bpo::value<unsigned int>(&m_dataPort)->composing(),
-	 "TCP port for broadcasting live sensor data (0 to disable)");
+	 "TCP port for broadcasting live sensor data (0 to disable)")
+	("command-socket", bpo::value<std::string>(&m_commandSocket),
+	 "Unix socket path for local clients of the command interface")
+	("data-socket", bpo::value<std::string>(&m_dataSocket),
+	 "Unix socket path for local clients of the live sensor data")
+	("socket-mode", bpo::value<std::string>()->default_value("0660"),
+	 "Permissions of the command and data sockets (octal)")
+	("max-connections", bpo::value<unsigned int>(&m_maxConnections)->default_value(32),
+	 "Maximum number of clients of each of the command and data interfaces (0 for no limit)")
+	("connection-rate", bpo::value<unsigned int>(&m_connectionRate)->default_value(60),
+	 "Connections per minute accepted from one address (0 for no limit)")
+	("request-rate", bpo::value<unsigned int>(&m_requestRate)->default_value(20),
+	 "Requests per second read from one command or data client (0 for no limit)")
+	("idle-timeout", bpo::value<unsigned int>(&m_idleTimeout)->default_value(0),
+	 "Seconds after which command clients without requests and data clients not taking data are disconnected (0 to disable)")
+	("series-retention", bpo::value<unsigned int>(&m_seriesRetention)->default_value(0),
+	 "Hours of numeric values to keep in memory for the series command (0 to disable)")
+	("window-stats", bpo::value<std::vector<std::string> >(&m_windowStatsValues)->multitoken(),
+	 "Values to keep day to month statistics of for the stats command, as list of [<subtype>/]<type>")
+	("value-timestamps", "Append the reception time to values sent via data port and MQTT");
+
+    bpo::options_description derived("Derived value options");
+    derived.add_options()
+	("short-cycle-length", bpo::value<unsigned int>(&m_shortCycleLength)->default_value(600),
+	 "Burner cycles shorter than this (in s) count as short cycles")
+	("short-cycle-count", bpo::value<unsigned int>(&m_shortCycleCount)->default_value(3),
+	 "Raise the short cycling alarm at this many short cycles per hour (0 to disable)")
+	("nominal-power", bpo::value<float>(&m_nominalPower)->default_value(0),
+	 "Nominal heat input of the burner at full modulation (in kW, 0 to disable energy estimation)")
+	("fuel-energy-content", bpo::value<float>(&m_fuelEnergyContent)->default_value(0),
+	 "Energy content of one unit of fuel, e.g. kWh per m³ of gas (0 to not estimate fuel usage)")
+	("anomaly-values", bpo::value<std::vector<std::string> >(&m_anomalyValues)->multitoken(),
+	 "Values to learn the normal behaviour of and report deviations for, as list of [<subtype>/]<type>")
+	("anomaly-threshold", bpo::value<float>(&m_anomalyThreshold)->default_value(4),
+	 "Deviation from the learned mean (in standard deviations) that is reported as anomaly")
+	("state-file", bpo::value<std::string>(&m_stateFile)->composing(),
+	 "File to keep derived counters in across restarts");
+
+    bpo::options_description alerts("Alert options");
+    alerts.add_options()
+	("alert-rules", bpo::value<std::string>(&m_alertRules)->composing(),
+	 "File with alert rules to evaluate on every received value")
+	("alert-log", bpo::value<std::string>(&m_alertLog)->composing(),
+	 "File to log raised and cleared alerts into")
+	("error-history", bpo::value<std::string>(&m_errorHistory)->composing(),
+	 "File to append new and cleared entries of the heater error logs to");
+
+    bpo::options_description capture("Capture options");
+    capture.add_options()
+	("capture-file", bpo::value<std::string>(&m_captureFile)->composing(),
+	 "File to record all received frames into")
+	("capture-compact", "Store repeated and slowly changing frames in compact form")
+	("compact", bpo::value<std::vector<std::string> >(&m_compactFiles)->multitoken(),
+	 "Rewrite the capture file given as first argument into the compact form given as second argument and exit");
+
+    bpo::options_description reprocess("Reprocessing options");
+    reprocess.add_options()
+	("reprocess", bpo::value<std::vector<std::string> >(&m_reprocessFiles)->multitoken(),
+	 "Rebuild sensor history from the given capture files and exit; derived values are kept as stored")
+	("reprocess-start", bpo::value<std::string>(&reprocessStart),
+	 "Start of the time range to rebuild (YYYY-MM-DD HH:MM:SS)")
+	("reprocess-end", bpo::value<std::string>(&reprocessEnd),
+	 "End of the time range to rebuild (YYYY-MM-DD HH:MM:SS)")
+	("reprocess-threads", bpo::value<unsigned int>(&m_reprocessThreads)->default_value(0),
+	 "Number of decoding threads (0 to use all CPUs)")
+	("reprocess-output", bpo::value<std::string>(&m_reprocessOutput),
+	 "Write rebuilt history as LOAD DATA files into the given directory instead of the database");
+
+    bpo::options_description replay("Capture replay options");
+    replay.add_options()
+	("replay-start", bpo::value<std::string>(&replayStart),
+	 "Only replay frames received after the given time (YYYY-MM-DD HH:MM:SS)")
+	("replay-end", bpo::value<std::string>(&replayEnd),
+	 "Only replay frames received before the given time (YYYY-MM-DD HH:MM:SS)")
+	("replay-filter", bpo::value<std::vector<std::string> >(&replayFilter)->multitoken(),
+	 "Only replay telegrams of the given types, as list of [<source>:]<type> in hex");
 
-#ifdef HAVE_MQTT
     bpo::options_description interface("Interface options");
+    interface.add_options()
+	("line-protocol-target", bpo::value<std::string>(&m_lineProtocolTarget)->composing(),
+	 "Time series database to write values to in line protocol (udp:<host>:<port> or http://<host>[:<port>]/<path>)")
+	("line-protocol-spool", bpo::value<std::string>(&m_lineProtocolSpool)->composing(),
+	 "File to keep line protocol batches in while the time series database is unreachable");
+#ifdef HAVE_MQTT
     interface.add_options()
 	("mqtt-broker", bpo::value<std::string>(&m_mqttTarget)->composing(),
 	 "MQTT broker address (<host>:<port>)")
@@ -109,6 +327,22 @@ Options::parse(int argc, char *argv[])
 	 "MQTT topic prefix (default: /ems)");
 #endif
 
+    bpo::options_description forward("Forwarding options");
+    forward.add_options()
+	("forward-to", bpo::value<std::string>(&m_forwardTarget)->composing(),
+	 "Aggregator to forward all received frames to (<host>:<port>)")
+	("forward-site", bpo::value<std::string>(&m_forwardSite)->composing(),
+	 "Site name to forward frames under (default: host name)")
+	("forward-spool", bpo::value<std::string>(&m_forwardSpool)->composing(),
+	 "File to keep unacknowledged frames in during outages and restarts")
+#ifdef HAVE_ZLIB
+	("forward-compress", "Compress the connection to the aggregator")
+#endif
+	("aggregate-port", bpo::value<unsigned int>(&m_aggregatePort)->composing(),
+	 "Run as aggregator for forwarding collectors on the given TCP port")
+	("aggregate-dir", bpo::value<std::string>(&m_aggregateDirectory)->default_value("."),
+	 "Directory to store the frames of each forwarding site in");
+
     bpo::options_description hidden("Hidden options");
     hidden.add_options()
 	("target", bpo::value<std::string>(&m_target), "Connection target");
@@ -120,9 +354,13 @@ Options::parse(int argc, char *argv[])
     options.add(db);
 #endif
     options.add(tcp);
-#ifdef HAVE_MQTT
+    options.add(derived);
+    options.add(alerts);
+    options.add(capture);
+    options.add(reprocess);
+    options.add(replay);
     options.add(interface);
-#endif
+    options.add(forward);
     options.add(hidden);
 
     bpo::options_description configOptions;
@@ -131,9 +369,11 @@ Options::parse(int argc, char *argv[])
     configOptions.add(db);
 #endif
     configOptions.add(tcp);
-#ifdef HAVE_MQTT
+    configOptions.add(derived);
+    configOptions.add(alerts);
+    configOptions.add(capture);
     configOptions.add(interface);
-#endif
+    configOptions.add(forward);
 
     bpo::options_description visible;
     visible.add(general);
@@ -142,23 +382,50 @@ Options::parse(int argc, char *argv[])
     visible.add(db);
 #endif
     visible.add(tcp);
-#ifdef HAVE_MQTT
+    visible.add(derived);
+    visible.add(alerts);
+    visible.add(capture);
+    visible.add(reprocess);
+    visible.add(replay);
     visible.add(interface);
-#endif
+    visible.add(forward);
 
     bpo::positional_options_description p;
     p.add("target", 1);
 
+    std::set<std::string> reloadable(reloadableOptions,
+	    reloadableOptions + sizeof(reloadableOptions) / sizeof(reloadableOptions[0]));
+    for (auto& option : configOptions.options()) {
+	m_configOptions.insert(option->long_name());
+	if (reloadable.count(option->long_name())) {
+	    reloadDescriptions.add(option);
+	}
+    }
+
     bpo::variables_map variables;
     try {
-	bpo::store(bpo::command_line_parser(argc, argv).options(options).positional(p).run(),
-		   variables);
+	bpo::parsed_options commandLine =
+		bpo::command_line_parser(argc, argv).options(options).positional(p).run();
+	bpo::store(commandLine, variables);
 	bpo::notify(variables);
+	for (auto& option : commandLine.options) {
+	    m_commandLineOptions.insert(option.string_key);
+	}
 
 	if (!config.empty()) {
 	    std::ifstream configFile(config.c_str());
-	    bpo::store(bpo::parse_config_file(configFile, configOptions), variables);
+	    bpo::parsed_options configValues = bpo::parse_config_file(configFile, configOptions);
+	    bpo::store(configValues, variables);
 	    bpo::notify(variables);
+	    for (auto& option : configValues.options) {
+		std::vector<std::string>& values = m_configValues[option.string_key];
+		values.insert(values.end(), option.value.begin(), option.value.end());
+	    }
+
+	    /* daemonizing changes the working directory */
+	    char *path = realpath(config.c_str(), NULL);
+	    m_configFile = path ? path : config;
+	    free(path);
 	}
     } catch (bpo::unknown_option& e) {
 	usage(std::cerr, argv[0], visible);
@@ -174,7 +441,46 @@ Options::parse(int argc, char *argv[])
     }
 
     /* check for missing variables */
-    if (!variables.count("target")) {
+    if (!variables.count("target") && m_reprocessFiles.empty() && m_compactFiles.empty() &&
+	    m_exportDirectory.empty() && m_aggregatePort == 0) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+
+    if (!reprocessStart.empty() && !parseLocalTime(reprocessStart, m_reprocessStart)) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+    if (!reprocessEnd.empty() && !parseLocalTime(reprocessEnd, m_reprocessEnd)) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+    if (!exportStart.empty() && !parseLocalTime(exportStart, m_exportStart)) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+    if (!exportEnd.empty() && !parseLocalTime(exportEnd, m_exportEnd)) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+    if (!replayStart.empty() && !parseLocalTime(replayStart, m_replayStart)) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+    if (!replayEnd.empty() && !parseLocalTime(replayEnd, m_replayEnd)) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+    for (auto& text : replayFilter) {
+	FrameFilter filter;
+	if (!parseFrameFilter(text, filter)) {
+	    usage(std::cerr, argv[0], visible);
+	    return ParseFailure;
+	}
+	m_replayFilter.push_back(filter);
+    }
+
+    if (!parseSocketMode(variables["socket-mode"].as<std::string>(), m_socketMode)) {
 	usage(std::cerr, argv[0], visible);
 	return ParseFailure;
     }
@@ -195,47 +501,182 @@ Options::parse(int argc, char *argv[])
 	m_daemonize = false;
     }
 
-    if (variables.count("debug")) {
-	std::string flags = variables["debug"].as<std::string>();
-	if (flags == "none") {
-	    for (unsigned int i = 0; i < DebugCount; i++) {
-		m_debugStreams[i].reset();
-	    }
-	} else if (flags.substr(0, 3) == "all") {
-	    size_t start = flags.find('=', 3);
-	    std::string file;
-	    if (start != std::string::npos) {
-		file = flags.substr(start + 1);
+    if (variables.count("value-timestamps")) {
+	m_valueTimestamps = true;
+    }
+    if (variables.count("db-ms-precision")) {
+	m_dbMsPrecision = true;
+    }
+    if (variables.count("capture-compact")) {
+	m_compactCapture = true;
+    }
+    if (variables.count("forward-compress")) {
+	m_forwardCompress = true;
+    }
+    if (!m_compactFiles.empty() && m_compactFiles.size() != 2) {
+	usage(std::cerr, argv[0], visible);
+	return ParseFailure;
+    }
+
+    DebugLog::instance().setMaxFileSize(variables["debug-file-size"].as<unsigned int>() * 1024 * 1024);
+    if (!m_reprocessFiles.empty()) {
+	/* reprocessing decodes messages in several threads, the debug
+	 * streams must only be written from one */
+	setupDebugStreams("none");
+    } else {
+	setupDebugStreams(variables["debug"].as<std::string>());
+    }
+
+    return ParseSuccess;
+}
+
+
+void
+Options::setupDebugStreams(const std::string& flags)
+{
+    for (unsigned int i = 0; i < DebugCount; i++) {
+	m_debugStreams[i].reset();
+    }
+
+    if (flags == "none") {
+	return;
+    }
+
+    if (flags.substr(0, 3) == "all") {
+	size_t start = flags.find('=', 3);
+	std::string file;
+	if (start != std::string::npos) {
+	    file = flags.substr(start + 1);
+	}
+	for (unsigned int i = 0; i < DebugCount; i++) {
+	    m_debugStreams[i].setFile(file);
+	}
+	return;
+    }
+
+    boost::char_separator<char> sep(",");
+    boost::tokenizer<boost::char_separator<char> > tokens(flags, sep);
+    BOOST_FOREACH(const std::string& item, tokens) {
+	std::string file;
+	size_t start = item.find('=');
+	unsigned int module;
+
+	if (item.compare(0, 2, "io") == 0) {
+	    module = DebugIo;
+	} else if (item.compare(0, 7, "message") == 0) {
+	    module = DebugMessages;
+	} else if (item.compare(0, 4, "data") == 0) {
+	    module = DebugData;
+	} else {
+	    continue;
+	}
+
+	if (start != std::string::npos) {
+	    file = item.substr(start + 1);
+	}
+	m_debugStreams[module].setFile(file);
+    }
+}
+
+bool
+Options::reload(std::set<std::string>& changed)
+{
+    if (m_configFile.empty()) {
+	std::cerr << "No configuration file to reload" << std::endl;
+	return false;
+    }
+
+    std::ifstream file(m_configFile.c_str());
+    if (!file.is_open()) {
+	std::cerr << "Could not open configuration file " << m_configFile << std::endl;
+	return false;
+    }
+
+    /* only the reloadable settings are parsed, all others are compared as text */
+    bpo::variables_map variables;
+    std::map<std::string, std::vector<std::string> > values;
+    try {
+	bpo::parsed_options parsed = bpo::parse_config_file(file, reloadDescriptions, true);
+	for (auto& option : parsed.options) {
+	    if (!m_configOptions.count(option.string_key)) {
+		std::cerr << "Unknown option " << option.string_key << " in "
+			  << m_configFile << std::endl;
+		return false;
 	    }
-	    for (unsigned int i = 0; i < DebugCount; i++) {
-		m_debugStreams[i].setFile(file);
+	    std::vector<std::string>& optionValues = values[option.string_key];
+	    optionValues.insert(optionValues.end(), option.value.begin(), option.value.end());
+	}
+	bpo::store(parsed, variables);
+    } catch (bpo::error& e) {
+	std::cerr << "Could not read " << m_configFile << ": " << e.what() << std::endl;
+	return false;
+    }
+
+    unsigned int socketMode;
+    if (!parseSocketMode(variables["socket-mode"].as<std::string>(), socketMode)) {
+	std::cerr << "Invalid socket mode in " << m_configFile << std::endl;
+	return false;
+    }
+
+    std::set<std::string> names;
+    for (auto& entry : m_configValues) {
+	names.insert(entry.first);
+    }
+    for (auto& entry : values) {
+	names.insert(entry.first);
+    }
+
+    for (auto& name : names) {
+	auto previous = m_configValues.find(name);
+	auto current = values.find(name);
+
+	if (previous != m_configValues.end() && current != values.end() &&
+		previous->second == current->second) {
+	    continue;
+	}
+	if (m_commandLineOptions.count(name)) {
+	    continue;
+	}
+	if (!reloadDescriptions.find_nothrow(name, false)) {
+	    std::cerr << "Changing " << name << " needs a restart of the collector" << std::endl;
+	    /* keep reporting it until the restart happened */
+	    if (previous != m_configValues.end()) {
+		values[name] = previous->second;
+	    } else {
+		values.erase(name);
 	    }
+	    continue;
+	}
+	changed.insert(name);
+    }
+
+    /* everything is validated, so apply all changes at once */
+    m_configValues = values;
+
+    for (auto& name : changed) {
+	const bpo::value_semantic& semantic = *reloadDescriptions.find(name, false).semantic();
+	if (variables.count(name)) {
+	    semantic.notify(variables[name].value());
 	} else {
-	    boost::char_separator<char> sep(",");
-	    boost::tokenizer<boost::char_separator<char> > tokens(flags, sep);
-	    BOOST_FOREACH(const std::string& item, tokens) {
-		std::string file;
-		size_t start = item.find('=');
-		unsigned int module;
-
-		if (item.compare(0, 2, "io") == 0) {
-		    module = DebugIo;
-		} else if (item.compare(0, 7, "message") == 0) {
-		    module = DebugMessages;
-		} else if (item.compare(0, 4, "data") == 0) {
-		    module = DebugData;
-		} else {
-		    continue;
-		}
-
-		if (start != std::string::npos) {
-		    file = item.substr(start + 1);
-		}
-		m_debugStreams[module].setFile(file);
-	    }
+	    resetOption<std::string>(semantic) || resetOption<unsigned int>(semantic);
 	}
     }
 
-    return ParseSuccess;
-}
+    if (changed.count("value-timestamps")) {
+	m_valueTimestamps = variables.count("value-timestamps") != 0;
+    }
+    if (changed.count("forward-compress")) {
+	m_forwardCompress = variables.count("forward-compress") != 0;
+    }
+    if (changed.count("socket-mode")) {
+	m_socketMode = socketMode;
+    }
+    if (changed.count("debug-file-size")) {
+	DebugLog::instance().setMaxFileSize(variables["debug-file-size"].as<unsigned int>() * 1024 * 1024);
+    }
+    if (changed.count("debug")) {
+	setupDebugStreams(variables["debug"].as<std::string>());
+    }
 
+    return true;
+}
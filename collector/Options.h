@@ -20,31 +20,67 @@
 #ifndef __OPTIONS_H__
 #define __OPTIONS_H__
 
+#include <time.h>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+#include "DebugLog.h"
 
+class DebugStreamBuf : public std::streambuf
+{
+    public:
+	DebugStreamBuf() : m_sink(0) {
+	    setp(m_buffer, m_buffer + sizeof(m_buffer));
+	}
+
+	void setSink(unsigned int sink) {
+	    m_sink = sink;
+	}
+
+    protected:
+	virtual int_type overflow(int_type c) override {
+	    sync();
+	    if (c != traits_type::eof()) {
+		*pptr() = c;
+		pbump(1);
+	    }
+	    return traits_type::not_eof(c);
+	}
+	virtual int sync() override {
+	    if (pptr() != pbase()) {
+		DebugLog::instance().push(m_sink, DebugLog::TextRecord,
+					  (const uint8_t *) pbase(), pptr() - pbase());
+		setp(m_buffer, m_buffer + sizeof(m_buffer));
+	    }
+	    return 0;
+	}
+
+    private:
+	unsigned int m_sink;
+	char m_buffer[DebugLog::PayloadSize];
+};
+
+/* Text written to the stream is handed to the DebugLog on every flush,
+ * e.g. by std::endl. Hot paths should use the binary record functions
+ * instead, which defer all formatting to the log thread. */
 class DebugStream : public std::ostream
 {
     public:
 	DebugStream() :
-	    std::ostream(std::cout.rdbuf()),
-	    m_active(false)
+	    std::ostream(&m_buf),
+	    m_active(false),
+	    m_sink(0)
 	{ }
 
 	void reset() {
 	    m_active = false;
-	    rdbuf(std::cout.rdbuf());
 	}
 
 	void setFile(const std::string& file) {
-	    if (file == "stdout") {
-		rdbuf(std::cout.rdbuf());
-	    } else if (file == "stderr") {
-		rdbuf(std::cerr.rdbuf());
-	    } else if (!file.empty()) {
-		m_fileBuf.open(file.c_str(), std::ios::out | std::ios::app);
-		rdbuf(&m_fileBuf);
-	    }
+	    m_sink = DebugLog::instance().openSink(file);
+	    m_buf.setSink(m_sink);
 	    m_active = true;
 	}
 
@@ -52,9 +88,19 @@ class DebugStream : public std::ostream
 	    return m_active;
 	}
 
+	void logBytes(bool sent, const uint8_t *data, size_t length) {
+	    DebugLog::instance().push(m_sink,
+		    sent ? DebugLog::SentBytesRecord : DebugLog::ReceivedBytesRecord,
+		    data, length);
+	}
+	void logMessage(const uint8_t *data, size_t length) {
+	    DebugLog::instance().push(m_sink, DebugLog::MessageRecord, data, length);
+	}
+
     private:
+	DebugStreamBuf m_buf;
 	bool m_active;
-	std::filebuf m_fileBuf;
+	unsigned int m_sink;
 };
 
 class Options
@@ -72,6 +118,12 @@ class Options
 	    RC35
 	} RoomControllerType;
 
+	typedef struct {
+	    /* -1 matches any source */
+	    int source;
+	    unsigned int type;
+	} FrameFilter;
+
 	static unsigned int rateLimit() {
 	    return m_rateLimit;
 	}
@@ -85,6 +137,30 @@ class Options
 	static const std::string& mqttPrefix() {
 	    return m_mqttPrefix;
 	}
+	static const std::string& lineProtocolTarget() {
+	    return m_lineProtocolTarget;
+	}
+	static const std::string& lineProtocolSpool() {
+	    return m_lineProtocolSpool;
+	}
+	static const std::string& forwardTarget() {
+	    return m_forwardTarget;
+	}
+	static const std::string& forwardSite() {
+	    return m_forwardSite;
+	}
+	static const std::string& forwardSpool() {
+	    return m_forwardSpool;
+	}
+	static bool forwardCompress() {
+	    return m_forwardCompress;
+	}
+	static unsigned int aggregatePort() {
+	    return m_aggregatePort;
+	}
+	static const std::string& aggregateDirectory() {
+	    return m_aggregateDirectory;
+	}
 	static bool daemonize() {
 	    return m_daemonize;
 	}
@@ -106,12 +182,128 @@ class Options
 	static unsigned int dataPort() {
 	    return m_dataPort;
 	}
+	static const std::string& commandSocket() {
+	    return m_commandSocket;
+	}
+	static const std::string& dataSocket() {
+	    return m_dataSocket;
+	}
+	static unsigned int socketMode() {
+	    return m_socketMode;
+	}
+	static unsigned int maxConnections() {
+	    return m_maxConnections;
+	}
+	static unsigned int connectionRate() {
+	    return m_connectionRate;
+	}
+	static unsigned int requestRate() {
+	    return m_requestRate;
+	}
+	static unsigned int idleTimeout() {
+	    return m_idleTimeout;
+	}
+	static unsigned int seriesRetention() {
+	    return m_seriesRetention;
+	}
+	static const std::vector<std::string>& windowStatsValues() {
+	    return m_windowStatsValues;
+	}
+	static bool valueTimestamps() {
+	    return m_valueTimestamps;
+	}
+	static const std::string& exportDirectory() {
+	    return m_exportDirectory;
+	}
+	static time_t exportStart() {
+	    return m_exportStart;
+	}
+	static time_t exportEnd() {
+	    return m_exportEnd;
+	}
+	static unsigned int exportThreads() {
+	    return m_exportThreads;
+	}
+	static bool databaseMsPrecision() {
+	    return m_dbMsPrecision;
+	}
+
+	static unsigned int shortCycleLength() {
+	    return m_shortCycleLength;
+	}
+	static unsigned int shortCycleCount() {
+	    return m_shortCycleCount;
+	}
+	static float nominalPower() {
+	    return m_nominalPower;
+	}
+	static float fuelEnergyContent() {
+	    return m_fuelEnergyContent;
+	}
+	static const std::vector<std::string>& anomalyValues() {
+	    return m_anomalyValues;
+	}
+	static float anomalyThreshold() {
+	    return m_anomalyThreshold;
+	}
+	static const std::string& stateFile() {
+	    return m_stateFile;
+	}
+	static const std::string& alertRules() {
+	    return m_alertRules;
+	}
+	static const std::string& alertLog() {
+	    return m_alertLog;
+	}
+	static const std::string& errorHistory() {
+	    return m_errorHistory;
+	}
 
 	static RoomControllerType roomControllerType() {
 	    return m_rcType;
 	}
 
+	static const std::string& captureFile() {
+	    return m_captureFile;
+	}
+	static bool compactCapture() {
+	    return m_compactCapture;
+	}
+	static const std::vector<std::string>& compactFiles() {
+	    return m_compactFiles;
+	}
+	static const std::vector<std::string>& reprocessFiles() {
+	    return m_reprocessFiles;
+	}
+	static time_t reprocessStart() {
+	    return m_reprocessStart;
+	}
+	static time_t reprocessEnd() {
+	    return m_reprocessEnd;
+	}
+	static unsigned int reprocessThreads() {
+	    return m_reprocessThreads;
+	}
+	static const std::string& reprocessOutput() {
+	    return m_reprocessOutput;
+	}
+	static time_t replayStart() {
+	    return m_replayStart;
+	}
+	static time_t replayEnd() {
+	    return m_replayEnd;
+	}
+	static const std::vector<FrameFilter>& replayFilter() {
+	    return m_replayFilter;
+	}
+
 	static ParseResult parse(int argc, char *argv[]);
+	/* rereads the configuration file and applies the settings which can
+	 * change at runtime, returns the names of those which changed */
+	static bool reload(std::set<std::string>& changed);
+
+    private:
+	static void setupDebugStreams(const std::string& flags);
 
     private:
 	static const unsigned int DebugIo = 0;
@@ -135,6 +327,14 @@ class Options
 	static std::string m_target;
 	static std::string m_mqttTarget;
 	static std::string m_mqttPrefix;
+	static std::string m_lineProtocolTarget;
+	static std::string m_lineProtocolSpool;
+	static std::string m_forwardTarget;
+	static std::string m_forwardSite;
+	static std::string m_forwardSpool;
+	static bool m_forwardCompress;
+	static unsigned int m_aggregatePort;
+	static std::string m_aggregateDirectory;
 	static unsigned int m_rateLimit;
 	static std::string m_pidFilePath;
 	static bool m_daemonize;
@@ -143,7 +343,51 @@ class Options
 	static std::string m_dbPass;
 	static unsigned int m_commandPort;
 	static unsigned int m_dataPort;
+	static std::string m_commandSocket;
+	static std::string m_dataSocket;
+	static unsigned int m_socketMode;
+	static unsigned int m_maxConnections;
+	static unsigned int m_connectionRate;
+	static unsigned int m_requestRate;
+	static unsigned int m_idleTimeout;
+	static unsigned int m_seriesRetention;
+	static std::vector<std::string> m_windowStatsValues;
+	static bool m_valueTimestamps;
+	static bool m_dbMsPrecision;
+	static std::string m_exportDirectory;
+	static time_t m_exportStart;
+	static time_t m_exportEnd;
+	static unsigned int m_exportThreads;
+	static unsigned int m_shortCycleLength;
+	static unsigned int m_shortCycleCount;
+	static float m_nominalPower;
+	static float m_fuelEnergyContent;
+	static std::vector<std::string> m_anomalyValues;
+	static float m_anomalyThreshold;
+	static std::string m_stateFile;
+	static std::string m_alertRules;
+	static std::string m_alertLog;
+	static std::string m_errorHistory;
 	static RoomControllerType m_rcType;
+	static std::string m_captureFile;
+	static bool m_compactCapture;
+	static std::vector<std::string> m_compactFiles;
+	static std::vector<std::string> m_reprocessFiles;
+	static time_t m_reprocessStart;
+	static time_t m_reprocessEnd;
+	static unsigned int m_reprocessThreads;
+	static std::string m_reprocessOutput;
+	static time_t m_replayStart;
+	static time_t m_replayEnd;
+	static std::vector<FrameFilter> m_replayFilter;
+
+	static std::string m_configFile;
+	/* all options accepted in the configuration file */
+	static std::set<std::string> m_configOptions;
+	/* options given on the command line, which the file doesn't override */
+	static std::set<std::string> m_commandLineOptions;
+	/* settings of the file as last read, for finding changes */
+	static std::map<std::string, std::vector<std::string> > m_configValues;
 };
 
 #endif /* __OPTIONS_H__ */
@@ -89,4 +89,12 @@ PidFile::write()
     }
 }
 
-
+void
+PidFile::release()
+{
+    if (m_fd != -1) {
+	lockf(m_fd, F_ULOCK, 0);
+	close(m_fd);
+	m_fd = -1;
+    }
+}
@@ -40,6 +40,9 @@ class PidFile
 	/** write current process PID to pidfile */
 	void write();
 
+	/** unlock pidfile without removing it, for a process taking over */
+	void release();
+
     private:
 	/** Pathname to the pidfile. */
 	std::string m_path;
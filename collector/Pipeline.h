@@ -0,0 +1,72 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "EmsMessage.h"
+
+/*
+ * Value sinks composed at compile time, as an alternative to registering
+ * every sink as value callback of its own. Each sink is described by a
+ * policy naming the object receiving the values, a filter and the call
+ * passing a value to it:
+ *
+ *   struct CacheSink {
+ *       typedef ValueCache Target;
+ *       static bool accepts(const EmsValue& value) { return true; }
+ *       static void handle(Target& cache, const EmsValue& value) {
+ *           cache.handleValue(value);
+ *       }
+ *   };
+ *
+ * handleValue() passes a value to the sinks in the given order. As the
+ * policies are known to the compiler, the filters and calls are inlined
+ * into one function instead of going through a type erased callback per
+ * sink. Sinks constructed without a target are skipped.
+ */
+template<typename... Sinks> class Pipeline;
+
+template<> class Pipeline<>
+{
+    public:
+	void handleValue(const EmsValue& /* value */) { }
+};
+
+template<typename Sink, typename... Rest>
+class Pipeline<Sink, Rest...> : private Pipeline<Rest...>
+{
+    public:
+	Pipeline(typename Sink::Target *target, typename Rest::Target *... rest) :
+	    Pipeline<Rest...>(rest...),
+	    m_target(target)
+	{ }
+
+	void handleValue(const EmsValue& value) {
+	    if (m_target && Sink::accepts(value)) {
+		Sink::handle(*m_target, value);
+	    }
+	    Pipeline<Rest...>::handleValue(value);
+	}
+
+    private:
+	typename Sink::Target *m_target;
+};
+
+#endif /* __PIPELINE_H__ */
@@ -0,0 +1,421 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include "Options.h"
+#include "Reprocessor.h"
+
+Reprocessor::Reprocessor(const std::vector<std::string>& files,
+			 time_t start, time_t end, unsigned int threads) :
+    m_files(files),
+    m_start(start),
+    m_end(end),
+    m_threads(threads),
+    m_first(0),
+    m_last(0)
+{
+    if (m_threads == 0) {
+	m_threads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+}
+
+bool
+Reprocessor::inRange(uint64_t timestamp) const
+{
+    time_t seconds = timestamp / 1000;
+    return (m_start == 0 || seconds >= m_start) && (m_end == 0 || seconds < m_end);
+}
+
+bool
+Reprocessor::open()
+{
+    uint64_t start = m_start * 1000ULL, end = m_end * 1000ULL;
+
+    for (size_t i = 0; i < m_files.size(); i++) {
+	CaptureReader reader(m_files[i]);
+
+	if (!reader.isOpen()) {
+	    std::cerr << "Could not read capture file " << m_files[i] << std::endl;
+	    return false;
+	}
+
+	/*
+	 * The value cache is carried from block to block in file order, so
+	 * keep that order even if the clock went backwards during capture.
+	 */
+	uint64_t order = 0;
+	for (auto& block : reader.findBlocks(start, end)) {
+	    order = std::max(order, block.firstTimestamp);
+	    Chunk chunk = { i, block, order };
+	    m_chunks.push_back(chunk);
+	}
+    }
+
+    /* captures may be passed in any order, merging needs them sorted by time */
+    std::stable_sort(m_chunks.begin(), m_chunks.end(), [] (const Chunk& a, const Chunk& b) {
+	return a.order < b.order;
+    });
+
+    for (auto& chunk : m_chunks) {
+	time_t first = chunk.block.firstTimestamp / 1000;
+	time_t last = chunk.block.lastTimestamp / 1000 + 1;
+
+	if (m_first == 0 || first < m_first) {
+	    m_first = first;
+	}
+	m_last = std::max(m_last, last);
+    }
+    if (m_start != 0) {
+	m_first = std::max(m_first, m_start);
+    }
+    if (m_end != 0) {
+	m_last = std::min(m_last, m_end);
+    }
+
+    return true;
+}
+
+void
+Reprocessor::decodeChunk(const Chunk& chunk, ReaderList& readers,
+			 ChunkResult& result) const
+{
+    std::vector<CaptureFile::Frame> frames;
+
+    if (!readers[chunk.file]) {
+	readers[chunk.file].reset(new CaptureReader(m_files[chunk.file]));
+    }
+    if (!readers[chunk.file]->readBlock(chunk.block, frames)) {
+	std::cerr << "Capture file " << m_files[chunk.file]
+		  << " has a damaged block at offset " << chunk.block.offset << std::endl;
+    }
+
+    EmsMessage::ValueHandler valueCb = [&result] (const EmsValue& value) {
+	Sample sample;
+	if (SensorMapping::map(value, sample.reading)) {
+	    sample.timestamp = value.getTimestamp().realtime;
+	    result.samples.push_back(sample);
+	}
+	result.cache.handleValue(value);
+    };
+    EmsMessage::CacheAccessor cacheCb = [&result] (EmsValue::Type type, EmsValue::SubType subtype) {
+	const EmsValue *value = result.cache.getValue(type, subtype);
+	if (!value) {
+	    result.misses.push_back(std::make_pair(type, subtype));
+	}
+	return value;
+    };
+
+    for (auto& frame : frames) {
+	if (!inRange(frame.timestamp)) {
+	    continue;
+	}
+	EmsMessage message(valueCb, cacheCb, frame.data, Timestamp::fromRealtime(frame.timestamp));
+	message.handle();
+    }
+
+    std::stable_sort(result.samples.begin(), result.samples.end(),
+		     [] (const Sample& a, const Sample& b) {
+	return a.timestamp < b.timestamp;
+    });
+}
+
+bool
+Reprocessor::run(const SensorMapping::IntervalHandler& handler)
+{
+    m_handler = handler;
+    m_sensors.clear();
+
+    /*
+     * Workers decode chunks out of order, while this thread merges them in
+     * order. Workers may only run a limited amount of chunks ahead of the
+     * merge position, which bounds memory usage regardless of archive size.
+     */
+    std::vector<ChunkResult> results(m_chunks.size());
+    std::vector<bool> finished(m_chunks.size(), false);
+    std::mutex lock;
+    std::condition_variable cond;
+    size_t nextChunk = 0, mergePos = 0;
+    const size_t window = m_threads * ChunksPerThread;
+
+    auto worker = [&] () {
+	/* each worker keeps its own readers, as they aren't thread safe */
+	ReaderList readers(m_files.size());
+
+	while (true) {
+	    size_t index;
+	    {
+		std::unique_lock<std::mutex> guard(lock);
+		cond.wait(guard, [&] {
+		    return nextChunk >= m_chunks.size() || nextChunk < mergePos + window;
+		});
+		if (nextChunk >= m_chunks.size()) {
+		    return;
+		}
+		index = nextChunk++;
+	    }
+
+	    ChunkResult result;
+	    decodeChunk(m_chunks[index], readers, result);
+
+	    {
+		std::lock_guard<std::mutex> guard(lock);
+		std::swap(results[index], result);
+		finished[index] = true;
+	    }
+	    cond.notify_all();
+	}
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < m_threads; i++) {
+	workers.push_back(std::thread(worker));
+    }
+
+    /*
+     * Overlapping captures yield chunks covering the same time, so their
+     * samples are merged by timestamp. A chunk joins the merge once the
+     * merge reaches its start.
+     */
+    struct Cursor {
+	uint64_t timestamp;
+	size_t chunk;
+	size_t position;
+
+	bool operator<(const Cursor& other) const {
+	    /* std::priority_queue returns the largest element first */
+	    if (timestamp != other.timestamp) {
+		return timestamp > other.timestamp;
+	    }
+	    return chunk > other.chunk;
+	}
+    };
+    std::priority_queue<Cursor> cursors;
+    std::map<size_t, ChunkResult> active;
+    std::vector<ValueCache> fileCaches(m_files.size());
+    ReaderList readers(m_files.size());
+
+    while (true) {
+	while (mergePos < m_chunks.size()
+		&& (cursors.empty() || m_chunks[mergePos].order <= cursors.top().timestamp)) {
+	    size_t index = mergePos;
+	    ChunkResult& result = active[index];
+	    {
+		std::unique_lock<std::mutex> guard(lock);
+		cond.wait(guard, [&] { return finished[index]; });
+		std::swap(result, results[index]);
+		mergePos++;
+	    }
+	    cond.notify_all();
+
+	    const Chunk& chunk = m_chunks[index];
+	    ValueCache& fileCache = fileCaches[chunk.file];
+	    bool dependent = false;
+
+	    for (auto& miss : result.misses) {
+		if (fileCache.getValue(miss.first, miss.second)) {
+		    dependent = true;
+		    break;
+		}
+	    }
+	    if (dependent) {
+		ChunkResult redecoded;
+		redecoded.cache = fileCache;
+		decodeChunk(chunk, readers, redecoded);
+		std::swap(result, redecoded);
+		std::swap(fileCache, result.cache);
+	    } else {
+		fileCache.merge(result.cache);
+	    }
+
+	    if (result.samples.empty()) {
+		active.erase(index);
+	    } else {
+		Cursor cursor = { result.samples[0].timestamp, index, 0 };
+		cursors.push(cursor);
+	    }
+	}
+
+	if (cursors.empty()) {
+	    break;
+	}
+
+	Cursor cursor = cursors.top();
+	std::vector<Sample>& samples = active[cursor.chunk].samples;
+
+	cursors.pop();
+	mergeSample(samples[cursor.position]);
+	if (++cursor.position < samples.size()) {
+	    cursor.timestamp = samples[cursor.position].timestamp;
+	    cursors.push(cursor);
+	} else {
+	    active.erase(cursor.chunk);
+	}
+    }
+
+    for (auto& thread : workers) {
+	thread.join();
+    }
+
+    finishMerge();
+    return true;
+}
+
+static bool
+sameValue(const SensorMapping::Reading& a, const SensorMapping::Reading& b)
+{
+    switch (a.kind) {
+	case SensorMapping::NumericReading: return a.numeric == b.numeric;
+	case SensorMapping::BooleanReading: return a.boolean == b.boolean;
+	case SensorMapping::StateReading: return a.state == b.state;
+    }
+    return false;
+}
+
+/* mirrors Database::addSensorValue */
+void
+Reprocessor::mergeSample(const Sample& sample)
+{
+    auto iter = m_sensors.find(sample.reading.sensor);
+    if (iter == m_sensors.end()) {
+	SensorState state = SensorState();
+	iter = m_sensors.insert(std::make_pair(sample.reading.sensor, state)).first;
+    }
+
+    SensorState& state = iter->second;
+    time_t limit = Options::rateLimit();
+    uint64_t timestamp = sample.timestamp;
+
+    /* the clock of the capturing host may have been set back */
+    if (state.open && timestamp < state.current.end) {
+	timestamp = state.current.end;
+    }
+    time_t seconds = timestamp / 1000;
+
+    if (sample.reading.kind == SensorMapping::NumericReading && limit != 0
+	    && state.open && seconds - state.lastWrite < limit) {
+	return;
+    }
+    state.lastWrite = seconds;
+
+    if (state.open) {
+	state.current.end = timestamp;
+	if (!sameValue(state.current.reading, sample.reading)) {
+	    m_handler(state.current);
+	    state.open = false;
+	}
+    }
+    if (!state.open) {
+	state.current.reading = sample.reading;
+	state.current.start = state.current.end = timestamp;
+	state.open = true;
+    }
+}
+
+void
+Reprocessor::finishMerge()
+{
+    for (auto& entry : m_sensors) {
+	if (entry.second.open) {
+	    m_handler(entry.second.current);
+	    entry.second.open = false;
+	}
+    }
+}
+
+static std::string
+formatTime(uint64_t timestamp)
+{
+    time_t seconds = timestamp / 1000;
+    char buffer[32];
+
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localtime(&seconds));
+    if (Options::databaseMsPrecision()) {
+	snprintf(buffer + strlen(buffer), sizeof(buffer) - strlen(buffer),
+		 ".%03u", (unsigned int) (timestamp % 1000));
+    }
+    return buffer;
+}
+
+static std::string
+escapeField(const std::string& value)
+{
+    std::string escaped;
+
+    for (auto c : value) {
+	switch (c) {
+	    case '\\': escaped += "\\\\"; break;
+	    case '\t': escaped += "\\t"; break;
+	    case '\n': escaped += "\\n"; break;
+	    default: escaped += c; break;
+	}
+    }
+
+    return escaped;
+}
+
+/*
+ * Writes the intervals in a format suitable for
+ * LOAD DATA INFILE '<file>' INTO TABLE <table> (sensor, value, starttime, endtime)
+ */
+bool
+Reprocessor::writeFiles(const std::string& directory)
+{
+    static const char * fileNames[] = {
+	"numeric_data.txt", "boolean_data.txt", "state_data.txt"
+    };
+    std::ofstream files[3];
+
+    for (size_t i = 0; i < 3; i++) {
+	std::string path = directory + "/" + fileNames[i];
+	files[i].open(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!files[i].is_open()) {
+	    std::cerr << "Could not open output file " << path << std::endl;
+	    return false;
+	}
+    }
+
+    bool success = run([&files] (const SensorMapping::Interval& interval) {
+	const SensorMapping::Reading& reading = interval.reading;
+	std::ofstream& file = files[reading.kind];
+
+	file << reading.sensor << '\t';
+	switch (reading.kind) {
+	    case SensorMapping::NumericReading: file << reading.numeric; break;
+	    case SensorMapping::BooleanReading: file << (reading.boolean ? 1 : 0); break;
+	    case SensorMapping::StateReading: file << escapeField(reading.state); break;
+	}
+	file << '\t' << formatTime(interval.start) << '\t' << formatTime(interval.end) << '\n';
+    });
+
+    for (size_t i = 0; i < 3; i++) {
+	files[i].close();
+	if (files[i].fail()) {
+	    return false;
+	}
+    }
+
+    return success;
+}
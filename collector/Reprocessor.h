@@ -0,0 +1,110 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __REPROCESSOR_H__
+#define __REPROCESSOR_H__
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "CaptureFile.h"
+#include "Noncopyable.h"
+#include "SensorMapping.h"
+#include "ValueCache.h"
+
+/*
+ * Rebuilds the sensor history from raw capture files. The capture blocks
+ * covering the requested time range are decoded in parallel; the decoded
+ * values are then merged in time order into the same change-only
+ * intervals the online database writer produces. Intervals are passed on
+ * as soon as they are complete, so nothing proportional to the length of
+ * the archive is kept in memory.
+ *
+ * Some messages are decoded using values of earlier messages. Blocks are
+ * therefore decoded with an empty value cache first; a block which looked
+ * up a value its predecessors in the same file provide is decoded again
+ * with their cache while merging.
+ */
+class Reprocessor : private boost::noncopyable
+{
+    public:
+	Reprocessor(const std::vector<std::string>& files,
+		    time_t start, time_t end, unsigned int threads);
+
+	/* reads the capture indexes, must be called before anything else */
+	bool open();
+	bool run(const SensorMapping::IntervalHandler& handler);
+	bool writeFiles(const std::string& directory);
+
+	/* time range [first, last) covered by the captures within the requested range */
+	time_t firstTimestamp() const {
+	    return m_first;
+	}
+	time_t lastTimestamp() const {
+	    return m_last;
+	}
+
+    private:
+	struct Chunk {
+	    size_t file;
+	    CaptureFile::Block block;
+	    /* merge position, never decreases within a file */
+	    uint64_t order;
+	};
+	typedef std::vector<std::unique_ptr<CaptureReader> > ReaderList;
+
+	struct Sample {
+	    uint64_t timestamp;
+	    SensorMapping::Reading reading;
+	};
+
+	struct ChunkResult {
+	    std::vector<Sample> samples;
+	    ValueCache cache;
+	    /* cache lookups that found nothing */
+	    std::vector<std::pair<EmsValue::Type, EmsValue::SubType> > misses;
+	};
+
+	struct SensorState {
+	    bool open;
+	    time_t lastWrite;
+	    SensorMapping::Interval current;
+	};
+
+	void decodeChunk(const Chunk& chunk, ReaderList& readers,
+			 ChunkResult& result) const;
+	void mergeSample(const Sample& sample);
+	void finishMerge();
+	bool inRange(uint64_t timestamp) const;
+
+    private:
+	/* number of decoded chunks kept in memory per worker thread */
+	static const size_t ChunksPerThread = 4;
+
+	std::vector<std::string> m_files;
+	time_t m_start, m_end;
+	unsigned int m_threads;
+	std::vector<Chunk> m_chunks;
+	std::map<unsigned int, SensorState> m_sensors;
+	SensorMapping::IntervalHandler m_handler;
+	time_t m_first, m_last;
+};
+
+#endif /* __REPROCESSOR_H__ */
@@ -22,17 +22,20 @@
 #include "SendingSerialHandler.h"
 
 SendingSerialHandler::SendingSerialHandler(const std::string& device,
-					   ValueCache& cache) :
-    SerialHandler(device, cache),
+					   ValueCache& cache,
+					   int fd) :
+    SerialHandler(device, cache, fd),
     EmsCommandSender((boost::asio::io_service&) *this)
 {
 }
 
 void
-SendingSerialHandler::sendMessageImpl(const EmsMessage& msg)
+SendingSerialHandler::sendMessageImpl(const EmsCommandRequest& request)
 {
     boost::system::error_code error;
-    std::vector<uint8_t> sendData = msg.getSendData(false);
+    /* 0xaa 0x55 <length> <telegram> <checksum> */
+    uint8_t sendData[EmsCommandRequest::MaxSendSize + 4] = { 0xaa, 0x55 };
+    size_t length = request.getSendData(sendData + 3, false);
     DebugStream& debug = Options::ioDebug();
     uint8_t checksum = 0;
 
@@ -40,22 +43,17 @@ SendingSerialHandler::sendMessageImpl(const EmsMessage& msg)
 	return;
     }
 
-    for (size_t i = 0; i < sendData.size(); i++) {
-	checksum ^= sendData[i];
+    for (size_t i = 0; i < length; i++) {
+	checksum ^= sendData[i + 3];
     }
-    sendData.insert(sendData.begin(), { 0xaa, 0x55, static_cast<uint8_t>(sendData.size()) });
-    sendData.push_back(checksum);
+    sendData[2] = length;
+    sendData[length + 3] = checksum;
+    length += 4;
 
     if (debug) {
-	debug << "IO: Sending bytes ";
-	for (size_t i = 0; i < sendData.size(); i++) {
-	    debug << std::setfill('0') << std::setw(2)
-		  << std::showbase << std::hex
-		  << (unsigned int) sendData[i] << " ";
-	}
-	debug << std::endl;
+	debug.logBytes(true, sendData, length);
     }
 
-    boost::asio::write(m_serialPort, boost::asio::buffer(sendData),
+    boost::asio::write(m_serialPort, boost::asio::buffer(sendData, length),
 		       boost::asio::transfer_all(), error);
 }
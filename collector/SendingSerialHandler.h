@@ -26,10 +26,10 @@
 class SendingSerialHandler : public SerialHandler, public EmsCommandSender
 {
     public:
-	SendingSerialHandler(const std::string& device, ValueCache& cache);
+	SendingSerialHandler(const std::string& device, ValueCache& cache, int fd = -1);
 
     protected:
-	virtual void sendMessageImpl(const EmsMessage& msg) override;
+	virtual void sendMessageImpl(const EmsCommandRequest& request) override;
 	virtual void onPcMessageReceived(const EmsMessage& msg) override {
 	    handlePcMessage(msg);
 	}
@@ -0,0 +1,186 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SensorMapping.h"
+
+bool
+SensorMapping::map(const EmsValue& value, Reading& reading)
+{
+    static const struct {
+	EmsValue::Type type;
+	EmsValue::SubType subtype;
+	NumericSensors sensor;
+    } NUMERICMAPPING[] = {
+	{ EmsValue::SollTemp, EmsValue::Kessel, SensorKesselSollTemp },
+	{ EmsValue::IstTemp, EmsValue::Kessel, SensorKesselIstTemp },
+	{ EmsValue::SollTemp, EmsValue::WW, SensorWarmwasserSollTemp },
+	{ EmsValue::IstTemp, EmsValue::WW, SensorWarmwasserIstTemp },
+	{ EmsValue::SollTemp, EmsValue::HK1, SensorVorlaufHK1SollTemp },
+	{ EmsValue::IstTemp, EmsValue::HK1, SensorVorlaufHK1IstTemp },
+	{ EmsValue::SollTemp, EmsValue::HK2, SensorVorlaufHK2SollTemp },
+	{ EmsValue::IstTemp, EmsValue::HK2, SensorVorlaufHK2IstTemp },
+	{ EmsValue::IstTemp, EmsValue::Ruecklauf, SensorRuecklaufTemp },
+	{ EmsValue::IstTemp, EmsValue::Aussen, SensorAussenTemp },
+	{ EmsValue::GedaempfteTemp, EmsValue::Aussen, SensorGedaempfteAussenTemp },
+	{ EmsValue::RaumSollTemp, EmsValue::HK1, SensorRaumSollTemp },
+	{ EmsValue::RaumIstTemp, EmsValue::HK1, SensorRaumIstTemp },
+	{ EmsValue::Flammenstrom, EmsValue::None, SensorFlammenstrom },
+	{ EmsValue::Systemdruck, EmsValue::None, SensorSystemdruck },
+	{ EmsValue::IstTemp, EmsValue::Waermetauscher, SensorWaermetauscherTemp },
+	{ EmsValue::DurchflussMenge, EmsValue::WW, SensorWarmwasserDurchfluss },
+	{ EmsValue::IstTemp, EmsValue::SolarSpeicher, SensorSolarSpeicherTemp },
+	{ EmsValue::IstTemp, EmsValue::SolarKollektor, SensorSolarKollektorTemp },
+	{ EmsValue::BrennerZyklusDauer, EmsValue::Brenner, SensorBrennerZyklusDauer },
+	{ EmsValue::BrennerPausenDauer, EmsValue::Brenner, SensorBrennerPausenDauer },
+	{ EmsValue::BrennerTastgrad, EmsValue::Brenner, SensorBrennerTastgrad },
+	{ EmsValue::MittlereModulation, EmsValue::Brenner, SensorMittlereModulation },
+	{ EmsValue::EnergieStunde, EmsValue::Heizung, SensorEnergieHeizungStunde },
+	{ EmsValue::EnergieStunde, EmsValue::WW, SensorEnergieWWStunde },
+	{ EmsValue::EnergieTag, EmsValue::Heizung, SensorEnergieHeizungTag },
+	{ EmsValue::EnergieTag, EmsValue::WW, SensorEnergieWWTag },
+	{ EmsValue::EnergieGesamt, EmsValue::Heizung, SensorEnergieHeizungGesamt },
+	{ EmsValue::EnergieGesamt, EmsValue::WW, SensorEnergieWWGesamt },
+	{ EmsValue::BrennstoffTag, EmsValue::None, SensorBrennstoffTag },
+	{ EmsValue::BrennstoffGesamt, EmsValue::None, SensorBrennstoffGesamt }
+    };
+
+    static const struct {
+	EmsValue::Type type;
+	EmsValue::SubType subtype;
+	NumericSensors sensor;
+    } INTEGERMAPPING[] = {
+	{ EmsValue::BetriebsZeit, EmsValue::Kessel, SensorBetriebszeit },
+	{ EmsValue::HeizZeit, EmsValue::Kessel, SensorHeizZeit },
+	{ EmsValue::Brennerstarts, EmsValue::Kessel, SensorBrennerstarts },
+	{ EmsValue::WarmwasserbereitungsZeit, EmsValue::None, SensorWarmwasserbereitungsZeit },
+	{ EmsValue::WarmwasserBereitungen, EmsValue::None, SensorWarmwasserBereitungen },
+	{ EmsValue::Mischersteuerung, EmsValue::HK2, SensorMischersteuerung },
+	{ EmsValue::IstModulation, EmsValue::Brenner, SensorMomLeistung },
+	{ EmsValue::SollModulation, EmsValue::Brenner, SensorMaxLeistung },
+	{ EmsValue::IstModulation, EmsValue::KesselPumpe, SensorPumpenModulation },
+	{ EmsValue::BrennerStartsProStunde, EmsValue::Brenner, SensorBrennerStartsProStunde }
+    };
+
+    static const struct {
+	EmsValue::Type type;
+	EmsValue::SubType subtype;
+	BooleanSensors sensor;
+    } BOOLMAPPING[] = {
+	{ EmsValue::FlammeAktiv, EmsValue::None, SensorFlamme },
+	{ EmsValue::BrennerAktiv, EmsValue::None, SensorBrenner },
+	{ EmsValue::ZuendungAktiv, EmsValue::None, SensorZuendung },
+	{ EmsValue::PumpeAktiv, EmsValue::Kessel, SensorKesselPumpe },
+	{ EmsValue::DreiWegeVentilAufWW, EmsValue::None, Sensor3WegeVentil },
+	{ EmsValue::Tagbetrieb, EmsValue::HK1, SensorHK1Tagbetrieb },
+	{ EmsValue::PumpeAktiv, EmsValue::HK1, SensorHK1Pumpe },
+	{ EmsValue::Ferien, EmsValue::HK1, SensorHK1Ferien },
+	{ EmsValue::Party, EmsValue::HK1, SensorHK1Party },
+	{ EmsValue::Tagbetrieb, EmsValue::HK2, SensorHK2Tagbetrieb },
+	{ EmsValue::PumpeAktiv, EmsValue::HK2, SensorHK2Pumpe },
+	{ EmsValue::Ferien, EmsValue::HK2, SensorHK2Ferien },
+	{ EmsValue::Party, EmsValue::HK2, SensorHK2Party },
+	{ EmsValue::WarmwasserBereitung, EmsValue::None, SensorWarmwasserBereitung },
+	{ EmsValue::WarmwasserTempOK, EmsValue::None, SensorWarmwasserTempOK },
+	{ EmsValue::ZirkulationAktiv, EmsValue::None, SensorZirkulation },
+	{ EmsValue::Tagbetrieb, EmsValue::Zirkulation, SensorZirkulationTagbetrieb },
+	{ EmsValue::WWVorrang, EmsValue::None, SensorWWVorrang },
+	{ EmsValue::Tagbetrieb, EmsValue::WW, SensorWWTagbetrieb },
+	{ EmsValue::Sommerbetrieb, EmsValue::None, SensorSommerbetrieb },
+	{ EmsValue::PumpeAktiv, EmsValue::Solar, SensorSolarPumpe },
+	{ EmsValue::Taktalarm, EmsValue::Brenner, SensorTaktalarm }
+    };
+
+    static const struct {
+	EmsValue::Type type;
+	StateSensors sensor;
+    } STATEMAPPING[] = {
+	{ EmsValue::FehlerCode, SensorFehlerCode },
+	{ EmsValue::ServiceCode, SensorServiceCode },
+	{ EmsValue::Anomalie, SensorAnomalie }
+    };
+
+    if (!value.isValid()) {
+	return false;
+    }
+
+    EmsValue::Type type = value.getType();
+    EmsValue::SubType subtype = value.getSubType();
+
+    for (size_t i = 0; i < sizeof(NUMERICMAPPING) / sizeof(NUMERICMAPPING[0]); i++) {
+	if (type == NUMERICMAPPING[i].type && subtype == NUMERICMAPPING[i].subtype) {
+	    reading.sensor = NUMERICMAPPING[i].sensor;
+	    reading.kind = NumericReading;
+	    reading.numeric = value.getValue<float>();
+	    return true;
+	}
+    }
+    for (size_t i = 0; i < sizeof(INTEGERMAPPING) / sizeof(INTEGERMAPPING[0]); i++) {
+	if (type == INTEGERMAPPING[i].type && subtype == INTEGERMAPPING[i].subtype) {
+	    reading.sensor = INTEGERMAPPING[i].sensor;
+	    reading.kind = NumericReading;
+	    reading.numeric = value.getValue<unsigned int>();
+	    return true;
+	}
+    }
+    for (size_t i = 0; i < sizeof(BOOLMAPPING) / sizeof(BOOLMAPPING[0]); i++) {
+	if (type == BOOLMAPPING[i].type) {
+	    if (BOOLMAPPING[i].subtype == EmsValue::None || subtype == BOOLMAPPING[i].subtype) {
+		reading.sensor = BOOLMAPPING[i].sensor;
+		reading.kind = BooleanReading;
+		reading.boolean = value.getValue<bool>();
+		return true;
+	    }
+	}
+    }
+    for (size_t i = 0; i < sizeof(STATEMAPPING) / sizeof(STATEMAPPING[0]); i++) {
+	if (type == STATEMAPPING[i].type) {
+	    reading.sensor = STATEMAPPING[i].sensor;
+	    reading.kind = StateReading;
+	    reading.state = value.getValue<std::string>();
+	    return true;
+	}
+    }
+
+    if (type == EmsValue::Betriebsart && (subtype == EmsValue::HK1 || subtype == EmsValue::HK2)) {
+	reading.sensor = subtype == EmsValue::HK2 ? SensorHK2Automatik : SensorHK1Automatik;
+	reading.kind = BooleanReading;
+	reading.boolean = value.getValue<uint8_t>() == 2;
+	return true;
+    }
+
+    return false;
+}
+
+const std::vector<unsigned int>&
+SensorMapping::derivedSensors()
+{
+    static const unsigned int DERIVED[] = {
+	SensorBrennerZyklusDauer, SensorBrennerPausenDauer, SensorBrennerTastgrad,
+	SensorBrennerStartsProStunde, SensorMittlereModulation,
+	SensorEnergieHeizungStunde, SensorEnergieWWStunde,
+	SensorEnergieHeizungTag, SensorEnergieWWTag,
+	SensorEnergieHeizungGesamt, SensorEnergieWWGesamt,
+	SensorBrennstoffTag, SensorBrennstoffGesamt,
+	SensorTaktalarm, SensorAnomalie
+    };
+    static const std::vector<unsigned int> sensors(DERIVED,
+	    DERIVED + sizeof(DERIVED) / sizeof(DERIVED[0]));
+
+    return sensors;
+}
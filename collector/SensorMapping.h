@@ -0,0 +1,144 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SENSORMAPPING_H__
+#define __SENSORMAPPING_H__
+
+#include <time.h>
+#include <string>
+#include <vector>
+#include "EmsMessage.h"
+
+/* Mapping of EMS values to the sensor IDs used in the database. This is
+ * kept independent of the MySQL bindings, so it can be shared by the
+ * online database writer and the offline tools. */
+class SensorMapping
+{
+    public:
+	typedef enum {
+	    SensorKesselSollTemp = 1,
+	    SensorKesselIstTemp = 2,
+	    SensorWarmwasserSollTemp = 3,
+	    SensorWarmwasserIstTemp = 4,
+	    SensorVorlaufHK1SollTemp = 5,
+	    SensorVorlaufHK1IstTemp = 6,
+	    SensorVorlaufHK2SollTemp = 7,
+	    SensorVorlaufHK2IstTemp = 8,
+	    SensorMischersteuerung = 9,
+	    SensorRuecklaufTemp = 10,
+	    SensorAussenTemp = 11,
+	    SensorGedaempfteAussenTemp = 12,
+	    SensorRaumSollTemp = 13,
+	    SensorRaumIstTemp = 14,
+	    SensorMomLeistung = 15,
+	    SensorMaxLeistung = 16,
+	    SensorFlammenstrom = 17,
+	    SensorSystemdruck = 18,
+	    SensorBetriebszeit = 19,
+	    SensorHeizZeit = 23,
+	    SensorBrennerstarts = 20,
+	    SensorWarmwasserbereitungsZeit = 21,
+	    SensorWarmwasserBereitungen = 22,
+	    SensorPumpenModulation = 24,
+	    SensorWaermetauscherTemp = 25,
+	    SensorWarmwasserDurchfluss = 26,
+	    SensorSolarSpeicherTemp = 27,
+	    SensorSolarKollektorTemp = 28,
+	    SensorBrennerZyklusDauer = 29,
+	    SensorBrennerPausenDauer = 30,
+	    SensorBrennerTastgrad = 31,
+	    SensorBrennerStartsProStunde = 32,
+	    SensorMittlereModulation = 33,
+	    SensorEnergieHeizungStunde = 34,
+	    SensorEnergieWWStunde = 35,
+	    SensorEnergieHeizungTag = 36,
+	    SensorEnergieWWTag = 37,
+	    SensorEnergieHeizungGesamt = 38,
+	    SensorEnergieWWGesamt = 39,
+	    SensorBrennstoffTag = 40,
+	    SensorBrennstoffGesamt = 41
+	} NumericSensors;
+
+	typedef enum {
+	    SensorFlamme = 100,
+	    SensorBrenner = 101,
+	    SensorZuendung = 102,
+	    SensorKesselPumpe = 103,
+	    /* 0 = HK, 1 = WW */
+	    Sensor3WegeVentil = 106,
+	    SensorHK1Automatik = 122,
+	    SensorHK1Tagbetrieb = 104,
+	    SensorHK1Pumpe = 116,
+	    SensorHK1Ferien = 118,
+	    SensorHK1Party = 119,
+	    SensorHK2Automatik = 123,
+	    SensorHK2Tagbetrieb = 105,
+	    SensorHK2Pumpe = 117,
+	    SensorHK2Ferien = 120,
+	    SensorHK2Party = 121,
+	    SensorWarmwasserBereitung = 110,
+	    SensorWarmwasserTempOK = 114,
+	    SensorZirkulation = 107,
+	    SensorZirkulationTagbetrieb = 124,
+	    SensorWWVorrang = 115,
+	    SensorWWTagbetrieb = 112,
+	    SensorSommerbetrieb = 113,
+	    SensorSolarPumpe = 125,
+	    SensorTaktalarm = 126,
+	    /* not valid for DB */
+	    BooleanSensorLast = 127
+	} BooleanSensors;
+
+	typedef enum {
+	    SensorServiceCode = 200,
+	    SensorFehlerCode = 201,
+	    SensorAnomalie = 202,
+	    /* not valid for DB */
+	    StateSensorLast = 203
+	} StateSensors;
+
+	typedef enum {
+	    NumericReading,
+	    BooleanReading,
+	    StateReading
+	} ReadingKind;
+
+	struct Reading {
+	    unsigned int sensor;
+	    ReadingKind kind;
+	    float numeric;
+	    bool boolean;
+	    std::string state;
+	};
+
+	/* a value which was constant from start to end (ms since epoch) */
+	struct Interval {
+	    Reading reading;
+	    uint64_t start;
+	    uint64_t end;
+	};
+	typedef boost::function<void (const Interval& interval)> IntervalHandler;
+
+	/* Returns false if the value isn't stored in the database */
+	static bool map(const EmsValue& value, Reading& reading);
+	/* sensors computed by the collector instead of being read from the bus */
+	static const std::vector<unsigned int>& derivedSensors();
+};
+
+#endif /* __SENSORMAPPING_H__ */
@@ -22,10 +22,18 @@
 #include "SerialHandler.h"
 
 SerialHandler::SerialHandler(const std::string& device,
-			     ValueCache& cache) :
+			     ValueCache& cache,
+			     int fd) :
     IoHandler(cache),
-    m_serialPort(*this, device)
+    m_serialPort(*this)
 {
+    if (fd >= 0) {
+	/* set up by the previous process, which also read its first bytes */
+	m_serialPort.assign(fd);
+	return;
+    }
+
+    m_serialPort.open(device);
     if (!m_serialPort.is_open()) {
 	std::cerr << "Failed to open serial port." << std::endl;
 	m_active = false;
@@ -26,9 +26,14 @@
 class SerialHandler : public IoHandler
 {
     public:
-	SerialHandler(const std::string& device, ValueCache& cache);
+	/* 'fd' is an already opened port handed over by a previous process */
+	SerialHandler(const std::string& device, ValueCache& cache, int fd = -1);
 	~SerialHandler();
 
+	virtual int descriptor() override {
+	    return m_serialPort.native_handle();
+	}
+
     protected:
 	virtual void readStart() {
 	    /* Start an asynchronous read and call read_complete when it completes or fails */
@@ -39,6 +44,9 @@ class SerialHandler : public IoHandler
 	}
 
 	virtual void doCloseImpl();
+	virtual void cancelRead() {
+	    m_serialPort.cancel();
+	}
 
     protected:
 	boost::asio::serial_port m_serialPort;
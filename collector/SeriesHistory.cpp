@@ -0,0 +1,160 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "SeriesHistory.h"
+#include "ValueApi.h"
+
+void
+SeriesHistory::handleValue(const EmsValue& value)
+{
+    float reading;
+
+    if (!value.isValid()) {
+	return;
+    }
+
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    reading = value.getValue<float>();
+	    break;
+	case EmsValue::Integer:
+	    reading = value.getValue<unsigned int>();
+	    break;
+	default:
+	    return;
+    }
+
+    Series& series = m_series[std::make_pair(value.getType(), value.getSubType())];
+    uint32_t now = value.getTimestamp().seconds();
+
+    series.lastSeen = now;
+    if (!series.points.empty() && series.points.back().value == reading) {
+	return;
+    }
+
+    Point point = { now, reading };
+    series.points.push_back(point);
+
+    /* keep the last point before the retention window, it's still valid at its start */
+    uint32_t windowStart = now > m_retention ? now - m_retention : 0;
+    while (series.points.size() >= 2 && series.points[1].time <= windowStart) {
+	series.points.pop_front();
+    }
+}
+
+bool
+SeriesHistory::fetch(const std::string& key, time_t start, time_t end,
+		     size_t points, std::vector<Point>& result) const
+{
+    EmsValue::Type type;
+    EmsValue::SubType subtype;
+
+    result.clear();
+
+    if (!ValueApi::parseValueKey(key, type, subtype)) {
+	return false;
+    }
+
+    auto iter = m_series.find(std::make_pair(type, subtype));
+    if (iter == m_series.end()) {
+	/* known value which wasn't received yet */
+	return true;
+    }
+
+    const Series& series = iter->second;
+    std::vector<Point> selected;
+    auto first = std::upper_bound(series.points.begin(), series.points.end(), (uint32_t) start,
+				  [] (uint32_t time, const Point& point) {
+	return time < point.time;
+    });
+
+    /* the value held at the start of the range */
+    if (first != series.points.begin()) {
+	Point held = { (uint32_t) start, (first - 1)->value };
+	selected.push_back(held);
+    }
+    for (auto point = first; point != series.points.end() && point->time <= end; ++point) {
+	selected.push_back(*point);
+    }
+    if (!selected.empty()) {
+	uint32_t last = std::min((uint32_t) end, series.lastSeen);
+	if (last > selected.back().time) {
+	    Point held = { last, selected.back().value };
+	    selected.push_back(held);
+	}
+    }
+
+    downsample(selected, points, result);
+    return true;
+}
+
+/* largest triangle three buckets, keeps the visually significant points */
+void
+SeriesHistory::downsample(const std::vector<Point>& input, size_t threshold,
+			  std::vector<Point>& output)
+{
+    size_t count = input.size();
+
+    if (threshold >= count || threshold < 3) {
+	output = input;
+	return;
+    }
+
+    double bucketSize = (double) (count - 2) / (threshold - 2);
+    size_t selected = 0;
+
+    output.reserve(threshold);
+    output.push_back(input[0]);
+
+    for (size_t bucket = 0; bucket < threshold - 2; bucket++) {
+	/* the average of the next bucket is the third point of the triangle */
+	size_t nextStart = (size_t) ((bucket + 1) * bucketSize) + 1;
+	size_t nextEnd = std::min((size_t) ((bucket + 2) * bucketSize) + 1, count);
+	double avgTime = 0, avgValue = 0;
+
+	for (size_t i = nextStart; i < nextEnd; i++) {
+	    avgTime += input[i].time;
+	    avgValue += input[i].value;
+	}
+	avgTime /= nextEnd - nextStart;
+	avgValue /= nextEnd - nextStart;
+
+	size_t start = (size_t) (bucket * bucketSize) + 1;
+	size_t end = (size_t) ((bucket + 1) * bucketSize) + 1;
+	double baseTime = input[selected].time, baseValue = input[selected].value;
+	double maxArea = -1;
+	size_t next = start;
+
+	for (size_t i = start; i < end; i++) {
+	    double area = fabs((baseTime - avgTime) * (input[i].value - baseValue) -
+			       (baseTime - input[i].time) * (avgValue - baseValue));
+	    if (area > maxArea) {
+		maxArea = area;
+		next = i;
+	    }
+	}
+
+	output.push_back(input[next]);
+	selected = next;
+    }
+
+    output.push_back(input[count - 1]);
+}
@@ -0,0 +1,72 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SERIESHISTORY_H__
+#define __SERIESHISTORY_H__
+
+#include <deque>
+#include <map>
+#include <vector>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+
+/*
+ * Keeps the recent history of all numeric values in memory, so graphs
+ * can be drawn without querying the database. Only changes of a value
+ * are stored, the value is held until the next change.
+ */
+class SeriesHistory : private boost::noncopyable
+{
+    public:
+	struct Point {
+	    uint32_t time;
+	    float value;
+	};
+
+    public:
+	SeriesHistory(unsigned int retention) :
+	    m_retention(retention)
+	{ }
+
+	void handleValue(const EmsValue& value);
+
+	/*
+	 * Fetches the values of the given key between start and end, reduced
+	 * to at most the given amount of points. Returns false if the key is
+	 * unknown.
+	 */
+	bool fetch(const std::string& key, time_t start, time_t end,
+		   size_t points, std::vector<Point>& result) const;
+
+    private:
+	struct Series {
+	    std::deque<Point> points;
+	    /* time of the last sample, which may repeat the last point */
+	    uint32_t lastSeen;
+	};
+
+	static void downsample(const std::vector<Point>& input, size_t threshold,
+			       std::vector<Point>& output);
+
+    private:
+	unsigned int m_retention;
+	std::map<std::pair<EmsValue::Type, EmsValue::SubType>, Series> m_series;
+};
+
+#endif /* __SERIESHISTORY_H__ */
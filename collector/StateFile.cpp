@@ -0,0 +1,136 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "StateFile.h"
+
+bool
+StateFile::load()
+{
+    std::ifstream file(m_path.c_str());
+    std::string line;
+
+    if (!file.is_open()) {
+	/* not an error on the first start */
+	return false;
+    }
+
+    m_values.clear();
+    while (std::getline(file, line)) {
+	size_t pos = line.find(' ');
+	if (pos == std::string::npos || pos == 0) {
+	    continue;
+	}
+	m_values[line.substr(0, pos)] = line.substr(pos + 1);
+    }
+
+    return true;
+}
+
+bool
+StateFile::save() const
+{
+    std::string tmpPath = m_path + ".tmp";
+    std::ofstream file(tmpPath.c_str(), std::ios::out | std::ios::trunc);
+
+    if (!file.is_open()) {
+	std::cerr << "Could not open state file " << tmpPath << std::endl;
+	return false;
+    }
+
+    for (auto& entry : m_values) {
+	file << entry.first << ' ' << entry.second << '\n';
+    }
+    file.close();
+
+    if (file.fail() || rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+	std::cerr << "Could not write state file " << m_path << ": "
+		  << strerror(errno) << std::endl;
+	return false;
+    }
+
+    return true;
+}
+
+bool
+StateFile::get(const std::string& key, double& value) const
+{
+    auto iter = m_values.find(key);
+    char *end;
+
+    if (iter == m_values.end()) {
+	return false;
+    }
+    value = strtod(iter->second.c_str(), &end);
+    return *end == '\0';
+}
+
+bool
+StateFile::get(const std::string& key, long long& value) const
+{
+    auto iter = m_values.find(key);
+    char *end;
+
+    if (iter == m_values.end()) {
+	return false;
+    }
+    value = strtoll(iter->second.c_str(), &end, 10);
+    return *end == '\0';
+}
+
+bool
+StateFile::get(const std::string& key, std::string& value) const
+{
+    auto iter = m_values.find(key);
+
+    if (iter == m_values.end()) {
+	return false;
+    }
+    value = iter->second;
+    return true;
+}
+
+void
+StateFile::set(const std::string& key, double value)
+{
+    std::ostringstream stream;
+    stream << std::setprecision(17) << value;
+    m_values[key] = stream.str();
+}
+
+void
+StateFile::set(const std::string& key, long long value)
+{
+    std::ostringstream stream;
+    stream << value;
+    m_values[key] = stream.str();
+}
+
+void
+StateFile::set(const std::string& key, const std::string& value)
+{
+    m_values[key] = value;
+}
@@ -0,0 +1,54 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STATEFILE_H__
+#define __STATEFILE_H__
+
+#include <map>
+#include <string>
+
+/*
+ * Snapshot of derived state which should survive a restart, stored as
+ * one 'key value' pair per line. The file is replaced atomically, so a
+ * crash while saving leaves the previous snapshot intact.
+ */
+class StateFile
+{
+    public:
+	StateFile(const std::string& path) :
+	    m_path(path)
+	{ }
+
+	bool load();
+	bool save() const;
+
+	bool get(const std::string& key, double& value) const;
+	bool get(const std::string& key, long long& value) const;
+	bool get(const std::string& key, std::string& value) const;
+	void set(const std::string& key, double value);
+	void set(const std::string& key, long long value);
+	/* must not contain line breaks */
+	void set(const std::string& key, const std::string& value);
+
+    private:
+	std::string m_path;
+	std::map<std::string, std::string> m_values;
+};
+
+#endif /* __STATEFILE_H__ */
@@ -0,0 +1,173 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "StreamAcceptor.h"
+
+StreamAcceptor::StreamAcceptor(boost::asio::io_service& ios,
+			       const Endpoint& endpoint,
+			       unsigned int mode) :
+    m_acceptor(ios)
+{
+    if (adopt(endpoint)) {
+	return;
+    }
+
+    m_acceptor.open(endpoint.protocol());
+
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (endpoint.protocol().family() == AF_UNIX) {
+	const sockaddr_un *address = (const sockaddr_un *) endpoint.data();
+	std::string path(address->sun_path,
+			 strnlen(address->sun_path, sizeof(address->sun_path)));
+	struct stat st;
+
+	/* a socket file left behind by a crashed run blocks the bind */
+	if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+	    unlink(path.c_str());
+	}
+
+	m_acceptor.bind(endpoint);
+	m_path = path;
+	if (chmod(path.c_str(), mode) != 0) {
+	    throw boost::system::system_error(errno, boost::system::system_category(),
+					      "chmod " + path);
+	}
+    } else
+#endif
+    {
+	m_acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+	m_acceptor.bind(endpoint);
+    }
+
+    m_acceptor.listen();
+}
+
+StreamAcceptor::~StreamAcceptor()
+{
+    close();
+}
+
+std::vector<int> StreamAcceptor::s_inherited;
+
+static bool
+sameAddress(const sockaddr *a, const sockaddr *b)
+{
+    if (a->sa_family != b->sa_family) {
+	return false;
+    }
+
+    switch (a->sa_family) {
+	case AF_INET: {
+	    const sockaddr_in *a4 = (const sockaddr_in *) a, *b4 = (const sockaddr_in *) b;
+	    return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	}
+	case AF_INET6: {
+	    const sockaddr_in6 *a6 = (const sockaddr_in6 *) a, *b6 = (const sockaddr_in6 *) b;
+	    return a6->sin6_port == b6->sin6_port &&
+		    memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+	}
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	case AF_UNIX:
+	    return strncmp(((const sockaddr_un *) a)->sun_path, ((const sockaddr_un *) b)->sun_path,
+			   sizeof(((const sockaddr_un *) a)->sun_path)) == 0;
+#endif
+    }
+
+    return false;
+}
+
+bool
+StreamAcceptor::adopt(const Endpoint& endpoint)
+{
+    for (auto iter = s_inherited.begin(); iter != s_inherited.end(); ++iter) {
+	sockaddr_storage address;
+	socklen_t length = sizeof(address);
+
+	memset(&address, 0, sizeof(address));
+	if (getsockname(*iter, (sockaddr *) &address, &length) != 0 ||
+		!sameAddress((const sockaddr *) &address, endpoint.data())) {
+	    continue;
+	}
+
+	m_acceptor.assign(endpoint.protocol(), *iter);
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+	if (address.ss_family == AF_UNIX) {
+	    m_path = ((const sockaddr_un *) &address)->sun_path;
+	}
+#endif
+	s_inherited.erase(iter);
+	return true;
+    }
+
+    return false;
+}
+
+void
+StreamAcceptor::inherit(const std::vector<int>& fds)
+{
+    s_inherited.insert(s_inherited.end(), fds.begin(), fds.end());
+}
+
+void
+StreamAcceptor::closeInherited()
+{
+    for (int fd : s_inherited) {
+	::close(fd);
+    }
+    s_inherited.clear();
+}
+
+void
+StreamAcceptor::release()
+{
+    m_path.clear();
+    close();
+}
+
+void
+StreamAcceptor::close()
+{
+    boost::system::error_code error;
+    m_acceptor.close(error);
+
+    if (!m_path.empty()) {
+	unlink(m_path.c_str());
+	m_path.clear();
+    }
+}
+
+std::vector<StreamAcceptor::Endpoint>
+StreamAcceptor::endpoints(unsigned int port, const std::string& path)
+{
+    std::vector<Endpoint> endpoints;
+
+    if (port != 0) {
+	endpoints.push_back(boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+    }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (!path.empty()) {
+	endpoints.push_back(boost::asio::local::stream_protocol::endpoint(path));
+    }
+#endif
+
+    return endpoints;
+}
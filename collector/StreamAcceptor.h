@@ -0,0 +1,78 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __STREAMACCEPTOR_H__
+#define __STREAMACCEPTOR_H__
+
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include "Noncopyable.h"
+
+/*
+ * Listening socket of the command and data interfaces, which may either be a
+ * TCP port or - where supported - a Unix stream socket for local clients.
+ * Both use the generic stream protocol, so the connection classes don't need
+ * to care which one a client connected through. Unix sockets are created
+ * with the given permissions, replacing a stale socket file of a previous
+ * run, and are removed again on destruction unless they were released for
+ * another process.
+ */
+class StreamAcceptor : private boost::noncopyable
+{
+    public:
+	typedef boost::asio::generic::stream_protocol Protocol;
+	typedef Protocol::socket Socket;
+	typedef Protocol::endpoint Endpoint;
+	typedef boost::asio::basic_socket_acceptor<Protocol> Acceptor;
+
+    public:
+	StreamAcceptor(boost::asio::io_service& ios, const Endpoint& endpoint, unsigned int mode);
+	~StreamAcceptor();
+
+	/* endpoints for a TCP port and a socket path, 0 and "" disable them */
+	static std::vector<Endpoint> endpoints(unsigned int port, const std::string& path);
+	/* listening sockets handed over by a previous process, which are used
+	 * instead of creating new ones for the same endpoint */
+	static void inherit(const std::vector<int>& fds);
+	/* closes those inherited sockets which weren't used */
+	static void closeInherited();
+
+    public:
+	Acceptor& acceptor() {
+	    return m_acceptor;
+	}
+	int descriptor() {
+	    return m_acceptor.native_handle();
+	}
+	void close();
+	/* stops listening, but leaves the socket file to the next process */
+	void release();
+
+    private:
+	bool adopt(const Endpoint& endpoint);
+
+    private:
+	Acceptor m_acceptor;
+	std::string m_path;
+
+	static std::vector<int> s_inherited;
+};
+
+#endif /* __STREAMACCEPTOR_H__ */
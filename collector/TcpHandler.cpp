@@ -24,13 +24,25 @@
 
 TcpHandler::TcpHandler(const std::string& host,
 		       const std::string& port,
-		       ValueCache& cache) :
+		       ValueCache& cache,
+		       int fd) :
     IoHandler(cache),
     EmsCommandSender((boost::asio::io_service&) *this),
     m_socket(*this),
     m_watchdog(*this)
 {
     boost::system::error_code error;
+
+    if (fd >= 0) {
+	sockaddr_storage address;
+	socklen_t length = sizeof(address);
+	getsockname(fd, (sockaddr *) &address, &length);
+	m_socket.assign(address.ss_family == AF_INET6 ?
+			boost::asio::ip::tcp::v6() : boost::asio::ip::tcp::v4(), fd);
+	resetWatchdog();
+	return;
+    }
+
     boost::asio::ip::tcp::resolver resolver(*this);
     boost::asio::ip::tcp::resolver::query query(host, port);
     boost::asio::ip::tcp::resolver::iterator endpoint = resolver.resolve(query, error);
@@ -82,23 +94,18 @@ TcpHandler::doCloseImpl()
 }
 
 void
-TcpHandler::sendMessageImpl(const EmsMessage& msg)
+TcpHandler::sendMessageImpl(const EmsCommandRequest& request)
 {
     boost::system::error_code error;
-    std::vector<uint8_t> sendData = msg.getSendData(true);
+    uint8_t sendData[EmsCommandRequest::MaxSendSize];
+    size_t length = request.getSendData(sendData, true);
     DebugStream& debug = Options::ioDebug();
 
     if (debug) {
-	debug << "IO: Sending bytes ";
-	for (size_t i = 0; i < sendData.size(); i++) {
-	    debug << std::setfill('0') << std::setw(2)
-		  << std::showbase << std::hex
-		  << (unsigned int) sendData[i] << " ";
-	}
-	debug << std::endl;
+	debug.logBytes(true, sendData, length);
     }
 
-    boost::asio::write(m_socket, boost::asio::buffer(sendData),
+    boost::asio::write(m_socket, boost::asio::buffer(sendData, length),
 		       boost::asio::transfer_all(), error);
 }
 
@@ -27,11 +27,17 @@
 class TcpHandler : public IoHandler, public EmsCommandSender
 {
     public:
-	TcpHandler(const std::string& host, const std::string& port, ValueCache& cache);
+	/* 'fd' is an already connected socket handed over by a previous process */
+	TcpHandler(const std::string& host, const std::string& port,
+		   ValueCache& cache, int fd = -1);
 	~TcpHandler();
 
+	virtual int descriptor() override {
+	    return m_socket.native_handle();
+	}
+
     protected:
-	virtual void sendMessageImpl(const EmsMessage& msg) override;
+	virtual void sendMessageImpl(const EmsCommandRequest& request) override;
 	virtual void onPcMessageReceived(const EmsMessage& msg) override {
 	    handlePcMessage(msg);
 	}
@@ -46,6 +52,10 @@ class TcpHandler : public IoHandler, public EmsCommandSender
 	}
 
 	virtual void doCloseImpl();
+	virtual void cancelRead() {
+	    m_watchdog.cancel();
+	    m_socket.cancel();
+	}
 	virtual void readComplete(const boost::system::error_code& error, size_t bytesTransferred);
 
     private:
@@ -0,0 +1,60 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TIMESTAMP_H__
+#define __TIMESTAMP_H__
+
+#include <stdint.h>
+#include <time.h>
+#include <chrono>
+
+/*
+ * Reception time of a frame, taken once when the frame is complete and
+ * passed along with all values decoded from it. The monotonic part is
+ * meant for measuring intervals, the realtime part for storing.
+ */
+struct Timestamp {
+    /* ms of an arbitrary monotonic clock */
+    uint64_t monotonic;
+    /* ms since epoch */
+    uint64_t realtime;
+
+    Timestamp() : monotonic(0), realtime(0) { }
+    Timestamp(uint64_t mono, uint64_t real) : monotonic(mono), realtime(real) { }
+
+    static Timestamp now() {
+	typedef std::chrono::milliseconds ms;
+	return Timestamp(
+		std::chrono::duration_cast<ms>(std::chrono::steady_clock::now().time_since_epoch()).count(),
+		std::chrono::duration_cast<ms>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+    /* for frames from a capture, which only know their realtime */
+    static Timestamp fromRealtime(uint64_t realtime) {
+	return Timestamp(realtime, realtime);
+    }
+
+    time_t seconds() const {
+	return realtime / 1000;
+    }
+    unsigned int milliseconds() const {
+	return realtime % 1000;
+    }
+};
+
+#endif /* __TIMESTAMP_H__ */
@@ -17,317 +17,378 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <map>
-#include <sstream>
-#include <boost/format.hpp>
+#include <stdio.h>
 #include "ApiCommandParser.h"
+#include "NameTable.h"
 #include "ValueApi.h"
 
+static constexpr NameTable::Entry<EmsValue::Type> TYPEMAPPING[] = {
+    { EmsValue::SollTemp, "targettemperature" },
+    { EmsValue::IstTemp, "currenttemperature" },
+    { EmsValue::SetTemp, "settemperature" },
+    { EmsValue::MinTemp, "mintemperature" },
+    { EmsValue::MaxTemp, "maxtemperature" },
+    { EmsValue::TagTemp, "daytemperature" },
+    { EmsValue::NachtTemp, "nighttemperature" },
+    { EmsValue::UrlaubTemp, "vacationtemperature" },
+    { EmsValue::RaumSollTemp, "roomtargettemperature" },
+    { EmsValue::RaumIstTemp, "roomcurrenttemperature" },
+    { EmsValue::RaumEinfluss, "maxroomeffect" },
+    { EmsValue::RaumOffset, "roomtemperatureoffset" },
+    { EmsValue::GedaempfteTemp, "dampedtemperature" },
+    { EmsValue::DesinfektionsTemp, "desinfectiontemperature" },
+    { EmsValue::RaumTemperaturAenderung, "roomtemperaturechange" },
+    { EmsValue::Mischersteuerung, "mixercontrol" },
+    { EmsValue::Flammenstrom, "flamecurrent" },
+    { EmsValue::Systemdruck, "pressure" },
+    { EmsValue::IstModulation, "currentmodulation" },
+    { EmsValue::MinModulation, "minmodulation" },
+    { EmsValue::MaxModulation, "maxmodulation" },
+    { EmsValue::SollModulation, "targetmodulation" },
+    { EmsValue::SollLeistung, "requestedpower" },
+    { EmsValue::EinschaltHysterese, "onhysteresis" },
+    { EmsValue::AusschaltHysterese, "offhysteresis" },
+    { EmsValue::SchwelleSommerWinter, "summerwinterthreshold" },
+    { EmsValue::FrostSchutzTemp, "frostprotecttemperature" },
+    { EmsValue::AuslegungsTemp, "designtemperature" },
+    { EmsValue::RaumUebersteuerTemp, "temperatureoverride" },
+    { EmsValue::AbsenkungsSchwellenTemp, "reducedmodethreshold" },
+    { EmsValue::UrlaubAbsenkungsSchwellenTemp, "vacationreducedmodethreshold" },
+    { EmsValue::AbsenkungsAbbruchTemp, "cancelreducedmodethreshold" },
+    { EmsValue::DurchflussMenge, "flowrate" },
+    { EmsValue::BrennerZyklusDauer, "cycleminutes" },
+    { EmsValue::BrennerPausenDauer, "pauseminutes" },
+    { EmsValue::BrennerTastgrad, "dutycycle" },
+    { EmsValue::MittlereModulation, "meanmodulation" },
+    { EmsValue::EnergieStunde, "energyhour" },
+    { EmsValue::EnergieTag, "energyday" },
+    { EmsValue::EnergieGesamt, "energytotal" },
+    { EmsValue::BrennstoffTag, "fuelday" },
+    { EmsValue::BrennstoffGesamt, "fueltotal" },
+    { EmsValue::BetriebsZeit, "operatingminutes" },
+    { EmsValue::BetriebsZeit2, "operatingminutes2" },
+    { EmsValue::HeizZeit, "heatingminutes" },
+    { EmsValue::WarmwasserbereitungsZeit, "warmwaterminutes" },
+    { EmsValue::Brennerstarts, "heaterstarts" },
+    { EmsValue::WarmwasserBereitungen, "warmwaterpreparations" },
+    { EmsValue::DesinfektionStunde, "desinfectionhour" },
+    { EmsValue::HektoStundenVorWartung, "maintenanceintervalin100hours" },
+    { EmsValue::EinschaltoptimierungsZeit, "onoptimizationminutes" },
+    { EmsValue::AusschaltoptimierungsZeit, "offoptimizationminutes" },
+    { EmsValue::AntipendelZeit, "antipendelminutes" },
+    { EmsValue::NachlaufZeit, "followupminutes" },
+    { EmsValue::PartyZeit, "partyhours" },
+    { EmsValue::PausenZeit, "pausehours" },
+    { EmsValue::BrennerStartsProStunde, "startsperhour" },
+    { EmsValue::FlammeAktiv, "flameactive" },
+    { EmsValue::BrennerAktiv, "heateractive" },
+    { EmsValue::ZuendungAktiv, "ignitionactive" },
+    { EmsValue::PumpeAktiv, "pumpactive" },
+    { EmsValue::ZirkulationAktiv, "zirkpumpactive" },
+    { EmsValue::DreiWegeVentilAufWW, "3wayonww" },
+    { EmsValue::EinmalLadungAktiv, "onetimeload" },
+    { EmsValue::DesinfektionAktiv, "desinfectionactive" },
+    { EmsValue::NachladungAktiv, "boostcharge" },
+    { EmsValue::WarmwasserBereitung, "warmwaterpreparationactive" },
+    { EmsValue::WarmwasserTempOK, "warmwatertempok" },
+    { EmsValue::Tagbetrieb, "daymode" },
+    { EmsValue::Sommerbetrieb, "summermode" },
+    { EmsValue::Ausschaltoptimierung, "offoptimization" },
+    { EmsValue::Einschaltoptimierung, "onoptimization" },
+    { EmsValue::Estrichtrocknung, "floordrying" },
+    { EmsValue::WWVorrang, "wwoverride" },
+    { EmsValue::Ferien, "holidaymode" },
+    { EmsValue::Urlaub, "vacationmode" },
+    { EmsValue::Party, "partymode" },
+    { EmsValue::Pause, "pausemode" },
+    { EmsValue::Frostschutzbetrieb, "frostprotectmodeactive" },
+    { EmsValue::SchaltuhrEin, "switchpointactive" },
+    { EmsValue::KesselSchalter, "masterswitch" },
+    { EmsValue::EigenesProgrammAktiv, "customschedule" },
+    { EmsValue::Desinfektion, "desinfection" },
+    { EmsValue::EinmalLadungsLED, "onetimeloadindicator" },
+    { EmsValue::ATDaempfung, "outdoortempdamping" },
+    { EmsValue::SchaltzeitOptimierung, "scheduleoptimizer" },
+    { EmsValue::Fuehler1Defekt, "sensor1failure" },
+    { EmsValue::Fuehler2Defekt, "sensor2failure" },
+    { EmsValue::Stoerung, "failure" },
+    { EmsValue::StoerungDesinfektion, "desinfectionfailure" },
+    { EmsValue::Ladevorgang, "loading" },
+    { EmsValue::Taktalarm, "shortcycling" },
+    { EmsValue::WWSystemType, "warmwatersystemtype" },
+    { EmsValue::Schaltpunkte, "switchpoints" },
+    { EmsValue::Wartungsmeldungen, "maintenancereminder" },
+    { EmsValue::WartungFaellig, "maintenancedue" },
+    { EmsValue::Betriebsart, "opmode" },
+    { EmsValue::DesinfektionTag, "desinfectionday" },
+    { EmsValue::GebaeudeArt, "buildingtype" },
+    { EmsValue::AbsenkModus, "reductionmode" },
+    { EmsValue::HeizSystem, "heatingsystem" },
+    { EmsValue::FuehrungsGroesse, "relevantparameter" },
+    { EmsValue::UrlaubAbsenkungsArt, "vacationreductionmode" },
+    { EmsValue::Frostschutz, "frostprotectmode" },
+    { EmsValue::FBTyp, "remotecontroltype" },
+    { EmsValue::HKKennlinie, "characteristic" },
+    { EmsValue::Fehler, "error" },
+    { EmsValue::SystemZeit, "systemtime" },
+    { EmsValue::Wartungstermin, "maintenancedate" },
+    { EmsValue::ServiceCode, "servicecode" },
+    { EmsValue::FehlerCode, "errorcode" },
+    { EmsValue::Anomalie, "anomaly" },
+    { EmsValue::FehlerEreignis, "errorevent" }
+};
+static_assert(NameTable::isSorted(TYPEMAPPING), "TYPEMAPPING must be sorted");
+
+static constexpr NameTable::Entry<EmsValue::SubType> SUBTYPEMAPPING[] = {
+    { EmsValue::HK1, "hk1" },
+    { EmsValue::HK2, "hk2" },
+    { EmsValue::HK3, "hk3" },
+    { EmsValue::HK4, "hk4" },
+    { EmsValue::Brenner, "burner" },
+    { EmsValue::Kessel, "heater" },
+    { EmsValue::KesselPumpe, "heaterpump" },
+    { EmsValue::RC, "rc" },
+    { EmsValue::Ruecklauf, "returnflow" },
+    { EmsValue::Waermetauscher, "heatexchanger" },
+    { EmsValue::WW, "ww" },
+    { EmsValue::Zirkulation, "zirkpump" },
+    { EmsValue::Aussen, "outdoor" },
+    { EmsValue::Abgas, "exhaust" },
+    { EmsValue::Ansaugluft, "intake" },
+    { EmsValue::Solar, "solar" },
+    { EmsValue::SolarPumpe, "solarpump" },
+    { EmsValue::SolarSpeicher, "solartank" },
+    { EmsValue::SolarKollektor, "solarcollector" },
+    { EmsValue::Heizung, "heating" }
+};
+static_assert(NameTable::isSorted(SUBTYPEMAPPING), "SUBTYPEMAPPING must be sorted");
+
 std::string
 ValueApi::getTypeName(EmsValue::Type type)
 {
-    static const std::map<EmsValue::Type, const char *> TYPEMAPPING = {
-	{ EmsValue::SollTemp, "targettemperature" },
-	{ EmsValue::IstTemp, "currenttemperature" },
-	{ EmsValue::SetTemp, "settemperature" },
-	{ EmsValue::MinTemp, "mintemperature" },
-	{ EmsValue::MaxTemp, "maxtemperature" },
-	{ EmsValue::TagTemp, "daytemperature" },
-	{ EmsValue::NachtTemp, "nighttemperature" },
-	{ EmsValue::UrlaubTemp, "vacationtemperature" },
-	{ EmsValue::RaumSollTemp, "roomtargettemperature" },
-	{ EmsValue::RaumIstTemp, "roomcurrenttemperature" },
-	{ EmsValue::RaumEinfluss, "maxroomeffect" },
-	{ EmsValue::RaumOffset, "roomtemperatureoffset" },
-	{ EmsValue::SchwelleSommerWinter, "summerwinterthreshold" },
-	{ EmsValue::FrostSchutzTemp, "frostprotecttemperature" },
-	{ EmsValue::AuslegungsTemp, "designtemperature" },
-	{ EmsValue::RaumUebersteuerTemp, "temperatureoverride" },
-	{ EmsValue::AbsenkungsSchwellenTemp, "reducedmodethreshold" },
-	{ EmsValue::UrlaubAbsenkungsSchwellenTemp, "vacationreducedmodethreshold" },
-	{ EmsValue::AbsenkungsAbbruchTemp, "cancelreducedmodethreshold" },
-	{ EmsValue::GedaempfteTemp, "dampedtemperature" },
-	{ EmsValue::DesinfektionsTemp, "desinfectiontemperature" },
-	{ EmsValue::RaumTemperaturAenderung, "roomtemperaturechange" },
-	{ EmsValue::Mischersteuerung, "mixercontrol" },
-	{ EmsValue::Flammenstrom, "flamecurrent" },
-	{ EmsValue::Systemdruck, "pressure" },
-	{ EmsValue::BetriebsZeit, "operatingminutes" },
-	{ EmsValue::BetriebsZeit2, "operatingminutes2" },
-	{ EmsValue::MinModulation, "minmodulation" },
-	{ EmsValue::MaxModulation, "maxmodulation" },
-	{ EmsValue::SollModulation, "targetmodulation" },
-	{ EmsValue::IstModulation, "currentmodulation" },
-	{ EmsValue::SollLeistung, "requestedpower" },
-	{ EmsValue::EinschaltHysterese, "onhysteresis" },
-	{ EmsValue::AusschaltHysterese, "offhysteresis" },
-	{ EmsValue::DurchflussMenge, "flowrate" },
-
-	{ EmsValue::HeizZeit, "heatingminutes" },
-	{ EmsValue::WarmwasserbereitungsZeit, "warmwaterminutes" },
-	{ EmsValue::Brennerstarts, "heaterstarts" },
-	{ EmsValue::WarmwasserBereitungen, "warmwaterpreparations" },
-	{ EmsValue::EinschaltoptimierungsZeit, "onoptimizationminutes" },
-	{ EmsValue::AusschaltoptimierungsZeit, "offoptimizationminutes" },
-	{ EmsValue::AntipendelZeit, "antipendelminutes" },
-	{ EmsValue::NachlaufZeit, "followupminutes" },
-	{ EmsValue::DesinfektionStunde, "desinfectionhour" },
-	{ EmsValue::HektoStundenVorWartung, "maintenanceintervalin100hours" },
-	{ EmsValue::PausenZeit, "pausehours" },
-	{ EmsValue::PartyZeit, "partyhours" },
-
-	{ EmsValue::FlammeAktiv, "flameactive" },
-	{ EmsValue::BrennerAktiv, "heateractive" },
-	{ EmsValue::ZuendungAktiv, "ignitionactive" },
-	{ EmsValue::PumpeAktiv, "pumpactive" },
-	{ EmsValue::ZirkulationAktiv, "zirkpumpactive" },
-	{ EmsValue::DreiWegeVentilAufWW, "3wayonww" },
-	{ EmsValue::EinmalLadungAktiv, "onetimeload" },
-	{ EmsValue::DesinfektionAktiv, "desinfectionactive" },
-	{ EmsValue::Desinfektion, "desinfection" },
-	{ EmsValue::NachladungAktiv, "boostcharge" },
-	{ EmsValue::WarmwasserBereitung, "warmwaterpreparationactive" },
-	{ EmsValue::WarmwasserTempOK, "warmwatertempok" },
-	{ EmsValue::Tagbetrieb, "daymode" },
-	{ EmsValue::Sommerbetrieb, "summermode" },
-	{ EmsValue::Ausschaltoptimierung, "offoptimization" },
-	{ EmsValue::Einschaltoptimierung, "onoptimization" },
-	{ EmsValue::Estrichtrocknung, "floordrying" },
-	{ EmsValue::WWVorrang, "wwoverride" },
-	{ EmsValue::Urlaub, "vacationmode" },
-	{ EmsValue::Ferien, "holidaymode" },
-	{ EmsValue::Party, "partymode" },
-	{ EmsValue::Pause, "pausemode" },
-	{ EmsValue::Frostschutzbetrieb, "frostprotectmodeactive" },
-	{ EmsValue::SchaltuhrEin, "switchpointactive" },
-	{ EmsValue::KesselSchalter, "masterswitch" },
-	{ EmsValue::EigenesProgrammAktiv, "customschedule" },
-	{ EmsValue::EinmalLadungsLED, "onetimeloadindicator" },
-	{ EmsValue::ATDaempfung, "outdoortempdamping" },
-	{ EmsValue::SchaltzeitOptimierung, "scheduleoptimizer" },
-	{ EmsValue::Fuehler1Defekt, "sensor1failure" },
-	{ EmsValue::Fuehler2Defekt, "sensor2failure" },
-	{ EmsValue::Stoerung, "failure" },
-	{ EmsValue::StoerungDesinfektion, "desinfectionfailure" },
-	{ EmsValue::Ladevorgang, "loading" },
-	{ EmsValue::WWSystemType, "warmwatersystemtype" },
-	{ EmsValue::Schaltpunkte, "switchpoints" },
-	{ EmsValue::Wartungsmeldungen, "maintenancereminder" },
-	{ EmsValue::WartungFaellig, "maintenancedue" },
-	{ EmsValue::Betriebsart, "opmode" },
-	{ EmsValue::DesinfektionTag, "desinfectionday" },
-	{ EmsValue::GebaeudeArt, "buildingtype" },
-	{ EmsValue::AbsenkModus, "reductionmode" },
-	{ EmsValue::HeizSystem, "heatingsystem" },
-	{ EmsValue::FuehrungsGroesse, "relevantparameter" },
-	{ EmsValue::Frostschutz, "frostprotectmode" },
-	{ EmsValue::UrlaubAbsenkungsArt, "vacationreductionmode" },
-	{ EmsValue::FBTyp, "remotecontroltype" },
-
-	{ EmsValue::HKKennlinie, "characteristic" },
-	{ EmsValue::Fehler, "error" },
-	{ EmsValue::SystemZeit, "systemtime" },
-	{ EmsValue::Wartungstermin, "maintenancedate" },
+    const char *name = NameTable::lookup(TYPEMAPPING, type);
+    return name ? name : "";
+}
 
-	{ EmsValue::ServiceCode, "servicecode" },
-	{ EmsValue::FehlerCode, "errorcode" }
-    };
+std::string
+ValueApi::getSubTypeName(EmsValue::SubType subtype)
+{
+    const char *name = NameTable::lookup(SUBTYPEMAPPING, subtype);
+    return name ? name : "";
+}
 
-    auto iter = TYPEMAPPING.find(type);
-    if (iter == TYPEMAPPING.end()) {
-	return "";
+bool
+ValueApi::parseTypeName(const std::string& name, EmsValue::Type& type)
+{
+    for (auto& entry : TYPEMAPPING) {
+	if (name == entry.name) {
+	    type = entry.key;
+	    return true;
+	}
     }
+    return false;
+}
 
-    return iter->second;
+bool
+ValueApi::parseSubTypeName(const std::string& name, EmsValue::SubType& subtype)
+{
+    for (auto& entry : SUBTYPEMAPPING) {
+	if (name == entry.name) {
+	    subtype = entry.key;
+	    return true;
+	}
+    }
+    return false;
 }
 
-std::string
-ValueApi::getSubTypeName(EmsValue::SubType subtype)
+bool
+ValueApi::parseValueKey(const std::string& key, EmsValue::Type& type, EmsValue::SubType& subtype)
 {
-    static const std::map<EmsValue::SubType, const char *> SUBTYPEMAPPING = {
-	{ EmsValue::HK1, "hk1" },
-	{ EmsValue::HK2, "hk2" },
-	{ EmsValue::HK3, "hk3" },
-	{ EmsValue::HK4, "hk4" },
-	{ EmsValue::RC, "rc" },
-	{ EmsValue::Kessel, "heater" },
-	{ EmsValue::KesselPumpe, "heaterpump" },
-	{ EmsValue::Brenner, "burner" },
-	{ EmsValue::Ruecklauf, "returnflow" },
-	{ EmsValue::Waermetauscher, "heatexchanger" },
-	{ EmsValue::WW, "ww" },
-	{ EmsValue::Zirkulation, "zirkpump" },
-	{ EmsValue::Aussen, "outdoor" },
-	{ EmsValue::Abgas, "exhaust" },
-	{ EmsValue::Ansaugluft, "intake" },
-	{ EmsValue::Solar, "solar" },
-	{ EmsValue::SolarPumpe, "solarpump" },
-	{ EmsValue::SolarSpeicher, "solartank" },
-	{ EmsValue::SolarKollektor, "solarcollector" }
-    };
+    size_t pos = key.find('/');
 
-    auto iter = SUBTYPEMAPPING.find(subtype);
-    if (iter == SUBTYPEMAPPING.end()) {
-	return "";
+    subtype = EmsValue::None;
+    if (pos != std::string::npos && !parseSubTypeName(key.substr(0, pos), subtype)) {
+	return false;
     }
-
-    return iter->second;
+    return parseTypeName(key.substr(pos == std::string::npos ? 0 : pos + 1), type);
 }
 
 std::string
 ValueApi::formatValue(const EmsValue& value)
 {
-    static const std::map<uint8_t, const char *> WWSYSTEMMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> WWSYSTEMMAPPING[] = {
 	{ EmsProto::WWSystemNone, "none" },
 	{ EmsProto::WWSystemDurchlauf, "tankless" },
 	{ EmsProto::WWSystemKlein, "small" },
 	{ EmsProto::WWSystemGross, "large" },
 	{ EmsProto::WWSystemSpeicherlade, "speicherladesystem" }
     };
+    static_assert(NameTable::isSorted(WWSYSTEMMAPPING), "WWSYSTEMMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> ZIRKSPMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> ZIRKSPMAPPING[] = {
 	{ 0, "off" }, { 1, "1x" }, { 2, "2x" }, { 3, "3x" },
 	{ 4, "4x" }, { 5, "5x" }, { 6, "6x" }, { 7, "alwayson" }
     };
+    static_assert(NameTable::isSorted(ZIRKSPMAPPING), "ZIRKSPMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> MAINTENANCEMESSAGESMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> MAINTENANCEMESSAGESMAPPING[] = {
 	{ 0, "off" }, { 1, "byhours" }, { 2, "bydate" }
     };
+    static_assert(NameTable::isSorted(MAINTENANCEMESSAGESMAPPING), "MAINTENANCEMESSAGESMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> MAINTENANCENEEDEDMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> MAINTENANCENEEDEDMAPPING[] = {
 	{ 0, "no" }, { 3, "byhours" }, { 8, "bydate" }
     };
+    static_assert(NameTable::isSorted(MAINTENANCENEEDEDMAPPING), "MAINTENANCENEEDEDMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> ERRORTYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> ERRORTYPEMAPPING[] = {
 	{ 0x10, "L" }, { 0x11, "B" }, { 0x12, "S" }, { 0x13, "D" }
     };
+    static_assert(NameTable::isSorted(ERRORTYPEMAPPING), "ERRORTYPEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> OPMODEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> OPMODEMAPPING[] = {
 	{ 0, "off" }, { 1, "on" }, { 2, "auto" }
     };
+    static_assert(NameTable::isSorted(OPMODEMAPPING), "OPMODEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> HKOPMODEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> HKOPMODEMAPPING[] = {
 	{ 0, "night" }, { 1, "day" }, { 2, "auto" }
     };
+    static_assert(NameTable::isSorted(HKOPMODEMAPPING), "HKOPMODEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> DAYMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> DAYMAPPING[] = {
 	{ 0, "monday" }, { 1, "tuesday" }, { 2, "wednesday"}, { 3, "thursday" },
 	{ 4, "friday" }, { 5, "saturday" }, { 6, "sunday" }, { 7, "everyday" }
     };
+    static_assert(NameTable::isSorted(DAYMAPPING), "DAYMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> BUILDINGTYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> BUILDINGTYPEMAPPING[] = {
 	{ 0, "light" }, { 1, "medium" }, { 2, "heavy" }
     };
+    static_assert(NameTable::isSorted(BUILDINGTYPEMAPPING), "BUILDINGTYPEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> HEATINGTYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> HEATINGTYPEMAPPING[] = {
 	{ 0, "none" }, { 1, "heater" }, { 2, "convection" }, { 3, "floorheater" },
     };
+    static_assert(NameTable::isSorted(HEATINGTYPEMAPPING), "HEATINGTYPEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> REDUCTIONMODEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> REDUCTIONMODEMAPPING[] = {
 	{ 0, "offmode" }, { 1, "reduced" }, { 2, "raumhalt" }, { 3, "aussenhalt" }
     };
+    static_assert(NameTable::isSorted(REDUCTIONMODEMAPPING), "REDUCTIONMODEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> FROSTPROTECTMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> FROSTPROTECTMAPPING[] = {
 	{ 0, "off" }, { 1, "byoutdoortemp" }, { 2, "byindoortemp" }
     };
+    static_assert(NameTable::isSorted(FROSTPROTECTMAPPING), "FROSTPROTECTMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> RELEVANTVALUEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> RELEVANTVALUEMAPPING[] = {
 	{ 0, "outdoor" }, { 1, "indoor" }
     };
+    static_assert(NameTable::isSorted(RELEVANTVALUEMAPPING), "RELEVANTVALUEMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> VACATIONREDUCTIONMAPPING = {
-	{ 3, "outdoor" }, { 2, "indoor" }
+    static constexpr NameTable::Entry<uint8_t> VACATIONREDUCTIONMAPPING[] = {
+	{ 2, "indoor" }, { 3, "outdoor" }
     };
+    static_assert(NameTable::isSorted(VACATIONREDUCTIONMAPPING), "VACATIONREDUCTIONMAPPING must be sorted");
 
-    static const std::map<uint8_t, const char *> REMOTETYPEMAPPING = {
+    static constexpr NameTable::Entry<uint8_t> REMOTETYPEMAPPING[] = {
 	{ 0, "none" }, { 1, "rc20" }, { 2, "rc3x" }
     };
+    static_assert(NameTable::isSorted(REMOTETYPEMAPPING), "REMOTETYPEMAPPING must be sorted");
 
-    std::ostringstream stream;
+    /* called for every value sent to clients, so avoid streams here */
+    char buffer[64];
 
     switch (value.getReadingType()) {
 	case EmsValue::Numeric:
 	    if (!value.isValid()) {
-		stream << "unavailable";
-	    } else {
-		stream << value.getValue<float>();
+		return "unavailable";
 	    }
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%g", value.getValue<float>());
+	    return buffer;
 	case EmsValue::Integer:
 	    if (!value.isValid()) {
-		stream << "unavailable";
-	    } else {
-		stream << value.getValue<unsigned int>();
+		return "unavailable";
 	    }
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%u", value.getValue<unsigned int>());
+	    return buffer;
 	case EmsValue::Boolean:
-	    stream << (value.getValue<bool>() ? "on" : "off");
-	    break;
+	    return value.getValue<bool>() ? "on" : "off";
 	case EmsValue::Enumeration: {
-	    const std::map<uint8_t, const char *> *map = NULL;
+	    const char *name = NULL;
 	    uint8_t enumValue = value.getValue<uint8_t>();
 	    switch (value.getType()) {
-		case EmsValue::WWSystemType: map = &WWSYSTEMMAPPING; break;
-		case EmsValue::Schaltpunkte: map = &ZIRKSPMAPPING; break;
-		case EmsValue::Wartungsmeldungen: map = &MAINTENANCEMESSAGESMAPPING; break;
-		case EmsValue::WartungFaellig: map = &MAINTENANCENEEDEDMAPPING; break;
+		case EmsValue::WWSystemType: name = NameTable::lookup(WWSYSTEMMAPPING, enumValue); break;
+		case EmsValue::Schaltpunkte: name = NameTable::lookup(ZIRKSPMAPPING, enumValue); break;
+		case EmsValue::Wartungsmeldungen: name = NameTable::lookup(MAINTENANCEMESSAGESMAPPING, enumValue); break;
+		case EmsValue::WartungFaellig: name = NameTable::lookup(MAINTENANCENEEDEDMAPPING, enumValue); break;
 		case EmsValue::Betriebsart:
-		    map = value.isForHK() ? &HKOPMODEMAPPING : &OPMODEMAPPING;
+		    name = value.isForHK() ? NameTable::lookup(HKOPMODEMAPPING, enumValue)
+					   : NameTable::lookup(OPMODEMAPPING, enumValue);
 		    break;
-		case EmsValue::DesinfektionTag: map = &DAYMAPPING; break;
-		case EmsValue::GebaeudeArt: map = &BUILDINGTYPEMAPPING; break;
-		case EmsValue::HeizSystem: map = &HEATINGTYPEMAPPING; break;
-		case EmsValue::AbsenkModus: map = &REDUCTIONMODEMAPPING; break;
-		case EmsValue::Frostschutz: map = &FROSTPROTECTMAPPING; break;
-		case EmsValue::FuehrungsGroesse: map = &RELEVANTVALUEMAPPING; break;
-		case EmsValue::FBTyp: map = &REMOTETYPEMAPPING; break;
-		case EmsValue::UrlaubAbsenkungsArt: map = &VACATIONREDUCTIONMAPPING; break;
+		case EmsValue::DesinfektionTag: name = NameTable::lookup(DAYMAPPING, enumValue); break;
+		case EmsValue::GebaeudeArt: name = NameTable::lookup(BUILDINGTYPEMAPPING, enumValue); break;
+		case EmsValue::HeizSystem: name = NameTable::lookup(HEATINGTYPEMAPPING, enumValue); break;
+		case EmsValue::AbsenkModus: name = NameTable::lookup(REDUCTIONMODEMAPPING, enumValue); break;
+		case EmsValue::Frostschutz: name = NameTable::lookup(FROSTPROTECTMAPPING, enumValue); break;
+		case EmsValue::FuehrungsGroesse: name = NameTable::lookup(RELEVANTVALUEMAPPING, enumValue); break;
+		case EmsValue::FBTyp: name = NameTable::lookup(REMOTETYPEMAPPING, enumValue); break;
+		case EmsValue::UrlaubAbsenkungsArt: name = NameTable::lookup(VACATIONREDUCTIONMAPPING, enumValue); break;
 		default: break;
 	    }
-	    if (map && map->find(enumValue) != map->end()) {
-		stream << map->at(enumValue);
-	    } else {
-		stream << (unsigned int) enumValue;
+	    if (name) {
+		return name;
 	    }
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%u", (unsigned int) enumValue);
+	    return buffer;
 	}
 	case EmsValue::Kennlinie: {
 	    std::vector<uint8_t> kennlinie = value.getValue<std::vector<uint8_t> >();
-	    stream << boost::format("%d/%d/%d")
-		    % (unsigned int) kennlinie[0] % (unsigned int) kennlinie[1]
-		    % (unsigned int) kennlinie[2];
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%u/%u/%u",
+		     (unsigned int) kennlinie[0], (unsigned int) kennlinie[1],
+		     (unsigned int) kennlinie[2]);
+	    return buffer;
 	}
 	case EmsValue::Error: {
 	    EmsValue::ErrorEntry entry = value.getValue<EmsValue::ErrorEntry>();
 	    std::string formatted = ApiCommandParser::buildRecordResponse(&entry.record);
+	    const char *type = NameTable::lookup(ERRORTYPEMAPPING, entry.type);
 	    if (formatted.empty()) {
 		formatted = "empty";
 	    }
 
-	    stream << boost::format("%s%02d %s")
-		    % ERRORTYPEMAPPING.at(entry.type) % entry.index % formatted;
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%s%02u ", type ? type : "?", entry.index);
+	    return buffer + formatted;
 	}
 	case EmsValue::Date: {
 	    EmsProto::DateRecord record = value.getValue<EmsProto::DateRecord>();
-	    stream << boost::format("%04d-%02d-%02d")
-		    % (2000 + record.year) % (unsigned int) record.month
-		    % (unsigned int) record.day;
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u",
+		     2000 + record.year, (unsigned int) record.month,
+		     (unsigned int) record.day);
+	    return buffer;
 	}
 	case EmsValue::SystemTime: {
 	    EmsProto::SystemTimeRecord record = value.getValue<EmsProto::SystemTimeRecord>();
-	    stream << boost::format("%04d-%02d-%02d %02d:%02d:%02d")
-		    % (2000 + record.common.year) % (unsigned int) record.common.month
-		    % (unsigned int) record.common.day % (unsigned int) record.common.hour
-		    % (unsigned int)  record.common.minute % (unsigned int) record.second;
-	    break;
+	    snprintf(buffer, sizeof(buffer), "%04d-%02u-%02u %02u:%02u:%02u",
+		     2000 + record.common.year, (unsigned int) record.common.month,
+		     (unsigned int) record.common.day, (unsigned int) record.common.hour,
+		     (unsigned int) record.common.minute, (unsigned int) record.second);
+	    return buffer;
 	}
 	case EmsValue::Formatted:
-	    stream << value.getValue<std::string>();
-	    break;
+	    return value.getValue<std::string>();
     }
 
-    return stream.str();
+    return "";
+}
+
+std::string
+ValueApi::formatTimestamp(const Timestamp& timestamp)
+{
+    char buffer[32];
+
+    snprintf(buffer, sizeof(buffer), "%llu.%03u",
+	     (unsigned long long) timestamp.seconds(), timestamp.milliseconds());
+    return buffer;
 }
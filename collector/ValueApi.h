@@ -25,7 +25,14 @@
 namespace ValueApi {
     std::string getTypeName(EmsValue::Type type);
     std::string getSubTypeName(EmsValue::SubType subtype);
+    /* reverse of the above, returns false for unknown names */
+    bool parseTypeName(const std::string& name, EmsValue::Type& type);
+    bool parseSubTypeName(const std::string& name, EmsValue::SubType& subtype);
+    /* parses '[<subtype>/]<type>', as used for configuring values */
+    bool parseValueKey(const std::string& key, EmsValue::Type& type, EmsValue::SubType& subtype);
     std::string formatValue(const EmsValue& value);
+    /* seconds since epoch with millisecond fraction */
+    std::string formatTimestamp(const Timestamp& timestamp);
 }
 
 #endif /* __DATAHANDLER_H__ */
@@ -17,6 +17,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <iostream>
 #include "ValueApi.h"
 #include "ValueCache.h"
 
@@ -28,19 +29,42 @@ ValueCache::~ValueCache()
 {
 }
 
+ValueCache::CacheKey
+ValueCache::keyForValue(const EmsValue& value)
+{
+    unsigned int index = 0;
+
+    if (value.getReadingType() == EmsValue::Error) {
+	const EmsValue::ErrorEntry& entry = value.getValue<EmsValue::ErrorEntry>();
+	index = (entry.type << 8) | entry.index;
+    }
+
+    return CacheKey(value.getType(), value.getSubType(), index);
+}
+
 void
 ValueCache::handleValue(const EmsValue& value)
 {
-    CacheKey key(value.getType(), value.getSubType());
+    CacheKey key = keyForValue(value);
     m_cache.erase(key);
     m_cache.insert(std::make_pair(key, CacheEntry(value)));
 }
 
+void
+ValueCache::merge(const ValueCache& newer)
+{
+    for (auto& entry : newer.m_cache) {
+	m_cache.erase(entry.first);
+	m_cache.insert(entry);
+    }
+}
+
 const EmsValue *
 ValueCache::getValue(EmsValue::Type type, EmsValue::SubType subtype) const
 {
-    auto iter = m_cache.find(CacheKey(type, subtype));
-    if (iter == m_cache.end()) {
+    /* for the error logs this returns the first slot present */
+    auto iter = m_cache.lower_bound(CacheKey(type, subtype));
+    if (iter == m_cache.end() || iter->first.m_type != type || iter->first.m_subtype != subtype) {
 	return NULL;
     }
     return &iter->second.value;
@@ -32,34 +32,43 @@ class ValueCache
 	~ValueCache();
 
 	void handleValue(const EmsValue& value);
+	/* takes over all values of a cache filled later in time */
+	void merge(const ValueCache& newer);
 	void outputValues(const std::vector<std::string>& selector, std::ostream& stream);
 	const EmsValue * getValue(EmsValue::Type type, EmsValue::SubType subtype) const;
 
     private:
 	class CacheKey {
 	    public:
-		CacheKey(EmsValue::Type type, EmsValue::SubType subtype) :
-		    m_type(type), m_subtype(subtype) { }
+		CacheKey(EmsValue::Type type, EmsValue::SubType subtype, unsigned int index = 0) :
+		    m_type(type), m_subtype(subtype), m_index(index) { }
 		bool operator=(const CacheKey& rhs) {
-		    return m_type == rhs.m_type && m_subtype == rhs.m_subtype;
+		    return m_type == rhs.m_type && m_subtype == rhs.m_subtype && m_index == rhs.m_index;
 		}
 		bool operator<(const CacheKey& rhs) const {
 		    if (m_type != rhs.m_type) {
 			return m_type < rhs.m_type;
 		    }
-		    return m_subtype < rhs.m_subtype;
+		    if (m_subtype != rhs.m_subtype) {
+			return m_subtype < rhs.m_subtype;
+		    }
+		    return m_index < rhs.m_index;
 		}
 
 		EmsValue::Type m_type;
 		EmsValue::SubType m_subtype;
+		/* distinguishes the slots of the error logs */
+		unsigned int m_index;
 	};
 
+	static CacheKey keyForValue(const EmsValue& value);
+
 	struct CacheEntry {
 	    time_t timestamp;
 	    EmsValue value;
 
 	    CacheEntry(const EmsValue& v) :
-		timestamp(time(NULL)), value(v) { }
+		timestamp(v.getTimestamp().seconds()), value(v) { }
 	};
 
 	std::map<CacheKey, CacheEntry> m_cache;
@@ -0,0 +1,317 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include "ValueApi.h"
+#include "WindowStats.h"
+
+static const struct {
+    const char *name;
+    uint32_t length;
+} WINDOWS[] = {
+    { "day", 86400 },
+    { "halfweek", 3 * 86400 },
+    { "week", 7 * 86400 },
+    { "month", 31 * 86400 }
+};
+
+void
+WindowStats::Aggregate::add(float value, uint32_t time)
+{
+    if (!valid) {
+	valid = true;
+	since = time;
+	min = max = value;
+	minTime = maxTime = time;
+	return;
+    }
+    if (value < min) {
+	min = value;
+	minTime = time;
+    }
+    if (value > max) {
+	max = value;
+	maxTime = time;
+    }
+}
+
+void
+WindowStats::Aggregate::addHold(float value, uint32_t length)
+{
+    integral += (double) value * length;
+    duration += length;
+}
+
+void
+WindowStats::Aggregate::merge(const Aggregate& other)
+{
+    if (!other.valid) {
+	return;
+    }
+    if (!valid) {
+	*this = other;
+	return;
+    }
+    since = std::min(since, other.since);
+    if (other.min < min) {
+	min = other.min;
+	minTime = other.minTime;
+    }
+    if (other.max > max) {
+	max = other.max;
+	maxTime = other.maxTime;
+    }
+    integral += other.integral;
+    duration += other.duration;
+}
+
+WindowStats::WindowStats()
+{
+}
+
+bool
+WindowStats::addValue(const std::string& name)
+{
+    EmsValue::SubType subtype;
+    EmsValue::Type type;
+
+    if (!ValueApi::parseValueKey(name, type, subtype)) {
+	return false;
+    }
+
+    Entry entry = Entry();
+    entry.name = name;
+    for (size_t i = 0; i < WindowCount; i++) {
+	entry.windows[i].length = WINDOWS[i].length;
+    }
+    m_index[std::make_pair(type, subtype)] = m_entries.size();
+    m_entries.push_back(entry);
+    return true;
+}
+
+void
+WindowStats::handleValue(const EmsValue& value)
+{
+    if (!value.isValid()) {
+	return;
+    }
+
+    auto iter = m_index.find(std::make_pair(value.getType(), value.getSubType()));
+    if (iter == m_index.end()) {
+	return;
+    }
+
+    float reading;
+    switch (value.getReadingType()) {
+	case EmsValue::Numeric:
+	    reading = value.getValue<float>();
+	    break;
+	case EmsValue::Integer:
+	    reading = value.getValue<unsigned int>();
+	    break;
+	default:
+	    return;
+    }
+
+    addSample(m_entries[iter->second], reading, value.getTimestamp().seconds());
+}
+
+void
+WindowStats::addSample(Entry& entry, float value, uint32_t now)
+{
+    bool holding = entry.haveLast && now >= entry.lastTime && now - entry.lastTime <= MaxGap;
+
+    if (entry.haveLast && now < entry.lastTime) {
+	/* time went backwards, don't mess up the bucket order */
+	return;
+    }
+
+    /* the previous value is held until now; split it at midnight */
+    if (holding && now >= entry.dayEnd) {
+	if (entry.dayEnd > entry.lastTime) {
+	    entry.today.addHold(entry.lastValue, entry.dayEnd - entry.lastTime);
+	}
+    }
+    if (now >= entry.dayEnd) {
+	rollDay(entry, now);
+	if (holding) {
+	    entry.today.add(entry.lastValue, entry.dayStart);
+	    entry.today.addHold(entry.lastValue, now - entry.dayStart);
+	}
+    } else if (holding) {
+	entry.today.addHold(entry.lastValue, now - entry.lastTime);
+    }
+    entry.today.add(value, now);
+
+    /* the hold is accounted to the bucket it started in */
+    if (holding && !entry.buckets.empty()) {
+	entry.buckets.back().addHold(entry.lastValue, now - entry.lastTime);
+    }
+
+    uint32_t bucketStart = now - now % BucketLength;
+    if (entry.buckets.empty() || entry.buckets.back().since < bucketStart) {
+	if (!entry.buckets.empty()) {
+	    closeBucket(entry);
+	}
+	entry.buckets.push_back(Aggregate());
+    }
+    entry.buckets.back().add(value, now);
+
+    entry.haveLast = true;
+    entry.lastValue = value;
+    entry.lastTime = now;
+
+    expire(entry, now);
+}
+
+void
+WindowStats::rollDay(Entry& entry, uint32_t now)
+{
+    time_t seconds = now;
+    struct tm local = *localtime(&seconds);
+
+    local.tm_hour = local.tm_min = local.tm_sec = 0;
+    local.tm_isdst = -1;
+    time_t start = mktime(&local);
+    local.tm_mday++;
+    local.tm_isdst = -1;
+    time_t end = mktime(&local);
+
+    /* only keep the previous day if it's the one before this */
+    if (entry.dayEnd == (uint32_t) start) {
+	entry.yesterday = entry.today;
+    } else {
+	entry.yesterday = Aggregate();
+    }
+    entry.today = Aggregate();
+    entry.dayStart = start;
+    entry.dayEnd = end;
+}
+
+void
+WindowStats::closeBucket(Entry& entry)
+{
+    uint64_t seq = entry.firstSeq + entry.buckets.size() - 1;
+    const Aggregate& closed = entry.buckets.back();
+
+    for (auto& window : entry.windows) {
+	while (!window.minQueue.empty() && bucket(entry, window.minQueue.back()).min >= closed.min) {
+	    window.minQueue.pop_back();
+	}
+	window.minQueue.push_back(seq);
+	while (!window.maxQueue.empty() && bucket(entry, window.maxQueue.back()).max <= closed.max) {
+	    window.maxQueue.pop_back();
+	}
+	window.maxQueue.push_back(seq);
+	window.integral += closed.integral;
+	window.duration += closed.duration;
+    }
+}
+
+void
+WindowStats::expire(Entry& entry, uint32_t now)
+{
+    uint64_t openSeq = entry.firstSeq + entry.buckets.size() - 1;
+    uint64_t keepFrom = openSeq;
+
+    for (auto& window : entry.windows) {
+	uint32_t windowStart = now > window.length ? now - window.length : 0;
+
+	if (window.first < entry.firstSeq) {
+	    window.first = entry.firstSeq;
+	}
+	while (window.first < openSeq && bucket(entry, window.first).since < windowStart) {
+	    const Aggregate& old = bucket(entry, window.first);
+	    window.integral -= old.integral;
+	    window.duration -= old.duration;
+	    if (!window.minQueue.empty() && window.minQueue.front() == window.first) {
+		window.minQueue.pop_front();
+	    }
+	    if (!window.maxQueue.empty() && window.maxQueue.front() == window.first) {
+		window.maxQueue.pop_front();
+	    }
+	    window.first++;
+	}
+	keepFrom = std::min(keepFrom, window.first);
+    }
+
+    while (entry.firstSeq < keepFrom) {
+	entry.buckets.pop_front();
+	entry.firstSeq++;
+    }
+}
+
+void
+WindowStats::print(std::ostream& stream, const std::string& name,
+		   const char *period, const Aggregate& aggregate)
+{
+    stream << name << ' ' << period << ' ';
+    if (!aggregate.valid) {
+	stream << "none\n";
+	return;
+    }
+
+    float average = aggregate.duration != 0
+	    ? aggregate.integral / aggregate.duration : aggregate.min;
+    stream << aggregate.since << ' ' << aggregate.min << ' ' << aggregate.minTime << ' '
+	   << aggregate.max << ' ' << aggregate.maxTime << ' ' << average << '\n';
+}
+
+bool
+WindowStats::output(const std::string& name, std::ostream& stream) const
+{
+    auto iter = std::find_if(m_entries.begin(), m_entries.end(), [&] (const Entry& entry) {
+	return entry.name == name;
+    });
+    if (iter == m_entries.end()) {
+	return false;
+    }
+
+    const Entry& entry = *iter;
+    for (size_t i = 0; i < WindowCount; i++) {
+	const Window& window = entry.windows[i];
+	Aggregate result = Aggregate();
+
+	if (!entry.buckets.empty()) {
+	    uint64_t openSeq = entry.firstSeq + entry.buckets.size() - 1;
+	    uint64_t first = std::max(window.first, entry.firstSeq);
+
+	    result = entry.buckets.back();
+	    if (first < openSeq) {
+		const Aggregate& minBucket = bucket(entry, window.minQueue.front());
+		const Aggregate& maxBucket = bucket(entry, window.maxQueue.front());
+		Aggregate closed = Aggregate();
+
+		closed.valid = true;
+		closed.since = bucket(entry, first).since;
+		closed.min = minBucket.min;
+		closed.minTime = minBucket.minTime;
+		closed.max = maxBucket.max;
+		closed.maxTime = maxBucket.maxTime;
+		closed.integral = window.integral;
+		closed.duration = window.duration;
+		result.merge(closed);
+	    }
+	}
+	print(stream, entry.name, WINDOWS[i].name, result);
+    }
+    print(stream, entry.name, "today", entry.today);
+    print(stream, entry.name, "yesterday", entry.yesterday);
+    return true;
+}
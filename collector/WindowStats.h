@@ -0,0 +1,115 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2011 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WINDOWSTATS_H__
+#define __WINDOWSTATS_H__
+
+#include <time.h>
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "EmsMessage.h"
+#include "Noncopyable.h"
+
+/*
+ * Keeps minimum, maximum and time weighted average of selected numeric
+ * values over the sliding windows shown by the web pages (day, half week,
+ * week, month) and over the current and previous calendar day. Values are
+ * collected into one minute buckets; the windows keep running sums and
+ * monotonic queues of those, so each incoming value costs amortized
+ * constant time and a query doesn't depend on the amount of history.
+ */
+class WindowStats : private boost::noncopyable
+{
+    public:
+	WindowStats();
+
+	/* [<subtype>/]<type> as used by the data port */
+	bool addValue(const std::string& name);
+	void handleValue(const EmsValue& value);
+
+	/*
+	 * Writes one line per period:
+	 * <key> <period> <since> <min> <min time> <max> <max time> <average>
+	 * Returns false if the value isn't tracked.
+	 */
+	bool output(const std::string& name, std::ostream& stream) const;
+
+    private:
+	struct Aggregate {
+	    bool valid;
+	    /* start of the data covered */
+	    uint32_t since;
+	    float min, max;
+	    uint32_t minTime, maxTime;
+	    double integral;
+	    uint32_t duration;
+
+	    void add(float value, uint32_t time);
+	    void addHold(float value, uint32_t duration);
+	    void merge(const Aggregate& other);
+	};
+
+	struct Window {
+	    uint32_t length;
+	    /* sequence number of the first closed bucket inside the window */
+	    uint64_t first;
+	    /* buckets which may still become minimum or maximum */
+	    std::deque<uint64_t> minQueue, maxQueue;
+	    double integral;
+	    uint64_t duration;
+	};
+
+	static const size_t WindowCount = 4;
+
+	struct Entry {
+	    std::string name;
+	    /* all buckets of the longest window, the last one is still open */
+	    std::deque<Aggregate> buckets;
+	    uint64_t firstSeq;
+	    Window windows[WindowCount];
+	    Aggregate today, yesterday;
+	    uint32_t dayStart, dayEnd;
+	    bool haveLast;
+	    float lastValue;
+	    uint32_t lastTime;
+	};
+
+	void addSample(Entry& entry, float value, uint32_t now);
+	void rollDay(Entry& entry, uint32_t now);
+	void closeBucket(Entry& entry);
+	void expire(Entry& entry, uint32_t now);
+	const Aggregate& bucket(const Entry& entry, uint64_t seq) const {
+	    return entry.buckets[seq - entry.firstSeq];
+	}
+	static void print(std::ostream& stream, const std::string& name,
+			  const char *period, const Aggregate& aggregate);
+
+    private:
+	static const uint32_t BucketLength = 60;
+	/* values further apart than this are treated as missing data */
+	static const uint32_t MaxGap = 5 * 60;
+
+	std::vector<Entry> m_entries;
+	std::map<std::pair<EmsValue::Type, EmsValue::SubType>, size_t> m_index;
+};
+
+#endif /* __WINDOWSTATS_H__ */
@@ -20,36 +20,57 @@
 #include <cerrno>
 #include <csignal>
 #include <iostream>
+#include <set>
 #include <boost/asio/signal_set.hpp>
 #include <boost/scoped_ptr.hpp>
+#include "AlertRules.h"
+#include "AnomalyDetector.h"
+#include "Aggregator.h"
+#include "CaptureFile.h"
+#include "CaptureReplayHandler.h"
 #include "CommandHandler.h"
 #include "CommandScheduler.h"
 #ifdef HAVE_MYSQL
 # include "Database.h"
 #endif
 #include "DataHandler.h"
+#include "DebugLog.h"
+#include "DerivedValues.h"
+#include "GraphRenderer.h"
+#include "EnergyEstimator.h"
+#include "ErrorTracker.h"
+#include "FrameForwarder.h"
+#include "Handoff.h"
+#include "LineProtocolSink.h"
 #include "MqttAdapter.h"
 #include "Options.h"
 #include "PidFile.h"
+#include "Pipeline.h"
+#include "Reprocessor.h"
 #include "SendingSerialHandler.h"
 #include "SerialHandler.h"
+#include "SeriesHistory.h"
+#include "StateFile.h"
 #include "TcpHandler.h"
 #include "ValueCache.h"
+#include "WindowStats.h"
 
 static IoHandler *
-getHandler(const std::string& target, ValueCache& cache)
+getHandler(const std::string& target, ValueCache& cache, int fd)
 {
     if (target.compare(0, 7, "serial:") == 0) {
-	return new SerialHandler(target.substr(7), cache);
+	return new SerialHandler(target.substr(7), cache, fd);
     } else if (target.compare(0, 10, "tx-serial:") == 0) {
-	return new SendingSerialHandler(target.substr(10), cache);
+	return new SendingSerialHandler(target.substr(10), cache, fd);
     } else if (target.compare(0, 4, "tcp:") == 0) {
 	size_t pos = target.find(':', 4);
 	if (pos != std::string::npos) {
 	    std::string host = target.substr(4, pos - 4);
 	    std::string port = target.substr(pos + 1);
-	    return new TcpHandler(host, port, cache);
+	    return new TcpHandler(host, port, cache, fd);
 	}
+    } else if (target.compare(0, 8, "capture:") == 0) {
+	return new CaptureReplayHandler(target.substr(8), cache);
     }
 
     return nullptr;
@@ -68,6 +89,99 @@ getMqttAdapter(boost::asio::io_service& ios, EmsCommandSender *sender, const std
     return nullptr;
 }
 
+#ifdef HAVE_STATIC_PIPELINE
+#ifdef HAVE_MYSQL
+struct DatabaseSink {
+    typedef Database Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& db, const EmsValue& value) {
+	db.handleValue(value);
+    }
+};
+#endif
+
+struct CacheSink {
+    typedef ValueCache Target;
+    static bool accepts(const EmsValue& /* value */) {
+	return true;
+    }
+    static void handle(Target& cache, const EmsValue& value) {
+	cache.handleValue(value);
+    }
+};
+
+struct HistorySink {
+    typedef SeriesHistory Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& history, const EmsValue& value) {
+	history.handleValue(value);
+    }
+};
+
+struct StatsSink {
+    typedef WindowStats Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& stats, const EmsValue& value) {
+	stats.handleValue(value);
+    }
+};
+
+struct DerivedSink {
+    typedef DerivedValues Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& derived, const EmsValue& value) {
+	derived.handleValue(value);
+    }
+};
+
+struct EnergySink {
+    typedef EnergyEstimator Target;
+    static bool accepts(const EmsValue& value) {
+	return value.getType() == EmsValue::DreiWegeVentilAufWW ||
+		(value.getType() == EmsValue::IstModulation &&
+		 value.getSubType() == EmsValue::Brenner);
+    }
+    static void handle(Target& energy, const EmsValue& value) {
+	energy.handleValue(value);
+    }
+};
+
+struct AnomalySink {
+    typedef AnomalyDetector Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& anomaly, const EmsValue& value) {
+	anomaly.handleValue(value);
+    }
+};
+
+struct ErrorSink {
+    typedef ErrorTracker Target;
+    static bool accepts(const EmsValue& value) {
+	return value.getReadingType() == EmsValue::Error;
+    }
+    static void handle(Target& errors, const EmsValue& value) {
+	errors.handleValue(value);
+    }
+};
+
+typedef Pipeline<
+#ifdef HAVE_MYSQL
+    DatabaseSink,
+#endif
+    CacheSink, HistorySink, StatsSink, DerivedSink, EnergySink, AnomalySink, ErrorSink
+> CorePipeline;
+#endif
+
 static void
 fillSignalSet(boost::asio::signal_set& signals) {
     signals.add(SIGINT);
@@ -84,6 +198,145 @@ stopHandler(boost::asio::io_service *ios, bool *running)
     ios->stop();
 }
 
+static void
+saveState(StateFile *state, EnergyEstimator *energy, AnomalyDetector *anomaly,
+	  ErrorTracker *errors)
+{
+    if (energy) {
+	energy->saveState(*state);
+    }
+    anomaly->saveState(*state);
+    errors->saveState(*state);
+    state->save();
+}
+
+static int
+reprocess()
+{
+    Reprocessor reprocessor(Options::reprocessFiles(), Options::reprocessStart(),
+			    Options::reprocessEnd(), Options::reprocessThreads());
+
+    if (!reprocessor.open()) {
+	return 1;
+    }
+
+    const std::string& outputPath = Options::reprocessOutput();
+    if (!outputPath.empty()) {
+	return reprocessor.writeFiles(outputPath) ? 0 : 1;
+    }
+
+#ifdef HAVE_MYSQL
+    const std::string& dbPath = Options::databasePath();
+    if (dbPath != "none") {
+	Database db;
+	if (!db.connect(dbPath, Options::databaseUser(), Options::databasePassword())) {
+	    std::cerr << "Could not connect to database" << std::endl;
+	    return 1;
+	}
+
+	/* replace the whole requested range, or what the captures cover */
+	time_t start = Options::reprocessStart();
+	time_t end = Options::reprocessEnd();
+	if (start == 0) {
+	    start = reprocessor.firstTimestamp();
+	}
+	if (end == 0) {
+	    end = reprocessor.lastTimestamp();
+	}
+	return db.storeIntervals(start, end, boost::bind(&Reprocessor::run, &reprocessor, _1)) ? 0 : 1;
+    }
+#endif
+
+    std::cerr << "No output for reprocessed data configured" << std::endl;
+    return 1;
+}
+
+#ifdef HAVE_MYSQL
+static int
+exportHistory()
+{
+    Database db;
+
+    if (!db.connect(Options::databasePath(), Options::databaseUser(), Options::databasePassword())) {
+	std::cerr << "Could not connect to database" << std::endl;
+	return 1;
+    }
+
+    return db.exportHistory(Options::exportDirectory(), Options::exportStart(),
+			    Options::exportEnd(), Options::exportThreads()) ? 0 : 1;
+}
+#endif
+
+static int
+compact(const std::string& input, const std::string& output)
+{
+    CaptureReader reader(input);
+    std::vector<CaptureFile::Frame> frames;
+    size_t damaged = 0;
+
+    if (!reader.isOpen()) {
+	std::cerr << "Could not read capture file " << input << std::endl;
+	return 1;
+    }
+
+    CaptureWriter writer(output, true);
+    if (!writer.isOpen()) {
+	return 1;
+    }
+
+    for (auto& block : reader.blocks()) {
+	if (!reader.readBlock(block, frames)) {
+	    damaged++;
+	}
+	for (auto& frame : frames) {
+	    writer.writeFrame(frame.timestamp, frame.data);
+	}
+    }
+    writer.flush();
+
+    if (damaged != 0) {
+	std::cerr << damaged << " damaged blocks in " << input << std::endl;
+	return 1;
+    }
+
+    return 0;
+}
+
+static int
+aggregate()
+{
+    try {
+#ifdef HAVE_DAEMONIZE
+	PidFile pid(Options::pidFilePath());
+	if (Options::daemonize()) {
+	    pid.aquire();
+	    if (daemon(0, 0) == -1) {
+		std::ostringstream msg;
+		msg << "Could not daemonize: " << strerror(errno);
+		throw std::runtime_error(msg.str());
+	    }
+	    pid.write();
+	}
+#endif
+	DebugLog::instance().start();
+
+	boost::asio::io_service ios;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::tcp::v4(), Options::aggregatePort());
+	Aggregator aggregator(ios, endpoint, Options::aggregateDirectory());
+	boost::asio::signal_set signals(ios);
+	bool running = true;
+
+	fillSignalSet(signals);
+	signals.async_wait(boost::bind(&stopHandler, &ios, &running));
+	ios.run();
+    } catch (std::exception& e) {
+	std::cerr << "Exception: " << e.what() << std::endl;
+	return 1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     Options::ParseResult result = Options::parse(argc, argv);
@@ -93,33 +346,85 @@ int main(int argc, char *argv[])
 	return 0;
     }
 
+    if (!Options::reprocessFiles().empty()) {
+	DebugLog::instance().start();
+	return reprocess();
+    }
+#ifdef HAVE_MYSQL
+    if (!Options::exportDirectory().empty()) {
+	DebugLog::instance().start();
+	return exportHistory();
+    }
+#endif
+    if (!Options::compactFiles().empty()) {
+	DebugLog::instance().start();
+	return compact(Options::compactFiles()[0], Options::compactFiles()[1]);
+    }
+    if (Options::aggregatePort() != 0) {
+	return aggregate();
+    }
+
+    Handoff::init(argc, argv);
+
     try {
 	ValueCache cache;
 	bool running = true;
 
 #ifdef HAVE_DAEMONIZE
+	/* when taking over, the previous process holds the lock until then */
 	PidFile pid(Options::pidFilePath());
-	if (Options::daemonize()) {
+	if (Options::daemonize() && !Handoff::pending()) {
 	    pid.aquire();
 	}
 #endif
 
+	/* always registered, as rules may be added on reload */
+	AlertRules alerts;
+	IoHandler::ValueCallback alertValueCb = boost::bind(&AlertRules::handleValue, &alerts, _1);
+	if (!Options::alertRules().empty()) {
+	    if (!alerts.load(Options::alertRules())) {
+		return 1;
+	    }
+	    if (!Options::alertLog().empty()) {
+		alerts.setLogFile(Options::alertLog());
+	    }
+	}
+
 	IoHandler::ValueCallback dbValueCb;
 #ifdef HAVE_MYSQL
 	const std::string& dbPath = Options::databasePath();
 	Database db;
 
 	if (dbPath != "none") {
-	    if (!db.connect(dbPath, Options::databaseUser(), Options::databasePassword())) {
-		std::cerr << "Could not connect to database" << std::endl;
-		return 1;
-	    }
+	    db.connectInBackground(dbPath, Options::databaseUser(), Options::databasePassword());
 	}
 	dbValueCb = boost::bind(&Database::handleValue,&db, _1);
 #endif
 
+	ErrorTracker errors;
+	IoHandler::ValueCallback errorValueCb = boost::bind(&ErrorTracker::handleValue, &errors, _1);
+	if (!Options::errorHistory().empty() && !errors.openHistory(Options::errorHistory())) {
+	    return 1;
+	}
+#ifdef HAVE_MYSQL
+	if (dbPath != "none") {
+	    errors.addEventCallback(boost::bind(&Database::handleErrorEvent, &db, _1));
+	}
+#endif
+
+	/* the previous process keeps collecting until we get here */
+	Handoff::State inherited;
+	if (Handoff::pending()) {
+	    if (!Handoff::receive(inherited)) {
+		return 1;
+	    }
+	    StreamAcceptor::inherit(inherited.listeners);
+	    FrameSnapshot::restore(inherited.frames, cache);
 #ifdef HAVE_DAEMONIZE
-	if (Options::daemonize()) {
+	    if (Options::daemonize()) {
+		pid.write();
+	    }
+	} else if (Options::daemonize()) {
 	    if (daemon(0, 0) == -1) {
 		std::ostringstream msg;
 		msg << "Could not daemonize: " << strerror(errno);
@@ -127,56 +432,469 @@ int main(int argc, char *argv[])
 	    }
 
 	    pid.write();
-	}
 #endif
+	}
+
+	/* threads don't survive daemonizing, so only start it now */
+	DebugLog::instance().start();
 
 	IoHandler::ValueCallback cacheValueCb = boost::bind(&ValueCache::handleValue, &cache, _1);
 
+	/* kept across reconnects, gaps in the data are detected by it */
+	DerivedValues derived;
+	IoHandler::ValueCallback derivedValueCb = boost::bind(&DerivedValues::handleValue, &derived, _1);
+
+	boost::scoped_ptr<EnergyEstimator> energy;
+	IoHandler::ValueCallback energyValueCb;
+	if (Options::nominalPower() > 0) {
+	    energy.reset(new EnergyEstimator(Options::nominalPower(), Options::fuelEnergyContent()));
+	    energyValueCb = boost::bind(&EnergyEstimator::handleValue, energy.get(), _1);
+	}
+
+	AnomalyDetector anomaly(Options::anomalyThreshold());
+	IoHandler::ValueCallback anomalyValueCb;
+	for (auto& name : Options::anomalyValues()) {
+	    if (!anomaly.addValue(name)) {
+		std::ostringstream msg;
+		msg << "Value " << name << " is invalid.";
+		throw std::runtime_error(msg.str());
+	    }
+	    anomalyValueCb = boost::bind(&AnomalyDetector::handleValue, &anomaly, _1);
+	}
+
+	boost::scoped_ptr<SeriesHistory> history;
+	boost::scoped_ptr<GraphRenderer> graphs;
+	IoHandler::ValueCallback historyValueCb;
+	if (Options::seriesRetention() != 0) {
+	    history.reset(new SeriesHistory(Options::seriesRetention() * 3600));
+	    graphs.reset(new GraphRenderer(*history));
+	    historyValueCb = boost::bind(&SeriesHistory::handleValue, history.get(), _1);
+	}
+
+	WindowStats stats;
+	IoHandler::ValueCallback statsValueCb;
+	for (auto& name : Options::windowStatsValues()) {
+	    if (!stats.addValue(name)) {
+		std::ostringstream msg;
+		msg << "Value " << name << " is invalid.";
+		throw std::runtime_error(msg.str());
+	    }
+	    statsValueCb = boost::bind(&WindowStats::handleValue, &stats, _1);
+	}
+
+	boost::scoped_ptr<StateFile> state;
+	if (!Options::stateFile().empty()) {
+	    state.reset(new StateFile(Options::stateFile()));
+	    if (state->load()) {
+		if (energy) {
+		    energy->loadState(*state);
+		}
+		anomaly.loadState(*state);
+		errors.loadState(*state);
+	    }
+	}
+
+	/* saving periodically limits the loss on crashes or power failures */
+	uint64_t lastStateSave = 0;
+	IoHandler::ValueCallback stateValueCb = [&] (const EmsValue& value) {
+	    uint64_t now = value.getTimestamp().monotonic;
+	    if (now < lastStateSave || now - lastStateSave >= 5 * 60 * 1000) {
+		lastStateSave = now;
+		saveState(state.get(), energy.get(), &anomaly, &errors);
+	    }
+	};
+
+	boost::scoped_ptr<CaptureWriter> capture;
+	IoHandler::FrameCallback captureFrameCb;
+	if (!Options::captureFile().empty()) {
+	    capture.reset(new CaptureWriter(Options::captureFile(), Options::compactCapture()));
+	    if (!capture->isOpen()) {
+		return 1;
+	    }
+	    captureFrameCb = boost::bind(&CaptureWriter::handleFrame, capture.get(), _1, _2);
+	}
+
+#ifdef HAVE_STATIC_PIPELINE
+	/* the sinks existing for the whole run, in the order of the callbacks
+	 * registered otherwise */
+	CorePipeline pipeline(
+#ifdef HAVE_MYSQL
+		dbValueCb ? &db : nullptr,
+#endif
+		&cache, history.get(), statsValueCb ? &stats : nullptr, &derived, energy.get(),
+		anomalyValueCb ? &anomaly : nullptr, &errors);
+	IoHandler::ValueCallback pipelineCb = boost::bind(&CorePipeline::handleValue, &pipeline, _1);
+#endif
+
+	FrameSnapshot snapshot;
+	IoHandler::FrameCallback snapshotFrameCb =
+		boost::bind(&FrameSnapshot::handleFrame, &snapshot, _1, _2);
+	bool handedOver = false;
+
 	while (running) {
-	    boost::scoped_ptr<IoHandler> handler(getHandler(Options::target(), cache));
+	    boost::scoped_ptr<IoHandler> handler(getHandler(Options::target(), cache,
+							    inherited.transport));
+	    bool resumeInput = inherited.transport >= 0;
+	    inherited.transport = -1;
 	    if (!handler) {
 		std::ostringstream msg;
 		msg << "Target " << Options::target() << " is invalid.";
 		throw std::runtime_error(msg.str());
 	    }
 
+	    derived.setOutput(boost::bind(&IoHandler::injectValue, handler.get(), _1));
+	    if (energy) {
+		energy->setOutput(boost::bind(&IoHandler::injectValue, handler.get(), _1));
+	    }
+	    if (anomalyValueCb) {
+		anomaly.setOutput(boost::bind(&IoHandler::injectValue, handler.get(), _1));
+	    }
+	    errors.setOutput(boost::bind(&IoHandler::injectValue, handler.get(), _1));
+
+#ifdef HAVE_STATIC_PIPELINE
+	    handler->addValueCallback(pipelineCb);
+#else
 	    if (dbValueCb) {
 		handler->addValueCallback(dbValueCb);
 	    }
 	    handler->addValueCallback(cacheValueCb);
+	    if (historyValueCb) {
+		handler->addValueCallback(historyValueCb);
+	    }
+	    if (statsValueCb) {
+		handler->addValueCallback(statsValueCb);
+	    }
+	    handler->addValueCallback(derivedValueCb);
+	    if (energyValueCb) {
+		handler->addValueCallback(energyValueCb);
+	    }
+	    if (anomalyValueCb) {
+		handler->addValueCallback(anomalyValueCb);
+	    }
+	    handler->addValueCallback(errorValueCb);
+#endif
+	    if (state) {
+		handler->addValueCallback(stateValueCb);
+	    }
+	    if (captureFrameCb) {
+		handler->addFrameCallback(captureFrameCb);
+	    }
+	    handler->addFrameCallback(snapshotFrameCb);
+
+	    /* these are recreated when their settings change on reload, so the
+	     * callbacks pass data to whichever instance is current */
+	    FrameForwarder::Ptr forwarder;
+	    auto stopForwarder = [&] () {
+		if (forwarder) {
+		    forwarder->close();
+		    forwarder.reset();
+		}
+	    };
+	    auto startForwarder = [&] () {
+		stopForwarder();
+
+		const std::string& forwardTarget = Options::forwardTarget();
+		if (forwardTarget.empty()) {
+		    return;
+		}
+
+		size_t pos = forwardTarget.rfind(':');
+		if (pos == std::string::npos) {
+		    std::ostringstream msg;
+		    msg << "Invalid forwarding target " << forwardTarget;
+		    throw std::runtime_error(msg.str());
+		}
+		std::string site = Options::forwardSite();
+		if (site.empty()) {
+		    site = boost::asio::ip::host_name();
+		}
+		forwarder.reset(new FrameForwarder(*handler, forwardTarget.substr(0, pos),
+						   forwardTarget.substr(pos + 1), site,
+						   Options::forwardSpool(),
+						   Options::forwardCompress()));
+		forwarder->start();
+	    };
+	    startForwarder();
+	    IoHandler::FrameCallback forwarderFrameCb =
+		    [&forwarder] (const std::vector<uint8_t>& data, const Timestamp& timestamp) {
+		if (forwarder) {
+		    forwarder->handleFrame(data, timestamp);
+		}
+	    };
+	    handler->addFrameCallback(forwarderFrameCb);
 
 	    EmsCommandSender *sender = dynamic_cast<EmsCommandSender *>(handler.get());
-	    boost::scoped_ptr<MqttAdapter> mqttAdapter(
-		    getMqttAdapter(*handler, sender, Options::mqttTarget()));
-	    if (mqttAdapter) {
-		IoHandler::ValueCallback valueCb =
-			boost::bind(&MqttAdapter::handleValue, mqttAdapter.get(), _1);
-		handler->addValueCallback(valueCb);
-	    }
+	    boost::scoped_ptr<MqttAdapter> mqttAdapter;
+	    auto startMqttAdapter = [&] () {
+		mqttAdapter.reset();
+		mqttAdapter.reset(getMqttAdapter(*handler, sender, Options::mqttTarget()));
+	    };
+	    startMqttAdapter();
+	    IoHandler::ValueCallback mqttValueCb = [&mqttAdapter] (const EmsValue& value) {
+		if (mqttAdapter) {
+		    mqttAdapter->handleValue(value);
+		}
+	    };
+	    handler->addValueCallback(mqttValueCb);
+
+	    LineProtocolSink::Ptr lineProtocolSink;
+	    auto stopLineProtocolSink = [&] () {
+		if (lineProtocolSink) {
+		    lineProtocolSink->close();
+		    lineProtocolSink.reset();
+		}
+	    };
+	    auto startLineProtocolSink = [&] () {
+		stopLineProtocolSink();
+		if (Options::lineProtocolTarget().empty()) {
+		    return;
+		}
+		lineProtocolSink.reset(new LineProtocolSink(*handler,
+			Options::lineProtocolTarget(), Options::lineProtocolSpool()));
+		if (!lineProtocolSink->isValid()) {
+		    lineProtocolSink.reset();
+		    std::ostringstream msg;
+		    msg << "Invalid line protocol target " << Options::lineProtocolTarget();
+		    throw std::runtime_error(msg.str());
+		}
+	    };
+	    startLineProtocolSink();
+	    IoHandler::ValueCallback lineProtocolValueCb = [&lineProtocolSink] (const EmsValue& value) {
+		if (lineProtocolSink) {
+		    lineProtocolSink->handleValue(value);
+		}
+	    };
+	    handler->addValueCallback(lineProtocolValueCb);
 
 	    boost::scoped_ptr<CommandHandler> cmdHandler;
-	    unsigned int cmdPort = Options::commandPort();
-	    if (sender && cmdPort != 0) {
-		boost::asio::ip::tcp::endpoint cmdEndpoint(boost::asio::ip::tcp::v4(), cmdPort);
-		cmdHandler.reset(new CommandHandler(*handler, *sender, &cache, cmdEndpoint));
-	    }
+	    auto startCommandHandler = [&] () {
+		/* the old sockets need to be gone before binding the new ones */
+		cmdHandler.reset();
+
+		std::vector<StreamAcceptor::Endpoint> endpoints =
+			StreamAcceptor::endpoints(Options::commandPort(), Options::commandSocket());
+		if (sender && !endpoints.empty()) {
+		    cmdHandler.reset(new CommandHandler(*handler, *sender, &cache, history.get(),
+						     graphs.get(), &stats, endpoints));
+		}
+	    };
+	    startCommandHandler();
 
 	    boost::scoped_ptr<DataHandler> dataHandler;
-	    unsigned int dataPort = Options::dataPort();
-	    if (dataPort != 0) {
-		boost::asio::ip::tcp::endpoint dataEndpoint(boost::asio::ip::tcp::v4(), dataPort);
-		dataHandler.reset(new DataHandler(*handler, dataEndpoint));
-		IoHandler::ValueCallback valueCb =
-			boost::bind(&DataHandler::handleValue, dataHandler.get(), _1);
-		handler->addValueCallback(valueCb);
-	    }
+	    auto startDataHandler = [&] () {
+		dataHandler.reset();
+
+		std::vector<StreamAcceptor::Endpoint> endpoints =
+			StreamAcceptor::endpoints(Options::dataPort(), Options::dataSocket());
+		if (!endpoints.empty()) {
+		    dataHandler.reset(new DataHandler(*handler, endpoints));
+		}
+	    };
+	    startDataHandler();
+	    IoHandler::ValueCallback dataValueCb = [&dataHandler] (const EmsValue& value) {
+		if (dataHandler) {
+		    dataHandler->handleValue(value);
+		}
+	    };
+	    handler->addValueCallback(dataValueCb);
+
+	    StreamAcceptor::closeInherited();
+
+	    alerts.setOutput([&mqttAdapter, &dataHandler] (const AlertRules::Alert& alert) {
+		if (mqttAdapter) {
+		    mqttAdapter->handleAlert(alert);
+		}
+		if (dataHandler) {
+		    dataHandler->handleAlert(alert);
+		}
+	    });
+	    handler->addValueCallback(alertValueCb);
 
 	    boost::asio::signal_set signals(*handler);
 	    fillSignalSet(signals);
 	    signals.async_wait(boost::bind(&stopHandler, handler.get(), &running));
 
+	    /* on SIGUSR2, start a new process and hand over to it once it's ready */
+	    bool handingOver = false;
+	    std::vector<uint8_t> unparsedInput;
+	    boost::asio::deadline_timer pauseTimeout(*handler);
+	    Handoff handoff(*handler, [&] () {
+		handler->pauseInput([&] (const std::vector<uint8_t>& input) {
+		    pauseTimeout.cancel();
+		    unparsedInput = input;
+		    handingOver = true;
+		    handler->stop();
+		});
+		/* don't wait for the rest of a broken frame forever */
+		pauseTimeout.expires_from_now(boost::posix_time::seconds(2));
+		pauseTimeout.async_wait([&] (const boost::system::error_code& error) {
+		    if (error != boost::asio::error::operation_aborted) {
+			handler->forcePause();
+		    }
+		});
+	    });
+#ifdef SIGUSR2
+	    boost::asio::signal_set handoffSignals(*handler, SIGUSR2);
+	    std::function<void (const boost::system::error_code&, int)> handoffSignalCb =
+		    [&] (const boost::system::error_code& error, int) {
+		if (error) {
+		    return;
+		}
+		if (handler->descriptor() < 0) {
+		    std::cerr << "Target " << Options::target() << " can't be handed over" << std::endl;
+		} else {
+		    handoff.start();
+		}
+		handoffSignals.async_wait(handoffSignalCb);
+	    };
+	    handoffSignals.async_wait(handoffSignalCb);
+#endif
+
+#ifdef SIGHUP
+	    /* on SIGHUP, reread the configuration file and restart only what
+	     * depends on changed settings; the bus connection is kept */
+	    boost::asio::signal_set reloadSignals(*handler, SIGHUP);
+	    std::function<void (const boost::system::error_code&, int)> reloadSignalCb =
+		    [&] (const boost::system::error_code& error, int) {
+		if (error) {
+		    return;
+		}
+
+		std::set<std::string> changed;
+		if (Options::reload(changed)) {
+		    auto restart = [&changed] (std::initializer_list<const char *> options,
+					       const std::function<void ()>& start) {
+			for (auto option : options) {
+			    if (changed.count(option)) {
+				try {
+				    start();
+				} catch (std::exception& e) {
+				    std::cerr << "Could not apply " << option << ": "
+					      << e.what() << std::endl;
+				}
+				return;
+			    }
+			}
+		    };
+
+		    restart({ "anomaly-threshold" }, [&] () {
+			anomaly.setThreshold(Options::anomalyThreshold());
+		    });
+		    restart({ "alert-rules" }, [&] () {
+			/* invalid rules keep the previous ones active */
+			if (Options::alertRules().empty()) {
+			    alerts.clear();
+			} else {
+			    alerts.load(Options::alertRules());
+			}
+		    });
+		    restart({ "alert-log" }, [&] () {
+			alerts.setLogFile(Options::alertLog());
+		    });
+		    restart({ "forward-to", "forward-site", "forward-spool", "forward-compress" },
+			    startForwarder);
+		    restart({ "mqtt-broker", "mqtt-prefix" }, startMqttAdapter);
+		    restart({ "line-protocol-target", "line-protocol-spool" }, startLineProtocolSink);
+		    restart({ "command-port", "command-socket", "socket-mode" }, startCommandHandler);
+		    restart({ "data-port", "data-socket", "socket-mode" }, startDataHandler);
+		    restart({ "max-connections" }, [&] () {
+			if (cmdHandler) {
+			    cmdHandler->resumeAccepting();
+			}
+			if (dataHandler) {
+			    dataHandler->resumeAccepting();
+			}
+		    });
+
+		    /* newly enabled debug streams need the writer thread */
+		    DebugLog::instance().start();
+		}
+		reloadSignals.async_wait(reloadSignalCb);
+	    };
+	    reloadSignals.async_wait(reloadSignalCb);
+#endif
+
+	    if (resumeInput) {
+		handler->resumeInput(inherited.input);
+	    }
+
 	    handler->run();
 
+	    if (handingOver) {
+		Handoff::State handoffState;
+		handoffState.transport = handler->descriptor();
+		if (cmdHandler) {
+		    handoffState.listeners = cmdHandler->listeners();
+		}
+		if (dataHandler) {
+		    std::vector<int> listeners = dataHandler->listeners();
+		    handoffState.listeners.insert(handoffState.listeners.end(), listeners.begin(), listeners.end());
+		}
+		handoffState.input = unparsedInput;
+		handoffState.frames = snapshot.frames();
+
+		/* files the new process continues writing must be complete first */
+		stopForwarder();
+		stopLineProtocolSink();
+		if (capture) {
+		    capture->flush();
+		}
+		if (state) {
+		    saveState(state.get(), energy.get(), &anomaly, &errors);
+		}
+#ifdef HAVE_DAEMONIZE
+		pid.release();
+#endif
+
+		if (!handoff.send(handoffState)) {
+		    /* start over with a fresh connection */
+#ifdef HAVE_DAEMONIZE
+		    if (Options::daemonize()) {
+			pid.write();
+		    }
+#endif
+		    continue;
+		}
+
+		/* let clients receive what's queued for them */
+		unsigned int draining = 0;
+		std::function<void ()> drainedCb = [&] () {
+		    if (--draining == 0) {
+			handler->stop();
+		    }
+		};
+		boost::asio::deadline_timer drainTimeout(*handler);
+		handler->reset();
+		if (cmdHandler) {
+		    draining++;
+		    cmdHandler->drain(drainedCb);
+		}
+		if (dataHandler) {
+		    draining++;
+		    dataHandler->drain(drainedCb);
+		}
+		if (draining) {
+		    drainTimeout.expires_from_now(boost::posix_time::seconds(5));
+		    drainTimeout.async_wait([&] (const boost::system::error_code& error) {
+			if (error != boost::asio::error::operation_aborted) {
+			    handler->stop();
+			}
+		    });
+		    handler->run();
+		}
+
+		handedOver = true;
+		break;
+	    }
+
+	    /* their pending operations keep them alive, so save their queues now */
+	    stopForwarder();
+	    stopLineProtocolSink();
+
+	    if (!handler->restartable()) {
+		break;
+	    }
+
 	    /* wait some time until retrying */
 	    if (running) {
 		boost::asio::io_service ios;
@@ -191,6 +909,11 @@ int main(int argc, char *argv[])
 		ios.run();
 	    }
 	}
+
+	/* the new process owns the state file now */
+	if (state && !handedOver) {
+	    saveState(state.get(), energy.get(), &anomaly, &errors);
+	}
     } catch (std::exception& e) {
 	std::cerr << "Exception: " << e.what() << std::endl;
 	return 1;
@@ -0,0 +1,216 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2016 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Counts the heap allocations of sending a command through the API parser,
+ * from parsing the request to handling the bus acknowledgement. Sending a
+ * command is expected not to allocate; the program fails if it does.
+ *
+ * Built and run by 'make alloc-check' in the collector directory.
+ */
+
+#include <stdlib.h>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include "ApiCommandParser.h"
+
+static size_t allocations = 0;
+
+/*
+ * All forms of new and delete are replaced and go through malloc and free,
+ * so no pointer is released by a different allocator than it came from.
+ * Inlining free() into a delete expression would make GCC see it applied
+ * to the result of operator new and warn, so it is kept out of line.
+ */
+static void *
+allocate(size_t size, bool nothrow)
+{
+    void *p = malloc(size ? size : 1);
+
+    allocations++;
+    if (!p && !nothrow) {
+	throw std::bad_alloc();
+    }
+    return p;
+}
+
+static void __attribute__((noinline))
+release(void *p)
+{
+    free(p);
+}
+
+void *
+operator new(size_t size)
+{
+    return allocate(size, false);
+}
+
+void *
+operator new[](size_t size)
+{
+    return allocate(size, false);
+}
+
+void *
+operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size, true);
+}
+
+void *
+operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size, true);
+}
+
+void
+operator delete(void *p) noexcept
+{
+    release(p);
+}
+
+void
+operator delete[](void *p) noexcept
+{
+    release(p);
+}
+
+void
+operator delete(void *p, size_t) noexcept
+{
+    release(p);
+}
+
+void
+operator delete[](void *p, size_t) noexcept
+{
+    release(p);
+}
+
+void
+operator delete(void *p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+void
+operator delete[](void *p, const std::nothrow_t&) noexcept
+{
+    release(p);
+}
+
+/* pretends every request went out on the bus */
+class FakeSender : public EmsCommandSender
+{
+    public:
+	FakeSender(boost::asio::io_service& ios) :
+	    EmsCommandSender(ios),
+	    m_sent(0)
+	{ }
+
+	size_t sent() const {
+	    return m_sent;
+	}
+
+    protected:
+	virtual void sendMessageImpl(const EmsCommandRequest&) override {
+	    m_sent++;
+	}
+
+    private:
+	size_t m_sent;
+};
+
+class ParserClient : public EmsCommandClient
+{
+    public:
+	ParserClient() :
+	    m_parser(NULL)
+	{ }
+
+	void setParser(ApiCommandParser *parser) {
+	    m_parser = parser;
+	}
+	virtual void onIncomingMessage(const EmsMessage& message) override {
+	    m_parser->onIncomingMessage(message);
+	}
+	virtual void onTimeout() override {
+	    m_parser->onTimeout();
+	}
+
+    private:
+	ApiCommandParser *m_parser;
+};
+
+int
+main(int argc, char **argv)
+{
+    /* the first commands fill pools and caches */
+    static const int WarmupCommands = 5;
+    const int commands = argc > 1 ? atoi(argv[1]) : 100;
+
+    boost::asio::io_service ios;
+    FakeSender sender(ios);
+    boost::shared_ptr<ParserClient> client(new ParserClient);
+    ApiCommandParser parser(sender, client, NULL, ApiCommandParser::OutputCallback());
+    EmsMessage::ValueHandler valueHandler;
+    std::vector<uint8_t> ackData = { 0x08, 0x0b, 0xff, 0x01 };
+    EmsMessage ack(valueHandler, EmsMessage::CacheAccessor(), ackData, Timestamp::now());
+    std::istringstream request("uba antipendel 10");
+    size_t before = 0;
+    int count = -WarmupCommands;
+
+    client->setParser(&parser);
+
+    /* like a connection, parse inside a handler, wait for the send, then respond */
+    std::function<void ()> step = [&] () {
+	if (count == 0) {
+	    before = allocations;
+	}
+	if (count == commands) {
+	    return;
+	}
+
+	size_t sent = sender.sent();
+	request.clear();
+	request.seekg(0);
+	if (parser.parse(request) != ApiCommandParser::Ok) {
+	    std::cerr << "Parsing the command failed" << std::endl;
+	    exit(1);
+	}
+	while (sender.sent() == sent) {
+	    ios.run_one();
+	}
+	sender.handlePcMessage(ack);
+	count++;
+	/* a plain lambda, posting the std::function would copy it */
+	ios.post([&step] () { step(); });
+    };
+
+    ios.post([&step] () { step(); });
+    ios.run();
+
+    double perCommand = (double) (allocations - before) / commands;
+    std::cout << sender.sent() << " commands sent, " << perCommand
+	      << " allocations per command" << std::endl;
+
+    return allocations == before ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+#! /bin/sh
+#
+# Prints the footprint of a collector binary as one line, for tracking it
+# across changes: file and section sizes, the time to start up and parse
+# the options, and the memory used while connecting to the given target.
+#
+# Usage: footprint.sh <collectord> [<target>] [<profile>]
+
+BINARY=$1
+TARGET=${2:-tcp:127.0.0.1:9}
+PROFILE=${3:-default}
+RUNS=10
+
+if [ ! -x "$BINARY" ]; then
+    echo "Usage: $0 <collectord> [<target>] [<profile>]" >&2
+    exit 1
+fi
+
+FILESIZE=$(wc -c < "$BINARY")
+SECTIONS=$(size "$BINARY" | awk 'NR == 2 { print "text=" $1 " data=" $2 " bss=" $3 }')
+
+# average over some runs, a single one is too short to measure reliably
+START=$(date +%s%N)
+i=0
+while [ $i -lt $RUNS ]; do
+    "$BINARY" --help > /dev/null
+    i=$((i + 1))
+done
+END=$(date +%s%N)
+STARTUP=$(( (END - START) / RUNS / 1000 ))
+
+"$BINARY" -f "$TARGET" > /dev/null 2>&1 &
+PID=$!
+sleep 2
+RSS=$(awk '/^VmRSS:/ { print $2 }' /proc/$PID/status 2> /dev/null)
+PEAK=$(awk '/^VmHWM:/ { print $2 }' /proc/$PID/status 2> /dev/null)
+kill $PID 2> /dev/null
+wait $PID 2> /dev/null
+
+VERSION=$(git describe --always --dirty 2> /dev/null)
+
+echo "$(date '+%Y-%m-%d %H:%M') ${VERSION:-unknown} profile=$PROFILE" \
+     "size=$FILESIZE $SECTIONS startup=${STARTUP}us rss=${RSS:-?}kB peak=${PEAK:-?}kB"
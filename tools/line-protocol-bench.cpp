@@ -0,0 +1,83 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2016 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measures the cost of rendering and sending values with the line protocol
+ * sink. Feeds the given amount of values of a few typical kinds with
+ * increasing timestamps and prints the time per value. The target should be
+ * tools/line-protocol-receiver.py, or anything else accepting the data.
+ *
+ * Built by 'make line-protocol-bench' in the collector directory.
+ * Usage: line-protocol-bench [<target> [<values>]]
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include "LineProtocolSink.h"
+
+int
+main(int argc, char **argv)
+{
+    std::string target = argc > 1 ? argv[1] : "udp:127.0.0.1:8089";
+    size_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : 3000000;
+    /* let sends and completions run every now and then, like the main loop */
+    static const size_t PollInterval = 256;
+
+    boost::asio::io_service ios;
+    LineProtocolSink::Ptr sink(new LineProtocolSink(ios, target, ""));
+
+    if (!sink->isValid()) {
+	std::cerr << "Invalid target " << target << std::endl;
+	return 1;
+    }
+
+    std::vector<EmsValue> values;
+    values.push_back(EmsValue(EmsValue::IstTemp, EmsValue::Kessel, 52.5f));
+    values.push_back(EmsValue(EmsValue::SollTemp, EmsValue::Kessel, 60.0f));
+    values.push_back(EmsValue(EmsValue::IstTemp, EmsValue::WW, 48.1f));
+    values.push_back(EmsValue(EmsValue::IstTemp, EmsValue::Aussen, -3.4f));
+    values.push_back(EmsValue(EmsValue::IstModulation, EmsValue::Brenner, 45U));
+    values.push_back(EmsValue(EmsValue::Brennerstarts, EmsValue::None, 123456U));
+    values.push_back(EmsValue(EmsValue::FlammeAktiv, EmsValue::None, (uint8_t) 0x01, (uint8_t) 0));
+    values.push_back(EmsValue(EmsValue::PumpeAktiv, EmsValue::None, (uint8_t) 0x00, (uint8_t) 0));
+
+    uint64_t timestamp = 1500000000000ULL;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i++) {
+	EmsValue& value = values[i % values.size()];
+	value.setTimestamp(Timestamp::fromRealtime(timestamp + i * 10));
+	sink->handleValue(value);
+	if (i % PollInterval == 0) {
+	    ios.poll();
+	}
+    }
+    ios.poll();
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+    std::cout << count << " values to " << target << ": "
+	      << ns / count << " ns per value" << std::endl;
+
+    sink->close();
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+#
+# Stand-in for a time series database, for trying the line protocol sink
+# (--line-protocol-target) without one. Counts the received lines and
+# prints the totals every few seconds.
+#
+# Usage: line-protocol-receiver.py [options] udp:<port> | http:<port>
+#
+# With --fail-for, HTTP requests are answered with 503 for the given
+# amount of seconds after startup, so the sink fills its spool and has to
+# drain it once the receiver starts accepting data.
+
+import argparse
+import http.server
+import socket
+import sys
+import threading
+import time
+
+REPORT_INTERVAL = 5
+
+
+class Counters:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.lines = 0
+        self.bytes = 0
+        self.messages = 0
+        self.rejected = 0
+        self.malformed = 0
+
+    def add(self, data, echo):
+        lines = [line for line in data.split(b"\n") if line]
+        # <measurement>[,<tags>] <fields> [<timestamp>]
+        malformed = sum(1 for line in lines if len(line.split(b" ")) not in (2, 3))
+        with self.lock:
+            self.lines += len(lines)
+            self.bytes += len(data)
+            self.messages += 1
+            self.malformed += malformed
+        if echo:
+            sys.stdout.write(data.decode("utf-8", "replace"))
+
+    def reject(self):
+        with self.lock:
+            self.rejected += 1
+
+    def report(self, elapsed):
+        with self.lock:
+            print("%6.0fs: %d lines (%.0f/s), %d bytes, %d messages, "
+                  "%d rejected, %d malformed"
+                  % (elapsed, self.lines, self.lines / max(elapsed, 1),
+                     self.bytes, self.messages, self.rejected, self.malformed))
+            sys.stdout.flush()
+
+
+def serve_udp(port, counters, echo):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 * 1024 * 1024)
+    sock.bind(("", port))
+    while True:
+        data, _ = sock.recvfrom(65536)
+        counters.add(data, echo)
+
+
+def serve_http(port, counters, echo, fail_until):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_POST(self):
+            length = int(self.headers.get("Content-Length", 0))
+            data = self.rfile.read(length)
+            if time.time() < fail_until:
+                counters.reject()
+                self.send_response(503)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            counters.add(data, echo)
+            self.send_response(204)
+            self.end_headers()
+
+        def log_message(self, format, *args):
+            pass
+
+    server = http.server.ThreadingHTTPServer(("", port), Handler)
+    server.serve_forever()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Line protocol stand-in receiver")
+    parser.add_argument("listen", help="udp:<port> or http:<port>")
+    parser.add_argument("--fail-for", type=float, default=0, metavar="SECONDS",
+                        help="answer HTTP requests with 503 for this long")
+    parser.add_argument("--echo", action="store_true",
+                        help="print the received lines")
+    args = parser.parse_args()
+
+    protocol, _, port = args.listen.partition(":")
+    if protocol not in ("udp", "http") or not port.isdigit():
+        parser.error("invalid listen address " + args.listen)
+
+    counters = Counters()
+    start = time.time()
+    if protocol == "udp":
+        target = lambda: serve_udp(int(port), counters, args.echo)
+    else:
+        target = lambda: serve_http(int(port), counters, args.echo,
+                                    start + args.fail_for)
+    thread = threading.Thread(target=target)
+    thread.daemon = True
+    thread.start()
+
+    try:
+        while thread.is_alive():
+            time.sleep(REPORT_INTERVAL)
+            counters.report(time.time() - start)
+    except KeyboardInterrupt:
+        counters.report(time.time() - start)
+
+
+if __name__ == "__main__":
+    main()
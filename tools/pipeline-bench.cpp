@@ -0,0 +1,213 @@
+/*
+ * Buderus EMS data collector
+ *
+ * Copyright (C) 2016 Danny Baumann <dannybaumann@web.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compares passing values to a typical set of four sinks (cache, history,
+ * statistics and derived values) through one callback per sink, as the
+ * default build does, with passing them through a Pipeline composed at
+ * compile time, as built with HAVE_STATIC_PIPELINE. The values are decoded
+ * from a capture file and replayed with increasing timestamps until the
+ * requested amount was handled.
+ *
+ * Built by 'make pipeline-bench' in the collector directory.
+ * Usage: pipeline-bench <capture file> [<values> [<rounds>]]
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <list>
+#include "CaptureFile.h"
+#include "DerivedValues.h"
+#include "IoHandler.h"
+#include "Pipeline.h"
+#include "SeriesHistory.h"
+#include "ValueCache.h"
+#include "WindowStats.h"
+
+/* same policies as in main.cpp */
+struct CacheSink {
+    typedef ValueCache Target;
+    static bool accepts(const EmsValue& /* value */) {
+	return true;
+    }
+    static void handle(Target& cache, const EmsValue& value) {
+	cache.handleValue(value);
+    }
+};
+
+struct HistorySink {
+    typedef SeriesHistory Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& history, const EmsValue& value) {
+	history.handleValue(value);
+    }
+};
+
+struct StatsSink {
+    typedef WindowStats Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& stats, const EmsValue& value) {
+	stats.handleValue(value);
+    }
+};
+
+struct DerivedSink {
+    typedef DerivedValues Target;
+    static bool accepts(const EmsValue& value) {
+	return value.isValid();
+    }
+    static void handle(Target& derived, const EmsValue& value) {
+	derived.handleValue(value);
+    }
+};
+
+typedef Pipeline<CacheSink, HistorySink, StatsSink, DerivedSink> BenchPipeline;
+
+/* the sinks, created anew for every run */
+struct Sinks {
+    ValueCache cache;
+    SeriesHistory history;
+    WindowStats stats;
+    DerivedValues derived;
+
+    Sinks() : history(24 * 3600) {
+	stats.addValue("heater/currenttemperature");
+	stats.addValue("outdoor/currenttemperature");
+    }
+};
+
+static bool
+readValues(const std::string& path, std::vector<EmsValue>& values, uint64_t& span)
+{
+    CaptureReader reader(path);
+
+    if (!reader.isOpen()) {
+	return false;
+    }
+
+    ValueCache cache;
+    EmsMessage::ValueHandler valueCb = [&] (const EmsValue& value) {
+	values.push_back(value);
+	cache.handleValue(value);
+    };
+    EmsMessage::CacheAccessor cacheCb = [&cache] (EmsValue::Type type, EmsValue::SubType subtype) {
+	return cache.getValue(type, subtype);
+    };
+    uint64_t first = 0, last = 0;
+
+    for (auto& block : reader.findBlocks(0, 0)) {
+	std::vector<CaptureFile::Frame> frames;
+	reader.readBlock(block, frames);
+	for (auto& frame : frames) {
+	    EmsMessage message(valueCb, cacheCb, frame.data, Timestamp::fromRealtime(frame.timestamp));
+	    message.handle();
+	    if (first == 0) {
+		first = frame.timestamp;
+	    }
+	    last = frame.timestamp;
+	}
+    }
+
+    /* replays continue one second after the end of the capture */
+    span = last - first + 1000;
+    return !values.empty();
+}
+
+template<typename Handler> static double
+measure(const std::vector<EmsValue>& values, uint64_t span, size_t count, Handler handler)
+{
+    EmsValue value = values[0];
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < count; i++) {
+	const EmsValue& source = values[i % values.size()];
+	Timestamp timestamp = source.getTimestamp();
+	uint64_t offset = (i / values.size()) * span;
+
+	value = source;
+	value.setTimestamp(Timestamp(timestamp.monotonic + offset, timestamp.realtime + offset));
+	handler(value);
+    }
+
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / (double) count;
+}
+
+int
+main(int argc, char **argv)
+{
+    if (argc < 2) {
+	std::cerr << "Usage: " << argv[0] << " <capture file> [<values> [<rounds>]]" << std::endl;
+	return 1;
+    }
+
+    size_t count = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    unsigned int rounds = argc > 3 ? strtoul(argv[3], NULL, 10) : 3;
+    std::vector<EmsValue> values;
+    uint64_t span;
+
+    if (!readValues(argv[1], values, span)) {
+	std::cerr << "Could not read values from " << argv[1] << std::endl;
+	return 1;
+    }
+
+    for (unsigned int round = 1; round <= rounds; round++) {
+	double dynamic, composed;
+
+	{
+	    /* as registered by main.cpp in the default build */
+	    Sinks sinks;
+	    std::list<IoHandler::ValueCallback> callbacks;
+	    callbacks.push_back(boost::bind(&ValueCache::handleValue, &sinks.cache, _1));
+	    callbacks.push_back(boost::bind(&SeriesHistory::handleValue, &sinks.history, _1));
+	    callbacks.push_back(boost::bind(&WindowStats::handleValue, &sinks.stats, _1));
+	    callbacks.push_back(boost::bind(&DerivedValues::handleValue, &sinks.derived, _1));
+
+	    dynamic = measure(values, span, count, [&callbacks] (const EmsValue& value) {
+		for (auto& cb : callbacks) {
+		    cb(value);
+		}
+	    });
+	}
+	{
+	    Sinks sinks;
+	    BenchPipeline pipeline(&sinks.cache, &sinks.history, &sinks.stats, &sinks.derived);
+	    IoHandler::ValueCallback pipelineCb = boost::bind(&BenchPipeline::handleValue, &pipeline, _1);
+	    std::list<IoHandler::ValueCallback> callbacks;
+	    callbacks.push_back(pipelineCb);
+
+	    composed = measure(values, span, count, [&callbacks] (const EmsValue& value) {
+		for (auto& cb : callbacks) {
+		    cb(value);
+		}
+	    });
+	}
+
+	std::cout << "round " << round << ", " << count << " values: "
+		  << "callbacks " << dynamic << " ns, pipeline " << composed
+		  << " ns per value" << std::endl;
+    }
+
+    return 0;
+}